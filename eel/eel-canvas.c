@@ -75,6 +75,8 @@ static void group_add (EelCanvasGroup *group,
                        EelCanvasItem  *item);
 static void group_remove (EelCanvasGroup *group,
                           EelCanvasItem  *item);
+static void group_index_restack (EelCanvasGroup *group,
+                                 GList          *link);
 static void redraw_and_repick_if_mapped (EelCanvasItem *item);
 
 /*** EelCanvasItem ***/
@@ -697,6 +699,12 @@ put_item_after (GList *link,
             parent->item_list_end = link;
         }
     }
+
+    if (parent->index != NULL)
+    {
+        group_index_restack (parent, link);
+    }
+
     return TRUE;
 }
 
@@ -1591,6 +1599,484 @@ eel_canvas_group_get_property (GObject    *gobject,
     }
 }
 
+/*** Spatial index of the children of a group ***/
+
+/* Size of the grid cells, in canvas pixels */
+#define GROUP_INDEX_CELL_SIZE 256.0
+
+/* Children covering more cells than this are kept aside and looked at by
+ * every query, instead of being added to a large part of the grid.
+ */
+#define GROUP_INDEX_MAX_ITEM_CELLS 64
+
+typedef struct
+{
+    gint64 key;
+    GPtrArray *entries;
+} GroupIndexCell;
+
+typedef struct
+{
+    EelCanvasItem *item;
+
+    /* Range of cells the item was added to, inclusive */
+    int cx1, cy1, cx2, cy2;
+    gboolean large;
+
+    /* Position in the stacking order of the group */
+    guint order;
+
+    /* Last query that found the item, so it is only returned once */
+    guint stamp;
+} GroupIndexEntry;
+
+struct _EelCanvasGroupIndex
+{
+    GHashTable *cells;          /* &cell->key -> GroupIndexCell */
+    GHashTable *entries;        /* item -> GroupIndexEntry */
+    GPtrArray *large_entries;
+
+    guint next_order;
+    gboolean order_dirty;
+
+    guint stamp;
+};
+
+#define GROUP_INDEX_CELL_KEY(cx, cy) (((gint64) (cy) << 32) | (guint32) (cx))
+
+static void
+group_index_cell_free (GroupIndexCell *cell)
+{
+    g_ptr_array_free (cell->entries, TRUE);
+    g_free (cell);
+}
+
+static struct _EelCanvasGroupIndex *
+group_index_new (void)
+{
+    struct _EelCanvasGroupIndex *index;
+
+    index = g_new0 (struct _EelCanvasGroupIndex, 1);
+    index->cells = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                          NULL, (GDestroyNotify) group_index_cell_free);
+    index->entries = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+    index->large_entries = g_ptr_array_new ();
+
+    return index;
+}
+
+static void
+group_index_free (struct _EelCanvasGroupIndex *index)
+{
+    g_hash_table_destroy (index->cells);
+    g_hash_table_destroy (index->entries);
+    g_ptr_array_free (index->large_entries, TRUE);
+    g_free (index);
+}
+
+static void
+group_index_get_cells (EelCanvasItem *item,
+                       int           *cx1,
+                       int           *cy1,
+                       int           *cx2,
+                       int           *cy2)
+{
+    *cx1 = floor (item->x1 / GROUP_INDEX_CELL_SIZE);
+    *cy1 = floor (item->y1 / GROUP_INDEX_CELL_SIZE);
+    *cx2 = floor (item->x2 / GROUP_INDEX_CELL_SIZE);
+    *cy2 = floor (item->y2 / GROUP_INDEX_CELL_SIZE);
+
+    if (*cx2 < *cx1)
+    {
+        *cx2 = *cx1;
+    }
+
+    if (*cy2 < *cy1)
+    {
+        *cy2 = *cy1;
+    }
+}
+
+static void
+group_index_link (struct _EelCanvasGroupIndex *index,
+                  GroupIndexEntry             *entry)
+{
+    GroupIndexCell *cell;
+    gint64 key;
+    int cx, cy;
+
+    group_index_get_cells (entry->item,
+                           &entry->cx1, &entry->cy1,
+                           &entry->cx2, &entry->cy2);
+
+    entry->large = ((gint64) (entry->cx2 - entry->cx1 + 1) *
+                    (entry->cy2 - entry->cy1 + 1)) > GROUP_INDEX_MAX_ITEM_CELLS;
+    if (entry->large)
+    {
+        g_ptr_array_add (index->large_entries, entry);
+        return;
+    }
+
+    for (cy = entry->cy1; cy <= entry->cy2; cy++)
+    {
+        for (cx = entry->cx1; cx <= entry->cx2; cx++)
+        {
+            key = GROUP_INDEX_CELL_KEY (cx, cy);
+            cell = g_hash_table_lookup (index->cells, &key);
+            if (cell == NULL)
+            {
+                cell = g_new (GroupIndexCell, 1);
+                cell->key = key;
+                cell->entries = g_ptr_array_new ();
+                g_hash_table_insert (index->cells, &cell->key, cell);
+            }
+
+            g_ptr_array_add (cell->entries, entry);
+        }
+    }
+}
+
+static void
+group_index_unlink (struct _EelCanvasGroupIndex *index,
+                    GroupIndexEntry             *entry)
+{
+    GroupIndexCell *cell;
+    gint64 key;
+    int cx, cy;
+
+    if (entry->large)
+    {
+        g_ptr_array_remove_fast (index->large_entries, entry);
+        return;
+    }
+
+    for (cy = entry->cy1; cy <= entry->cy2; cy++)
+    {
+        for (cx = entry->cx1; cx <= entry->cx2; cx++)
+        {
+            key = GROUP_INDEX_CELL_KEY (cx, cy);
+            cell = g_hash_table_lookup (index->cells, &key);
+            if (cell == NULL)
+            {
+                continue;
+            }
+
+            g_ptr_array_remove_fast (cell->entries, entry);
+            if (cell->entries->len == 0)
+            {
+                g_hash_table_remove (index->cells, &key);
+            }
+        }
+    }
+}
+
+static void
+group_index_add (EelCanvasGroup *group,
+                 EelCanvasItem  *item)
+{
+    GroupIndexEntry *entry;
+
+    entry = g_new0 (GroupIndexEntry, 1);
+    entry->item = item;
+    entry->order = group->index->next_order++;
+
+    g_hash_table_insert (group->index->entries, item, entry);
+    group_index_link (group->index, entry);
+}
+
+static void
+group_index_remove (EelCanvasGroup *group,
+                    EelCanvasItem  *item)
+{
+    GroupIndexEntry *entry;
+
+    entry = g_hash_table_lookup (group->index->entries, item);
+    if (entry != NULL)
+    {
+        group_index_unlink (group->index, entry);
+        g_hash_table_remove (group->index->entries, item);
+    }
+}
+
+/* Moves the child to the cells of its new bounding box, if it changed */
+static void
+group_index_update (EelCanvasGroup *group,
+                    EelCanvasItem  *item)
+{
+    GroupIndexEntry *entry;
+    int cx1, cy1, cx2, cy2;
+
+    entry = g_hash_table_lookup (group->index->entries, item);
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    group_index_get_cells (item, &cx1, &cy1, &cx2, &cy2);
+    if (cx1 != entry->cx1 || cy1 != entry->cy1 ||
+        cx2 != entry->cx2 || cy2 != entry->cy2)
+    {
+        group_index_unlink (group->index, entry);
+        group_index_link (group->index, entry);
+    }
+}
+
+/* Called after @link was moved in the stacking order.  Raising an item to the
+ * top, or just below the top one, is common enough to avoid renumbering the
+ * whole group on the next query.
+ */
+static void
+group_index_restack (EelCanvasGroup *group,
+                     GList          *link)
+{
+    GroupIndexEntry *entry, *next_entry;
+
+    if (group->index->order_dirty)
+    {
+        return;
+    }
+
+    entry = g_hash_table_lookup (group->index->entries, link->data);
+
+    if (link->next == NULL)
+    {
+        entry->order = group->index->next_order++;
+    }
+    else if (link->next->next == NULL)
+    {
+        next_entry = g_hash_table_lookup (group->index->entries, link->next->data);
+        entry->order = next_entry->order;
+        next_entry->order = group->index->next_order++;
+    }
+    else
+    {
+        group->index->order_dirty = TRUE;
+    }
+}
+
+static void
+group_index_renumber (EelCanvasGroup *group)
+{
+    GroupIndexEntry *entry;
+    GList *list;
+
+    group->index->next_order = 0;
+    for (list = group->item_list; list; list = list->next)
+    {
+        entry = g_hash_table_lookup (group->index->entries, list->data);
+        entry->order = group->index->next_order++;
+    }
+
+    group->index->order_dirty = FALSE;
+}
+
+static gboolean
+item_intersects_rect (EelCanvasItem *item,
+                      int            x1,
+                      int            y1,
+                      int            x2,
+                      int            y2)
+{
+    return !((item->x1 > x2) || (item->y1 > y2) || (item->x2 < x1) || (item->y2 < y1));
+}
+
+static void
+group_index_collect (struct _EelCanvasGroupIndex *index,
+                     GPtrArray                   *entries,
+                     GPtrArray                   *found,
+                     int                          x1,
+                     int                          y1,
+                     int                          x2,
+                     int                          y2)
+{
+    GroupIndexEntry *entry;
+    guint i;
+
+    for (i = 0; i < entries->len; i++)
+    {
+        entry = g_ptr_array_index (entries, i);
+        if (entry->stamp != index->stamp &&
+            item_intersects_rect (entry->item, x1, y1, x2, y2))
+        {
+            entry->stamp = index->stamp;
+            g_ptr_array_add (found, entry);
+        }
+    }
+}
+
+static gint
+compare_entries_by_order (gconstpointer a,
+                          gconstpointer b)
+{
+    const GroupIndexEntry *entry_a = *(const GroupIndexEntry **) a;
+    const GroupIndexEntry *entry_b = *(const GroupIndexEntry **) b;
+
+    return entry_a->order < entry_b->order ? -1 : entry_a->order > entry_b->order;
+}
+
+static GList *
+group_index_query (EelCanvasGroup *group,
+                   int             x1,
+                   int             y1,
+                   int             x2,
+                   int             y2)
+{
+    struct _EelCanvasGroupIndex *index;
+    GroupIndexCell *cell;
+    GroupIndexEntry *entry;
+    GHashTableIter iter;
+    GPtrArray *found;
+    GList *items;
+    gint64 key;
+    gint64 n_cells;
+    int cx1, cy1, cx2, cy2;
+    int cx, cy;
+    guint i;
+
+    index = group->index;
+
+    if (index->order_dirty)
+    {
+        group_index_renumber (group);
+    }
+
+    index->stamp++;
+    if (index->stamp == 0)
+    {
+        g_hash_table_iter_init (&iter, index->entries);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+        {
+            entry->stamp = 0;
+        }
+        index->stamp = 1;
+    }
+
+    found = g_ptr_array_new ();
+
+    cx1 = floor (x1 / GROUP_INDEX_CELL_SIZE);
+    cy1 = floor (y1 / GROUP_INDEX_CELL_SIZE);
+    cx2 = floor (x2 / GROUP_INDEX_CELL_SIZE);
+    cy2 = floor (y2 / GROUP_INDEX_CELL_SIZE);
+    n_cells = (gint64) (cx2 - cx1 + 1) * (cy2 - cy1 + 1);
+
+    if (n_cells > g_hash_table_size (index->cells))
+    {
+        /* Zoomed far out, fewer cells are in use than the rectangle covers */
+        g_hash_table_iter_init (&iter, index->cells);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cell))
+        {
+            group_index_collect (index, cell->entries, found, x1, y1, x2, y2);
+        }
+    }
+    else
+    {
+        for (cy = cy1; cy <= cy2; cy++)
+        {
+            for (cx = cx1; cx <= cx2; cx++)
+            {
+                key = GROUP_INDEX_CELL_KEY (cx, cy);
+                cell = g_hash_table_lookup (index->cells, &key);
+                if (cell != NULL)
+                {
+                    group_index_collect (index, cell->entries, found, x1, y1, x2, y2);
+                }
+            }
+        }
+    }
+
+    group_index_collect (index, index->large_entries, found, x1, y1, x2, y2);
+
+    g_ptr_array_sort (found, compare_entries_by_order);
+
+    items = NULL;
+    for (i = found->len; i > 0; i--)
+    {
+        entry = g_ptr_array_index (found, i - 1);
+        items = g_list_prepend (items, entry->item);
+    }
+
+    g_ptr_array_free (found, TRUE);
+
+    return items;
+}
+
+/**
+ * eel_canvas_group_set_indexed:
+ * @group: A canvas group.
+ * @indexed: Whether to keep a spatial index of the children.
+ *
+ * Makes the group keep its children in a grid as their bounding boxes change,
+ * so that picking, drawing and eel_canvas_group_get_items_in_rect() only look
+ * at the children near the area they are interested in.
+ **/
+void
+eel_canvas_group_set_indexed (EelCanvasGroup *group,
+                              gboolean        indexed)
+{
+    GList *list;
+
+    g_return_if_fail (EEL_IS_CANVAS_GROUP (group));
+
+    if (indexed == (group->index != NULL))
+    {
+        return;
+    }
+
+    if (!indexed)
+    {
+        g_clear_pointer (&group->index, group_index_free);
+        return;
+    }
+
+    group->index = group_index_new ();
+    for (list = group->item_list; list; list = list->next)
+    {
+        group_index_add (group, list->data);
+    }
+}
+
+/**
+ * eel_canvas_group_get_items_in_rect:
+ * @group: A canvas group.
+ * @x1: Left edge of the rectangle, in canvas pixels.
+ * @y1: Top edge of the rectangle, in canvas pixels.
+ * @x2: Right edge of the rectangle, in canvas pixels.
+ * @y2: Bottom edge of the rectangle, in canvas pixels.
+ *
+ * Finds the children whose bounding box, as of the last update, intersects
+ * the rectangle.
+ *
+ * Return value: The children, bottom-most first.  Free the list with
+ * g_list_free().
+ **/
+GList *
+eel_canvas_group_get_items_in_rect (EelCanvasGroup *group,
+                                    int             x1,
+                                    int             y1,
+                                    int             x2,
+                                    int             y2)
+{
+    GList *list, *items;
+
+    g_return_val_if_fail (EEL_IS_CANVAS_GROUP (group), NULL);
+
+    if (group->index != NULL)
+    {
+        return group_index_query (group, x1, y1, x2, y2);
+    }
+
+    items = NULL;
+    for (list = group->item_list; list; list = list->next)
+    {
+        if (item_intersects_rect (list->data, x1, y1, x2, y2))
+        {
+            items = g_list_prepend (items, list->data);
+        }
+    }
+
+    return g_list_reverse (items);
+}
+
 /* Destroy handler for canvas groups */
 static void
 eel_canvas_group_destroy (EelCanvasItem *object)
@@ -1612,6 +2098,8 @@ eel_canvas_group_destroy (EelCanvasItem *object)
         eel_canvas_item_destroy (child);
     }
 
+    g_clear_pointer (&group->index, group_index_free);
+
     if (EEL_CANVAS_ITEM_CLASS (group_parent_class)->destroy)
     {
         (*EEL_CANVAS_ITEM_CLASS (group_parent_class)->destroy)(object);
@@ -1646,6 +2134,11 @@ eel_canvas_group_update (EelCanvasItem *item,
 
         eel_canvas_item_invoke_update (i, i2w_dx + group->xpos, i2w_dy + group->ypos, flags);
 
+        if (group->index != NULL)
+        {
+            group_index_update (group, i);
+        }
+
         if (first)
         {
             first = FALSE;
@@ -1756,12 +2249,27 @@ eel_canvas_group_draw (EelCanvasItem  *item,
                        cairo_region_t *region)
 {
     EelCanvasGroup *group;
-    GList *list;
+    GList *list, *children, *candidates;
     EelCanvasItem *child = NULL;
+    cairo_rectangle_int_t extents;
 
     group = EEL_CANVAS_GROUP (item);
 
-    for (list = group->item_list; list; list = list->next)
+    if (group->index != NULL)
+    {
+        cairo_region_get_extents (region, &extents);
+        children = candidates = group_index_query (group,
+                                                   extents.x, extents.y,
+                                                   extents.x + extents.width,
+                                                   extents.y + extents.height);
+    }
+    else
+    {
+        children = group->item_list;
+        candidates = NULL;
+    }
+
+    for (list = children; list; list = list->next)
     {
         child = list->data;
 
@@ -1781,6 +2289,8 @@ eel_canvas_group_draw (EelCanvasItem  *item,
             }
         }
     }
+
+    g_list_free (candidates);
 }
 
 /* Point handler for canvas groups */
@@ -1793,7 +2303,7 @@ eel_canvas_group_point (EelCanvasItem  *item,
                         EelCanvasItem **actual_item)
 {
     EelCanvasGroup *group;
-    GList *list;
+    GList *list, *children, *candidates;
     EelCanvasItem *child, *point_item;
     int x1, y1, x2, y2;
     double gx, gy;
@@ -1815,11 +2325,21 @@ eel_canvas_group_point (EelCanvasItem  *item,
 
     dist = 0.0;     /* keep gcc happy */
 
-    for (list = group->item_list; list; list = list->next)
+    if (group->index != NULL)
+    {
+        children = candidates = group_index_query (group, x1, y1, x2, y2);
+    }
+    else
+    {
+        children = group->item_list;
+        candidates = NULL;
+    }
+
+    for (list = children; list; list = list->next)
     {
         child = list->data;
 
-        if ((child->x1 > x2) || (child->y1 > y2) || (child->x2 < x1) || (child->y2 < y1))
+        if (!item_intersects_rect (child, x1, y1, x2, y2))
         {
             continue;
         }
@@ -1847,6 +2367,8 @@ eel_canvas_group_point (EelCanvasItem  *item,
         }
     }
 
+    g_list_free (candidates);
+
     return best;
 }
 
@@ -1975,6 +2497,11 @@ group_add (EelCanvasGroup *group,
         group->item_list_end = g_list_append (group->item_list_end, item)->next;
     }
 
+    if (group->index != NULL)
+    {
+        group_index_add (group, item);
+    }
+
     if (item->flags & EEL_CANVAS_ITEM_VISIBLE &&
         group->item.flags & EEL_CANVAS_ITEM_MAPPED)
     {
@@ -2024,6 +2551,11 @@ group_remove (EelCanvasGroup *group,
                 eel_canvas_queue_resize (item->canvas);
             }
 
+            if (group->index != NULL)
+            {
+                group_index_remove (group, item);
+            }
+
             /* Unparent the child */
 
             item->parent = NULL;
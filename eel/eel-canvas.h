@@ -327,6 +327,9 @@ struct _EelCanvasGroup {
 	/* Children of the group */
 	GList *item_list;
 	GList *item_list_end;
+
+	/* Grid of the children's bounding boxes, or NULL */
+	struct _EelCanvasGroupIndex *index;
 };
 
 struct _EelCanvasGroupClass {
@@ -337,6 +340,20 @@ struct _EelCanvasGroupClass {
 /* Standard Gtk function */
 GType eel_canvas_group_get_type (void) G_GNUC_CONST;
 
+/* Keeps the children of the group in a grid as their bounding boxes change,
+ * so that picking, drawing and eel_canvas_group_get_items_in_rect() only look
+ * at the children near the area they are interested in.  Worth it for groups
+ * with many children spread over a large canvas.
+ */
+void eel_canvas_group_set_indexed (EelCanvasGroup *group, gboolean indexed);
+
+/* Returns the children whose bounding box, as of the last update, intersects
+ * the given rectangle in canvas pixel coordinates, bottom-most first.  Free
+ * the list with g_list_free().
+ */
+GList *eel_canvas_group_get_items_in_rect (EelCanvasGroup *group,
+					   int x1, int y1, int x2, int y2);
+
 
 /*** EelCanvas ***/
 
@@ -391,7 +391,7 @@ desktop_directory_file_get_item_count (NautilusFile *file,
 
     if (count)
     {
-        *count += g_list_length (file->details->directory->details->file_list);
+        *count += file->details->directory->details->files->len;
     }
 
     return got_count;
@@ -418,7 +418,7 @@ desktop_directory_file_get_deep_counts (NautilusFile *file,
 
     if (file_count)
     {
-        *file_count += g_list_length (file->details->directory->details->file_list);
+        *file_count += file->details->directory->details->files->len;
     }
 
     return status;
@@ -41,6 +41,7 @@
 #include "nautilus-preferences-window.h"
 
 #include "nautilus-directory-private.h"
+#include "nautilus-directory-snapshot.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-file-operations.h"
 #include "nautilus-global-preferences.h"
@@ -1261,6 +1262,9 @@ nautilus_application_startup_common (NautilusApplication *self)
     /* initialize preferences and create the global GSettings objects */
     nautilus_global_preferences_init ();
 
+    /* Keep the snapshots of folder listings within their size */
+    nautilus_directory_snapshot_prune ();
+
     /* register property pages */
     nautilus_image_properties_page_register ();
 
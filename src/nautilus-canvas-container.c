@@ -257,15 +257,58 @@ icon_free (NautilusCanvasIcon *icon)
 {
     /* Destroy this icon item; the parent will unref it. */
     eel_canvas_item_destroy (EEL_CANVAS_ITEM (icon->item));
+    g_free (icon->uri);
     g_free (icon);
 }
 
+/* Keeps the icon findable by URI, as files can be renamed */
+static void
+update_icon_uri (NautilusCanvasContainer *container,
+                 NautilusCanvasIcon      *icon)
+{
+    GHashTable *icons_by_uri;
+    char *uri;
+
+    icons_by_uri = container->details->icons_by_uri;
+    uri = nautilus_canvas_container_get_icon_uri (container, icon);
+
+    if (g_strcmp0 (uri, icon->uri) == 0)
+    {
+        g_free (uri);
+        return;
+    }
+
+    if (icon->uri != NULL && g_hash_table_lookup (icons_by_uri, icon->uri) == icon)
+    {
+        g_hash_table_remove (icons_by_uri, icon->uri);
+    }
+
+    g_free (icon->uri);
+    icon->uri = uri;
+
+    if (uri != NULL)
+    {
+        /* The table has its own copy, another icon may still be
+         * known by the same URI and lose it later.
+         */
+        g_hash_table_replace (icons_by_uri, g_strdup (uri), icon);
+    }
+}
+
 static gboolean
 icon_is_positioned (const NautilusCanvasIcon *icon)
 {
     return icon->x != ICON_UNPOSITIONED_VALUE && icon->y != ICON_UNPOSITIONED_VALUE;
 }
 
+static void
+clear_layout_lines (NautilusCanvasContainer *container)
+{
+    g_ptr_array_set_size (container->details->layout_icons, 0);
+    g_array_set_size (container->details->layout_lines, 0);
+    container->details->layout_visible_valid = FALSE;
+}
+
 
 /* x, y are the top-left coordinates of the icon. */
 static void
@@ -290,6 +333,11 @@ icon_set_position (NautilusCanvasIcon *icon,
 
     container = NAUTILUS_CANVAS_CONTAINER (EEL_CANVAS_ITEM (icon->item)->canvas);
 
+    if (icon->y != y)
+    {
+        clear_layout_lines (container);
+    }
+
     if (nautilus_canvas_container_get_is_fixed_size (container))
     {
         /*  FIXME: This should be:
@@ -1372,6 +1420,19 @@ resort (NautilusCanvasContainer *container)
     cache_icon_positions (container);
 }
 
+/* The icons list is sorted on demand, as icons added since the last full
+ * layout are not in order. Everything relying on that order sorts it here.
+ */
+static void
+ensure_icons_sorted (NautilusCanvasContainer *container)
+{
+    if (container->details->needs_resort)
+    {
+        resort (container);
+        container->details->needs_resort = FALSE;
+    }
+}
+
 typedef struct
 {
     double width;
@@ -1380,6 +1441,24 @@ typedef struct
     double y_offset;
 } IconPositions;
 
+typedef struct
+{
+    double y;
+    guint first_icon;
+} LayoutLine;
+
+static void
+add_layout_line (GArray *lines,
+                 double  y,
+                 guint   first_icon)
+{
+    LayoutLine line;
+
+    line.y = y;
+    line.first_icon = first_icon;
+    g_array_append_val (lines, line);
+}
+
 static void
 lay_down_one_line (NautilusCanvasContainer *container,
                    GList                   *line_start,
@@ -1420,10 +1499,14 @@ lay_down_one_line (NautilusCanvasContainer *container,
     }
 }
 
+/* Lays down @icons in lines, starting at @start_y. If @lines is not NULL,
+ * where each line starts is appended to it.
+ */
 static void
 lay_down_icons_horizontal (NautilusCanvasContainer *container,
                            GList                   *icons,
-                           double                   start_y)
+                           double                   start_y,
+                           GArray                  *lines)
 {
     GList *p, *line_start;
     NautilusCanvasIcon *icon;
@@ -1439,6 +1522,7 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
     int icon_width, icon_size;
     int i;
     GtkAllocation allocation;
+    guint n_icons, line_first_icon;
 
     g_assert (NAUTILUS_IS_CANVAS_CONTAINER (container));
 
@@ -1461,6 +1545,8 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
 
     line_width = 0;
     line_start = icons;
+    line_first_icon = 0;
+    n_icons = 0;
     y = start_y + CONTAINER_PAD_TOP;
     i = 0;
 
@@ -1490,6 +1576,11 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
         /* If this icon doesn't fit, it's time to lay out the line that's queued up. */
         if (line_start != p && line_width + icon_width >= canvas_width)
         {
+            if (lines != NULL)
+            {
+                add_layout_line (lines, y, line_first_icon);
+            }
+
             /* Advance to the baseline. */
             y += ICON_PAD_TOP + max_height_above;
 
@@ -1500,6 +1591,7 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
 
             line_width = 0;
             line_start = p;
+            line_first_icon = n_icons;
             i = 0;
 
             max_height_above = height_above;
@@ -1527,11 +1619,17 @@ lay_down_icons_horizontal (NautilusCanvasContainer *container,
 
         /* Add this icon. */
         line_width += icon_width;
+        n_icons++;
     }
 
     /* Lay down that last line of icons. */
     if (line_start != NULL)
     {
+        if (lines != NULL)
+        {
+            add_layout_line (lines, y, line_first_icon);
+        }
+
         /* Advance to the baseline. */
         y += ICON_PAD_TOP + max_height_above;
 
@@ -2153,18 +2251,245 @@ lay_down_icons (NautilusCanvasContainer *container,
     }
     else
     {
-        lay_down_icons_horizontal (container, icons, start_y);
+        lay_down_icons_horizontal (container, icons, start_y, NULL);
+    }
+}
+
+static double
+get_layout_width (NautilusCanvasContainer *container)
+{
+    GtkAllocation allocation;
+
+    gtk_widget_get_allocation (GTK_WIDGET (container), &allocation);
+
+    return CANVAS_WIDTH (container, allocation);
+}
+
+/* Lays down every icon, remembering the lines when they are laid out in
+ * lines so that the visible icons can be found quickly, and new icons can
+ * be placed without laying down the ones before them again.
+ */
+static void
+lay_down_all_icons (NautilusCanvasContainer *container)
+{
+    NautilusCanvasContainerDetails *details;
+    GArray *lines;
+    GList *p;
+
+    details = container->details;
+
+    if (details->is_desktop)
+    {
+        lay_down_icons (container, details->icons, 0);
+        return;
+    }
+
+    lines = g_array_new (FALSE, FALSE, sizeof (LayoutLine));
+    lay_down_icons_horizontal (container, details->icons, 0, lines);
+
+    /* Placing the icons cleared the previous lines */
+    clear_layout_lines (container);
+    for (p = details->icons; p != NULL; p = p->next)
+    {
+        g_ptr_array_add (details->layout_icons, p->data);
+    }
+    g_array_append_vals (details->layout_lines, lines->data, lines->len);
+    details->layout_width = get_layout_width (container);
+
+    g_array_free (lines, TRUE);
+}
+
+/* Returns the line holding the icon at @index in the layout */
+static guint
+find_layout_line_for_icon (GArray *lines,
+                           guint   index)
+{
+    guint low, high, middle;
+
+    low = 0;
+    high = lines->len;
+    while (high - low > 1)
+    {
+        middle = (low + high) / 2;
+        if (g_array_index (lines, LayoutLine, middle).first_icon <= index)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/* Places @new_icons among the icons of the previous layout, keeping the
+ * sort order, and only lays down the lines from the first one that changed.
+ * The icons list is left unsorted, the layout order is in layout_icons.
+ * Returns FALSE if every icon has to be laid down again instead.
+ */
+static gboolean
+lay_down_new_icons (NautilusCanvasContainer *container,
+                    GList                   *new_icons)
+{
+    NautilusCanvasContainerDetails *details;
+    NautilusCanvasIcon *icon;
+    GPtrArray *icons;
+    GArray *lines, *slots;
+    LayoutLine start;
+    GList *sorted_icons, *p, *tail;
+    guint low, high, middle, slot;
+    guint n_old, n_new, src, dest;
+    guint first_changed, line;
+    guint visible_start, visible_end;
+    gboolean visible_valid;
+    guint i;
+
+    details = container->details;
+    n_new = g_list_length (new_icons);
+
+    if (new_icons == NULL ||
+        details->is_desktop ||
+        details->layout_lines->len == 0 ||
+        details->layout_width != get_layout_width (container) ||
+        details->layout_icons->len + n_new != g_hash_table_size (details->icon_set))
+    {
+        return FALSE;
+    }
+
+    /* Placing the icons clears the lines of the container, so keep them
+     * apart until the new ones are laid down.
+     */
+    icons = details->layout_icons;
+    lines = details->layout_lines;
+    visible_start = details->layout_visible_start;
+    visible_end = details->layout_visible_end;
+    visible_valid = details->layout_visible_valid;
+    details->layout_icons = g_ptr_array_new ();
+    details->layout_lines = g_array_new (FALSE, FALSE, sizeof (LayoutLine));
+    n_old = icons->len;
+
+    /* Find where each of the sorted new icons goes by a binary search */
+    sorted_icons = g_list_sort_with_data (g_list_copy (new_icons), compare_icons, container);
+    slots = g_array_sized_new (FALSE, FALSE, sizeof (guint), n_new);
+    slot = 0;
+    for (p = sorted_icons; p != NULL; p = p->next)
+    {
+        low = slot;
+        high = n_old;
+        while (low < high)
+        {
+            middle = (low + high) / 2;
+            if (compare_icons (g_ptr_array_index (icons, middle), p->data, container) <= 0)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        slot = low;
+        g_array_append_val (slots, slot);
+    }
+    first_changed = g_array_index (slots, guint, 0);
+
+    /* The icons marked visible move along with the new ones */
+    if (visible_valid && first_changed < visible_end)
+    {
+        guint shift_start, shift_end;
+
+        shift_start = shift_end = 0;
+        for (i = 0; i < n_new; i++)
+        {
+            slot = g_array_index (slots, guint, i);
+            if (slot <= visible_start)
+            {
+                shift_start++;
+            }
+            if (slot < visible_end)
+            {
+                shift_end++;
+            }
+        }
+        visible_start += shift_start;
+        visible_end += shift_end;
+    }
+
+    /* Merge them in from the back, so only the icons after the first new
+     * one move, and icons sorting last are simply appended.
+     */
+    g_ptr_array_set_size (icons, n_old + n_new);
+    src = n_old;
+    dest = n_old + n_new;
+    p = g_list_last (sorted_icons);
+    for (i = n_new; i > 0; i--, p = p->prev)
+    {
+        slot = g_array_index (slots, guint, i - 1);
+        while (src > slot)
+        {
+            icons->pdata[--dest] = icons->pdata[--src];
+        }
+        icons->pdata[--dest] = p->data;
+
+        /* New icons among the visible ones are marked too. Those that
+         * end up out of view are unmarked again once the visible icons
+         * are updated after the layout.
+         */
+        if (visible_valid && dest >= visible_start && dest < visible_end)
+        {
+            icon = p->data;
+            nautilus_canvas_item_set_is_visible (icon->item, TRUE);
+            nautilus_canvas_container_prioritize_thumbnailing (container, icon);
+        }
+    }
+    g_list_free (sorted_icons);
+    g_array_free (slots, TRUE);
+
+    /* Keep the lines before the one the first new icon goes to */
+    line = find_layout_line_for_icon (lines, first_changed);
+    start = g_array_index (lines, LayoutLine, line);
+    g_array_set_size (lines, line);
+
+    tail = NULL;
+    for (i = icons->len; i > start.first_icon; i--)
+    {
+        icon = g_ptr_array_index (icons, i - 1);
+        icon->position = i - 1;
+        tail = g_list_prepend (tail, icon);
+    }
+
+    lay_down_icons_horizontal (container, tail, start.y - CONTAINER_PAD_TOP, lines);
+    for (i = line; i < lines->len; i++)
+    {
+        g_array_index (lines, LayoutLine, i).first_icon += start.first_icon;
     }
+    g_list_free (tail);
+
+    g_ptr_array_free (details->layout_icons, TRUE);
+    details->layout_icons = icons;
+    g_array_free (details->layout_lines, TRUE);
+    details->layout_lines = lines;
+    details->layout_visible_start = visible_start;
+    details->layout_visible_end = visible_end;
+    details->layout_visible_valid = visible_valid;
+
+    return TRUE;
 }
 
 static void
 redo_layout_internal (NautilusCanvasContainer *container)
 {
     gboolean layout_possible;
+    GList *new_icons;
+
+    new_icons = g_list_copy (container->details->new_icons);
 
     layout_possible = finish_adding_new_icons (container);
     if (!layout_possible)
     {
+        g_list_free (new_icons);
         schedule_redo_layout (container);
         return;
     }
@@ -2177,14 +2502,18 @@ redo_layout_internal (NautilusCanvasContainer *container)
     if (container->details->auto_layout
         && container->details->drag_state != DRAG_STATE_STRETCH)
     {
-        if (container->details->needs_resort)
+        /* When icons were only added since the last layout, the ones
+         * before them can stay where they are.
+         */
+        if (!lay_down_new_icons (container, new_icons))
         {
-            resort (container);
-            container->details->needs_resort = FALSE;
+            ensure_icons_sorted (container);
+            lay_down_all_icons (container);
         }
-        lay_down_icons (container, container->details->icons, 0);
     }
 
+    g_list_free (new_icons);
+
     if (nautilus_canvas_container_is_layout_rtl (container))
     {
         nautilus_canvas_container_set_rtl_positions (container);
@@ -2324,6 +2653,8 @@ invalidate_label_sizes (NautilusCanvasContainer *container)
 
         nautilus_canvas_item_invalidate_label_size (icon->item);
     }
+
+    clear_layout_lines (container);
 }
 
 static gboolean
@@ -2340,6 +2671,8 @@ select_range (NautilusCanvasContainer *container,
 
     selection_changed = FALSE;
 
+    ensure_icons_sorted (container);
+
     unmatched_icon = NULL;
     select = FALSE;
     for (p = container->details->icons; p != NULL; p = p->next)
@@ -2480,45 +2813,89 @@ static void
 rubberband_select (NautilusCanvasContainer *container,
                    const EelDRect          *current_rect)
 {
-    GList *p;
-    gboolean selection_changed, is_in, canvas_rect_calculated;
+    NautilusCanvasRubberbandInfo *band_info;
+    GList *p, *items;
+    gboolean selection_changed, is_in;
     NautilusCanvasIcon *icon;
-    EelIRect canvas_rect;
+    EelIRect canvas_rect, search_canvas_rect;
+    EelDRect search_rect;
     EelCanvas *canvas;
+    EelCanvasGroup *root;
 
+    band_info = &container->details->rubberband_info;
+    canvas = EEL_CANVAS (container);
+    root = eel_canvas_root (canvas);
     selection_changed = FALSE;
-    canvas_rect_calculated = FALSE;
 
-    for (p = container->details->icons; p != NULL; p = p->next)
-    {
-        icon = p->data;
+    eel_canvas_w2c (canvas,
+                    current_rect->x0,
+                    current_rect->y0,
+                    &canvas_rect.x0,
+                    &canvas_rect.y0);
+    eel_canvas_w2c (canvas,
+                    current_rect->x1,
+                    current_rect->y1,
+                    &canvas_rect.x1,
+                    &canvas_rect.y1);
+
+    if (root->index != NULL)
+    {
+        /* Icons outside of both the previous and the current rectangle
+         * still have the selection they had before rubberbanding, so
+         * only the ones in either need to be hit tested again.
+         */
+        eel_drect_union (&search_rect, &band_info->prev_rect, current_rect);
+        eel_canvas_w2c (canvas,
+                        search_rect.x0,
+                        search_rect.y0,
+                        &search_canvas_rect.x0,
+                        &search_canvas_rect.y0);
+        eel_canvas_w2c (canvas,
+                        search_rect.x1,
+                        search_rect.y1,
+                        &search_canvas_rect.x1,
+                        &search_canvas_rect.y1);
+
+        /* Bring the bounding boxes of moved icons up to date */
+        eel_canvas_update_now (canvas);
+
+        items = eel_canvas_group_get_items_in_rect (root,
+                                                    search_canvas_rect.x0,
+                                                    search_canvas_rect.y0,
+                                                    search_canvas_rect.x1,
+                                                    search_canvas_rect.y1);
+        for (p = items; p != NULL; p = p->next)
+        {
+            if (!NAUTILUS_IS_CANVAS_ITEM (p->data))
+            {
+                continue;
+            }
+
+            icon = NAUTILUS_CANVAS_ITEM (p->data)->user_data;
+            is_in = nautilus_canvas_item_hit_test_rectangle (icon->item, canvas_rect);
 
-        if (!canvas_rect_calculated)
+            selection_changed |= icon_set_selected
+                                     (container, icon,
+                                     is_in ^ icon->was_selected_before_rubberband);
+        }
+        g_list_free (items);
+    }
+    else
+    {
+        for (p = container->details->icons; p != NULL; p = p->next)
         {
-            /* Only do this calculation once, since all the canvas items
-             * we are interating are in the same coordinate space
-             */
-            canvas = EEL_CANVAS_ITEM (icon->item)->canvas;
-            eel_canvas_w2c (canvas,
-                            current_rect->x0,
-                            current_rect->y0,
-                            &canvas_rect.x0,
-                            &canvas_rect.y0);
-            eel_canvas_w2c (canvas,
-                            current_rect->x1,
-                            current_rect->y1,
-                            &canvas_rect.x1,
-                            &canvas_rect.y1);
-            canvas_rect_calculated = TRUE;
-        }
-
-        is_in = nautilus_canvas_item_hit_test_rectangle (icon->item, canvas_rect);
+            icon = p->data;
 
-        selection_changed |= icon_set_selected
-                                 (container, icon,
-                                 is_in ^ icon->was_selected_before_rubberband);
+            is_in = nautilus_canvas_item_hit_test_rectangle (icon->item, canvas_rect);
+
+            selection_changed |= icon_set_selected
+                                     (container, icon,
+                                     is_in ^ icon->was_selected_before_rubberband);
+        }
     }
 
+    band_info->prev_rect = *current_rect;
+
     if (selection_changed)
     {
         g_signal_emit (container,
@@ -2779,6 +3156,9 @@ start_rubberbanding (NautilusCanvasContainer *container,
         (EEL_CANVAS (container), event->x, event->y,
         &band_info->start_x, &band_info->start_y);
 
+    band_info->prev_rect.x0 = band_info->prev_rect.x1 = band_info->start_x;
+    band_info->prev_rect.y0 = band_info->prev_rect.y1 = band_info->start_y;
+
     get_rubber_color (container, &bg_color, &border_color);
 
     band_info->selection_rectangle = eel_canvas_item_new
@@ -4234,6 +4614,11 @@ finalize (GObject *object)
     g_hash_table_destroy (details->icon_set);
     details->icon_set = NULL;
 
+    g_ptr_array_free (details->layout_icons, TRUE);
+    g_array_free (details->layout_lines, TRUE);
+    g_hash_table_destroy (details->icons_by_uri);
+    g_hash_table_destroy (details->label_sizes);
+
     g_free (details->font);
 
     if (details->a11y_item_action_queue != NULL)
@@ -4465,6 +4850,9 @@ style_updated (GtkWidget *widget)
         GTK_WIDGET_CLASS (nautilus_canvas_container_parent_class)->style_updated (widget);
     }
 
+    /* The default font may have changed */
+    g_hash_table_remove_all (container->details->label_sizes);
+
     if (gtk_widget_get_realized (widget))
     {
         nautilus_canvas_container_request_update_all_internal (container, TRUE);
@@ -5763,6 +6151,7 @@ handle_scale_factor_changed (GObject    *object,
                              GParamSpec *pspec,
                              gpointer    user_data)
 {
+    g_hash_table_remove_all (NAUTILUS_CANVAS_CONTAINER (object)->details->label_sizes);
     nautilus_canvas_container_request_update_all_internal (NAUTILUS_CANVAS_CONTAINER (object),
                                                            TRUE);
 }
@@ -5870,11 +6259,19 @@ nautilus_canvas_container_init (NautilusCanvasContainer *container)
     details = g_new0 (NautilusCanvasContainerDetails, 1);
 
     details->icon_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+    details->layout_icons = g_ptr_array_new ();
+    details->layout_lines = g_array_new (FALSE, FALSE, sizeof (LayoutLine));
+    details->icons_by_uri = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, NULL);
+    details->label_sizes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
     details->layout_timestamp = UNDEFINED_TIME;
     details->zoom_level = NAUTILUS_CANVAS_ZOOM_LEVEL_STANDARD;
 
     container->details = details;
 
+    /* Keep picking, drawing and rubberbanding cheap in large folders */
+    eel_canvas_group_set_indexed (eel_canvas_root (EEL_CANVAS (container)), TRUE);
+
     g_signal_connect (container, "focus-in-event",
                       G_CALLBACK (handle_focus_in_event), NULL);
     g_signal_connect (container, "focus-out-event",
@@ -6157,6 +6554,9 @@ nautilus_canvas_container_clear (NautilusCanvasContainer *container)
     details->stretch_icon = NULL;
     details->drop_target = NULL;
 
+    clear_layout_lines (container);
+    g_hash_table_remove_all (details->icons_by_uri);
+
     for (p = details->icons; p != NULL; p = p->next)
     {
         icon_free (p->data);
@@ -6395,10 +6795,16 @@ icon_destroy (NautilusCanvasContainer *container,
     item = item->next ? item->next : item->prev;
     icon_to_focus = (item != NULL) ? item->data : NULL;
 
+    clear_layout_lines (container);
+
     details->icons = g_list_remove (details->icons, icon);
     details->new_icons = g_list_remove (details->new_icons, icon);
     details->selection = g_list_remove (details->selection, icon->data);
     g_hash_table_remove (details->icon_set, icon->data);
+    if (icon->uri != NULL && g_hash_table_lookup (details->icons_by_uri, icon->uri) == icon)
+    {
+        g_hash_table_remove (details->icons_by_uri, icon->uri);
+    }
 
     was_selected = icon->is_selected;
 
@@ -6557,6 +6963,97 @@ nautilus_canvas_container_prioritize_thumbnailing (NautilusCanvasContainer *cont
     klass->prioritize_thumbnailing (container, icon->data);
 }
 
+/* Returns the last line starting above @y, or the first line */
+static guint
+find_layout_line (GArray *lines,
+                  double  y)
+{
+    guint low, high, middle;
+
+    low = 0;
+    high = lines->len;
+    while (high - low > 1)
+    {
+        middle = (low + high) / 2;
+        if (g_array_index (lines, LayoutLine, middle).y <= y)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static void
+update_visible_layout_icons (NautilusCanvasContainer *container,
+                             double                   min_y,
+                             double                   max_y)
+{
+    NautilusCanvasContainerDetails *details;
+    NautilusCanvasIcon *icon;
+    guint start, end, old_start, old_end;
+    guint line, i;
+
+    details = container->details;
+
+    line = find_layout_line (details->layout_lines, min_y);
+    start = g_array_index (details->layout_lines, LayoutLine, line).first_icon;
+
+    line = find_layout_line (details->layout_lines, max_y) + 1;
+    if (line < details->layout_lines->len)
+    {
+        end = g_array_index (details->layout_lines, LayoutLine, line).first_icon;
+    }
+    else
+    {
+        end = details->layout_icons->len;
+    }
+
+    if (details->layout_visible_valid)
+    {
+        old_start = details->layout_visible_start;
+        old_end = details->layout_visible_end;
+    }
+    else
+    {
+        /* Nothing is known about the icons after a new layout */
+        old_start = 0;
+        old_end = details->layout_icons->len;
+    }
+
+    for (i = old_start; i < old_end; i++)
+    {
+        if (i < start || i >= end)
+        {
+            icon = g_ptr_array_index (details->layout_icons, i);
+            nautilus_canvas_item_set_is_visible (icon->item, FALSE);
+        }
+    }
+
+    /* Only the icons that just came into view need thumbnails. Go from the
+     * bottom up, as the thumbnails prioritized last are made first.
+     */
+    for (i = end; i > start; i--)
+    {
+        if (details->layout_visible_valid && i - 1 >= old_start && i - 1 < old_end)
+        {
+            continue;
+        }
+
+        icon = g_ptr_array_index (details->layout_icons, i - 1);
+        nautilus_canvas_item_set_is_visible (icon->item, TRUE);
+        nautilus_canvas_container_prioritize_thumbnailing (container, icon);
+    }
+
+    details->layout_visible_start = start;
+    details->layout_visible_end = end;
+    details->layout_visible_valid = TRUE;
+}
+
 static void
 nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *container)
 {
@@ -6584,6 +7081,12 @@ nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *contain
     eel_canvas_c2w (EEL_CANVAS (container),
                     max_x, max_y, &max_x, &max_y);
 
+    if (container->details->layout_lines->len > 0)
+    {
+        update_visible_layout_icons (container, min_y, max_y);
+        return;
+    }
+
     /* Do the iteration in reverse to get the render-order from top to
      * bottom for the prioritized thumbnails.
      */
@@ -6667,6 +7170,14 @@ nautilus_canvas_container_update_icon (NautilusCanvasContainer *container,
 
     details = container->details;
 
+    /* The size of a placed icon may change, so the next layout lays
+     * down every icon again.
+     */
+    if (icon_is_positioned (icon))
+    {
+        clear_layout_lines (container);
+    }
+
     /* compute the maximum size based on the scale factor */
     min_image_size = MINIMUM_IMAGE_SIZE * EEL_CANVAS (container)->pixels_per_unit;
     max_image_size = MAX (MAXIMUM_IMAGE_SIZE * EEL_CANVAS (container)->pixels_per_unit, NAUTILUS_ICON_MAXIMUM_SIZE);
@@ -6953,6 +7464,7 @@ nautilus_canvas_container_add (NautilusCanvasContainer *container,
     details->new_icons = g_list_prepend (details->new_icons, icon);
 
     g_hash_table_insert (details->icon_set, data, icon);
+    update_icon_uri (container, icon);
 
     details->needs_resort = TRUE;
 
@@ -7028,6 +7540,7 @@ nautilus_canvas_container_request_update (NautilusCanvasContainer *container,
 
     if (icon != NULL)
     {
+        update_icon_uri (container, icon);
         nautilus_canvas_container_update_icon (container, icon);
         container->details->needs_resort = TRUE;
         schedule_redo_layout (container);
@@ -7317,11 +7830,7 @@ nautilus_canvas_container_select_first (NautilusCanvasContainer *container)
 
     selection_changed = FALSE;
 
-    if (container->details->needs_resort)
-    {
-        resort (container);
-        container->details->needs_resort = FALSE;
-    }
+    ensure_icons_sorted (container);
 
     icon = g_list_nth_data (container->details->icons, 0);
     if (icon)
@@ -7465,36 +7974,7 @@ NautilusCanvasIcon *
 nautilus_canvas_container_get_icon_by_uri (NautilusCanvasContainer *container,
                                            const char              *uri)
 {
-    NautilusCanvasContainerDetails *details;
-    GList *p;
-
-    /* Eventually, we must avoid searching the entire canvas list,
-     *  but it's OK for now.
-     *  A hash table mapping uri to canvas is one possibility.
-     */
-
-    details = container->details;
-
-    for (p = details->icons; p != NULL; p = p->next)
-    {
-        NautilusCanvasIcon *icon;
-        char *icon_uri;
-        gboolean is_match;
-
-        icon = p->data;
-
-        icon_uri = nautilus_canvas_container_get_icon_uri
-                       (container, icon);
-        is_match = strcmp (uri, icon_uri) == 0;
-        g_free (icon_uri);
-
-        if (is_match)
-        {
-            return icon;
-        }
-    }
-
-    return NULL;
+    return g_hash_table_lookup (container->details->icons_by_uri, uri);
 }
 
 static NautilusCanvasIcon *
@@ -7786,6 +8266,7 @@ nautilus_canvas_container_set_auto_layout (NautilusCanvasContainer *container,
 
     reset_scroll_region_if_not_empty (container);
     container->details->auto_layout = auto_layout;
+    clear_layout_lines (container);
 
     if (!auto_layout)
     {
@@ -7911,6 +8392,7 @@ nautilus_canvas_container_sort (NautilusCanvasContainer *container)
     container->details->auto_layout = TRUE;
 
     reset_scroll_region_if_not_empty (container);
+    clear_layout_lines (container);
     container->details->needs_resort = TRUE;
     redo_layout (container);
 
@@ -8014,6 +8496,7 @@ nautilus_canvas_container_set_font (NautilusCanvasContainer *container,
 
     g_free (container->details->font);
     container->details->font = g_strdup (font);
+    g_hash_table_remove_all (container->details->label_sizes);
 
     nautilus_canvas_container_request_update_all_internal (container, TRUE);
     gtk_widget_queue_draw (GTK_WIDGET (container));
@@ -8299,6 +8782,7 @@ nautilus_canvas_container_accessible_add_selection (AtkSelection *accessible,
 
     container = NAUTILUS_CANVAS_CONTAINER (widget);
 
+    ensure_icons_sorted (container);
     l = g_list_nth (container->details->icons, i);
     if (l)
     {
@@ -8396,6 +8880,7 @@ nautilus_canvas_container_accessible_is_child_selected (AtkSelection *accessible
 
     container = NAUTILUS_CANVAS_CONTAINER (widget);
 
+    ensure_icons_sorted (container);
     l = g_list_nth (container->details->icons, i);
     if (l)
     {
@@ -8533,6 +9018,7 @@ nautilus_canvas_container_accessible_ref_child (AtkObject *accessible,
 
     container = NAUTILUS_CANVAS_CONTAINER (widget);
 
+    ensure_icons_sorted (container);
     item = (g_list_nth (container->details->icons, i));
 
     if (item)
@@ -57,6 +57,10 @@
 #define MAX_TEXT_WIDTH_LARGE 98
 #define MAX_TEXT_WIDTH_LARGER 100
 
+/* Label sizes kept by the container, per icon, before starting over */
+#define LABEL_SIZES_PER_ICON 4
+#define LABEL_SIZES_MIN 1024
+
 /* special text height handling
  * each item has three text height variables:
  *  + text_height: actual height of the displayed (i.e. on-screen) PangoLayout.
@@ -808,16 +812,13 @@ prepare_pango_layout_for_measure_entire_text (NautilusCanvasItem *item,
     pango_layout_set_height (layout, G_MININT);
 }
 
-static void
-prepare_pango_layout_for_draw (NautilusCanvasItem *item,
-                               PangoLayout        *layout)
+static int
+get_pango_layout_height_for_draw (NautilusCanvasItem *item)
 {
     NautilusCanvasItemDetails *details;
     NautilusCanvasContainer *container;
     gboolean needs_highlight;
 
-    prepare_pango_layout_width (item, layout);
-
     container = NAUTILUS_CANVAS_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
     details = item->details;
 
@@ -828,28 +829,122 @@ prepare_pango_layout_for_draw (NautilusCanvasItem *item,
         details->entire_text)
     {
         /* VOODOO-TODO, cf. compute_text_rectangle() */
-        pango_layout_set_height (layout, G_MININT);
+        return G_MININT;
     }
-    else
+
+    /* TODO? we might save some resources, when the re-layout is not neccessary in case
+     * the layout height already fits into max. layout lines. But pango should figure this
+     * out itself (which it doesn't ATM).
+     */
+    return nautilus_canvas_container_get_max_layout_lines_for_pango (container);
+}
+
+static void
+prepare_pango_layout_for_draw (NautilusCanvasItem *item,
+                               PangoLayout        *layout)
+{
+    prepare_pango_layout_width (item, layout);
+    pango_layout_set_height (layout, get_pango_layout_height_for_draw (item));
+}
+
+/* Size of one of the texts of the label, as laid out by Pango */
+typedef struct
+{
+    int width;
+    int height;
+    int dx;
+
+    /* Only measured for the editable text */
+    int height_for_layout;
+    int height_for_entire_text;
+} LabelTextSize;
+
+/* Measures @text, or finds how it was measured for another icon.
+ * The container keeps the sizes until the font or the style change,
+ * so icons with the same texts share them and changing the zoom level
+ * or highlighting an icon doesn't measure everything again.
+ */
+static const LabelTextSize *
+measure_label_layout (NautilusCanvasItem *item,
+                      const char         *text,
+                      gboolean            is_editable)
+{
+    NautilusCanvasContainer *container;
+    GHashTable *label_sizes;
+    LabelTextSize *size;
+    PangoLayout *layout;
+    int max_layout_lines;
+    char *key;
+
+    container = NAUTILUS_CANVAS_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
+    label_sizes = container->details->label_sizes;
+    max_layout_lines = nautilus_canvas_container_get_max_layout_lines (container);
+
+    key = g_strdup_printf ("%c %d %d %d %s",
+                           is_editable ? 'e' : 'a',
+                           (int) floor (nautilus_canvas_item_get_max_text_width (item)),
+                           is_editable ? max_layout_lines : 0,
+                           get_pango_layout_height_for_draw (item),
+                           text);
+
+    size = g_hash_table_lookup (label_sizes, key);
+    if (size != NULL)
+    {
+        g_free (key);
+        return size;
+    }
+
+    if (g_hash_table_size (label_sizes) >=
+        LABEL_SIZES_PER_ICON * g_hash_table_size (container->details->icon_set) + LABEL_SIZES_MIN)
+    {
+        g_hash_table_remove_all (label_sizes);
+    }
+
+    size = g_new0 (LabelTextSize, 1);
+
+    if (is_editable)
     {
-        /* TODO? we might save some resources, when the re-layout is not neccessary in case
-         * the layout height already fits into max. layout lines. But pango should figure this
-         * out itself (which it doesn't ATM).
+        /* first, measure required text height: height_for_entire_text
+         * then, measure text height applicable for layout: height_for_layout
+         * next, measure actually displayed height: height
          */
-        pango_layout_set_height (layout,
-                                 nautilus_canvas_container_get_max_layout_lines_for_pango (container));
+        layout = get_label_layout (&item->details->editable_text_layout, item, text);
+
+        prepare_pango_layout_for_measure_entire_text (item, layout);
+        layout_get_full_size (layout,
+                              NULL,
+                              &size->height_for_entire_text,
+                              NULL);
+        layout_get_size_for_layout (layout,
+                                    max_layout_lines,
+                                    size->height_for_entire_text,
+                                    &size->height_for_layout);
+    }
+    else
+    {
+        layout = get_label_layout (&item->details->additional_text_layout, item, text);
     }
+
+    prepare_pango_layout_for_draw (item, layout);
+    layout_get_full_size (layout,
+                          &size->width,
+                          &size->height,
+                          &size->dx);
+
+    g_object_unref (layout);
+
+    g_hash_table_insert (label_sizes, key, size);
+
+    return size;
 }
 
 static void
 measure_label_text (NautilusCanvasItem *item)
 {
     NautilusCanvasItemDetails *details;
-    NautilusCanvasContainer *container;
     gint editable_height, editable_height_for_layout, editable_height_for_entire_text, editable_width, editable_dx;
     gint additional_height, additional_width, additional_dx;
-    PangoLayout *editable_layout;
-    PangoLayout *additional_layout;
+    const LabelTextSize *size;
     gboolean have_editable, have_additional;
 
     /* check to see if the cached values are still valid; if so, there's
@@ -894,41 +989,22 @@ measure_label_text (NautilusCanvasItem *item)
     additional_height = 0;
     additional_dx = 0;
 
-    container = NAUTILUS_CANVAS_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
-    editable_layout = NULL;
-    additional_layout = NULL;
-
     if (have_editable)
     {
-        /* first, measure required text height: editable_height_for_entire_text
-         * then, measure text height applicable for layout: editable_height_for_layout
-         * next, measure actually displayed height: editable_height
-         */
-        editable_layout = get_label_layout (&details->editable_text_layout, item, details->editable_text);
-
-        prepare_pango_layout_for_measure_entire_text (item, editable_layout);
-        layout_get_full_size (editable_layout,
-                              NULL,
-                              &editable_height_for_entire_text,
-                              NULL);
-        layout_get_size_for_layout (editable_layout,
-                                    nautilus_canvas_container_get_max_layout_lines (container),
-                                    editable_height_for_entire_text,
-                                    &editable_height_for_layout);
-
-        prepare_pango_layout_for_draw (item, editable_layout);
-        layout_get_full_size (editable_layout,
-                              &editable_width,
-                              &editable_height,
-                              &editable_dx);
+        size = measure_label_layout (item, details->editable_text, TRUE);
+        editable_width = size->width;
+        editable_height = size->height;
+        editable_dx = size->dx;
+        editable_height_for_layout = size->height_for_layout;
+        editable_height_for_entire_text = size->height_for_entire_text;
     }
 
     if (have_additional)
     {
-        additional_layout = get_label_layout (&details->additional_text_layout, item, details->additional_text);
-        prepare_pango_layout_for_draw (item, additional_layout);
-        layout_get_full_size (additional_layout,
-                              &additional_width, &additional_height, &additional_dx);
+        size = measure_label_layout (item, details->additional_text, FALSE);
+        additional_width = size->width;
+        additional_height = size->height;
+        additional_dx = size->dx;
     }
 
     details->editable_text_height = editable_height;
@@ -967,16 +1043,6 @@ measure_label_text (NautilusCanvasItem *item)
 
     /* extra to make it look nicer */
     details->text_width += TEXT_BACK_PADDING_X * 2;
-
-    if (editable_layout)
-    {
-        g_object_unref (editable_layout);
-    }
-
-    if (additional_layout)
-    {
-        g_object_unref (additional_layout);
-    }
 }
 
 static void
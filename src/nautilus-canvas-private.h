@@ -54,6 +54,9 @@ typedef struct {
 	/* Position in the view */
 	int position;
 
+	/* URI of the icon data, as of the last update */
+	char *uri;
+
 	/* Whether this item is selected. */
 	eel_boolean_bit is_selected : 1;
 
@@ -80,6 +83,8 @@ typedef struct {
 	guint timer_id;
 
 	guint prev_x, prev_y;
+	/* Rectangle of the previous selection, in world coordinates */
+	EelDRect prev_rect;
 	int last_adj_x;
 	int last_adj_y;
 } NautilusCanvasRubberbandInfo;
@@ -122,6 +127,8 @@ struct NautilusCanvasContainerDetails {
 	GList *new_icons;
 	GList *selection;
 	GHashTable *icon_set;
+	/* URI -> icon */
+	GHashTable *icons_by_uri;
 
 	/* Currently focused icon for accessibility. */
 	NautilusCanvasIcon *focus;
@@ -192,6 +199,9 @@ struct NautilusCanvasContainerDetails {
 
 	/* specific fonts used to draw labels */
 	char *font;
+
+	/* Sizes of the label texts at this font, shared by the icons */
+	GHashTable *label_sizes;
 	
 	/* State used so arrow keys don't wander if icons aren't lined up.
 	 */
@@ -218,6 +228,19 @@ struct NautilusCanvasContainerDetails {
 	/* Is the container for a desktop window */
 	gboolean is_desktop;
 
+	/* Icons in the order of the last full layout in lines, and where each
+	 * line starts, so the visible icons can be found by a binary search.
+	 * Empty once icons are placed any other way.
+	 */
+	GPtrArray *layout_icons;
+	GArray *layout_lines;
+	/* Canvas width the lines were laid down for */
+	double layout_width;
+	/* Range of layout_icons that is marked as visible */
+	guint layout_visible_start;
+	guint layout_visible_end;
+	gboolean layout_visible_valid;
+
 	/* Ignore the visible area the next time the scroll region is recomputed */
 	gboolean reset_scroll_region_trigger;
 	
@@ -38,6 +38,7 @@ static GDebugKey keys[] =
     { "Application", NAUTILUS_DEBUG_APPLICATION },
     { "Bookmarks", NAUTILUS_DEBUG_BOOKMARKS },
     { "DBus", NAUTILUS_DEBUG_DBUS },
+    { "DirectorySnapshot", NAUTILUS_DEBUG_DIRECTORY_SNAPSHOT },
     { "DirectoryView", NAUTILUS_DEBUG_DIRECTORY_VIEW },
     { "File", NAUTILUS_DEBUG_FILE },
     { "CanvasContainer", NAUTILUS_DEBUG_CANVAS_CONTAINER },
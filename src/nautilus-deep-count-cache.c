@@ -0,0 +1,415 @@
+/*
+ *  nautilus-deep-count-cache.c: Cache of folder sizes and item counts.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Deep counts add up the listings of every folder in a tree. A folder's
+ * own listing can be reused as long as its modification time is the same,
+ * so a count only has to enumerate the folders that changed since the
+ * last one.
+ *
+ * Checking every folder's modification time still takes one query per
+ * folder, so once all the listings of a tree are in, they are rolled up
+ * into a total for each folder. Counting the tree again then only takes
+ * the modification time of its top folder. A folder's modification time
+ * doesn't change with what is deeper inside it, so totals are dropped
+ * along with the ones of every folder above when Nautilus is told about
+ * a change below them.
+ *
+ * Nothing is kept between sessions: a file written to in place doesn't
+ * change the modification time of its folder, so a saved listing could
+ * not be told apart from a stale one. Changes made by other programs in
+ * folders Nautilus doesn't show are not noticed within a session either.
+ *
+ * Only used from the main thread.
+ */
+
+#include <config.h>
+#include "nautilus-deep-count-cache.h"
+
+#include <string.h>
+
+/* Keeps the memory used by the cache in check */
+#define MAX_ENTRIES 100000
+
+/* Every total lists the files with several links below its folder, so
+ * trees with many of them are not rolled up.
+ */
+#define MAX_TOTAL_LINKS 4096
+
+typedef struct
+{
+    guint64 mtime;
+    NautilusDeepCountListing *listing;
+    NautilusDeepCountTotal *total;
+} CacheEntry;
+
+static GHashTable *cache_entries;    /* uri -> CacheEntry */
+
+NautilusDeepCountListing *
+nautilus_deep_count_listing_new (void)
+{
+    NautilusDeepCountListing *listing;
+
+    listing = g_new0 (NautilusDeepCountListing, 1);
+    listing->ref_count = 1;
+    listing->subdirectories = g_ptr_array_new_with_free_func (g_free);
+    listing->links = g_array_new (FALSE, FALSE, sizeof (NautilusDeepCountLink));
+
+    return listing;
+}
+
+NautilusDeepCountListing *
+nautilus_deep_count_listing_ref (NautilusDeepCountListing *listing)
+{
+    g_atomic_int_inc (&listing->ref_count);
+
+    return listing;
+}
+
+void
+nautilus_deep_count_listing_unref (NautilusDeepCountListing *listing)
+{
+    if (g_atomic_int_dec_and_test (&listing->ref_count))
+    {
+        g_ptr_array_unref (listing->subdirectories);
+        g_array_unref (listing->links);
+        g_free (listing);
+    }
+}
+
+static void
+deep_count_total_free (NautilusDeepCountTotal *total)
+{
+    g_array_unref (total->links);
+    g_free (total);
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+    g_clear_pointer (&entry->listing, nautilus_deep_count_listing_unref);
+    g_clear_pointer (&entry->total, deep_count_total_free);
+    g_free (entry);
+}
+
+static GHashTable *
+get_cache_entries (void)
+{
+    if (cache_entries == NULL)
+    {
+        cache_entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free, (GDestroyNotify) cache_entry_free);
+    }
+
+    return cache_entries;
+}
+
+static CacheEntry *
+lookup_entry (GFile *location)
+{
+    CacheEntry *entry;
+    char *uri;
+
+    uri = g_file_get_uri (location);
+    entry = g_hash_table_lookup (get_cache_entries (), uri);
+    g_free (uri);
+
+    return entry;
+}
+
+/* Returns NULL if the cache is full */
+static CacheEntry *
+ensure_entry (const char *uri)
+{
+    CacheEntry *entry;
+
+    entry = g_hash_table_lookup (get_cache_entries (), uri);
+    if (entry == NULL && g_hash_table_size (cache_entries) < MAX_ENTRIES)
+    {
+        entry = g_new0 (CacheEntry, 1);
+        g_hash_table_insert (cache_entries, g_strdup (uri), entry);
+    }
+
+    return entry;
+}
+
+/* Turns @uri into the one of its folder. Returns FALSE at the root. */
+static gboolean
+uri_to_parent (char *uri)
+{
+    char *slash;
+
+    slash = strrchr (uri, '/');
+    if (slash == NULL || slash == uri || slash[1] == '\0')
+    {
+        return FALSE;
+    }
+
+    if (slash[-1] == '/')
+    {
+        /* Keep the slash of the root */
+        slash[1] = '\0';
+    }
+    else
+    {
+        *slash = '\0';
+    }
+
+    return TRUE;
+}
+
+/* Drops the totals that include @uri: its own and the ones of the folders
+ * above it. Totals are rolled up from the bottom, so a folder without one
+ * has none above it either.
+ */
+static void
+forget_totals (const char *uri)
+{
+    CacheEntry *entry;
+    char *folder_uri;
+
+    entry = g_hash_table_lookup (cache_entries, uri);
+    if (entry != NULL)
+    {
+        g_clear_pointer (&entry->total, deep_count_total_free);
+    }
+
+    folder_uri = g_strdup (uri);
+    while (uri_to_parent (folder_uri))
+    {
+        entry = g_hash_table_lookup (cache_entries, folder_uri);
+        if (entry == NULL || entry->total == NULL)
+        {
+            break;
+        }
+
+        g_clear_pointer (&entry->total, deep_count_total_free);
+    }
+    g_free (folder_uri);
+}
+
+const NautilusDeepCountListing *
+nautilus_deep_count_cache_lookup_listing (GFile   *location,
+                                          guint64  mtime)
+{
+    CacheEntry *entry;
+
+    entry = lookup_entry (location);
+    if (entry == NULL || entry->listing == NULL || entry->mtime != mtime)
+    {
+        return NULL;
+    }
+
+    return entry->listing;
+}
+
+void
+nautilus_deep_count_cache_store_listing (GFile                    *location,
+                                         guint64                   mtime,
+                                         NautilusDeepCountListing *listing)
+{
+    CacheEntry *entry;
+    char *uri;
+
+    uri = g_file_get_uri (location);
+    entry = ensure_entry (uri);
+    if (entry == NULL)
+    {
+        nautilus_deep_count_listing_unref (listing);
+        g_free (uri);
+        return;
+    }
+
+    g_clear_pointer (&entry->listing, nautilus_deep_count_listing_unref);
+    entry->mtime = mtime;
+    entry->listing = listing;
+
+    forget_totals (uri);
+    g_free (uri);
+}
+
+static int
+compare_links (gconstpointer a,
+               gconstpointer b)
+{
+    const NautilusDeepCountLink *link_a = a;
+    const NautilusDeepCountLink *link_b = b;
+
+    if (link_a->device != link_b->device)
+    {
+        return link_a->device < link_b->device ? -1 : 1;
+    }
+    if (link_a->inode != link_b->inode)
+    {
+        return link_a->inode < link_b->inode ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/* Sorts @links and keeps each inode once */
+static void
+unique_links (GArray *links)
+{
+    NautilusDeepCountLink *link;
+    guint i, n;
+
+    g_array_sort (links, compare_links);
+
+    n = 0;
+    for (i = 0; i < links->len; i++)
+    {
+        link = &g_array_index (links, NautilusDeepCountLink, i);
+        if (n > 0 &&
+            compare_links (link, &g_array_index (links, NautilusDeepCountLink, n - 1)) == 0)
+        {
+            continue;
+        }
+
+        g_array_index (links, NautilusDeepCountLink, n) = *link;
+        n++;
+    }
+    g_array_set_size (links, n);
+}
+
+/* Adds up the listing of @entry and the totals of its subfolders, which
+ * are rolled up first. Returns NULL if any folder below has no listing.
+ */
+static const NautilusDeepCountTotal *
+roll_up_total (GFile      *location,
+               CacheEntry *entry)
+{
+    const NautilusDeepCountTotal *child_total;
+    NautilusDeepCountTotal *total;
+    NautilusDeepCountListing *listing;
+    CacheEntry *child_entry;
+    GFile *child;
+    char *child_uri;
+    guint i;
+
+    if (entry->total != NULL)
+    {
+        return entry->total;
+    }
+
+    if (entry->listing == NULL)
+    {
+        return NULL;
+    }
+
+    listing = entry->listing;
+
+    total = g_new0 (NautilusDeepCountTotal, 1);
+    total->directory_count = listing->directory_count;
+    total->file_count = listing->file_count;
+    total->unreadable_count = listing->unreadable_count;
+    total->size = listing->size;
+    total->links = g_array_new (FALSE, FALSE, sizeof (NautilusDeepCountLink));
+    g_array_append_vals (total->links, listing->links->data, listing->links->len);
+
+    for (i = 0; i < listing->subdirectories->len; i++)
+    {
+        child = g_file_get_child (location, g_ptr_array_index (listing->subdirectories, i));
+        child_uri = g_file_get_uri (child);
+        child_entry = g_hash_table_lookup (cache_entries, child_uri);
+        child_total = child_entry != NULL ? roll_up_total (child, child_entry) : NULL;
+        g_free (child_uri);
+        g_object_unref (child);
+
+        if (child_total == NULL)
+        {
+            deep_count_total_free (total);
+            return NULL;
+        }
+
+        total->directory_count += child_total->directory_count;
+        total->file_count += child_total->file_count;
+        total->unreadable_count += child_total->unreadable_count;
+        total->size += child_total->size;
+        g_array_append_vals (total->links, child_total->links->data, child_total->links->len);
+    }
+
+    unique_links (total->links);
+    if (total->links->len > MAX_TOTAL_LINKS)
+    {
+        deep_count_total_free (total);
+        return NULL;
+    }
+
+    entry->total = total;
+
+    return total;
+}
+
+const NautilusDeepCountTotal *
+nautilus_deep_count_cache_lookup_total (GFile   *location,
+                                        guint64  mtime)
+{
+    CacheEntry *entry;
+
+    entry = lookup_entry (location);
+    if (entry == NULL || entry->listing == NULL || entry->mtime != mtime)
+    {
+        return NULL;
+    }
+
+    return roll_up_total (location, entry);
+}
+
+/* Call after forget_totals (), so nothing is left in an entry */
+static void
+forget_listing (const char *uri)
+{
+    CacheEntry *entry;
+
+    entry = g_hash_table_lookup (cache_entries, uri);
+    if (entry != NULL && entry->listing != NULL)
+    {
+        g_assert (entry->total == NULL);
+        g_hash_table_remove (cache_entries, uri);
+    }
+}
+
+void
+nautilus_deep_count_cache_invalidate (GFile *location)
+{
+    char *uri;
+    char *folder_uri;
+
+    if (cache_entries == NULL || g_hash_table_size (cache_entries) == 0)
+    {
+        return;
+    }
+
+    /* Walk up the URI rather than the GFiles, this is done for every
+     * change notification.
+     */
+    uri = g_file_get_uri (location);
+    forget_totals (uri);
+    forget_listing (uri);
+
+    /* A file changing doesn't always change the modification time of
+     * its folder, so the listing can't be trusted anymore.
+     */
+    folder_uri = g_strdup (uri);
+    if (uri_to_parent (folder_uri))
+    {
+        forget_listing (folder_uri);
+    }
+
+    g_free (folder_uri);
+    g_free (uri);
+}
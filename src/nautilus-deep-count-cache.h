@@ -0,0 +1,91 @@
+/*
+   nautilus-deep-count-cache.h: Cache of folder sizes and item counts.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NAUTILUS_DEEP_COUNT_CACHE_H
+#define NAUTILUS_DEEP_COUNT_CACHE_H
+
+#include <gio/gio.h>
+
+/* A file with more than one link, which is only counted once. Folders
+ * are never listed as such.
+ */
+typedef struct
+{
+	guint32 device;
+	guint64 inode;
+	goffset size;
+} NautilusDeepCountLink;
+
+/* The direct contents of one folder, as seen at a given modification time.
+ * Listings are not changed once they are in the cache. A folder that
+ * can't be read gets a listing too, with only the unreadable count set,
+ * so the totals above it can still be rolled up.
+ */
+typedef struct
+{
+	gint ref_count;
+	guint directory_count;
+	guint file_count;
+	guint unreadable_count; /* 1 if the folder itself can't be read */
+	goffset size;           /* of the folders and the files with a single link */
+	GPtrArray *subdirectories; /* names of the folders to descend into */
+	GArray *links;          /* NautilusDeepCountLinks */
+} NautilusDeepCountListing;
+
+/* What a folder and everything below it add up to. The files with more
+ * than one link are kept apart, so they are still only counted once
+ * when the total is part of a larger count.
+ */
+typedef struct
+{
+	guint directory_count;
+	guint file_count;
+	guint unreadable_count;
+	goffset size;           /* of the folders and the files with a single link */
+	GArray *links;          /* NautilusDeepCountLinks, each inode once */
+} NautilusDeepCountTotal;
+
+NautilusDeepCountListing * nautilus_deep_count_listing_new   (void);
+NautilusDeepCountListing * nautilus_deep_count_listing_ref   (NautilusDeepCountListing *listing);
+void                       nautilus_deep_count_listing_unref (NautilusDeepCountListing *listing);
+
+/* Listings are only kept for the session. Returns NULL unless the
+ * listing of @location was taken when it had modification time @mtime.
+ */
+const NautilusDeepCountListing *
+         nautilus_deep_count_cache_lookup_listing (GFile                    *location,
+						   guint64                   mtime);
+/* Takes ownership of @listing */
+void     nautilus_deep_count_cache_store_listing  (GFile                    *location,
+						   guint64                   mtime,
+						   NautilusDeepCountListing *listing);
+
+/* Rolls the listings of @location and of every folder below it up into a
+ * total, if @location has modification time @mtime and every folder below
+ * has a listing. Returns NULL otherwise. The total is owned by the cache, and only good
+ * until the next call into it.
+ */
+const NautilusDeepCountTotal *
+         nautilus_deep_count_cache_lookup_total   (GFile                    *location,
+						   guint64                   mtime);
+
+/* Forgets what depends on @location: the listing of its folder, its own
+ * if it is a folder, and the totals of every folder above it.
+ */
+void     nautilus_deep_count_cache_invalidate     (GFile                    *location);
+
+#endif /* NAUTILUS_DEEP_COUNT_CACHE_H */
@@ -23,6 +23,9 @@
 
 #include "nautilus-directory-notify.h"
 #include "nautilus-directory-private.h"
+#include "nautilus-directory-snapshot.h"
+#include "nautilus-search-index.h"
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-file-attributes.h"
 #include "nautilus-file-private.h"
 #include "nautilus-file-utilities.h"
@@ -44,8 +47,46 @@
 
 #define DIRECTORY_LOAD_ITEMS_PER_CALLBACK 100
 
+/* Listing a directory starts with small batches so the first files show
+ * up quickly, then adapts the batch size to how fast the main loop turns
+ * them into NautilusFiles.
+ */
+#define DIRECTORY_LOAD_MIN_ITEMS_PER_CALLBACK 32
+#define DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK 1024
+
+/* How long one idle callback may spend turning pending file infos into
+ * files before yielding back to the main loop.
+ */
+#define DEQUEUE_PENDING_TIME_BUDGET_USEC 8000
+
 /* Keep async. jobs down to this number for all directories. */
-#define MAX_ASYNC_JOBS 10
+#define MAX_ASYNC_JOBS 40
+
+/* How many files past the head of the low priority queue we look at
+ * when filling the request windows below.
+ */
+#define REQUEST_WINDOW_LOOKAHEAD 64
+
+/* Number of requests of each kind that a single directory may have in
+ * flight at the same time, from the preferences. Kinds not listed here
+ * work on one file at a time. Counting and thumbnail loading are cheap
+ * per file but dominated by latency, so they benefit the most from
+ * overlapping requests.
+ */
+static guint request_window[REQUEST_TYPE_LAST];
+static gboolean request_window_initialized;
+
+#define REQUEST_WINDOW_SIZE(type) get_request_window_size (type)
+
+/* Number of folders a deep count enumerates at the same time */
+#define DEEP_COUNT_MAX_LOADS 4
+
+/* When at least this many files of a directory need their info, and
+ * they are a good part of the directory, the info is read with one
+ * enumeration of the directory rather than one query per file.
+ */
+#define FILE_INFO_BATCH_MIN_FILES 16
+#define FILE_INFO_BATCH_MAX_FILES 4096
 
 struct TopLeftTextReadState
 {
@@ -93,6 +134,13 @@ struct DirectoryLoadState
     GHashTable *load_mime_list_hash;
     NautilusFile *load_directory_file;
     int load_file_count;
+    int items_per_callback;
+
+    /* What the enumeration returned, to be saved as a snapshot. */
+    gboolean collect_snapshot;
+    GFileInfo *directory_info;
+    GList *snapshot_infos;
+    guint n_snapshot_infos;
 };
 
 struct MimeListState
@@ -108,6 +156,10 @@ struct GetInfoState
 {
     NautilusDirectory *directory;
     GCancellable *cancellable;
+
+    /* Only for batches, NULL when getting the info of get_info_file. */
+    GFileEnumerator *enumerator;
+    GHashTable *batch_files; /* name -> NautilusFile */
 };
 
 struct NewFilesState
@@ -130,13 +182,40 @@ struct DeepCountState
 {
     NautilusDirectory *directory;
     GCancellable *cancellable;
-    GFileEnumerator *enumerator;
-    GFile *deep_count_location;
-    GList *deep_count_subdirectories;
-    GArray *seen_deep_count_inodes;
+    GQueue deep_count_subdirectories;   /* DeepCountDirectories still to be loaded */
+    GHashTable *seen_deep_count_inodes; /* DeepCountInodes */
     char *fs_id;
+    guint n_loads;                      /* DeepCountLoads in flight */
+
+    /* Whether listings are taken from and saved to the cache */
+    gboolean use_cache;
+    gboolean has_mtime;
+    guint64 mtime;                      /* of the folder being counted */
 };
 
+typedef struct
+{
+    GFile *location;
+    gboolean has_mtime;
+    guint64 mtime;
+} DeepCountDirectory;
+
+/* One of the folders a deep count is enumerating */
+typedef struct
+{
+    DeepCountState *state;
+    DeepCountDirectory *directory;
+    GFileEnumerator *enumerator;
+    /* What the enumeration found, for the cache */
+    NautilusDeepCountListing *listing;
+} DeepCountLoad;
+
+typedef struct
+{
+    guint32 device;
+    guint64 inode;
+} DeepCountInode;
+
 
 
 typedef struct
@@ -183,8 +262,8 @@ static GHashTable *async_jobs;
 #endif
 
 /* Forward declarations for functions that need them. */
-static void     deep_count_load (DeepCountState *state,
-                                 GFile          *location);
+static void     deep_count_load (DeepCountState     *state,
+                                 DeepCountDirectory *directory);
 static gboolean request_is_satisfied (NautilusDirectory *directory,
                                       NautilusFile      *file,
                                       Request            request);
@@ -354,6 +433,61 @@ nautilus_directory_verify_request_counts (NautilusDirectory *directory)
 }
 #endif
 
+static void
+update_request_windows (void)
+{
+    request_window[REQUEST_DIRECTORY_COUNT] =
+        g_settings_get_int (nautilus_preferences,
+                            NAUTILUS_PREFERENCES_DIRECTORY_COUNT_REQUESTS);
+    request_window[REQUEST_THUMBNAIL] =
+        g_settings_get_int (nautilus_preferences,
+                            NAUTILUS_PREFERENCES_THUMBNAIL_REQUESTS);
+}
+
+static void
+request_window_changed_callback (GSettings  *settings,
+                                 const char *key,
+                                 gpointer    user_data)
+{
+    update_request_windows ();
+}
+
+static guint
+get_request_window_size (RequestType type)
+{
+    if (!request_window_initialized)
+    {
+        request_window_initialized = TRUE;
+        update_request_windows ();
+        g_signal_connect (nautilus_preferences,
+                          "changed::" NAUTILUS_PREFERENCES_DIRECTORY_COUNT_REQUESTS,
+                          G_CALLBACK (request_window_changed_callback), NULL);
+        g_signal_connect (nautilus_preferences,
+                          "changed::" NAUTILUS_PREFERENCES_THUMBNAIL_REQUESTS,
+                          G_CALLBACK (request_window_changed_callback), NULL);
+    }
+
+    return MAX (request_window[type], 1);
+}
+
+#ifdef DEBUG_ASYNC_JOBS
+/* How many of @job a directory may run at the same time */
+static guint
+get_async_job_window_size (const char *job)
+{
+    if (g_strcmp0 (job, "directory count") == 0)
+    {
+        return get_request_window_size (REQUEST_DIRECTORY_COUNT);
+    }
+    if (g_strcmp0 (job, "thumbnail") == 0)
+    {
+        return get_request_window_size (REQUEST_THUMBNAIL);
+    }
+
+    return 1;
+}
+#endif
+
 /* Start a job. This is really just a way of limiting the number of
  * async. requests that we issue at any given time. Without this, the
  * number of requests is unbounded.
@@ -388,19 +522,23 @@ async_job_start (NautilusDirectory *directory,
 #ifdef DEBUG_ASYNC_JOBS
     {
         char *uri;
+        guint n_jobs;
+
         if (async_jobs == NULL)
         {
-            async_jobs = g_hash_table_new (g_str_hash, g_str_equal);
+            async_jobs = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, NULL);
         }
         uri = nautilus_directory_get_uri (directory);
         key = g_strconcat (uri, ": ", job, NULL);
-        if (g_hash_table_lookup (async_jobs, key) != NULL)
+        n_jobs = GPOINTER_TO_UINT (g_hash_table_lookup (async_jobs, key)) + 1;
+        if (n_jobs > get_async_job_window_size (job))
         {
             g_warning ("same job twice: %s in %s",
                        job, uri);
         }
         g_free (uri);
-        g_hash_table_insert (async_jobs, key, directory);
+        g_hash_table_replace (async_jobs, key, GUINT_TO_POINTER (n_jobs));
     }
 #endif
 
@@ -415,7 +553,7 @@ async_job_end (NautilusDirectory *directory,
 {
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
-    gpointer table_key, value;
+    guint n_jobs;
 #endif
 
     g_debug ("stopping %s in %p", job, directory->details->location);
@@ -428,15 +566,20 @@ async_job_end (NautilusDirectory *directory,
         uri = nautilus_directory_get_uri (directory);
         g_assert (async_jobs != NULL);
         key = g_strconcat (uri, ": ", job, NULL);
-        if (!g_hash_table_lookup_extended (async_jobs, key, &table_key, &value))
+        n_jobs = GPOINTER_TO_UINT (g_hash_table_lookup (async_jobs, key));
+        if (n_jobs == 0)
         {
             g_warning ("ending job we didn't start: %s in %s",
                        job, uri);
         }
-        else
+        else if (n_jobs == 1)
         {
             g_hash_table_remove (async_jobs, key);
-            g_free (table_key);
+        }
+        else
+        {
+            g_hash_table_replace (async_jobs, g_strdup (key),
+                                  GUINT_TO_POINTER (n_jobs - 1));
         }
         g_free (uri);
         g_free (key);
@@ -507,10 +650,14 @@ async_job_wake_up (void)
 static void
 directory_count_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->count_in_progress != NULL)
+    GHashTableIter iter;
+    DirectoryCountState *state;
+
+    g_hash_table_iter_init (&iter, directory->details->counts_in_progress);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &state))
     {
-        g_cancellable_cancel (directory->details->count_in_progress->cancellable);
-        directory->details->count_in_progress = NULL;
+        g_cancellable_cancel (state->cancellable);
+        g_hash_table_iter_remove (&iter);
     }
 }
 
@@ -554,15 +701,29 @@ link_info_cancel (NautilusDirectory *directory)
     }
 }
 
+static void
+thumbnail_state_cancel (ThumbnailState *state)
+{
+    NautilusDirectory *directory;
+
+    directory = state->directory;
+
+    g_cancellable_cancel (state->cancellable);
+    state->directory = NULL;
+    async_job_end (directory, "thumbnail");
+}
+
 static void
 thumbnail_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->thumbnail_state != NULL)
+    GHashTableIter iter;
+    ThumbnailState *state;
+
+    g_hash_table_iter_init (&iter, directory->details->thumbnails_in_progress);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &state))
     {
-        g_cancellable_cancel (directory->details->thumbnail_state->cancellable);
-        directory->details->thumbnail_state->directory = NULL;
-        directory->details->thumbnail_state = NULL;
-        async_job_end (directory, "thumbnail");
+        g_hash_table_iter_remove (&iter);
+        thumbnail_state_cancel (state);
     }
 }
 
@@ -581,8 +742,23 @@ mount_cancel (NautilusDirectory *directory)
 static void
 file_info_cancel (NautilusDirectory *directory)
 {
-    if (directory->details->get_info_in_progress != NULL)
+    GetInfoState *state;
+    GHashTableIter iter;
+    NautilusFile *file;
+
+    state = directory->details->get_info_in_progress;
+    if (state != NULL)
     {
+        if (state->batch_files != NULL)
+        {
+            /* Let these files be batched again next time. */
+            g_hash_table_iter_init (&iter, state->batch_files);
+            while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &file))
+            {
+                file->details->file_info_batch_tried = FALSE;
+            }
+        }
+
         g_cancellable_cancel (directory->details->get_info_in_progress->cancellable);
         directory->details->get_info_in_progress->directory = NULL;
         directory->details->get_info_in_progress = NULL;
@@ -863,11 +1039,14 @@ set_file_unconfirmed (NautilusFile *file,
     directory = file->details->directory;
     if (unconfirmed)
     {
+        g_hash_table_add (directory->details->unconfirmed_files, file);
         directory->details->confirmed_file_count--;
     }
     else
     {
+        g_hash_table_remove (directory->details->unconfirmed_files, file);
         directory->details->confirmed_file_count++;
+        file->details->from_snapshot = FALSE;
     }
 }
 
@@ -909,70 +1088,57 @@ should_skip_file (NautilusDirectory *directory,
     return FALSE;
 }
 
+/* Handles pending file infos until the time budget runs out. Returns
+ * TRUE when there is nothing left to do.
+ */
 static gboolean
-dequeue_pending_idle_callback (gpointer callback_data)
+dequeue_pending_file_info (NautilusDirectory *directory)
 {
-    NautilusDirectory *directory;
-    GList *pending_file_info;
-    GList *node, *next;
+    GList *node, *unconfirmed_files;
     NautilusFile *file;
     GList *changed_files, *added_files;
+    GList *indexed_infos, *gone_locations;
     GFileInfo *file_info;
-    const char *mimetype, *name;
-    DirectoryLoadState *dir_load_state;
+    const char *name;
+    gint64 deadline;
+    guint n_items;
+    gboolean update_search_index;
 
-    directory = NAUTILUS_DIRECTORY (callback_data);
-
-    nautilus_directory_ref (directory);
-
-    nautilus_profile_start ("nitems %d", g_list_length (directory->details->pending_file_info));
-
-    directory->details->dequeue_pending_idle_id = 0;
-
-    /* Handle the files in the order we saw them. */
-    pending_file_info = g_list_reverse (directory->details->pending_file_info);
-    directory->details->pending_file_info = NULL;
+    nautilus_profile_start ("nitems %u", directory->details->pending_file_info.length);
 
     /* If we are no longer monitoring, then throw away these. */
     if (!nautilus_directory_is_file_list_monitored (directory))
     {
+        g_list_free_full (directory->details->pending_file_info.head, g_object_unref);
+        g_queue_init (&directory->details->pending_file_info);
+
         nautilus_directory_async_state_changed (directory);
-        goto drain;
+        nautilus_profile_end (NULL);
+        return TRUE;
     }
 
     added_files = NULL;
     changed_files = NULL;
+    indexed_infos = NULL;
+    gone_locations = NULL;
+    update_search_index = nautilus_search_index_is_enabled ();
 
-    dir_load_state = directory->details->directory_load_in_progress;
+    deadline = g_get_monotonic_time () + DEQUEUE_PENDING_TIME_BUDGET_USEC;
 
-    /* Build a list of NautilusFile objects. */
-    for (node = pending_file_info; node != NULL; node = node->next)
+    /* Build a list of NautilusFile objects, in the order we saw them. */
+    n_items = 0;
+    while (!g_queue_is_empty (&directory->details->pending_file_info))
     {
-        file_info = node->data;
-
-        name = g_file_info_get_name (file_info);
-
-        /* Update the file count. */
-        /* FIXME bugzilla.gnome.org 45063: This could count a
-         * file twice if we get it from both load_directory
-         * and from new_files_callback. Not too hard to fix by
-         * moving this into the actual callback instead of
-         * waiting for the idle function.
-         */
-        if (dir_load_state &&
-            !should_skip_file (directory, file_info))
+        if (n_items > 0 && g_get_monotonic_time () >= deadline)
         {
-            dir_load_state->load_file_count += 1;
-
-            /* Add the MIME type to the set. */
-            mimetype = g_file_info_get_content_type (file_info);
-            if (mimetype != NULL)
-            {
-                istr_set_insert (dir_load_state->load_mime_list_hash,
-                                 mimetype);
-            }
+            break;
         }
 
+        file_info = g_queue_pop_head (&directory->details->pending_file_info);
+        n_items++;
+
+        name = g_file_info_get_name (file_info);
+
         /* check if the file already exists */
         file = nautilus_directory_find_file_by_name (directory, name);
         if (file != NULL)
@@ -1005,27 +1171,53 @@ dequeue_pending_idle_callback (gpointer callback_data)
             file->details->is_added = TRUE;
             added_files = g_list_prepend (added_files, file);
         }
+
+        if (update_search_index)
+        {
+            indexed_infos = g_list_prepend (indexed_infos, file_info);
+        }
+        else
+        {
+            g_object_unref (file_info);
+        }
+    }
+
+    if (indexed_infos != NULL)
+    {
+        nautilus_search_index_add_files (directory->details->location, indexed_infos);
+        g_list_free_full (indexed_infos, g_object_unref);
     }
 
+    nautilus_profile_msg ("dequeued %u items, %u left", n_items,
+                          directory->details->pending_file_info.length);
+
     /* If we are done loading, then we assume that any unconfirmed
      * files are gone.
      */
-    if (directory->details->directory_loaded)
+    if (directory->details->directory_loaded &&
+        g_queue_is_empty (&directory->details->pending_file_info))
     {
-        for (node = directory->details->file_list;
-             node != NULL; node = next)
+        /* Marking a file gone removes it from the set, so walk a copy. */
+        unconfirmed_files = g_hash_table_get_keys (directory->details->unconfirmed_files);
+        for (node = unconfirmed_files; node != NULL; node = node->next)
         {
             file = NAUTILUS_FILE (node->data);
-            next = node->next;
 
-            if (file->details->unconfirmed)
-            {
-                nautilus_file_ref (file);
-                changed_files = g_list_prepend (changed_files, file);
+            nautilus_file_ref (file);
+            changed_files = g_list_prepend (changed_files, file);
 
-                nautilus_file_mark_gone (file);
+            if (update_search_index)
+            {
+                gone_locations = g_list_prepend (gone_locations,
+                                                 nautilus_file_get_location (file));
             }
+
+            nautilus_file_mark_gone (file);
         }
+        g_list_free (unconfirmed_files);
+
+        nautilus_search_index_remove_files (gone_locations);
+        g_list_free_full (gone_locations, g_object_unref);
     }
 
     /* Send the changed and added signals. */
@@ -1034,43 +1226,59 @@ dequeue_pending_idle_callback (gpointer callback_data)
     nautilus_directory_emit_files_added (directory, added_files);
     nautilus_file_list_free (added_files);
 
+    /* The handlers may have queued more, or stopped monitoring. */
+    if (!g_queue_is_empty (&directory->details->pending_file_info) &&
+        nautilus_directory_is_file_list_monitored (directory))
+    {
+        /* Let the files of this slice get their requests started, and
+         * the callers waiting only on them called, before the next one.
+         */
+        nautilus_directory_async_state_changed (directory);
+
+        nautilus_profile_end (NULL);
+        return FALSE;
+    }
+
     if (directory->details->directory_loaded &&
         !directory->details->directory_loaded_sent_notification)
     {
         /* Send the done_loading signal. */
         nautilus_directory_emit_done_loading (directory);
 
-        if (dir_load_state)
-        {
-            file = dir_load_state->load_directory_file;
-
-            file->details->directory_count = dir_load_state->load_file_count;
-            file->details->directory_count_is_up_to_date = TRUE;
-            file->details->got_directory_count = TRUE;
-
-            file->details->got_mime_list = TRUE;
-            file->details->mime_list_is_up_to_date = TRUE;
-            g_list_free_full (file->details->mime_list, g_free);
-            file->details->mime_list = istr_set_get_as_list
-                                           (dir_load_state->load_mime_list_hash);
-
-            nautilus_file_changed (file);
-        }
-
         nautilus_directory_async_state_changed (directory);
 
         directory->details->directory_loaded_sent_notification = TRUE;
     }
 
-drain:
-    g_list_free_full (pending_file_info, g_object_unref);
-
     /* Get the state machine running again. */
     nautilus_directory_async_state_changed (directory);
 
     nautilus_profile_end (NULL);
 
+    return TRUE;
+}
+
+static gboolean
+dequeue_pending_idle_callback (gpointer callback_data)
+{
+    NautilusDirectory *directory;
+    gboolean done;
+
+    directory = NAUTILUS_DIRECTORY (callback_data);
+
+    nautilus_directory_ref (directory);
+
+    directory->details->dequeue_pending_idle_id = 0;
+
+    /* Yield to the main loop and pick up the rest in the next idle. */
+    done = dequeue_pending_file_info (directory);
+    if (!done)
+    {
+        nautilus_directory_schedule_dequeue_pending (directory);
+    }
+
     nautilus_directory_unref (directory);
+
     return FALSE;
 }
 
@@ -1105,12 +1313,55 @@ directory_load_one (NautilusDirectory *directory,
     }
 
     /* Arrange for the "loading" part of the work. */
-    g_object_ref (info);
-    directory->details->pending_file_info
-        = g_list_prepend (directory->details->pending_file_info, info);
+    g_queue_push_tail (&directory->details->pending_file_info,
+                       g_object_ref (info));
     nautilus_directory_schedule_dequeue_pending (directory);
 }
 
+static void
+directory_load_count_file (DirectoryLoadState *state,
+                           GFileInfo          *info)
+{
+    const char *mimetype;
+
+    if (info == NULL ||
+        g_file_info_get_name (info) == NULL ||
+        should_skip_file (state->directory, info))
+    {
+        return;
+    }
+
+    state->load_file_count += 1;
+
+    /* Add the MIME type to the set. */
+    mimetype = g_file_info_get_content_type (info);
+    if (mimetype != NULL)
+    {
+        istr_set_insert (state->load_mime_list_hash,
+                         mimetype);
+    }
+}
+
+static void
+directory_load_apply_counts (DirectoryLoadState *state)
+{
+    NautilusFile *file;
+
+    file = state->load_directory_file;
+
+    file->details->directory_count = state->load_file_count;
+    file->details->directory_count_is_up_to_date = TRUE;
+    file->details->got_directory_count = TRUE;
+
+    file->details->got_mime_list = TRUE;
+    file->details->mime_list_is_up_to_date = TRUE;
+    g_list_free_full (file->details->mime_list, g_free);
+    file->details->mime_list = istr_set_get_as_list
+                                   (state->load_mime_list_hash);
+
+    nautilus_file_changed (file);
+}
+
 static void
 directory_load_cancel (NautilusDirectory *directory)
 {
@@ -1145,10 +1396,10 @@ file_list_cancel (NautilusDirectory *directory)
         directory->details->dequeue_pending_idle_id = 0;
     }
 
-    if (directory->details->pending_file_info != NULL)
+    if (!g_queue_is_empty (&directory->details->pending_file_info))
     {
-        g_list_free_full (directory->details->pending_file_info, g_object_unref);
-        directory->details->pending_file_info = NULL;
+        g_list_free_full (directory->details->pending_file_info.head, g_object_unref);
+        g_queue_init (&directory->details->pending_file_info);
     }
 }
 
@@ -1156,7 +1407,8 @@ static void
 directory_load_done (NautilusDirectory *directory,
                      GError            *error)
 {
-    GList *node;
+    NautilusFile *file;
+    guint i;
 
     nautilus_profile_start (NULL);
     g_object_ref (directory);
@@ -1171,22 +1423,41 @@ directory_load_done (NautilusDirectory *directory,
          * We clear the unconfirmed bit on each file here so that
          * they won't be marked "gone" later -- we don't know enough
          * about them to know whether they are really gone.
+         *
+         * Files only known from a snapshot are left unconfirmed, so
+         * they go away once the pending files are handled. The
+         * snapshot may be older than what the failed load saw.
          */
-        for (node = directory->details->file_list;
-             node != NULL; node = node->next)
+        for (i = 0; i < directory->details->files->len; i++)
         {
-            set_file_unconfirmed (NAUTILUS_FILE (node->data), FALSE);
+            file = g_ptr_array_index (directory->details->files, i);
+            if (!file->details->from_snapshot)
+            {
+                set_file_unconfirmed (file, FALSE);
+            }
         }
 
         nautilus_directory_emit_load_error (directory, error);
     }
 
-    /* Call the idle function right away. */
+    /* The load state goes away below, so hand its results to the
+     * directory file now rather than when the last file is dequeued.
+     */
+    if (directory->details->directory_load_in_progress != NULL)
+    {
+        directory_load_apply_counts (directory->details->directory_load_in_progress);
+    }
+
+    /* Handle what we can right away, the rest goes on in idle. */
     if (directory->details->dequeue_pending_idle_id != 0)
     {
         g_source_remove (directory->details->dequeue_pending_idle_id);
+        directory->details->dequeue_pending_idle_id = 0;
+    }
+    if (!dequeue_pending_file_info (directory))
+    {
+        nautilus_directory_schedule_dequeue_pending (directory);
     }
-    dequeue_pending_idle_callback (directory);
 
     directory_load_cancel (directory);
 
@@ -1652,6 +1923,8 @@ nautilus_async_destroying_file (NautilusFile *file)
     GList *node, *next;
     ReadyCallback *callback;
     Monitor *monitor;
+    DirectoryCountState *count_state;
+    ThumbnailState *thumbnail_state;
 
     directory = file->details->directory;
     changed = FALSE;
@@ -1692,10 +1965,11 @@ nautilus_async_destroying_file (NautilusFile *file)
     /* Check if it's a file that's currently being worked on.
      * If so, make that NULL so it gets canceled right away.
      */
-    if (directory->details->count_in_progress != NULL &&
-        directory->details->count_in_progress->count_file == file)
+    count_state = g_hash_table_lookup (directory->details->counts_in_progress, file);
+    if (count_state != NULL)
     {
-        directory->details->count_in_progress->count_file = NULL;
+        g_cancellable_cancel (count_state->cancellable);
+        g_hash_table_remove (directory->details->counts_in_progress, file);
         changed = TRUE;
     }
     if (directory->details->deep_count_file == file)
@@ -1726,10 +2000,11 @@ nautilus_async_destroying_file (NautilusFile *file)
         changed = TRUE;
     }
 
-    if (directory->details->thumbnail_state != NULL &&
-        directory->details->thumbnail_state->file == file)
+    thumbnail_state = g_hash_table_lookup (directory->details->thumbnails_in_progress, file);
+    if (thumbnail_state != NULL)
     {
-        directory->details->thumbnail_state->file = NULL;
+        g_hash_table_remove (directory->details->thumbnails_in_progress, file);
+        thumbnail_state_cancel (thumbnail_state);
         changed = TRUE;
     }
 
@@ -1860,16 +2135,16 @@ has_problem (NautilusDirectory *directory,
              NautilusFile      *file,
              FileCheck          problem)
 {
-    GList *node;
+    guint i;
 
     if (file != NULL)
     {
         return (*problem)(file);
     }
 
-    for (node = directory->details->file_list; node != NULL; node = node->next)
+    for (i = 0; i < directory->details->files->len; i++)
     {
-        if ((*problem)(node->data))
+        if ((*problem)(g_ptr_array_index (directory->details->files, i)))
         {
             return TRUE;
         }
@@ -2109,12 +2384,12 @@ nautilus_directory_is_file_list_monitored (NautilusDirectory *directory)
 static void
 mark_all_files_unconfirmed (NautilusDirectory *directory)
 {
-    GList *node;
     NautilusFile *file;
+    guint i;
 
-    for (node = directory->details->file_list; node != NULL; node = node->next)
+    for (i = 0; i < directory->details->files->len; i++)
     {
-        file = node->data;
+        file = g_ptr_array_index (directory->details->files, i);
         set_file_unconfirmed (file, TRUE);
     }
 }
@@ -2136,11 +2411,35 @@ directory_load_state_free (DirectoryLoadState *state)
     {
         istr_set_destroy (state->load_mime_list_hash);
     }
+    g_clear_object (&state->directory_info);
+    g_list_free_full (state->snapshot_infos, g_object_unref);
     nautilus_file_unref (state->load_directory_file);
     g_object_unref (state->cancellable);
     g_free (state);
 }
 
+static void
+directory_load_collect_snapshot (DirectoryLoadState *state,
+                                 GFileInfo          *info)
+{
+    if (!state->collect_snapshot)
+    {
+        return;
+    }
+
+    if (state->n_snapshot_infos >= NAUTILUS_DIRECTORY_SNAPSHOT_MAX_FILES)
+    {
+        state->collect_snapshot = FALSE;
+        g_list_free_full (state->snapshot_infos, g_object_unref);
+        state->snapshot_infos = NULL;
+        return;
+    }
+
+    state->snapshot_infos = g_list_prepend (state->snapshot_infos,
+                                            g_object_ref (info));
+    state->n_snapshot_infos++;
+}
+
 static void
 more_files_callback (GObject      *source_object,
                      GAsyncResult *res,
@@ -2173,19 +2472,42 @@ more_files_callback (GObject      *source_object,
     for (l = files; l != NULL; l = l->next)
     {
         info = l->data;
+        directory_load_count_file (state, info);
+        directory_load_collect_snapshot (state, info);
         directory_load_one (directory, info);
         g_object_unref (info);
     }
 
     if (files == NULL)
     {
+        if (error == NULL && state->collect_snapshot)
+        {
+            state->snapshot_infos = g_list_reverse (state->snapshot_infos);
+            nautilus_directory_snapshot_save (directory->details->location,
+                                              state->directory_info,
+                                              state->snapshot_infos);
+        }
         directory_load_done (directory, error);
         directory_load_state_free (state);
     }
     else
     {
+        /* Ask for smaller batches while the main loop is still busy
+         * with the previous ones, bigger ones while it keeps up.
+         */
+        if (directory->details->pending_file_info.length > (guint) state->items_per_callback)
+        {
+            state->items_per_callback = MAX (state->items_per_callback / 2,
+                                             DIRECTORY_LOAD_MIN_ITEMS_PER_CALLBACK);
+        }
+        else
+        {
+            state->items_per_callback = MIN (state->items_per_callback * 2,
+                                             DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK);
+        }
+
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             more_files_callback,
@@ -2235,7 +2557,7 @@ enumerate_children_callback (GObject      *source_object,
     {
         state->enumerator = enumerator;
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             more_files_callback,
@@ -2243,28 +2565,147 @@ enumerate_children_callback (GObject      *source_object,
     }
 }
 
+static void
+directory_load_start_enumeration (DirectoryLoadState *state)
+{
+    g_file_enumerate_children_async (state->directory->details->location,
+                                     NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
+                                     0,     /* flags */
+                                     G_PRIORITY_DEFAULT,     /* prio */
+                                     state->cancellable,
+                                     enumerate_children_callback,
+                                     state);
+}
 
-/* Start monitoring the file list if it isn't already. */
+/* Shows the files of a saved snapshot right away. They stay unconfirmed
+ * until the enumeration reports them, and are marked gone if it doesn't.
+ */
 static void
-start_monitoring_file_list (NautilusDirectory *directory)
+directory_load_add_snapshot (NautilusDirectory *directory,
+                             GList             *infos)
 {
-    DirectoryLoadState *state;
+    GList *l, *added_files;
+    GFileInfo *info;
+    NautilusFile *file;
 
-    if (!directory->details->file_list_monitored)
-    {
-        g_assert (!directory->details->directory_load_in_progress);
-        directory->details->file_list_monitored = TRUE;
-        nautilus_file_list_ref (directory->details->file_list);
-    }
+    nautilus_profile_start ("nitems %u", g_list_length (infos));
 
-    if (directory->details->directory_loaded ||
-        directory->details->directory_load_in_progress != NULL)
+    added_files = NULL;
+    for (l = infos; l != NULL; l = l->next)
     {
-        return;
+        info = l->data;
+
+        if (nautilus_directory_find_file_by_name (directory,
+                                                  g_file_info_get_name (info)) != NULL)
+        {
+            continue;
+        }
+
+        file = nautilus_file_new_from_info (directory, info);
+        file->details->unconfirmed = TRUE;
+        file->details->from_snapshot = TRUE;
+        nautilus_directory_add_file (directory, file);
+        file->details->is_added = TRUE;
+        added_files = g_list_prepend (added_files, file);
     }
 
-    if (!async_job_start (directory, "file list"))
-    {
+    nautilus_directory_emit_files_added (directory, added_files);
+    nautilus_file_list_free (added_files);
+
+    nautilus_profile_end (NULL);
+}
+
+static void
+snapshot_load_callback (GObject      *source_object,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+    DirectoryLoadState *state;
+    NautilusDirectory *directory;
+    GList *infos;
+
+    state = user_data;
+
+    infos = nautilus_directory_snapshot_load_finish (res);
+
+    if (state->directory == NULL)
+    {
+        /* Operation was cancelled. Bail out */
+        g_list_free_full (infos, g_object_unref);
+        directory_load_state_free (state);
+        return;
+    }
+
+    directory = nautilus_directory_ref (state->directory);
+
+    if (infos != NULL)
+    {
+        directory_load_add_snapshot (directory, infos);
+        g_list_free_full (infos, g_object_unref);
+    }
+
+    /* Someone may have stopped monitoring while we sent files_added. */
+    if (state->directory == NULL)
+    {
+        directory_load_state_free (state);
+    }
+    else
+    {
+        directory_load_start_enumeration (state);
+    }
+
+    nautilus_directory_unref (directory);
+}
+
+static void
+snapshot_query_info_callback (GObject      *source_object,
+                              GAsyncResult *res,
+                              gpointer      user_data)
+{
+    DirectoryLoadState *state;
+
+    state = user_data;
+
+    if (state->directory == NULL)
+    {
+        /* Operation was cancelled. Bail out */
+        directory_load_state_free (state);
+        return;
+    }
+
+    state->directory_info = g_file_query_info_finish (G_FILE (source_object),
+                                                      res, NULL);
+
+    nautilus_directory_snapshot_load_async (state->directory->details->location,
+                                            state->directory_info,
+                                            state->cancellable,
+                                            snapshot_load_callback,
+                                            state);
+}
+
+
+/* Start monitoring the file list if it isn't already. */
+static void
+start_monitoring_file_list (NautilusDirectory *directory)
+{
+    DirectoryLoadState *state;
+
+    if (!directory->details->file_list_monitored)
+    {
+        g_assert (!directory->details->directory_load_in_progress);
+        directory->details->file_list_monitored = TRUE;
+        g_ptr_array_foreach (directory->details->files,
+                             (GFunc) nautilus_file_ref, NULL);
+    }
+
+    if (directory->details->directory_loaded ||
+        directory->details->directory_load_in_progress != NULL)
+    {
+        return;
+    }
+
+    if (!async_job_start (directory, "file list"))
+    {
         return;
     }
 
@@ -2275,6 +2716,7 @@ start_monitoring_file_list (NautilusDirectory *directory)
     state->cancellable = g_cancellable_new ();
     state->load_mime_list_hash = istr_set_new ();
     state->load_file_count = 0;
+    state->items_per_callback = DIRECTORY_LOAD_MIN_ITEMS_PER_CALLBACK;
 
     g_assert (directory->details->location != NULL);
     state->load_directory_file =
@@ -2286,19 +2728,32 @@ start_monitoring_file_list (NautilusDirectory *directory)
 
     directory->details->directory_load_in_progress = state;
 
-    g_file_enumerate_children_async (directory->details->location,
-                                     NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
-                                     0,     /* flags */
-                                     G_PRIORITY_DEFAULT,     /* prio */
-                                     state->cancellable,
-                                     enumerate_children_callback,
-                                     state);
+    /* With snapshots, first check for one matching the current
+     * modification time of the directory.
+     */
+    if (nautilus_directory_snapshot_is_enabled (directory->details->location))
+    {
+        state->collect_snapshot = TRUE;
+        g_file_query_info_async (directory->details->location,
+                                 NAUTILUS_DIRECTORY_SNAPSHOT_ATTRIBUTES,
+                                 0,
+                                 G_PRIORITY_DEFAULT,
+                                 state->cancellable,
+                                 snapshot_query_info_callback,
+                                 state);
+        return;
+    }
+
+    directory_load_start_enumeration (state);
 }
 
 /* Stop monitoring the file list if it is being monitored. */
 void
 nautilus_directory_stop_monitoring_file_list (NautilusDirectory *directory)
 {
+    GList *files;
+    guint i;
+
     if (!directory->details->file_list_monitored)
     {
         g_assert (directory->details->directory_load_in_progress == NULL);
@@ -2307,7 +2762,17 @@ nautilus_directory_stop_monitoring_file_list (NautilusDirectory *directory)
 
     directory->details->file_list_monitored = FALSE;
     file_list_cancel (directory);
-    nautilus_file_list_unref (directory->details->file_list);
+
+    /* Dropping the last ref removes a file from the array, so
+     * release the refs through a copy.
+     */
+    files = NULL;
+    for (i = 0; i < directory->details->files->len; i++)
+    {
+        files = g_list_prepend (files,
+                                g_ptr_array_index (directory->details->files, i));
+    }
+    nautilus_file_list_free (files);
     directory->details->directory_loaded = FALSE;
 }
 
@@ -2360,13 +2825,13 @@ static void
 nautilus_directory_invalidate_file_attributes (NautilusDirectory      *directory,
                                                NautilusFileAttributes  file_attributes)
 {
-    GList *node;
+    guint i;
 
     cancel_loading_attributes (directory, file_attributes);
 
-    for (node = directory->details->file_list; node != NULL; node = node->next)
+    for (i = 0; i < directory->details->files->len; i++)
     {
-        nautilus_file_invalidate_attributes_internal (NAUTILUS_FILE (node->data),
+        nautilus_file_invalidate_attributes_internal (g_ptr_array_index (directory->details->files, i),
                                                       file_attributes);
     }
 
@@ -2479,25 +2944,25 @@ is_needy (NautilusFile *file,
 static void
 directory_count_stop (NautilusDirectory *directory)
 {
+    GHashTableIter iter;
     NautilusFile *file;
+    DirectoryCountState *state;
 
-    if (directory->details->count_in_progress != NULL)
+    g_hash_table_iter_init (&iter, directory->details->counts_in_progress);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &file, (gpointer *) &state))
     {
-        file = directory->details->count_in_progress->count_file;
-        if (file != NULL)
+        g_assert (NAUTILUS_IS_FILE (file));
+        g_assert (file->details->directory == directory);
+        if (is_needy (file,
+                      should_get_directory_count_now,
+                      REQUEST_DIRECTORY_COUNT))
         {
-            g_assert (NAUTILUS_IS_FILE (file));
-            g_assert (file->details->directory == directory);
-            if (is_needy (file,
-                          should_get_directory_count_now,
-                          REQUEST_DIRECTORY_COUNT))
-            {
-                return;
-            }
+            continue;
         }
 
         /* The count is not wanted, so stop it. */
-        directory_count_cancel (directory);
+        g_cancellable_cancel (state->cancellable);
+        g_hash_table_iter_remove (&iter);
     }
 }
 
@@ -2543,7 +3008,7 @@ count_children_done (NautilusDirectory *directory,
         count_file->details->got_directory_count = TRUE;
         count_file->details->directory_count = count;
     }
-    directory->details->count_in_progress = NULL;
+    g_hash_table_remove (directory->details->counts_in_progress, count_file);
 
     /* Send file-changed even if count failed, so interested parties can
      * distinguish between unknowable and not-yet-known cases.
@@ -2597,8 +3062,8 @@ count_more_files_callback (GObject      *source_object,
         return;
     }
 
-    g_assert (directory->details->count_in_progress != NULL);
-    g_assert (directory->details->count_in_progress == state);
+    g_assert (g_hash_table_lookup (directory->details->counts_in_progress,
+                                   state->count_file) == state);
 
     error = NULL;
     files = g_file_enumerator_next_files_finish (state->enumerator,
@@ -2688,7 +3153,7 @@ directory_count_start (NautilusDirectory *directory,
     DirectoryCountState *state;
     GFile *location;
 
-    if (directory->details->count_in_progress != NULL)
+    if (g_hash_table_contains (directory->details->counts_in_progress, file))
     {
         *doing_io = TRUE;
         return;
@@ -2712,6 +3177,12 @@ directory_count_start (NautilusDirectory *directory,
         return;
     }
 
+    if (g_hash_table_size (directory->details->counts_in_progress) >=
+        REQUEST_WINDOW_SIZE (REQUEST_DIRECTORY_COUNT))
+    {
+        return;
+    }
+
     if (!async_job_start (directory, "directory count"))
     {
         return;
@@ -2723,7 +3194,7 @@ directory_count_start (NautilusDirectory *directory,
     state->directory = nautilus_directory_ref (directory);
     state->cancellable = g_cancellable_new ();
 
-    directory->details->count_in_progress = state;
+    g_hash_table_insert (directory->details->counts_in_progress, file, state);
 
     location = nautilus_file_get_location (file);
 
@@ -2745,50 +3216,126 @@ directory_count_start (NautilusDirectory *directory,
     g_object_unref (location);
 }
 
-static inline gboolean
-seen_inode (DeepCountState *state,
-            GFileInfo      *info)
+static guint
+deep_count_inode_hash (gconstpointer key)
 {
-    guint64 inode, inode2;
-    guint i;
+    const DeepCountInode *inode = key;
+
+    return (guint) inode->inode ^ (guint) (inode->inode >> 32) ^ inode->device;
+}
+
+static gboolean
+deep_count_inode_equal (gconstpointer a,
+                        gconstpointer b)
+{
+    const DeepCountInode *inode_a = a;
+    const DeepCountInode *inode_b = b;
 
-    inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+    return inode_a->inode == inode_b->inode &&
+           inode_a->device == inode_b->device;
+}
 
-    if (inode != 0)
+/* Returns TRUE if @info is a file with more than one link, which can be
+ * met more than once in a tree. Folders have a link from each of their
+ * subfolders, but are only ever met once.
+ */
+static gboolean
+get_deep_count_link (GFileInfo             *info,
+                     NautilusDeepCountLink *link)
+{
+    if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
     {
-        for (i = 0; i < state->seen_deep_count_inodes->len; i++)
-        {
-            inode2 = g_array_index (state->seen_deep_count_inodes, guint64, i);
-            if (inode == inode2)
-            {
-                return TRUE;
-            }
-        }
+        return FALSE;
     }
 
-    return FALSE;
+    if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_NLINK) &&
+        g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK) < 2)
+    {
+        return FALSE;
+    }
+
+    link->inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+    link->device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+    link->size = g_file_info_get_size (info);
+
+    return link->inode != 0;
 }
 
-static inline void
-mark_inode_as_seen (DeepCountState *state,
-                    GFileInfo      *info)
+/* Returns TRUE if the file was counted before, and records it otherwise. */
+static gboolean
+check_and_mark_link_as_seen (DeepCountState              *state,
+                             const NautilusDeepCountLink *link)
 {
-    guint64 inode;
+    DeepCountInode *inode;
 
-    inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
-    if (inode != 0)
+    inode = g_new (DeepCountInode, 1);
+    inode->inode = link->inode;
+    inode->device = link->device;
+
+    if (g_hash_table_contains (state->seen_deep_count_inodes, inode))
     {
-        g_array_append_val (state->seen_deep_count_inodes, inode);
+        g_free (inode);
+        return TRUE;
     }
+
+    g_hash_table_add (state->seen_deep_count_inodes, inode);
+
+    return FALSE;
+}
+
+/* Modification times down to the microsecond, so a change within the
+ * second a listing was cached in is not missed.
+ */
+static gboolean
+get_deep_count_mtime (GFileInfo *info,
+                      guint64   *mtime)
+{
+    if (!g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+    {
+        *mtime = 0;
+        return FALSE;
+    }
+
+    *mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+             g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+    return TRUE;
+}
+
+static DeepCountDirectory *
+deep_count_directory_new (GFile    *location,
+                          gboolean  has_mtime,
+                          guint64   mtime)
+{
+    DeepCountDirectory *directory;
+
+    directory = g_new (DeepCountDirectory, 1);
+    directory->location = location;
+    directory->has_mtime = has_mtime;
+    directory->mtime = mtime;
+
+    return directory;
+}
+
+static void
+deep_count_directory_free (DeepCountDirectory *directory)
+{
+    g_object_unref (directory->location);
+    g_free (directory);
 }
 
 static void
-deep_count_one (DeepCountState *state,
-                GFileInfo      *info)
+deep_count_one (DeepCountLoad *load,
+                GFileInfo     *info)
 {
+    DeepCountState *state;
+    NautilusDeepCountListing *listing;
+    NautilusDeepCountLink link;
     NautilusFile *file;
     GFile *subdir;
-    gboolean is_seen_inode;
+    gboolean is_link, is_seen_inode;
+    gboolean has_mtime;
+    guint64 mtime;
     const char *fs_id;
 
     if (should_skip_file (NULL, info))
@@ -2796,11 +3343,10 @@ deep_count_one (DeepCountState *state,
         return;
     }
 
-    is_seen_inode = seen_inode (state, info);
-    if (!is_seen_inode)
-    {
-        mark_inode_as_seen (state, info);
-    }
+    state = load->state;
+    listing = load->listing;
+    is_link = get_deep_count_link (info, &link);
+    is_seen_inode = is_link && check_and_mark_link_as_seen (state, &link);
 
     file = state->directory->details->deep_count_file;
 
@@ -2808,95 +3354,260 @@ deep_count_one (DeepCountState *state,
     {
         /* Count the directory. */
         file->details->deep_directory_count += 1;
+        if (listing != NULL)
+        {
+            listing->directory_count += 1;
+        }
 
         /* Record the fact that we have to descend into this directory. */
         fs_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
         if (g_strcmp0 (fs_id, state->fs_id) == 0)
         {
             /* only if it is on the same filesystem */
-            subdir = g_file_get_child (state->deep_count_location, g_file_info_get_name (info));
-            state->deep_count_subdirectories = g_list_prepend
-                                                   (state->deep_count_subdirectories, subdir);
+            subdir = g_file_get_child (load->directory->location, g_file_info_get_name (info));
+            has_mtime = get_deep_count_mtime (info, &mtime);
+            g_queue_push_head (&state->deep_count_subdirectories,
+                               deep_count_directory_new (subdir, has_mtime, mtime));
+            if (listing != NULL)
+            {
+                g_ptr_array_add (listing->subdirectories,
+                                 g_strdup (g_file_info_get_name (info)));
+            }
         }
     }
     else
     {
         /* Even non-regular files count as files. */
         file->details->deep_file_count += 1;
+        if (listing != NULL)
+        {
+            listing->file_count += 1;
+        }
     }
 
     /* Count the size. */
-    if (!is_seen_inode && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+    if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
     {
-        file->details->deep_size += g_file_info_get_size (info);
+        if (!is_seen_inode)
+        {
+            file->details->deep_size += g_file_info_get_size (info);
+        }
+
+        if (listing != NULL && is_link)
+        {
+            g_array_append_val (listing->links, link);
+        }
+        else if (listing != NULL)
+        {
+            listing->size += g_file_info_get_size (info);
+        }
     }
 }
 
+/* Counts a folder from what was found in it the last time */
 static void
-deep_count_state_free (DeepCountState *state)
+deep_count_apply_listing (DeepCountState                 *state,
+                          GFile                          *location,
+                          const NautilusDeepCountListing *listing)
 {
-    if (state->enumerator)
+    NautilusDeepCountLink *link;
+    NautilusFile *file;
+    GFile *subdir;
+    guint i;
+
+    file = state->directory->details->deep_count_file;
+
+    file->details->deep_directory_count += listing->directory_count;
+    file->details->deep_file_count += listing->file_count;
+    file->details->deep_unreadable_count += listing->unreadable_count;
+    file->details->deep_size += listing->size;
+
+    for (i = 0; i < listing->links->len; i++)
     {
-        if (!g_file_enumerator_is_closed (state->enumerator))
+        link = &g_array_index (listing->links, NautilusDeepCountLink, i);
+        if (!check_and_mark_link_as_seen (state, link))
         {
-            g_file_enumerator_close_async (state->enumerator,
-                                           0, NULL, NULL, NULL);
+            file->details->deep_size += link->size;
         }
-        g_object_unref (state->enumerator);
     }
-    g_object_unref (state->cancellable);
-    if (state->deep_count_location)
+
+    /* Their own listings may still be good, which takes their
+     * modification time to tell.
+     */
+    for (i = 0; i < listing->subdirectories->len; i++)
     {
-        g_object_unref (state->deep_count_location);
+        subdir = g_file_get_child (location,
+                                   g_ptr_array_index (listing->subdirectories, i));
+        g_queue_push_head (&state->deep_count_subdirectories,
+                           deep_count_directory_new (subdir, FALSE, 0));
     }
-    g_list_free_full (state->deep_count_subdirectories, g_object_unref);
-    g_array_free (state->seen_deep_count_inodes, TRUE);
+}
+
+static void
+deep_count_state_free (DeepCountState *state)
+{
+    g_assert (state->n_loads == 0);
+
+    g_object_unref (state->cancellable);
+    g_queue_foreach (&state->deep_count_subdirectories, (GFunc) deep_count_directory_free, NULL);
+    g_queue_clear (&state->deep_count_subdirectories);
+    g_hash_table_destroy (state->seen_deep_count_inodes);
     g_free (state->fs_id);
     g_free (state);
 }
 
 static void
-deep_count_next_dir (DeepCountState *state)
+deep_count_load_free (DeepCountLoad *load)
 {
-    GFile *location;
+    if (load->enumerator)
+    {
+        if (!g_file_enumerator_is_closed (load->enumerator))
+        {
+            g_file_enumerator_close_async (load->enumerator,
+                                           0, NULL, NULL, NULL);
+        }
+        g_object_unref (load->enumerator);
+    }
+    g_clear_pointer (&load->listing, nautilus_deep_count_listing_unref);
+    deep_count_directory_free (load->directory);
+    g_free (load);
+}
+
+/* Counts a folder and everything below it from a rolled up total */
+static void
+deep_count_apply_total (DeepCountState               *state,
+                        const NautilusDeepCountTotal *total)
+{
+    NautilusDeepCountLink *link;
     NautilusFile *file;
-    NautilusDirectory *directory;
-    gboolean done;
+    guint i;
 
-    directory = state->directory;
+    file = state->directory->details->deep_count_file;
 
-    g_object_unref (state->deep_count_location);
-    state->deep_count_location = NULL;
+    file->details->deep_directory_count += total->directory_count;
+    file->details->deep_file_count += total->file_count;
+    file->details->deep_unreadable_count += total->unreadable_count;
+    file->details->deep_size += total->size;
 
-    done = FALSE;
-    file = directory->details->deep_count_file;
+    for (i = 0; i < total->links->len; i++)
+    {
+        link = &g_array_index (total->links, NautilusDeepCountLink, i);
+        if (!check_and_mark_link_as_seen (state, link))
+        {
+            file->details->deep_size += link->size;
+        }
+    }
+}
+
+/* Returns TRUE if @directory could be counted from the cache */
+static gboolean
+deep_count_apply_cached_listing (DeepCountState     *state,
+                                 DeepCountDirectory *directory)
+{
+    const NautilusDeepCountListing *listing;
+    const NautilusDeepCountTotal *total;
 
-    if (state->deep_count_subdirectories != NULL)
+    if (!state->use_cache || !directory->has_mtime)
     {
-        /* Work on a new directory. */
-        location = state->deep_count_subdirectories->data;
-        state->deep_count_subdirectories = g_list_remove
-                                               (state->deep_count_subdirectories, location);
-        deep_count_load (state, location);
-        g_object_unref (location);
+        return FALSE;
     }
-    else
+
+    /* The whole tree at once, if it was all checked before */
+    total = nautilus_deep_count_cache_lookup_total (directory->location,
+                                                    directory->mtime);
+    if (total != NULL)
     {
-        file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
-        directory->details->deep_count_file = NULL;
-        directory->details->deep_count_in_progress = NULL;
-        deep_count_state_free (state);
-        done = TRUE;
+        deep_count_apply_total (state, total);
+        return TRUE;
     }
 
+    listing = nautilus_deep_count_cache_lookup_listing (directory->location,
+                                                        directory->mtime);
+    if (listing == NULL)
+    {
+        return FALSE;
+    }
+
+    deep_count_apply_listing (state, directory->location, listing);
+
+    return TRUE;
+}
+
+/* Starts loading queued folders until there are as many loads as allowed.
+ * Returns FALSE if there is nothing left to do at all.
+ */
+static gboolean
+deep_count_start_loads (DeepCountState *state)
+{
+    DeepCountDirectory *directory;
+
+    while (state->n_loads < DEEP_COUNT_MAX_LOADS &&
+           !g_queue_is_empty (&state->deep_count_subdirectories))
+    {
+        /* Work on a new directory. */
+        directory = g_queue_pop_head (&state->deep_count_subdirectories);
+        if (deep_count_apply_cached_listing (state, directory))
+        {
+            deep_count_directory_free (directory);
+        }
+        else
+        {
+            deep_count_load (state, directory);
+        }
+    }
+
+    return state->n_loads > 0;
+}
+
+static void
+deep_count_finish (DeepCountState *state)
+{
+    NautilusDirectory *directory;
+    NautilusFile *file;
+
+    directory = state->directory;
+    file = directory->details->deep_count_file;
+
+    file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
+    directory->details->deep_count_file = NULL;
+    directory->details->deep_count_in_progress = NULL;
+    deep_count_state_free (state);
+
     nautilus_file_updated_deep_count_in_progress (file);
+    nautilus_file_changed (file);
+    async_job_end (directory, "deep count");
+    nautilus_directory_async_state_changed (directory);
+}
 
-    if (done)
+static void
+deep_count_load_done (DeepCountLoad *load)
+{
+    DeepCountState *state;
+    NautilusFile *file;
+
+    state = load->state;
+
+    deep_count_load_free (load);
+    state->n_loads--;
+
+    if (state->directory == NULL)
     {
-        nautilus_file_changed (file);
-        async_job_end (directory, "deep count");
-        nautilus_directory_async_state_changed (directory);
+        /* Operation was cancelled, the last load cleans up */
+        if (state->n_loads == 0)
+        {
+            deep_count_state_free (state);
+        }
+        return;
+    }
+
+    if (deep_count_start_loads (state))
+    {
+        file = state->directory->details->deep_count_file;
+        nautilus_file_updated_deep_count_in_progress (file);
+        return;
     }
+
+    deep_count_finish (state);
 }
 
 static void
@@ -2904,17 +3615,20 @@ deep_count_more_files_callback (GObject      *source_object,
                                 GAsyncResult *res,
                                 gpointer      user_data)
 {
+    DeepCountLoad *load;
     DeepCountState *state;
     NautilusDirectory *directory;
     GList *files, *l;
     GFileInfo *info;
+    GError *error;
 
-    state = user_data;
+    load = user_data;
+    state = load->state;
 
     if (state->directory == NULL)
     {
         /* Operation was cancelled. Bail out */
-        deep_count_state_free (state);
+        deep_count_load_done (load);
         return;
     }
 
@@ -2923,32 +3637,42 @@ deep_count_more_files_callback (GObject      *source_object,
     g_assert (directory->details->deep_count_in_progress != NULL);
     g_assert (directory->details->deep_count_in_progress == state);
 
-    files = g_file_enumerator_next_files_finish (state->enumerator,
-                                                 res, NULL);
+    error = NULL;
+    files = g_file_enumerator_next_files_finish (load->enumerator,
+                                                 res, &error);
 
     for (l = files; l != NULL; l = l->next)
     {
         info = l->data;
-        deep_count_one (state, info);
+        deep_count_one (load, info);
         g_object_unref (info);
     }
 
     if (files == NULL)
     {
-        g_file_enumerator_close_async (state->enumerator, 0, NULL, NULL, NULL);
-        g_object_unref (state->enumerator);
-        state->enumerator = NULL;
+        /* Only a complete listing is worth keeping */
+        if (error == NULL && load->listing != NULL)
+        {
+            nautilus_deep_count_cache_store_listing (load->directory->location,
+                                                     load->directory->mtime,
+                                                     load->listing);
+            load->listing = NULL;
+        }
+        g_clear_error (&error);
 
-        deep_count_next_dir (state);
+        deep_count_load_done (load);
     }
     else
     {
-        g_file_enumerator_next_files_async (state->enumerator,
+        /* Get going on the folders just found while this one goes on */
+        deep_count_start_loads (state);
+
+        g_file_enumerator_next_files_async (load->enumerator,
                                             DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
                                             G_PRIORITY_LOW,
                                             state->cancellable,
                                             deep_count_more_files_callback,
-                                            state);
+                                            load);
     }
 
     g_list_free (files);
@@ -2961,62 +3685,149 @@ deep_count_callback (GObject      *source_object,
                      GAsyncResult *res,
                      gpointer      user_data)
 {
+    DeepCountLoad *load;
     DeepCountState *state;
     GFileEnumerator *enumerator;
     NautilusFile *file;
 
-    state = user_data;
+    load = user_data;
+    state = load->state;
+
+    enumerator = g_file_enumerate_children_finish (G_FILE (source_object), res, NULL);
 
     if (state->directory == NULL)
     {
         /* Operation was cancelled. Bail out */
-        deep_count_state_free (state);
+        load->enumerator = enumerator;
+        deep_count_load_done (load);
         return;
     }
 
     file = state->directory->details->deep_count_file;
 
-    enumerator = g_file_enumerate_children_finish (G_FILE (source_object), res, NULL);
-
     if (enumerator == NULL)
     {
         file->details->deep_unreadable_count += 1;
 
-        deep_count_next_dir (state);
+        /* Kept too, or no total above it could be rolled up */
+        if (load->listing != NULL)
+        {
+            load->listing->unreadable_count = 1;
+            nautilus_deep_count_cache_store_listing (load->directory->location,
+                                                     load->directory->mtime,
+                                                     load->listing);
+            load->listing = NULL;
+        }
+
+        deep_count_load_done (load);
     }
     else
     {
-        state->enumerator = enumerator;
-        g_file_enumerator_next_files_async (state->enumerator,
+        load->enumerator = enumerator;
+        g_file_enumerator_next_files_async (load->enumerator,
                                             DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
                                             G_PRIORITY_LOW,
                                             state->cancellable,
                                             deep_count_more_files_callback,
-                                            state);
+                                            load);
+    }
+}
+
+static void
+deep_count_enumerate (DeepCountLoad *load)
+{
+    DeepCountState *state;
+
+    state = load->state;
+
+    if (state->use_cache && load->directory->has_mtime)
+    {
+        load->listing = nautilus_deep_count_listing_new ();
     }
+
+    g_debug ("load_directory called to get deep file count for %p", load->directory->location);
+    g_file_enumerate_children_async (load->directory->location,
+                                     G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                     G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                     G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                     G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+                                     G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
+                                     G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
+                                     G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                     G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+                                     G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+                                     G_FILE_ATTRIBUTE_UNIX_INODE ","
+                                     G_FILE_ATTRIBUTE_UNIX_NLINK,
+                                     G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,     /* flags */
+                                     G_PRIORITY_LOW,     /* prio */
+                                     state->cancellable,
+                                     deep_count_callback,
+                                     load);
 }
 
+static void
+deep_count_got_mtime (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+    DeepCountLoad *load;
+    GFileInfo *info;
+
+    load = user_data;
 
+    info = g_file_query_info_finish (G_FILE (source_object), res, NULL);
+
+    if (load->state->directory == NULL)
+    {
+        /* Operation was cancelled. Bail out */
+        g_clear_object (&info);
+        deep_count_load_done (load);
+        return;
+    }
+
+    if (info != NULL)
+    {
+        load->directory->has_mtime = get_deep_count_mtime (info, &load->directory->mtime);
+        g_object_unref (info);
+    }
+
+    if (deep_count_apply_cached_listing (load->state, load->directory))
+    {
+        deep_count_load_done (load);
+        return;
+    }
+
+    deep_count_enumerate (load);
+}
+
+/* Takes ownership of @directory */
 static void
-deep_count_load (DeepCountState *state,
-                 GFile          *location)
+deep_count_load (DeepCountState     *state,
+                 DeepCountDirectory *directory)
 {
-    state->deep_count_location = g_object_ref (location);
+    DeepCountLoad *load;
+
+    load = g_new0 (DeepCountLoad, 1);
+    load->state = state;
+    load->directory = directory;
+    state->n_loads++;
+
+    if (state->use_cache && !directory->has_mtime)
+    {
+        /* Known from a cached listing only, find out whether its own
+         * listing is still good */
+        g_file_query_info_async (directory->location,
+                                 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                 G_PRIORITY_LOW,
+                                 state->cancellable,
+                                 deep_count_got_mtime,
+                                 load);
+        return;
+    }
 
-    g_debug ("load_directory called to get deep file count for %p", location);
-    g_file_enumerate_children_async (state->deep_count_location,
-                                     G_FILE_ATTRIBUTE_STANDARD_NAME ","
-                                     G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-                                     G_FILE_ATTRIBUTE_STANDARD_SIZE ","
-                                     G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
-                                     G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
-                                     G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
-                                     G_FILE_ATTRIBUTE_UNIX_INODE,
-                                     G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,     /* flags */
-                                     G_PRIORITY_LOW,     /* prio */
-                                     state->cancellable,
-                                     deep_count_callback,
-                                     state);
+    deep_count_enumerate (load);
 }
 
 static void
@@ -3059,9 +3870,24 @@ deep_count_got_info (GObject      *source_object,
     {
         id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
         state->fs_id = g_strdup (id);
+        state->has_mtime = get_deep_count_mtime (info, &state->mtime);
         g_object_unref (info);
     }
-    deep_count_load (state, file);
+
+    if (state->directory == NULL)
+    {
+        /* Operation was cancelled. Bail out */
+        deep_count_state_free (state);
+        return;
+    }
+
+    g_queue_push_head (&state->deep_count_subdirectories,
+                       deep_count_directory_new (g_object_ref (file),
+                                                 state->has_mtime, state->mtime));
+    if (!deep_count_start_loads (state))
+    {
+        deep_count_finish (state);
+    }
 }
 
 static void
@@ -3110,14 +3936,20 @@ deep_count_start (NautilusDirectory *directory,
     state = g_new0 (DeepCountState, 1);
     state->directory = directory;
     state->cancellable = g_cancellable_new ();
-    state->seen_deep_count_inodes = g_array_new (FALSE, TRUE, sizeof (guint64));
+    g_queue_init (&state->deep_count_subdirectories);
+    state->seen_deep_count_inodes = g_hash_table_new_full (deep_count_inode_hash,
+                                                           deep_count_inode_equal,
+                                                           g_free, NULL);
     state->fs_id = NULL;
 
     directory->details->deep_count_in_progress = state;
 
     location = nautilus_file_get_location (file);
+    state->use_cache = g_file_is_native (location);
     g_file_query_info_async (location,
-                             G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+                             G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
+                             G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                             G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                              G_PRIORITY_DEFAULT,
                              NULL,
@@ -3410,6 +4242,19 @@ mime_list_start (NautilusDirectory *directory,
 static void
 get_info_state_free (GetInfoState *state)
 {
+    if (state->enumerator)
+    {
+        if (!g_file_enumerator_is_closed (state->enumerator))
+        {
+            g_file_enumerator_close_async (state->enumerator,
+                                           0, NULL, NULL, NULL);
+        }
+        g_object_unref (state->enumerator);
+    }
+    if (state->batch_files != NULL)
+    {
+        g_hash_table_destroy (state->batch_files);
+    }
     g_object_unref (state->cancellable);
     g_free (state);
 }
@@ -3447,6 +4292,7 @@ query_info_callback (GObject      *source_object,
      * least long enough to send the change notification.
      */
     nautilus_file_ref (get_info_file);
+    get_info_file->details->file_info_batch_tried = FALSE;
 
     error = NULL;
     info = g_file_query_info_finish (G_FILE (source_object), res, &error);
@@ -3480,6 +4326,248 @@ query_info_callback (GObject      *source_object,
     get_info_state_free (state);
 }
 
+static gboolean
+file_info_batch_is_needed (GetInfoState *state)
+{
+    GHashTableIter iter;
+    NautilusFile *file;
+
+    g_hash_table_iter_init (&iter, state->batch_files);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &file))
+    {
+        if (is_needy (file, lacks_info, REQUEST_FILE_INFO))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+file_info_batch_done (GetInfoState *state)
+{
+    NautilusDirectory *directory;
+
+    directory = state->directory;
+
+    directory->details->get_info_in_progress = NULL;
+
+    /* Whatever is left in the batch wasn't returned by the
+     * enumeration, file_info_batch_tried makes sure those files get
+     * queried one by one next.
+     */
+    async_job_end (directory, "file info");
+    nautilus_directory_async_state_changed (directory);
+}
+
+static void
+file_info_batch_more_files_callback (GObject      *source_object,
+                                     GAsyncResult *res,
+                                     gpointer      user_data)
+{
+    GetInfoState *state;
+    NautilusDirectory *directory;
+    GList *files, *l, *changed_files;
+    GFileInfo *info;
+    NautilusFile *file;
+    gboolean done;
+
+    state = user_data;
+
+    if (state->directory == NULL)
+    {
+        /* Operation was cancelled. Bail out */
+        get_info_state_free (state);
+        return;
+    }
+
+    directory = nautilus_directory_ref (state->directory);
+
+    g_assert (directory->details->get_info_in_progress == state);
+
+    files = g_file_enumerator_next_files_finish (state->enumerator,
+                                                 res, NULL);
+
+    changed_files = NULL;
+    for (l = files; l != NULL; l = l->next)
+    {
+        info = l->data;
+
+        file = g_hash_table_lookup (state->batch_files,
+                                    g_file_info_get_name (info));
+        if (file != NULL)
+        {
+            nautilus_file_ref (file);
+            g_hash_table_remove (state->batch_files,
+                                 g_file_info_get_name (info));
+
+            file->details->file_info_batch_tried = FALSE;
+            file->details->get_info_failed = FALSE;
+            g_clear_error (&file->details->get_info_error);
+            nautilus_file_update_info (file, info);
+
+            changed_files = g_list_prepend (changed_files, file);
+        }
+
+        g_object_unref (info);
+    }
+
+    done = files == NULL || g_hash_table_size (state->batch_files) == 0;
+    g_list_free (files);
+
+    nautilus_directory_emit_change_signals (directory, changed_files);
+    nautilus_file_list_free (changed_files);
+
+    if (done)
+    {
+        file_info_batch_done (state);
+        get_info_state_free (state);
+    }
+    else
+    {
+        g_file_enumerator_next_files_async (state->enumerator,
+                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            G_PRIORITY_DEFAULT,
+                                            state->cancellable,
+                                            file_info_batch_more_files_callback,
+                                            state);
+    }
+
+    nautilus_directory_unref (directory);
+}
+
+static void
+file_info_batch_enumerate_callback (GObject      *source_object,
+                                    GAsyncResult *res,
+                                    gpointer      user_data)
+{
+    GetInfoState *state;
+    GFileEnumerator *enumerator;
+
+    state = user_data;
+
+    if (state->directory == NULL)
+    {
+        /* Operation was cancelled. Bail out */
+        get_info_state_free (state);
+        return;
+    }
+
+    enumerator = g_file_enumerate_children_finish (G_FILE (source_object),
+                                                   res, NULL);
+
+    if (enumerator == NULL)
+    {
+        /* The files will be queried one by one instead. */
+        file_info_batch_done (state);
+        get_info_state_free (state);
+        return;
+    }
+
+    state->enumerator = enumerator;
+    g_file_enumerator_next_files_async (state->enumerator,
+                                        DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                        G_PRIORITY_DEFAULT,
+                                        state->cancellable,
+                                        file_info_batch_more_files_callback,
+                                        state);
+}
+
+static gboolean
+can_batch_file_info (NautilusFile *file)
+{
+    return !file->details->file_info_batch_tried &&
+           !nautilus_file_is_self_owned (file) &&
+           is_needy (file, lacks_info, REQUEST_FILE_INFO);
+}
+
+static gboolean
+collect_file_info_batch (NautilusFile *file,
+                         gpointer      callback_data)
+{
+    GHashTable *batch_files;
+
+    batch_files = callback_data;
+
+    if (can_batch_file_info (file))
+    {
+        g_hash_table_insert (batch_files,
+                             nautilus_file_get_name (file),
+                             nautilus_file_ref (file));
+    }
+
+    return g_hash_table_size (batch_files) < FILE_INFO_BATCH_MAX_FILES;
+}
+
+/* Gets the info for the files of the work queue that need it with a
+ * single enumeration of the directory. Returns FALSE if it's not worth
+ * it, in which case the info of file is to be queried on its own.
+ */
+static gboolean
+file_info_batch_start (NautilusDirectory *directory,
+                       NautilusFile      *file)
+{
+    GHashTable *batch_files;
+    GHashTableIter iter;
+    NautilusFile *batch_file;
+    GetInfoState *state;
+    guint batch_size;
+
+    if (!can_batch_file_info (file))
+    {
+        return FALSE;
+    }
+
+    batch_files = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free,
+                                         (GDestroyNotify) nautilus_file_unref);
+    nautilus_file_queue_foreach (directory->details->high_priority_queue,
+                                 collect_file_info_batch,
+                                 batch_files);
+
+    /* Reading the whole directory only pays off if enough of it has
+     * to be read anyway.
+     */
+    batch_size = g_hash_table_size (batch_files);
+    if (batch_size < FILE_INFO_BATCH_MIN_FILES ||
+        batch_size * 4 < g_hash_table_size (directory->details->file_hash))
+    {
+        g_hash_table_destroy (batch_files);
+        return FALSE;
+    }
+
+    g_hash_table_iter_init (&iter, batch_files);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &batch_file))
+    {
+        batch_file->details->file_info_batch_tried = TRUE;
+    }
+
+    state = g_new0 (GetInfoState, 1);
+    state->directory = directory;
+    state->cancellable = g_cancellable_new ();
+    state->batch_files = batch_files;
+
+    directory->details->get_info_in_progress = state;
+
+    {
+        g_autofree char *uri = NULL;
+        uri = g_file_get_uri (directory->details->location);
+        g_debug ("load_directory called to get info of %u files of %s",
+                 batch_size, uri);
+    }
+
+    g_file_enumerate_children_async (directory->details->location,
+                                     NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
+                                     0,
+                                     G_PRIORITY_DEFAULT,
+                                     state->cancellable,
+                                     file_info_batch_enumerate_callback,
+                                     state);
+
+    return TRUE;
+}
+
 static void
 file_info_stop (NautilusDirectory *directory)
 {
@@ -3487,6 +4575,16 @@ file_info_stop (NautilusDirectory *directory)
 
     if (directory->details->get_info_in_progress != NULL)
     {
+        if (directory->details->get_info_in_progress->batch_files != NULL)
+        {
+            if (!file_info_batch_is_needed (directory->details->get_info_in_progress))
+            {
+                /* The info is not wanted, so stop it. */
+                file_info_cancel (directory);
+            }
+            return;
+        }
+
         file = directory->details->get_info_file;
         if (file != NULL)
         {
@@ -3530,6 +4628,11 @@ file_info_start (NautilusDirectory *directory,
         return;
     }
 
+    if (file_info_batch_start (directory, file))
+    {
+        return;
+    }
+
     directory->details->get_info_file = file;
     file->details->get_info_failed = FALSE;
     if (file->details->get_info_error)
@@ -3538,7 +4641,7 @@ file_info_start (NautilusDirectory *directory,
         file->details->get_info_error = NULL;
     }
 
-    state = g_new (GetInfoState, 1);
+    state = g_new0 (GetInfoState, 1);
     state->directory = directory;
     state->cancellable = g_cancellable_new ();
 
@@ -3866,26 +4969,25 @@ thumbnail_done (NautilusDirectory *directory,
 static void
 thumbnail_stop (NautilusDirectory *directory)
 {
+    GHashTableIter iter;
     NautilusFile *file;
+    ThumbnailState *state;
 
-    if (directory->details->thumbnail_state != NULL)
+    g_hash_table_iter_init (&iter, directory->details->thumbnails_in_progress);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &file, (gpointer *) &state))
     {
-        file = directory->details->thumbnail_state->file;
-
-        if (file != NULL)
+        g_assert (NAUTILUS_IS_FILE (file));
+        g_assert (file->details->directory == directory);
+        if (is_needy (file,
+                      lacks_thumbnail,
+                      REQUEST_THUMBNAIL))
         {
-            g_assert (NAUTILUS_IS_FILE (file));
-            g_assert (file->details->directory == directory);
-            if (is_needy (file,
-                          lacks_thumbnail,
-                          REQUEST_THUMBNAIL))
-            {
-                return;
-            }
+            continue;
         }
 
-        /* The link info is not wanted, so stop it. */
-        thumbnail_cancel (directory);
+        /* The thumbnail is not wanted, so stop it. */
+        g_hash_table_iter_remove (&iter);
+        thumbnail_state_cancel (state);
     }
 }
 
@@ -4043,7 +5145,8 @@ thumbnail_read_callback (GObject      *source_object,
     }
     else
     {
-        state->directory->details->thumbnail_state = NULL;
+        g_hash_table_remove (state->directory->details->thumbnails_in_progress,
+                             state->file);
         async_job_end (state->directory, "thumbnail");
 
         thumbnail_got_pixbuf (state->directory, state->file, pixbuf, state->tried_original);
@@ -4062,7 +5165,7 @@ thumbnail_start (NautilusDirectory *directory,
     GFile *location;
     ThumbnailState *state;
 
-    if (directory->details->thumbnail_state != NULL)
+    if (g_hash_table_contains (directory->details->thumbnails_in_progress, file))
     {
         *doing_io = TRUE;
         return;
@@ -4076,6 +5179,12 @@ thumbnail_start (NautilusDirectory *directory,
     }
     *doing_io = TRUE;
 
+    if (g_hash_table_size (directory->details->thumbnails_in_progress) >=
+        REQUEST_WINDOW_SIZE (REQUEST_THUMBNAIL))
+    {
+        return;
+    }
+
     if (!async_job_start (directory, "thumbnail"))
     {
         return;
@@ -4097,7 +5206,7 @@ thumbnail_start (NautilusDirectory *directory,
         location = g_file_new_for_path (file->details->thumbnail_path);
     }
 
-    directory->details->thumbnail_state = state;
+    g_hash_table_insert (directory->details->thumbnails_in_progress, file, state);
 
     g_file_load_contents_async (location,
                                 state->cancellable,
@@ -4649,6 +5758,49 @@ extension_info_start (NautilusDirectory *directory,
     }
 }
 
+typedef struct
+{
+    NautilusDirectory *directory;
+    guint lookahead;
+} RequestWindowFill;
+
+static gboolean
+fill_request_windows_for_file (NautilusFile *file,
+                               gpointer      callback_data)
+{
+    RequestWindowFill *fill;
+    gboolean doing_io;
+
+    fill = callback_data;
+
+    /* We don't care whether these files are busy, only the head of
+     * the queue holds up the rest.
+     */
+    doing_io = FALSE;
+    directory_count_start (fill->directory, file, &doing_io);
+    thumbnail_start (fill->directory, file, &doing_io);
+
+    return --fill->lookahead > 0;
+}
+
+/* Start requests for the files queued behind the head of the low
+ * priority queue, as long as there is room in their request window,
+ * so that slow per-file requests overlap instead of running one after
+ * the other.
+ */
+static void
+fill_request_windows (NautilusDirectory *directory)
+{
+    RequestWindowFill fill;
+
+    fill.directory = directory;
+    fill.lookahead = REQUEST_WINDOW_LOOKAHEAD;
+
+    nautilus_file_queue_foreach (directory->details->low_priority_queue,
+                                 fill_request_windows_for_file,
+                                 &fill);
+}
+
 static void
 start_or_stop_io (NautilusDirectory *directory)
 {
@@ -4688,6 +5840,8 @@ start_or_stop_io (NautilusDirectory *directory)
     }
 
     /* High priority queue must be empty */
+    fill_request_windows (directory);
+
     while (!nautilus_file_queue_is_empty (directory->details->low_priority_queue))
     {
         file = nautilus_file_queue_head (directory->details->low_priority_queue);
@@ -4792,10 +5946,13 @@ static void
 cancel_directory_count_for_file (NautilusDirectory *directory,
                                  NautilusFile      *file)
 {
-    if (directory->details->count_in_progress != NULL &&
-        directory->details->count_in_progress->count_file == file)
+    DirectoryCountState *state;
+
+    state = g_hash_table_lookup (directory->details->counts_in_progress, file);
+    if (state != NULL)
     {
-        directory_count_cancel (directory);
+        g_cancellable_cancel (state->cancellable);
+        g_hash_table_remove (directory->details->counts_in_progress, file);
     }
 }
 
@@ -4824,7 +5981,12 @@ static void
 cancel_file_info_for_file (NautilusDirectory *directory,
                            NautilusFile      *file)
 {
-    if (directory->details->get_info_file == file)
+    GetInfoState *state;
+
+    state = directory->details->get_info_in_progress;
+    if (directory->details->get_info_file == file ||
+        (state != NULL && state->batch_files != NULL &&
+         g_hash_table_lookup (state->batch_files, file->details->name) == file))
     {
         file_info_cancel (directory);
     }
@@ -4834,10 +5996,13 @@ static void
 cancel_thumbnail_for_file (NautilusDirectory *directory,
                            NautilusFile      *file)
 {
-    if (directory->details->thumbnail_state != NULL &&
-        directory->details->thumbnail_state->file == file)
+    ThumbnailState *state;
+
+    state = g_hash_table_lookup (directory->details->thumbnails_in_progress, file);
+    if (state != NULL)
     {
-        thumbnail_cancel (directory);
+        g_hash_table_remove (directory->details->thumbnails_in_progress, file);
+        thumbnail_state_cancel (state);
     }
 }
 
@@ -4987,12 +6152,12 @@ nautilus_directory_add_file_to_work_queue (NautilusDirectory *directory,
 static void
 add_all_files_to_work_queue (NautilusDirectory *directory)
 {
-    GList *node;
     NautilusFile *file;
+    guint i;
 
-    for (node = directory->details->file_list; node != NULL; node = node->next)
+    for (i = 0; i < directory->details->files->len; i++)
     {
-        file = NAUTILUS_FILE (node->data);
+        file = g_ptr_array_index (directory->details->files, i);
 
         nautilus_directory_add_file_to_work_queue (directory, file);
     }
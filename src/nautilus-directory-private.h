@@ -69,8 +69,9 @@ struct NautilusDirectoryDetails
 
 	/* The file objects. */
 	NautilusFile *as_file;
-	GList *file_list;
-	GHashTable *file_hash;
+	GPtrArray *files; /* in no particular order, see directory_file_index */
+	GHashTable *file_hash; /* name -> NautilusFile */
+	GHashTable *unconfirmed_files; /* set of NautilusFile */
 
 	/* Queues of files needing some I/O done. */
 	NautilusFileQueue *high_priority_queue;
@@ -97,13 +98,13 @@ struct NautilusDirectoryDetails
 	gboolean directory_loaded_sent_notification;
 	DirectoryLoadState *directory_load_in_progress;
 
-	GList *pending_file_info; /* list of GnomeVFSFileInfo's that are pending */
+	GQueue pending_file_info; /* GFileInfo's waiting to be turned into files */
 	int confirmed_file_count;
         guint dequeue_pending_idle_id;
 
 	GList *new_files_in_progress; /* list of NewFilesState * */
 
-	DirectoryCountState *count_in_progress;
+	GHashTable *counts_in_progress; /* NautilusFile -> DirectoryCountState */
 
 	NautilusFile *deep_count_file;
 	DeepCountState *deep_count_in_progress;
@@ -118,7 +119,7 @@ struct NautilusDirectoryDetails
 	NautilusOperationHandle *extension_info_in_progress;
 	guint extension_info_idle;
 
-	ThumbnailState *thumbnail_state;
+	GHashTable *thumbnails_in_progress; /* NautilusFile -> ThumbnailState */
 
 	MountState *mount_state;
 
@@ -210,11 +211,12 @@ void               nautilus_directory_add_file_monitors               (NautilusD
 								       FileMonitors              *monitors);
 void               nautilus_directory_add_file                        (NautilusDirectory         *directory,
 								       NautilusFile              *file);
-GList *            nautilus_directory_begin_file_name_change          (NautilusDirectory         *directory,
+gboolean           nautilus_directory_begin_file_name_change          (NautilusDirectory         *directory,
 								       NautilusFile              *file);
 void               nautilus_directory_end_file_name_change            (NautilusDirectory         *directory,
 								       NautilusFile              *file,
-								       GList                     *node);
+								       gboolean                   was_listed);
+GList *            nautilus_directory_copy_file_list_internal         (NautilusDirectory         *directory);
 void               nautilus_directory_moved                           (const char                *from_uri,
 								       const char                *to_uri);
 /* Interface to the work queue. */
@@ -0,0 +1,669 @@
+/*
+ *  nautilus-directory-snapshot.c: On-disk cache of directory listings.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A snapshot holds the GFileInfos a directory enumeration returned,
+ * together with the modification time the directory had at the time.
+ * It is stored as a serialized GVariant so it can be mapped and read
+ * without copying. The snapshot is only ever used as a first guess:
+ * the live enumeration always runs afterwards and corrects it.
+ *
+ * Snapshots that were not written or used for a while are removed at
+ * startup, and so are the oldest ones once they take too much space.
+ *
+ * Reading and writing the snapshot files happens in worker threads, only
+ * the GFileInfos are turned into a GVariant on the main thread, as they
+ * are shared with the rest of the directory load.
+ */
+
+#include <config.h>
+#include "nautilus-directory-snapshot.h"
+
+#include <string.h>
+#include <time.h>
+#include <glib/gstdio.h>
+
+#include "nautilus-global-preferences.h"
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_DIRECTORY_SNAPSHOT
+#include "nautilus-debug.h"
+
+#define SNAPSHOT_VERSION 1
+
+/* (version, mtime, mtime usec, [{attribute: value}]) */
+#define SNAPSHOT_TYPE "(utuaa{sv})"
+
+/* Limits on what is kept on disk, checked at startup */
+#define SNAPSHOT_MAX_AGE (30 * 24 * 60 * 60)
+#define SNAPSHOTS_MAX_SIZE (100 * 1024 * 1024)
+
+/* An unchanged snapshot is not written again, only its modification time
+ * is updated once in a while so it doesn't look unused.
+ */
+#define SNAPSHOT_TOUCH_INTERVAL (24 * 60 * 60)
+
+typedef struct
+{
+    char *path;
+    time_t mtime;
+    goffset size;
+} SnapshotFile;
+
+typedef struct
+{
+    char *path;
+    guint64 mtime;
+    guint32 mtime_usec;
+} LoadData;
+
+typedef struct
+{
+    char *path;
+    GBytes *bytes;
+} SaveData;
+
+static void
+load_data_free (LoadData *data)
+{
+    g_free (data->path);
+    g_free (data);
+}
+
+static void
+save_data_free (SaveData *data)
+{
+    g_free (data->path);
+    g_bytes_unref (data->bytes);
+    g_free (data);
+}
+
+static char *
+get_snapshots_dir (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "nautilus", "listings", NULL);
+}
+
+static char *
+get_snapshot_path (GFile *location)
+{
+    char *uri;
+    char *checksum;
+    char *dirname;
+    char *path;
+
+    uri = g_file_get_uri (location);
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+    dirname = get_snapshots_dir ();
+    path = g_build_filename (dirname, checksum, NULL);
+
+    g_free (dirname);
+    g_free (checksum);
+    g_free (uri);
+
+    return path;
+}
+
+static gint
+compare_snapshot_files_by_mtime (gconstpointer a,
+                                 gconstpointer b)
+{
+    const SnapshotFile *file_a = a;
+    const SnapshotFile *file_b = b;
+
+    return file_a->mtime < file_b->mtime ? -1 : file_a->mtime > file_b->mtime;
+}
+
+static gpointer
+prune_thread_func (gpointer user_data)
+{
+    GArray *files;
+    SnapshotFile file;
+    GStatBuf stat_buf;
+    GDir *dir;
+    const char *name;
+    char *dirname;
+    char *path;
+    goffset total_size;
+    time_t now;
+    guint i, n_removed;
+
+    dirname = get_snapshots_dir ();
+    dir = g_dir_open (dirname, 0, NULL);
+    if (dir == NULL)
+    {
+        g_free (dirname);
+        return NULL;
+    }
+
+    files = g_array_new (FALSE, FALSE, sizeof (SnapshotFile));
+    total_size = 0;
+    n_removed = 0;
+    now = time (NULL);
+
+    while ((name = g_dir_read_name (dir)) != NULL)
+    {
+        path = g_build_filename (dirname, name, NULL);
+        if (g_stat (path, &stat_buf) != 0 || !S_ISREG (stat_buf.st_mode))
+        {
+            g_free (path);
+            continue;
+        }
+
+        if (now - stat_buf.st_mtime > SNAPSHOT_MAX_AGE)
+        {
+            g_unlink (path);
+            g_free (path);
+            n_removed++;
+            continue;
+        }
+
+        file.path = path;
+        file.mtime = stat_buf.st_mtime;
+        file.size = stat_buf.st_size;
+        g_array_append_val (files, file);
+        total_size += file.size;
+    }
+    g_dir_close (dir);
+
+    /* Make room by removing the least recently written ones */
+    g_array_sort (files, compare_snapshot_files_by_mtime);
+    for (i = 0; i < files->len; i++)
+    {
+        file = g_array_index (files, SnapshotFile, i);
+        if (total_size > SNAPSHOTS_MAX_SIZE)
+        {
+            g_unlink (file.path);
+            total_size -= file.size;
+            n_removed++;
+        }
+        g_free (file.path);
+    }
+
+    DEBUG ("Removed %u old directory snapshots", n_removed);
+
+    g_array_free (files, TRUE);
+    g_free (dirname);
+
+    return NULL;
+}
+
+void
+nautilus_directory_snapshot_prune (void)
+{
+    GThread *thread;
+
+    thread = g_thread_new ("nautilus-snapshot-prune", prune_thread_func, NULL);
+    g_thread_unref (thread);
+}
+
+gboolean
+nautilus_directory_snapshot_is_enabled (GFile *location)
+{
+    if (!g_settings_get_boolean (nautilus_preferences,
+                                 NAUTILUS_PREFERENCES_CACHE_DIRECTORY_LISTINGS))
+    {
+        return FALSE;
+    }
+
+    /* The modification time of these doesn't follow their contents. */
+    if (g_file_has_uri_scheme (location, "trash") ||
+        g_file_has_uri_scheme (location, "recent"))
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+get_directory_mtime (GFileInfo *directory_info,
+                     guint64   *mtime,
+                     guint32   *mtime_usec)
+{
+    if (directory_info == NULL ||
+        !g_file_info_has_attribute (directory_info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+    {
+        return FALSE;
+    }
+
+    *mtime = g_file_info_get_attribute_uint64 (directory_info,
+                                               G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    *mtime_usec = g_file_info_get_attribute_uint32 (directory_info,
+                                                    G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+    return TRUE;
+}
+
+static GVariant *
+serialize_attribute (GFileInfo  *info,
+                     const char *attribute)
+{
+    GObject *object;
+    GVariant *icon;
+    GVariant *value;
+    const char *byte_string;
+    char **stringv;
+
+    switch (g_file_info_get_attribute_type (info, attribute))
+    {
+        case G_FILE_ATTRIBUTE_TYPE_STRING:
+        {
+            return g_variant_new_string (g_file_info_get_attribute_string (info, attribute));
+        }
+
+        case G_FILE_ATTRIBUTE_TYPE_BYTE_STRING:
+        {
+            byte_string = g_file_info_get_attribute_byte_string (info, attribute);
+            return g_variant_new_bytestring (byte_string);
+        }
+
+        case G_FILE_ATTRIBUTE_TYPE_BOOLEAN:
+        {
+            return g_variant_new_boolean (g_file_info_get_attribute_boolean (info, attribute));
+        }
+
+        case G_FILE_ATTRIBUTE_TYPE_UINT32:
+        {
+            return g_variant_new_uint32 (g_file_info_get_attribute_uint32 (info, attribute));
+        }
+
+        case G_FILE_ATTRIBUTE_TYPE_INT32:
+        {
+            return g_variant_new_int32 (g_file_info_get_attribute_int32 (info, attribute));
+        }
+
+        case G_FILE_ATTRIBUTE_TYPE_UINT64:
+        {
+            return g_variant_new_uint64 (g_file_info_get_attribute_uint64 (info, attribute));
+        }
+
+        case G_FILE_ATTRIBUTE_TYPE_INT64:
+        {
+            return g_variant_new_int64 (g_file_info_get_attribute_int64 (info, attribute));
+        }
+
+        case G_FILE_ATTRIBUTE_TYPE_STRINGV:
+        {
+            stringv = g_file_info_get_attribute_stringv (info, attribute);
+            return g_variant_new_strv ((const char * const *) stringv, -1);
+        }
+
+        case G_FILE_ATTRIBUTE_TYPE_OBJECT:
+        {
+            /* Icons are the only objects in a file info we know how to store. */
+            object = g_file_info_get_attribute_object (info, attribute);
+            if (G_IS_ICON (object))
+            {
+                icon = g_icon_serialize (G_ICON (object));
+                if (icon != NULL)
+                {
+                    value = g_variant_new_variant (icon);
+                    g_variant_unref (icon);
+                    return value;
+                }
+            }
+            return NULL;
+        }
+
+        default:
+        {
+            return NULL;
+        }
+    }
+}
+
+static void
+deserialize_attribute (GFileInfo  *info,
+                       const char *attribute,
+                       GVariant   *value)
+{
+    GVariant *inner;
+    GIcon *icon;
+    const char **stringv;
+
+    if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+    {
+        g_file_info_set_attribute_string (info, attribute,
+                                          g_variant_get_string (value, NULL));
+    }
+    else if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING))
+    {
+        g_file_info_set_attribute_byte_string (info, attribute,
+                                               g_variant_get_bytestring (value));
+    }
+    else if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+    {
+        g_file_info_set_attribute_boolean (info, attribute,
+                                           g_variant_get_boolean (value));
+    }
+    else if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32))
+    {
+        g_file_info_set_attribute_uint32 (info, attribute,
+                                          g_variant_get_uint32 (value));
+    }
+    else if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT32))
+    {
+        g_file_info_set_attribute_int32 (info, attribute,
+                                         g_variant_get_int32 (value));
+    }
+    else if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT64))
+    {
+        g_file_info_set_attribute_uint64 (info, attribute,
+                                          g_variant_get_uint64 (value));
+    }
+    else if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT64))
+    {
+        g_file_info_set_attribute_int64 (info, attribute,
+                                         g_variant_get_int64 (value));
+    }
+    else if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY))
+    {
+        stringv = g_variant_get_strv (value, NULL);
+        g_file_info_set_attribute_stringv (info, attribute, (char **) stringv);
+        g_free (stringv);
+    }
+    else if (g_variant_is_of_type (value, G_VARIANT_TYPE_VARIANT))
+    {
+        inner = g_variant_get_variant (value);
+        icon = g_icon_deserialize (inner);
+        if (icon != NULL)
+        {
+            g_file_info_set_attribute_object (info, attribute, G_OBJECT (icon));
+            g_object_unref (icon);
+        }
+        g_variant_unref (inner);
+    }
+}
+
+static GVariant *
+serialize_file_info (GFileInfo *info)
+{
+    GVariantBuilder builder;
+    GVariant *value;
+    char **attributes;
+    int i;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+    attributes = g_file_info_list_attributes (info, NULL);
+    for (i = 0; attributes[i] != NULL; i++)
+    {
+        value = serialize_attribute (info, attributes[i]);
+        if (value != NULL)
+        {
+            g_variant_builder_add (&builder, "{sv}", attributes[i], value);
+        }
+    }
+    g_strfreev (attributes);
+
+    return g_variant_builder_end (&builder);
+}
+
+static GFileInfo *
+deserialize_file_info (GVariant *variant)
+{
+    GFileInfo *info;
+    GVariantIter iter;
+    const char *attribute;
+    GVariant *value;
+
+    info = g_file_info_new ();
+
+    g_variant_iter_init (&iter, variant);
+    while (g_variant_iter_loop (&iter, "{&sv}", &attribute, &value))
+    {
+        deserialize_attribute (info, attribute, value);
+    }
+
+    if (g_file_info_get_name (info) == NULL)
+    {
+        g_object_unref (info);
+        return NULL;
+    }
+
+    return info;
+}
+
+static void
+infos_free (GList *infos)
+{
+    g_list_free_full (infos, g_object_unref);
+}
+
+static void
+load_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+    LoadData *data = task_data;
+    GMappedFile *mapped_file;
+    GBytes *bytes;
+    GVariant *snapshot;
+    GVariant *entries;
+    GVariant *entry;
+    GVariantIter iter;
+    GFileInfo *info;
+    GList *infos;
+    guint32 version;
+    guint64 snapshot_mtime;
+    guint32 snapshot_mtime_usec;
+
+    mapped_file = g_mapped_file_new (data->path, FALSE, NULL);
+    if (mapped_file == NULL)
+    {
+        g_task_return_pointer (task, NULL, NULL);
+        return;
+    }
+
+    bytes = g_mapped_file_get_bytes (mapped_file);
+    g_mapped_file_unref (mapped_file);
+
+    /* Not trusted: the file may be truncated or from a different version. */
+    snapshot = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (SNAPSHOT_TYPE),
+                                                             bytes, FALSE));
+    g_bytes_unref (bytes);
+
+    infos = NULL;
+
+    g_variant_get (snapshot, "(utu@aa{sv})", &version, &snapshot_mtime,
+                   &snapshot_mtime_usec, &entries);
+    if (version == SNAPSHOT_VERSION &&
+        snapshot_mtime == data->mtime &&
+        snapshot_mtime_usec == data->mtime_usec)
+    {
+        g_variant_iter_init (&iter, entries);
+        while (!g_cancellable_is_cancelled (cancellable) &&
+               (entry = g_variant_iter_next_value (&iter)) != NULL)
+        {
+            info = deserialize_file_info (entry);
+            if (info != NULL)
+            {
+                infos = g_list_prepend (infos, info);
+            }
+            g_variant_unref (entry);
+        }
+    }
+    g_variant_unref (entries);
+    g_variant_unref (snapshot);
+
+    DEBUG ("Loaded %u cached files", g_list_length (infos));
+
+    g_task_return_pointer (task, g_list_reverse (infos), (GDestroyNotify) infos_free);
+}
+
+void
+nautilus_directory_snapshot_load_async (GFile               *location,
+                                        GFileInfo           *directory_info,
+                                        GCancellable        *cancellable,
+                                        GAsyncReadyCallback  callback,
+                                        gpointer             user_data)
+{
+    GTask *task;
+    LoadData *data;
+    guint64 mtime;
+    guint32 mtime_usec;
+
+    task = g_task_new (NULL, cancellable, callback, user_data);
+
+    if (!get_directory_mtime (directory_info, &mtime, &mtime_usec))
+    {
+        g_task_return_pointer (task, NULL, NULL);
+        g_object_unref (task);
+        return;
+    }
+
+    data = g_new (LoadData, 1);
+    data->path = get_snapshot_path (location);
+    data->mtime = mtime;
+    data->mtime_usec = mtime_usec;
+    g_task_set_task_data (task, data, (GDestroyNotify) load_data_free);
+
+    g_task_run_in_thread (task, load_thread);
+    g_object_unref (task);
+}
+
+GList *
+nautilus_directory_snapshot_load_finish (GAsyncResult *result)
+{
+    return g_task_propagate_pointer (G_TASK (result), NULL);
+}
+
+/* Whether the snapshot at @path holds @bytes already. It was just read
+ * when the folder was loaded, so comparing is cheap.
+ */
+static gboolean
+snapshot_is_unchanged (const char *path,
+                       GBytes     *bytes)
+{
+    GMappedFile *mapped_file;
+    gboolean unchanged;
+
+    mapped_file = g_mapped_file_new (path, FALSE, NULL);
+    if (mapped_file == NULL)
+    {
+        return FALSE;
+    }
+
+    unchanged = g_mapped_file_get_length (mapped_file) == g_bytes_get_size (bytes) &&
+                memcmp (g_mapped_file_get_contents (mapped_file),
+                        g_bytes_get_data (bytes, NULL),
+                        g_bytes_get_size (bytes)) == 0;
+    g_mapped_file_unref (mapped_file);
+
+    return unchanged;
+}
+
+static void
+save_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+    SaveData *data = task_data;
+    GFile *snapshot_file;
+    GStatBuf stat_buf;
+    GError *error;
+    char *dirname;
+
+    if (snapshot_is_unchanged (data->path, data->bytes))
+    {
+        DEBUG ("Directory snapshot unchanged, not writing it");
+
+        if (g_stat (data->path, &stat_buf) == 0 &&
+            time (NULL) - stat_buf.st_mtime > SNAPSHOT_TOUCH_INTERVAL)
+        {
+            g_utime (data->path, NULL);
+        }
+
+        g_task_return_boolean (task, TRUE);
+        return;
+    }
+
+    dirname = g_path_get_dirname (data->path);
+    g_mkdir_with_parents (dirname, 0700);
+    g_free (dirname);
+
+    snapshot_file = g_file_new_for_path (data->path);
+    error = NULL;
+    if (g_file_replace_contents (snapshot_file,
+                                 g_bytes_get_data (data->bytes, NULL),
+                                 g_bytes_get_size (data->bytes),
+                                 NULL, FALSE, G_FILE_CREATE_PRIVATE,
+                                 NULL, NULL, &error))
+    {
+        g_task_return_boolean (task, TRUE);
+    }
+    else
+    {
+        g_task_return_error (task, error);
+    }
+    g_object_unref (snapshot_file);
+}
+
+static void
+save_callback (GObject      *source_object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+    GError *error;
+
+    error = NULL;
+    if (!g_task_propagate_boolean (G_TASK (res), &error))
+    {
+        DEBUG ("Failed to save directory snapshot: %s", error->message);
+        g_error_free (error);
+    }
+}
+
+void
+nautilus_directory_snapshot_save (GFile     *location,
+                                  GFileInfo *directory_info,
+                                  GList     *file_infos)
+{
+    GVariantBuilder builder;
+    GVariant *snapshot;
+    SaveData *data;
+    GTask *task;
+    guint64 mtime;
+    guint32 mtime_usec;
+    GList *l;
+
+    if (!get_directory_mtime (directory_info, &mtime, &mtime_usec))
+    {
+        return;
+    }
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+    for (l = file_infos; l != NULL; l = l->next)
+    {
+        g_variant_builder_add_value (&builder, serialize_file_info (l->data));
+    }
+
+    snapshot = g_variant_ref_sink (g_variant_new ("(utu@aa{sv})", SNAPSHOT_VERSION,
+                                                  mtime, mtime_usec,
+                                                  g_variant_builder_end (&builder)));
+
+    data = g_new (SaveData, 1);
+    data->path = get_snapshot_path (location);
+    data->bytes = g_variant_get_data_as_bytes (snapshot);
+    g_variant_unref (snapshot);
+
+    task = g_task_new (NULL, NULL, save_callback, NULL);
+    g_task_set_task_data (task, data, (GDestroyNotify) save_data_free);
+    g_task_run_in_thread (task, save_thread);
+    g_object_unref (task);
+}
@@ -0,0 +1,57 @@
+/*
+   nautilus-directory-snapshot.h: On-disk cache of directory listings.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NAUTILUS_DIRECTORY_SNAPSHOT_H
+#define NAUTILUS_DIRECTORY_SNAPSHOT_H
+
+#include <gio/gio.h>
+
+/* Listings with more files than this are not worth keeping around. */
+#define NAUTILUS_DIRECTORY_SNAPSHOT_MAX_FILES 50000
+
+/* The attributes needed to decide whether a snapshot is still valid. */
+#define NAUTILUS_DIRECTORY_SNAPSHOT_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+
+gboolean nautilus_directory_snapshot_is_enabled  (GFile               *location);
+
+/* Removes the least recently written snapshots in a thread, once they
+ * take more space than allowed. Called once at startup.
+ */
+void     nautilus_directory_snapshot_prune       (void);
+
+/* Reads the snapshot of @location in a thread. The finish function
+ * returns a list of GFileInfos saved for @location when it had the
+ * modification time found in @directory_info, or NULL if there is no
+ * such snapshot or the load was cancelled.
+ */
+void     nautilus_directory_snapshot_load_async  (GFile               *location,
+						  GFileInfo           *directory_info,
+						  GCancellable        *cancellable,
+						  GAsyncReadyCallback  callback,
+						  gpointer             user_data);
+GList *  nautilus_directory_snapshot_load_finish (GAsyncResult        *result);
+
+/* Writes @file_infos as the snapshot of @location, replacing any
+ * previous one unless it holds the same. The comparison and the write
+ * happen in a thread.
+ */
+void     nautilus_directory_snapshot_save        (GFile               *location,
+						  GFileInfo           *directory_info,
+						  GList               *file_infos);
+
+#endif /* NAUTILUS_DIRECTORY_SNAPSHOT_H */
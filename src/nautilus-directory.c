@@ -22,12 +22,14 @@
 #include <config.h>
 #include "nautilus-directory-private.h"
 
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-directory-notify.h"
 #include "nautilus-file-attributes.h"
 #include "nautilus-file-private.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-search-directory.h"
 #include "nautilus-search-directory-file.h"
+#include "nautilus-search-index.h"
 #include "nautilus-vfs-file.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-lib-self-check-functions.h"
@@ -81,7 +83,7 @@ real_are_all_files_seen (NautilusDirectory *directory)
 static gboolean
 real_is_not_empty (NautilusDirectory *directory)
 {
-    return directory->details->file_list != NULL;
+    return directory->details->files->len > 0;
 }
 
 static gboolean
@@ -100,11 +102,20 @@ is_tentative (NautilusFile *file,
 static GList *
 real_get_file_list (NautilusDirectory *directory)
 {
-    GList *tentative_files, *non_tentative_files;
+    GList *non_tentative_files;
+    NautilusFile *file;
+    guint i;
 
-    tentative_files = nautilus_file_list_filter (directory->details->file_list,
-                                                 &non_tentative_files, is_tentative, NULL);
-    nautilus_file_list_free (tentative_files);
+    non_tentative_files = NULL;
+    for (i = 0; i < directory->details->files->len; i++)
+    {
+        file = g_ptr_array_index (directory->details->files, i);
+        if (!is_tentative (file, NULL))
+        {
+            non_tentative_files = g_list_prepend (non_tentative_files,
+                                                  nautilus_file_ref (file));
+        }
+    }
 
     return non_tentative_files;
 }
@@ -165,7 +176,7 @@ nautilus_directory_finalize (GObject *object)
     g_hash_table_remove (directories, directory->details->location);
 
     nautilus_directory_cancel (directory);
-    g_assert (directory->details->count_in_progress == NULL);
+    g_assert (g_hash_table_size (directory->details->counts_in_progress) == 0);
 
     if (directory->details->monitor_list != NULL)
     {
@@ -193,16 +204,20 @@ nautilus_directory_finalize (GObject *object)
         g_object_unref (directory->details->location);
     }
 
-    g_assert (directory->details->file_list == NULL);
+    g_assert (directory->details->files->len == 0);
+    g_ptr_array_free (directory->details->files, TRUE);
     g_hash_table_destroy (directory->details->file_hash);
+    g_hash_table_destroy (directory->details->unconfirmed_files);
 
     nautilus_file_queue_destroy (directory->details->high_priority_queue);
     nautilus_file_queue_destroy (directory->details->low_priority_queue);
     nautilus_file_queue_destroy (directory->details->extension_queue);
     g_assert (directory->details->directory_load_in_progress == NULL);
-    g_assert (directory->details->count_in_progress == NULL);
+    g_assert (g_hash_table_size (directory->details->thumbnails_in_progress) == 0);
+    g_hash_table_destroy (directory->details->counts_in_progress);
+    g_hash_table_destroy (directory->details->thumbnails_in_progress);
     g_assert (directory->details->dequeue_pending_idle_id == 0);
-    g_list_free_full (directory->details->pending_file_info, g_object_unref);
+    g_list_free_full (directory->details->pending_file_info.head, g_object_unref);
 
     G_OBJECT_CLASS (nautilus_directory_parent_class)->finalize (object);
 }
@@ -322,10 +337,15 @@ static void
 nautilus_directory_init (NautilusDirectory *directory)
 {
     directory->details = G_TYPE_INSTANCE_GET_PRIVATE ((directory), NAUTILUS_TYPE_DIRECTORY, NautilusDirectoryDetails);
+    directory->details->files = g_ptr_array_new ();
     directory->details->file_hash = g_hash_table_new (g_str_hash, g_str_equal);
+    directory->details->unconfirmed_files = g_hash_table_new (NULL, NULL);
+    g_queue_init (&directory->details->pending_file_info);
     directory->details->high_priority_queue = nautilus_file_queue_new ();
     directory->details->low_priority_queue = nautilus_file_queue_new ();
     directory->details->extension_queue = nautilus_file_queue_new ();
+    directory->details->counts_in_progress = g_hash_table_new (NULL, NULL);
+    directory->details->thumbnails_in_progress = g_hash_table_new (NULL, NULL);
 }
 
 NautilusDirectory *
@@ -397,13 +417,13 @@ emit_change_signals_for_all_files (NautilusDirectory *directory)
 {
     GList *files;
 
-    files = g_list_copy (directory->details->file_list);
+    files = nautilus_directory_copy_file_list_internal (directory);
     if (directory->details->as_file != NULL)
     {
-        files = g_list_prepend (files, directory->details->as_file);
+        files = g_list_prepend (files,
+                                nautilus_file_ref (directory->details->as_file));
     }
 
-    nautilus_file_list_ref (files);
     nautilus_directory_emit_change_signals (directory, files);
 
     nautilus_file_list_free (files);
@@ -824,58 +844,64 @@ nautilus_directory_are_all_files_seen (NautilusDirectory *directory)
 
 static void
 add_to_hash_table (NautilusDirectory *directory,
-                   NautilusFile      *file,
-                   GList             *node)
+                   NautilusFile      *file)
 {
     const char *name;
 
     name = eel_ref_str_peek (file->details->name);
 
-    g_assert (node != NULL);
     g_assert (g_hash_table_lookup (directory->details->file_hash,
                                    name) == NULL);
-    g_hash_table_insert (directory->details->file_hash, (char *) name, node);
+    g_hash_table_insert (directory->details->file_hash, (char *) name, file);
 }
 
-static GList *
+static gboolean
 extract_from_hash_table (NautilusDirectory *directory,
                          NautilusFile      *file)
 {
     const char *name;
-    GList *node;
 
     name = eel_ref_str_peek (file->details->name);
     if (name == NULL)
     {
-        return NULL;
+        return FALSE;
     }
 
-    /* Find the list node in the hash table. */
-    node = g_hash_table_lookup (directory->details->file_hash, name);
+    /* Find the file in the hash table. */
+    if (g_hash_table_lookup (directory->details->file_hash, name) != file)
+    {
+        return FALSE;
+    }
     g_hash_table_remove (directory->details->file_hash, name);
 
-    return node;
+    return TRUE;
 }
 
 void
 nautilus_directory_add_file (NautilusDirectory *directory,
                              NautilusFile      *file)
 {
-    GList *node;
     gboolean add_to_work_queue;
 
     g_assert (NAUTILUS_IS_DIRECTORY (directory));
     g_assert (NAUTILUS_IS_FILE (file));
     g_assert (file->details->name != NULL);
 
-    /* Add to list. */
-    node = g_list_prepend (directory->details->file_list, file);
-    directory->details->file_list = node;
+    /* Add to the array, remembering where so it can be removed fast. */
+    file->details->directory_file_index = directory->details->files->len;
+    g_ptr_array_add (directory->details->files, file);
 
     /* Add to hash table. */
-    add_to_hash_table (directory, file, node);
+    add_to_hash_table (directory, file);
 
-    directory->details->confirmed_file_count++;
+    if (file->details->unconfirmed)
+    {
+        g_hash_table_add (directory->details->unconfirmed_files, file);
+    }
+    else
+    {
+        directory->details->confirmed_file_count++;
+    }
 
     add_to_work_queue = FALSE;
     if (nautilus_directory_is_file_list_monitored (directory))
@@ -902,25 +928,39 @@ void
 nautilus_directory_remove_file (NautilusDirectory *directory,
                                 NautilusFile      *file)
 {
-    GList *node;
+    GPtrArray *files;
+    NautilusFile *last_file;
+    guint index;
 
     g_assert (NAUTILUS_IS_DIRECTORY (directory));
     g_assert (NAUTILUS_IS_FILE (file));
     g_assert (file->details->name != NULL);
 
-    /* Find the list node in the hash table. */
-    node = extract_from_hash_table (directory, file);
-    g_assert (node != NULL);
-    g_assert (node->data == file);
+    /* Remove the file from the hash table. */
+    if (!extract_from_hash_table (directory, file))
+    {
+        g_assert_not_reached ();
+    }
+
+    /* Remove the file from the array by moving the last file
+     * into its slot.
+     */
+    files = directory->details->files;
+    index = file->details->directory_file_index;
+    g_assert (index < files->len);
+    g_assert (g_ptr_array_index (files, index) == file);
 
-    /* Remove the item from the list. */
-    directory->details->file_list = g_list_remove_link
-                                        (directory->details->file_list, node);
-    g_list_free_1 (node);
+    last_file = g_ptr_array_index (files, files->len - 1);
+    last_file->details->directory_file_index = index;
+    g_ptr_array_remove_index_fast (files, index);
 
     nautilus_directory_remove_file_from_work_queue (directory, file);
 
-    if (!file->details->unconfirmed)
+    if (file->details->unconfirmed)
+    {
+        g_hash_table_remove (directory->details->unconfirmed_files, file);
+    }
+    else
     {
         directory->details->confirmed_file_count--;
     }
@@ -932,38 +972,54 @@ nautilus_directory_remove_file (NautilusDirectory *directory,
     }
 }
 
-GList *
+gboolean
 nautilus_directory_begin_file_name_change (NautilusDirectory *directory,
                                            NautilusFile      *file)
 {
-    /* Find the list node in the hash table. */
+    /* Take the file out of the hash table while the name changes. */
     return extract_from_hash_table (directory, file);
 }
 
 void
 nautilus_directory_end_file_name_change (NautilusDirectory *directory,
                                          NautilusFile      *file,
-                                         GList             *node)
+                                         gboolean           was_listed)
+{
+    /* Put the file back into the hash table under its new name. */
+    if (was_listed)
+    {
+        add_to_hash_table (directory, file);
+    }
+}
+
+/* Returns a list with a ref to each of the files of the directory,
+ * including the ones that haven't been announced yet.
+ */
+GList *
+nautilus_directory_copy_file_list_internal (NautilusDirectory *directory)
 {
-    /* Add the list node to the hash table. */
-    if (node != NULL)
+    GList *files;
+    guint i;
+
+    files = NULL;
+    for (i = directory->details->files->len; i > 0; i--)
     {
-        add_to_hash_table (directory, file, node);
+        files = g_list_prepend (files,
+                                nautilus_file_ref (g_ptr_array_index (directory->details->files,
+                                                                      i - 1)));
     }
+
+    return files;
 }
 
 NautilusFile *
 nautilus_directory_find_file_by_name (NautilusDirectory *directory,
                                       const char        *name)
 {
-    GList *node;
-
     g_return_val_if_fail (NAUTILUS_IS_DIRECTORY (directory), NULL);
     g_return_val_if_fail (name != NULL, NULL);
 
-    node = g_hash_table_lookup (directory->details->file_hash,
-                                name);
-    return node == NULL ? NULL : NAUTILUS_FILE (node->data);
+    return g_hash_table_lookup (directory->details->file_hash, name);
 }
 
 void
@@ -1201,6 +1257,8 @@ nautilus_directory_notify_files_added (GList *files)
     {
         location = p->data;
 
+        nautilus_deep_count_cache_invalidate (location);
+
         /* See if the directory is already known. */
         directory = get_parent_directory_if_exists (location);
         if (directory == NULL)
@@ -1280,6 +1338,9 @@ nautilus_directory_notify_files_changed (GList *files)
     GFile *location;
     NautilusFile *file;
 
+    /* The mtime of a file is searched on, so keep it current */
+    nautilus_search_index_refresh_files (files);
+
     /* Make a list of changed files in each directory. */
     changed_lists = g_hash_table_new (NULL, NULL);
 
@@ -1288,6 +1349,8 @@ nautilus_directory_notify_files_changed (GList *files)
     {
         location = node->data;
 
+        nautilus_deep_count_cache_invalidate (location);
+
         /* Find the file. */
         file = nautilus_file_get_existing (location);
         if (file != NULL)
@@ -1320,6 +1383,8 @@ nautilus_directory_notify_files_removed (GList *files)
     NautilusFile *file;
     GFile *location;
 
+    nautilus_search_index_remove_files (files);
+
     /* Make a list of changed files in each directory. */
     changed_lists = g_hash_table_new (NULL, NULL);
 
@@ -1331,6 +1396,8 @@ nautilus_directory_notify_files_removed (GList *files)
     {
         location = p->data;
 
+        nautilus_deep_count_cache_invalidate (location);
+
         /* Update file count for parent directory if anyone might care. */
         directory = get_parent_directory_if_exists (location);
         if (directory != NULL)
@@ -1476,7 +1543,7 @@ nautilus_directory_moved_internal (GFile *old_location,
             }
             affected_files = g_list_concat
                                  (affected_files,
-                                 nautilus_file_list_copy (directory->details->file_list));
+                                 nautilus_directory_copy_file_list_internal (directory));
         }
 
         nautilus_directory_unref (directory);
@@ -1533,6 +1600,8 @@ nautilus_directory_notify_files_moved (GList *file_pairs)
     NautilusFileAttributes cancel_attributes;
     GFile *to_location, *from_location;
 
+    nautilus_search_index_move_files (file_pairs);
+
     /* Make a list of added and changed files in each directory. */
     new_files_list = NULL;
     added_lists = g_hash_table_new (NULL, NULL);
@@ -1550,6 +1619,9 @@ nautilus_directory_notify_files_moved (GList *file_pairs)
         from_location = pair->from;
         to_location = pair->to;
 
+        nautilus_deep_count_cache_invalidate (from_location);
+        nautilus_deep_count_cache_invalidate (to_location);
+
         /* Handle overwriting a file. */
         file = nautilus_file_get_existing (to_location);
         if (file != NULL)
@@ -2064,7 +2136,7 @@ nautilus_self_check_directory (void)
         gtk_main_iteration ();
     }
 
-    EEL_CHECK_BOOLEAN_RESULT (directory->details->file_list == NULL, TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (directory->details->files->len == 0, TRUE);
 
     EEL_CHECK_INTEGER_RESULT (g_hash_table_size (directories), 1);
 
@@ -22,6 +22,8 @@
  *           Pavel Cisler <pavel@eazel.com>
  */
 
+#define _GNU_SOURCE
+
 #include <config.h>
 #include <string.h>
 #include <stdio.h>
@@ -29,8 +31,17 @@
 #include <locale.h>
 #include <math.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <stdlib.h>
+#include <dirent.h>
+
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
 
 #include "nautilus-file-operations.h"
 
@@ -81,6 +92,22 @@ typedef struct
     gboolean delete_all;
 } CommonJob;
 
+/* Copies of the regular files inside folders run on a pool of threads,
+ * while everything that may need to ask the user stays on the job thread.
+ */
+typedef struct
+{
+    GThreadPool *pool;
+    GAsyncQueue *results;     /* ParallelCopyTasks the pool is done with */
+    int n_pending;
+    int max_pending;
+
+    GMutex mutex;
+    goffset num_bytes;        /* copied but not added up yet */
+
+    GList *directories;       /* ParallelCopyDirectory, in reverse order */
+} ParallelCopy;
+
 typedef struct
 {
     CommonJob common;
@@ -95,6 +122,7 @@ typedef struct
     gchar *target_name;
     NautilusCopyCallback done_callback;
     gpointer done_callback_data;
+    ParallelCopy *parallel_copy;
 } CopyMoveJob;
 
 typedef struct
@@ -133,6 +161,15 @@ typedef struct
     gpointer done_callback_data;
 } EmptyTrashJob;
 
+typedef struct
+{
+    CommonJob common;
+    GHashTable *trashed;      /* original path -> time it was trashed */
+    gboolean success;
+    NautilusCopyCallback done_callback;
+    gpointer done_callback_data;
+} RestoreJob;
+
 typedef struct
 {
     CommonJob common;
@@ -169,8 +206,30 @@ typedef struct
     goffset num_bytes;
     int num_files_since_progress;
     OpKind op;
+    GHashTable *listings;     /* folder GFile -> GPtrArray of ScannedEntry, for copies */
 } SourceInfo;
 
+/* A file found in a folder while scanning, kept so that copying the folder
+ * doesn't need to list it again.
+ */
+typedef struct
+{
+    GFileType type;
+    char name[1];
+} ScannedEntry;
+
+typedef struct
+{
+    guint32 device;
+    guint64 inode;
+} ScannedInode;
+
+typedef struct
+{
+    GHashTable *inodes;       /* ScannedInodes of the local folders and toplevel files */
+    GHashTable *uris;         /* of the other files */
+} ScanState;
+
 typedef struct
 {
     int num_files;
@@ -1938,6 +1997,465 @@ file_deleted_callback (GFile    *file,
     }
 }
 
+/* Local folders are emptied by a few threads at once, each taking the most
+ * recently found folder from a shared stack. The results go back to the job
+ * thread, which reports them through file_deleted_callback(). While an error
+ * waits for an answer there, the threads stop deleting.
+ *
+ * Folders are opened and removed relative to their parent, which is kept
+ * open until everything inside it is done with, so that a folder swapped
+ * for a link along the way can't lead outside of what is being deleted.
+ */
+#define PARALLEL_DELETE_THREADS 4
+#define PARALLEL_DELETE_BATCH_SIZE 1000
+
+typedef struct DeleteNode DeleteNode;
+
+struct DeleteNode
+{
+    DeleteNode *parent;       /* NULL for the toplevel folders */
+    char *path;
+    const char *name;         /* points into path */
+    DIR *dir;                 /* open until the folder is released */
+    gint n_pending;           /* its own listing and the folders inside */
+    gint failed;              /* something inside could not be deleted */
+    int errsv;                /* why it could not be listed */
+};
+
+typedef struct
+{
+    char *path;
+    int errsv;                /* 0 if it was deleted */
+    gboolean skipped;         /* a folder left because of its contents */
+    gboolean toplevel;
+} DeleteResult;
+
+typedef struct
+{
+    GCancellable *cancellable;
+
+    GMutex mutex;
+    GCond cond;
+    GQueue stack;             /* DeleteNodes to list */
+    gboolean finished;
+
+    GCond resume_cond;
+    gint n_errors_pending;    /* errors not answered yet, pausing the threads */
+
+    GAsyncQueue *results;     /* GPtrArrays of DeleteResults */
+    GThread *threads[PARALLEL_DELETE_THREADS];
+    int n_toplevel;           /* only used from the job thread */
+} ParallelDelete;
+
+static void
+delete_result_free (DeleteResult *result)
+{
+    g_free (result->path);
+    g_free (result);
+}
+
+static void
+parallel_delete_add_result (ParallelDelete  *parallel_delete,
+                            GPtrArray      **batch,
+                            char            *path,
+                            int              errsv,
+                            gboolean         skipped,
+                            gboolean         toplevel)
+{
+    DeleteResult *result;
+
+    result = g_new (DeleteResult, 1);
+    result->path = path;
+    result->errsv = errsv;
+    result->skipped = skipped;
+    result->toplevel = toplevel;
+
+    if (*batch == NULL)
+    {
+        *batch = g_ptr_array_new_with_free_func ((GDestroyNotify) delete_result_free);
+    }
+    g_ptr_array_add (*batch, result);
+
+    if (errsv != 0)
+    {
+        /* Stop everyone until the job thread got an answer about it */
+        g_mutex_lock (&parallel_delete->mutex);
+        g_atomic_int_inc (&parallel_delete->n_errors_pending);
+        g_mutex_unlock (&parallel_delete->mutex);
+
+        g_async_queue_push (parallel_delete->results, *batch);
+        *batch = NULL;
+    }
+    else if ((*batch)->len >= PARALLEL_DELETE_BATCH_SIZE)
+    {
+        g_async_queue_push (parallel_delete->results, *batch);
+        *batch = NULL;
+    }
+}
+
+/* Waits while an error is pending, then returns whether to go on deleting */
+static gboolean
+parallel_delete_can_go_on (ParallelDelete *parallel_delete)
+{
+    if (g_atomic_int_get (&parallel_delete->n_errors_pending) > 0)
+    {
+        g_mutex_lock (&parallel_delete->mutex);
+        while (g_atomic_int_get (&parallel_delete->n_errors_pending) > 0)
+        {
+            g_cond_wait (&parallel_delete->resume_cond, &parallel_delete->mutex);
+        }
+        g_mutex_unlock (&parallel_delete->mutex);
+    }
+
+    return !g_cancellable_is_cancelled (parallel_delete->cancellable);
+}
+
+/* Called from the job thread once an error was answered */
+static void
+parallel_delete_resume (ParallelDelete *parallel_delete)
+{
+    g_mutex_lock (&parallel_delete->mutex);
+    if (g_atomic_int_dec_and_test (&parallel_delete->n_errors_pending))
+    {
+        g_cond_broadcast (&parallel_delete->resume_cond);
+    }
+    g_mutex_unlock (&parallel_delete->mutex);
+}
+
+static void
+parallel_delete_push_node (ParallelDelete *parallel_delete,
+                           DeleteNode     *parent,
+                           char           *path)
+{
+    DeleteNode *node;
+
+    node = g_new0 (DeleteNode, 1);
+    node->parent = parent;
+    node->path = path;
+    node->name = strrchr (path, G_DIR_SEPARATOR) + 1;
+    node->n_pending = 1;
+
+    if (parent != NULL)
+    {
+        g_atomic_int_inc (&parent->n_pending);
+    }
+
+    g_mutex_lock (&parallel_delete->mutex);
+    g_queue_push_tail (&parallel_delete->stack, node);
+    g_cond_signal (&parallel_delete->cond);
+    g_mutex_unlock (&parallel_delete->mutex);
+}
+
+/* Drops one of the things @node waits for. Whoever drops the last one
+ * removes the folder, and then does the same for its parent.
+ */
+static void
+parallel_delete_release_node (ParallelDelete  *parallel_delete,
+                              DeleteNode      *node,
+                              GPtrArray      **batch)
+{
+    DeleteNode *parent;
+    gboolean failed;
+    int errsv;
+
+    while (node != NULL && g_atomic_int_dec_and_test (&node->n_pending))
+    {
+        parent = node->parent;
+        failed = g_atomic_int_get (&node->failed);
+        errsv = node->errsv;
+
+        g_clear_pointer (&node->dir, closedir);
+
+        if (errsv == 0 && !failed && !parallel_delete_can_go_on (parallel_delete))
+        {
+            failed = TRUE;
+        }
+
+        if (errsv == 0 && !failed &&
+            unlinkat (parent != NULL ? dirfd (parent->dir) : AT_FDCWD,
+                      parent != NULL ? node->name : node->path,
+                      AT_REMOVEDIR) != 0)
+        {
+            errsv = errno;
+        }
+
+        parallel_delete_add_result (parallel_delete, batch, node->path,
+                                    errsv, errsv == 0 && failed, parent == NULL);
+
+        if (parent != NULL && (errsv != 0 || failed))
+        {
+            g_atomic_int_set (&parent->failed, TRUE);
+        }
+
+        g_free (node);
+        node = parent;
+    }
+}
+
+static void
+parallel_delete_list_node (ParallelDelete  *parallel_delete,
+                           DeleteNode      *node,
+                           GPtrArray      **batch)
+{
+    DIR *dir;
+    struct dirent *entry;
+    struct stat entry_stat;
+    gboolean is_directory;
+    char *path;
+    int dir_fd;
+    int errsv;
+
+    errsv = 0;
+
+    if (!parallel_delete_can_go_on (parallel_delete))
+    {
+        g_atomic_int_set (&node->failed, TRUE);
+        parallel_delete_release_node (parallel_delete, node, batch);
+        return;
+    }
+
+    if (node->parent != NULL)
+    {
+        dir_fd = openat (dirfd (node->parent->dir), node->name,
+                         O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    else
+    {
+        dir_fd = open (node->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    dir = dir_fd >= 0 ? fdopendir (dir_fd) : NULL;
+    if (dir == NULL)
+    {
+        node->errsv = errno;
+        if (dir_fd >= 0)
+        {
+            close (dir_fd);
+        }
+        parallel_delete_release_node (parallel_delete, node, batch);
+        return;
+    }
+
+    /* The folders inside are opened relative to it */
+    node->dir = dir;
+
+    while (parallel_delete_can_go_on (parallel_delete))
+    {
+        errno = 0;
+        entry = readdir (dir);
+        if (entry == NULL)
+        {
+            node->errsv = errno;
+            break;
+        }
+
+        if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        path = g_build_filename (node->path, entry->d_name, NULL);
+
+        is_directory = entry->d_type == DT_DIR;
+        if (!is_directory)
+        {
+            if (unlinkat (dir_fd, entry->d_name, 0) == 0)
+            {
+                parallel_delete_add_result (parallel_delete, batch, path, 0, FALSE, FALSE);
+                continue;
+            }
+
+            errsv = errno;
+            /* Folders give EISDIR on Linux, EPERM elsewhere */
+            is_directory = errsv == EISDIR ||
+                           (errsv == EPERM && entry->d_type == DT_UNKNOWN &&
+                            fstatat (dir_fd, entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) == 0 &&
+                            S_ISDIR (entry_stat.st_mode));
+        }
+
+        if (is_directory)
+        {
+            parallel_delete_push_node (parallel_delete, node, path);
+        }
+        else
+        {
+            g_atomic_int_set (&node->failed, TRUE);
+            parallel_delete_add_result (parallel_delete, batch, path, errsv, FALSE, FALSE);
+        }
+    }
+
+    if (g_cancellable_is_cancelled (parallel_delete->cancellable))
+    {
+        g_atomic_int_set (&node->failed, TRUE);
+    }
+
+    parallel_delete_release_node (parallel_delete, node, batch);
+}
+
+static gpointer
+parallel_delete_thread_func (gpointer user_data)
+{
+    ParallelDelete *parallel_delete;
+    DeleteNode *node;
+    GPtrArray *batch;
+
+    parallel_delete = user_data;
+    batch = NULL;
+
+    g_mutex_lock (&parallel_delete->mutex);
+    while (TRUE)
+    {
+        node = g_queue_pop_tail (&parallel_delete->stack);
+        if (node == NULL)
+        {
+            /* Hand over what was done before waiting for more */
+            if (batch != NULL)
+            {
+                g_async_queue_push (parallel_delete->results, batch);
+                batch = NULL;
+            }
+
+            if (parallel_delete->finished)
+            {
+                break;
+            }
+
+            g_cond_wait (&parallel_delete->cond, &parallel_delete->mutex);
+            continue;
+        }
+        g_mutex_unlock (&parallel_delete->mutex);
+
+        parallel_delete_list_node (parallel_delete, node, &batch);
+
+        g_mutex_lock (&parallel_delete->mutex);
+    }
+    g_mutex_unlock (&parallel_delete->mutex);
+
+    return NULL;
+}
+
+static ParallelDelete *
+parallel_delete_new (CommonJob *job)
+{
+    ParallelDelete *parallel_delete;
+    int i;
+
+    parallel_delete = g_new0 (ParallelDelete, 1);
+    parallel_delete->cancellable = g_object_ref (job->cancellable);
+    g_mutex_init (&parallel_delete->mutex);
+    g_cond_init (&parallel_delete->cond);
+    g_cond_init (&parallel_delete->resume_cond);
+    g_queue_init (&parallel_delete->stack);
+    parallel_delete->results = g_async_queue_new ();
+
+    for (i = 0; i < PARALLEL_DELETE_THREADS; i++)
+    {
+        parallel_delete->threads[i] = g_thread_new ("nautilus-delete",
+                                                    parallel_delete_thread_func,
+                                                    parallel_delete);
+    }
+
+    return parallel_delete;
+}
+
+static void
+parallel_delete_handle_batch (ParallelDelete *parallel_delete,
+                              GPtrArray      *batch,
+                              DeleteData     *data,
+                              int            *files_skipped)
+{
+    DeleteResult *result;
+    GError *error;
+    char *display_name;
+    guint i;
+
+    for (i = 0; i < batch->len; i++)
+    {
+        g_autoptr (GFile) file = NULL;
+
+        result = g_ptr_array_index (batch, i);
+
+        if (result->toplevel)
+        {
+            parallel_delete->n_toplevel--;
+            if (result->errsv != 0 || result->skipped)
+            {
+                (*files_skipped)++;
+            }
+        }
+
+        if (result->skipped)
+        {
+            /* Whatever kept it was reported already */
+            data->transfer_info->num_files++;
+            continue;
+        }
+
+        file = g_file_new_for_path (result->path);
+        error = NULL;
+        if (result->errsv != 0)
+        {
+            display_name = g_filename_display_name (result->path);
+            error = g_error_new (G_IO_ERROR, g_io_error_from_errno (result->errsv),
+                                 _("Error removing file %s: %s"),
+                                 display_name, g_strerror (result->errsv));
+            g_free (display_name);
+        }
+
+        file_deleted_callback (file, error, data);
+
+        if (error != NULL)
+        {
+            /* Answered, or skipped without asking */
+            parallel_delete_resume (parallel_delete);
+        }
+
+        g_clear_error (&error);
+    }
+
+    g_ptr_array_unref (batch);
+}
+
+/* Waits for every toplevel folder to be done with, reporting the deleted
+ * files and asking about the errors as they come.
+ */
+static void
+parallel_delete_finish (ParallelDelete *parallel_delete,
+                        DeleteData     *data,
+                        int            *files_skipped)
+{
+    GPtrArray *batch;
+    int i;
+
+    while (parallel_delete->n_toplevel > 0)
+    {
+        batch = g_async_queue_pop (parallel_delete->results);
+        parallel_delete_handle_batch (parallel_delete, batch, data, files_skipped);
+    }
+
+    g_mutex_lock (&parallel_delete->mutex);
+    parallel_delete->finished = TRUE;
+    g_cond_broadcast (&parallel_delete->cond);
+    g_mutex_unlock (&parallel_delete->mutex);
+
+    for (i = 0; i < PARALLEL_DELETE_THREADS; i++)
+    {
+        g_thread_join (parallel_delete->threads[i]);
+    }
+
+    /* Threads may still have been holding on to some results */
+    while ((batch = g_async_queue_try_pop (parallel_delete->results)) != NULL)
+    {
+        parallel_delete_handle_batch (parallel_delete, batch, data, files_skipped);
+    }
+
+    g_async_queue_unref (parallel_delete->results);
+    g_mutex_clear (&parallel_delete->mutex);
+    g_cond_clear (&parallel_delete->cond);
+    g_cond_clear (&parallel_delete->resume_cond);
+    g_object_unref (parallel_delete->cancellable);
+    g_free (parallel_delete);
+}
+
 static void
 delete_files (CommonJob *job,
               GList     *files,
@@ -1948,6 +2466,7 @@ delete_files (CommonJob *job,
     SourceInfo source_info;
     TransferInfo transfer_info;
     DeleteData data;
+    ParallelDelete *parallel_delete;
 
     if (job_aborted (job))
     {
@@ -1972,11 +2491,14 @@ delete_files (CommonJob *job,
     data.source_info = &source_info;
     data.transfer_info = &transfer_info;
 
+    parallel_delete = NULL;
+
     for (l = files;
          l != NULL && !job_aborted (job);
          l = l->next)
     {
         gboolean success;
+        g_autoptr (GError) error = NULL;
 
         file = l->data;
 
@@ -1986,15 +2508,39 @@ delete_files (CommonJob *job,
             continue;
         }
 
-        success = delete_file_recursively (file, job->cancellable,
-                                           file_deleted_callback,
-                                           &data);
+        if (g_file_is_native (file))
+        {
+            success = g_file_delete (file, job->cancellable, &error);
+            if (!success && IS_IO_ERROR (error, NOT_EMPTY))
+            {
+                if (parallel_delete == NULL)
+                {
+                    parallel_delete = parallel_delete_new (job);
+                }
+                parallel_delete->n_toplevel++;
+                parallel_delete_push_node (parallel_delete, NULL, g_file_get_path (file));
+                continue;
+            }
+
+            file_deleted_callback (file, error, &data);
+        }
+        else
+        {
+            success = delete_file_recursively (file, job->cancellable,
+                                               file_deleted_callback,
+                                               &data);
+        }
 
         if (!success)
         {
             (*files_skipped)++;
         }
     }
+
+    if (parallel_delete != NULL)
+    {
+        parallel_delete_finish (parallel_delete, &data, files_skipped);
+    }
 }
 
 #pragma GCC diagnostic push
@@ -3045,12 +3591,12 @@ report_preparing_count_progress (CommonJob  *job,
 }
 
 static void
-count_file (GFileInfo  *info,
+count_file (goffset     size,
             CommonJob  *job,
             SourceInfo *source_info)
 {
     source_info->num_files += 1;
-    source_info->num_bytes += g_file_info_get_size (info);
+    source_info->num_bytes += size;
 
     if (source_info->num_files_since_progress++ > 100)
     {
@@ -3090,63 +3636,303 @@ get_scan_primary (OpKind kind)
     }
 }
 
-static void
-scan_dir (GFile      *dir,
-          SourceInfo *source_info,
-          CommonJob  *job,
-          GQueue     *dirs,
-          GHashTable *scanned)
+static guint
+scanned_inode_hash (gconstpointer key)
 {
-    GFileInfo *info;
-    GError *error;
-    GFile *subdir;
-    GFileEnumerator *enumerator;
-    char *primary, *secondary, *details;
-    int response;
-    SourceInfo saved_info;
+    const ScannedInode *inode = key;
 
-    saved_info = *source_info;
+    return (guint) inode->inode ^ (guint) (inode->inode >> 32) ^ inode->device;
+}
+
+static gboolean
+scanned_inode_equal (gconstpointer a,
+                     gconstpointer b)
+{
+    const ScannedInode *inode_a = a;
+    const ScannedInode *inode_b = b;
+
+    return inode_a->inode == inode_b->inode &&
+           inode_a->device == inode_b->device;
+}
+
+static void
+scanned_inode_add (ScanState          *state,
+                   const ScannedInode *inode)
+{
+    ScannedInode *copy;
+
+    copy = g_new (ScannedInode, 1);
+    *copy = *inode;
+    g_hash_table_add (state->inodes, copy);
+}
+
+static void
+scanned_listing_add (GPtrArray   *listing,
+                     const char  *name,
+                     GFileType    type)
+{
+    ScannedEntry *entry;
+    gsize length;
+
+    length = strlen (name);
+    entry = g_malloc (sizeof (ScannedEntry) + length);
+    entry->type = type;
+    memcpy (entry->name, name, length + 1);
+
+    g_ptr_array_add (listing, entry);
+}
+
+static GFileType
+file_type_from_mode (mode_t mode)
+{
+    if (S_ISDIR (mode))
+    {
+        return G_FILE_TYPE_DIRECTORY;
+    }
+    else if (S_ISREG (mode))
+    {
+        return G_FILE_TYPE_REGULAR;
+    }
+    else if (S_ISLNK (mode))
+    {
+        return G_FILE_TYPE_SYMBOLIC_LINK;
+    }
+
+    return G_FILE_TYPE_SPECIAL;
+}
+
+/* Lists a local folder relative to its descriptor, so no GFile or URI is
+ * made for the files in it. Files already seen are recognized by their
+ * inode, which only needs to be remembered for the folders.
+ *
+ * Returns FALSE if the folder could not be opened.
+ */
+static gboolean
+scan_dir_native (GFile      *dir,
+                 const char *path,
+                 SourceInfo *source_info,
+                 CommonJob  *job,
+                 GQueue     *dirs,
+                 ScanState  *state,
+                 GPtrArray  *listing,
+                 GError    **error)
+{
+    DIR *dir_stream;
+    struct dirent *entry;
+    struct stat entry_stat;
+    ScannedInode inode;
+    g_autofree char *display_name = NULL;
+    int dir_fd;
+    int errsv;
+
+    dir_fd = open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    dir_stream = dir_fd >= 0 ? fdopendir (dir_fd) : NULL;
+    if (dir_stream == NULL)
+    {
+        errsv = errno;
+        if (dir_fd >= 0)
+        {
+            close (dir_fd);
+        }
+
+        display_name = g_filename_display_name (path);
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                     _("Error opening directory “%s”: %s"),
+                     display_name, g_strerror (errsv));
+        return FALSE;
+    }
+
+    while (TRUE)
+    {
+        if (g_cancellable_set_error_if_cancelled (job->cancellable, error))
+        {
+            break;
+        }
+
+        errno = 0;
+        entry = readdir (dir_stream);
+        if (entry == NULL)
+        {
+            errsv = errno;
+            if (errsv != 0)
+            {
+                display_name = g_filename_display_name (path);
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                             _("Error reading directory “%s”: %s"),
+                             display_name, g_strerror (errsv));
+            }
+            break;
+        }
+
+        if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        if (fstatat (dir_fd, entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+            /* Gone already, or not ours to look at; the operation itself
+             * will tell which.
+             */
+            count_file (0, job, source_info);
+            if (listing != NULL)
+            {
+                scanned_listing_add (listing, entry->d_name, G_FILE_TYPE_UNKNOWN);
+            }
+            continue;
+        }
+
+        /* Copying the folder needs all of it, even what was counted already */
+        if (listing != NULL)
+        {
+            scanned_listing_add (listing, entry->d_name, file_type_from_mode (entry_stat.st_mode));
+        }
+
+        inode.device = (guint32) entry_stat.st_dev;
+        inode.inode = entry_stat.st_ino;
+
+        if (S_ISDIR (entry_stat.st_mode))
+        {
+            if (g_hash_table_contains (state->inodes, &inode))
+            {
+                continue;
+            }
+            scanned_inode_add (state, &inode);
+
+            /* Push to head, since we want depth-first */
+            g_queue_push_head (dirs, g_file_get_child (dir, entry->d_name));
+        }
+        else if (g_hash_table_contains (state->inodes, &inode))
+        {
+            /* Also passed as a toplevel file */
+            continue;
+        }
+
+        count_file (entry_stat.st_size, job, source_info);
+    }
+
+    closedir (dir_stream);
+
+    return TRUE;
+}
+
+/* Returns FALSE if @dir could not be opened */
+static gboolean
+scan_dir_enumerate (GFile      *dir,
+                    SourceInfo *source_info,
+                    CommonJob  *job,
+                    GQueue     *dirs,
+                    ScanState  *state,
+                    GPtrArray  *listing,
+                    GError    **error)
+{
+    GFileInfo *info;
+    GFile *subdir;
+    GFileEnumerator *enumerator;
 
-retry:
-    error = NULL;
     enumerator = g_file_enumerate_children (dir,
                                             G_FILE_ATTRIBUTE_STANDARD_NAME ","
                                             G_FILE_ATTRIBUTE_STANDARD_TYPE ","
                                             G_FILE_ATTRIBUTE_STANDARD_SIZE,
                                             G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                             job->cancellable,
-                                            &error);
-    if (enumerator)
+                                            error);
+    if (enumerator == NULL)
     {
-        error = NULL;
-        while ((info = g_file_enumerator_next_file (enumerator, job->cancellable, &error)) != NULL)
+        return FALSE;
+    }
+
+    while ((info = g_file_enumerator_next_file (enumerator, job->cancellable, error)) != NULL)
+    {
+        g_autoptr (GFile) file = NULL;
+        g_autofree char *file_uri = NULL;
+
+        file = g_file_enumerator_get_child (enumerator, info);
+        file_uri = g_file_get_uri (file);
+
+        /* Copying the folder needs all of it, even what was counted already */
+        if (listing != NULL)
+        {
+            scanned_listing_add (listing, g_file_info_get_name (info),
+                                 g_file_info_get_file_type (info));
+        }
+
+        if (!g_hash_table_contains (state->uris, file_uri))
         {
-            g_autoptr (GFile) file = NULL;
-            g_autofree char *file_uri = NULL;
+            g_hash_table_add (state->uris, g_strdup (file_uri));
 
-            file = g_file_enumerator_get_child (enumerator, info);
-            file_uri = g_file_get_uri (file);
+            count_file (g_file_info_get_size (info), job, source_info);
 
-            if (!g_hash_table_contains (scanned, file_uri))
+            if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
             {
-                g_hash_table_add (scanned, g_strdup (file_uri));
+                subdir = g_file_get_child (dir,
+                                           g_file_info_get_name (info));
 
-                count_file (info, job, source_info);
+                /* Push to head, since we want depth-first */
+                g_queue_push_head (dirs, subdir);
+            }
+        }
+        g_object_unref (info);
+    }
+    g_file_enumerator_close (enumerator, job->cancellable, NULL);
+    g_object_unref (enumerator);
 
-                if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
-                {
-                    subdir = g_file_get_child (dir,
-                                               g_file_info_get_name (info));
+    return TRUE;
+}
 
-                    /* Push to head, since we want depth-first */
-                    g_queue_push_head (dirs, subdir);
-                }
-            }
-            g_object_unref (info);
+static void
+scan_dir (GFile      *dir,
+          SourceInfo *source_info,
+          CommonJob  *job,
+          GQueue     *dirs,
+          ScanState  *state)
+{
+    GError *error;
+    GPtrArray *listing;
+    g_autofree char *path = NULL;
+    char *primary, *secondary, *details;
+    int response;
+    gboolean opened;
+    SourceInfo saved_info;
+
+    saved_info = *source_info;
+
+    if (g_file_is_native (dir))
+    {
+        path = g_file_get_path (dir);
+    }
+
+retry:
+    error = NULL;
+    listing = NULL;
+    if (source_info->listings != NULL)
+    {
+        listing = g_ptr_array_new_with_free_func (g_free);
+    }
+
+    if (path != NULL)
+    {
+        opened = scan_dir_native (dir, path, source_info, job, dirs, state, listing, &error);
+    }
+    else
+    {
+        opened = scan_dir_enumerate (dir, source_info, job, dirs, state, listing, &error);
+    }
+
+    if (listing != NULL)
+    {
+        if (opened && error == NULL)
+        {
+            g_hash_table_insert (source_info->listings, g_object_ref (dir), listing);
         }
-        g_file_enumerator_close (enumerator, job->cancellable, NULL);
-        g_object_unref (enumerator);
+        else
+        {
+            g_ptr_array_unref (listing);
+        }
+    }
 
+    if (opened)
+    {
         if (error && IS_IO_ERROR (error, CANCELLED))
         {
             g_error_free (error);
@@ -3265,11 +4051,66 @@ retry:
     }
 }
 
+/* Returns FALSE if the toplevel @file was counted already */
+static gboolean
+scan_state_add_toplevel (ScanState *state,
+                         GFile     *file,
+                         GFileInfo *info)
+{
+    ScannedInode inode;
+    g_autoptr (GFile) parent = NULL;
+    g_autofree char *parent_path = NULL;
+    g_autofree char *uri = NULL;
+    struct stat parent_stat;
+
+    if (g_file_is_native (file) &&
+        g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_INODE))
+    {
+        inode.device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+        inode.inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+        if (g_hash_table_contains (state->inodes, &inode))
+        {
+            return FALSE;
+        }
+
+        /* Only folders are remembered while scanning, so a file inside a
+         * scanned folder is recognized by its parent.
+         */
+        parent = g_file_get_parent (file);
+        parent_path = parent != NULL ? g_file_get_path (parent) : NULL;
+        if (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY &&
+            parent_path != NULL &&
+            stat (parent_path, &parent_stat) == 0)
+        {
+            ScannedInode parent_inode;
+
+            parent_inode.device = (guint32) parent_stat.st_dev;
+            parent_inode.inode = parent_stat.st_ino;
+            if (g_hash_table_contains (state->inodes, &parent_inode))
+            {
+                return FALSE;
+            }
+        }
+
+        scanned_inode_add (state, &inode);
+        return TRUE;
+    }
+
+    uri = g_file_get_uri (file);
+    if (g_hash_table_contains (state->uris, uri))
+    {
+        return FALSE;
+    }
+    g_hash_table_add (state->uris, g_steal_pointer (&uri));
+
+    return TRUE;
+}
+
 static void
 scan_file (GFile      *file,
            SourceInfo *source_info,
            CommonJob  *job,
-           GHashTable *scanned)
+           ScanState  *state)
 {
     GFileInfo *info;
     GError *error;
@@ -3286,21 +4127,18 @@ retry:
     error = NULL;
     info = g_file_query_info (file,
                               G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-                              G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                              G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                              G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+                              G_FILE_ATTRIBUTE_UNIX_INODE,
                               G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                               job->cancellable,
                               &error);
 
     if (info)
     {
-        g_autofree char *file_uri = NULL;
-
-        file_uri = g_file_get_uri (file);
-        if (!g_hash_table_contains (scanned, file_uri))
+        if (scan_state_add_toplevel (state, file, info))
         {
-            g_hash_table_add (scanned, g_strdup (file_uri));
-
-            count_file (info, job, source_info);
+            count_file (g_file_info_get_size (info), job, source_info);
 
             /* trashing operation doesn't recurse */
             if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY &&
@@ -3377,7 +4215,7 @@ retry:
     while (!job_aborted (job) &&
            (dir = g_queue_pop_head (dirs)) != NULL)
     {
-        scan_dir (dir, source_info, job, dirs, scanned);
+        scan_dir (dir, source_info, job, dirs, state);
         g_object_unref (dir);
     }
 
@@ -3394,15 +4232,28 @@ scan_sources (GList      *files,
 {
     GList *l;
     GFile *file;
-    g_autoptr (GHashTable) scanned = NULL;
+    ScanState state;
 
     memset (source_info, 0, sizeof (SourceInfo));
     source_info->op = kind;
 
-    scanned = g_hash_table_new_full (g_str_hash,
-                                     g_str_equal,
-                                     (GDestroyNotify) g_free,
-                                     NULL);
+    /* Copies go through the folders again right away */
+    if (kind == OP_KIND_COPY)
+    {
+        source_info->listings = g_hash_table_new_full (g_file_hash,
+                                                       (GEqualFunc) g_file_equal,
+                                                       g_object_unref,
+                                                       (GDestroyNotify) g_ptr_array_unref);
+    }
+
+    state.inodes = g_hash_table_new_full (scanned_inode_hash,
+                                          scanned_inode_equal,
+                                          g_free,
+                                          NULL);
+    state.uris = g_hash_table_new_full (g_str_hash,
+                                        g_str_equal,
+                                        (GDestroyNotify) g_free,
+                                        NULL);
 
     report_preparing_count_progress (job, source_info);
 
@@ -3413,9 +4264,12 @@ scan_sources (GList      *files,
         scan_file (file,
                    source_info,
                    job,
-                   scanned);
+                   &state);
     }
 
+    g_hash_table_unref (state.inodes);
+    g_hash_table_unref (state.uris);
+
     /* Make sure we report the final count */
     report_preparing_count_progress (job, source_info);
 }
@@ -3633,56 +4487,211 @@ retry:
     g_object_unref (fsinfo);
 }
 
+/* Returns INT_MAX until something was transferred */
+static int
+get_transfer_remaining_time (const NautilusProgressTransfer *transfer,
+                             double                         *transfer_rate)
+{
+    *transfer_rate = 0;
+    if (transfer->elapsed > 0)
+    {
+        *transfer_rate = transfer->bytes_done / transfer->elapsed;
+        if (*transfer_rate > 0)
+        {
+            return (transfer->bytes_total - transfer->bytes_done) / *transfer_rate;
+        }
+    }
+
+    return INT_MAX;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-nonliteral"
-static void
-report_copy_progress (CopyMoveJob  *copy_job,
-                      SourceInfo   *source_info,
-                      TransferInfo *transfer_info)
+/* Runs wherever the details are shown, with counters sampled from the job */
+static char *
+get_transfer_details (const NautilusProgressTransfer *transfer)
 {
     int files_left;
-    goffset total_size;
-    double elapsed, transfer_rate;
+    double transfer_rate;
     int remaining_time;
-    guint64 now;
-    CommonJob *job;
-    gboolean is_move;
-    gchar *status;
     char *details;
-    gchar *tmp;
-
-    job = (CommonJob *) copy_job;
-
-    is_move = copy_job->is_move;
 
-    now = g_get_monotonic_time ();
-
-    files_left = source_info->num_files - transfer_info->num_files;
+    files_left = MAX (transfer->files_total - transfer->files_done, 0);
+    remaining_time = get_transfer_remaining_time (transfer, &transfer_rate);
 
-    /* Races and whatnot could cause this to be negative... */
-    if (files_left < 0)
+    if (transfer->elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE &&
+        transfer_rate > 0)
     {
-        files_left = 0;
-    }
+        if (transfer->files_total == 1)
+        {
+            g_autofree gchar *formatted_size_num_bytes = NULL;
+            g_autofree gchar *formatted_size_total_size = NULL;
 
-    /* If the number of files left is 0, we want to update the status without
-     * considering this time, since we want to change the status to completed
-     * and probably we won't get more calls to this function */
-    if (transfer_info->last_report_time != 0 &&
-        ABS ((gint64) (transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC &&
-        files_left > 0)
-    {
-        return;
+            formatted_size_num_bytes = g_format_size (transfer->bytes_done);
+            formatted_size_total_size = g_format_size (transfer->bytes_total);
+            /* To translators: %s will expand to a size like "2 bytes" or "3 MB", so something like "4 kb / 4 MB" */
+            details = g_strdup_printf (_("%s / %s"),
+                                       formatted_size_num_bytes,
+                                       formatted_size_total_size);
+        }
+        else
+        {
+            if (files_left > 0)
+            {
+                /* To translators: %'d is the number of files completed for the operation,
+                 * so it will be something like 2/14. */
+                details = g_strdup_printf (_("%'d / %'d"),
+                                           transfer->files_done + 1,
+                                           transfer->files_total);
+            }
+            else
+            {
+                /* To translators: %'d is the number of files completed for the operation,
+                 * so it will be something like 2/14. */
+                details = g_strdup_printf (_("%'d / %'d"),
+                                           transfer->files_done,
+                                           transfer->files_total);
+            }
+        }
     }
-    transfer_info->last_report_time = now;
-
-    if (files_left != transfer_info->last_reported_files_left ||
-        transfer_info->last_reported_files_left == 0)
+    else
     {
-        /* Avoid changing this unless files_left changed since last time */
-        transfer_info->last_reported_files_left = files_left;
-
-        if (source_info->num_files == 1)
+        if (transfer->files_total == 1)
+        {
+            if (files_left > 0)
+            {
+                g_autofree gchar *formatted_time = NULL;
+                g_autofree gchar *formatted_size_num_bytes = NULL;
+                g_autofree gchar *formatted_size_total_size = NULL;
+                g_autofree gchar *formatted_size_transfer_rate = NULL;
+
+                formatted_time = get_formatted_time (remaining_time);
+                formatted_size_num_bytes = g_format_size (transfer->bytes_done);
+                formatted_size_total_size = g_format_size (transfer->bytes_total);
+                formatted_size_transfer_rate = g_format_size ((goffset) transfer_rate);
+                /* To translators: %s will expand to a size like "2 bytes" or "3 MB", %s to a time duration like
+                 * "2 minutes". So the whole thing will be something like "2 kb / 4 MB -- 2 hours left (4kb/sec)"
+                 *
+                 * The singular/plural form will be used depending on the remaining time (i.e. the %s argument).
+                 */
+                details = g_strdup_printf (ngettext ("%s / %s \xE2\x80\x94 %s left (%s/sec)",
+                                                     "%s / %s \xE2\x80\x94 %s left (%s/sec)",
+                                                     seconds_count_format_time_units (remaining_time)),
+                                           formatted_size_num_bytes,
+                                           formatted_size_total_size,
+                                           formatted_time,
+                                           formatted_size_transfer_rate);
+            }
+            else
+            {
+                g_autofree gchar *formatted_size_num_bytes = NULL;
+                g_autofree gchar *formatted_size_total_size = NULL;
+
+                formatted_size_num_bytes = g_format_size (transfer->bytes_done);
+                formatted_size_total_size = g_format_size (transfer->bytes_total);
+                /* To translators: %s will expand to a size like "2 bytes" or "3 MB". */
+                details = g_strdup_printf (_("%s / %s"),
+                                           formatted_size_num_bytes,
+                                           formatted_size_total_size);
+            }
+        }
+        else
+        {
+            if (files_left > 0)
+            {
+                g_autofree gchar *formatted_time = NULL;
+                g_autofree gchar *formatted_size = NULL;
+                formatted_time = get_formatted_time (remaining_time);
+                formatted_size = g_format_size ((goffset) transfer_rate);
+                /* To translators: %s will expand to a time duration like "2 minutes".
+                 * So the whole thing will be something like "1 / 5 -- 2 hours left (4kb/sec)"
+                 *
+                 * The singular/plural form will be used depending on the remaining time (i.e. the %s argument).
+                 */
+                details = g_strdup_printf (ngettext ("%'d / %'d \xE2\x80\x94 %s left (%s/sec)",
+                                                     "%'d / %'d \xE2\x80\x94 %s left (%s/sec)",
+                                                     seconds_count_format_time_units (remaining_time)),
+                                           transfer->files_done + 1, transfer->files_total,
+                                           formatted_time,
+                                           formatted_size);
+            }
+            else
+            {
+                /* To translators: %'d is the number of files completed for the operation,
+                 * so it will be something like 2/14. */
+                details = g_strdup_printf (_("%'d / %'d"),
+                                           transfer->files_done,
+                                           transfer->files_total);
+            }
+        }
+    }
+
+    return details;
+}
+
+static void
+report_copy_progress (CopyMoveJob  *copy_job,
+                      SourceInfo   *source_info,
+                      TransferInfo *transfer_info)
+{
+    NautilusProgressTransfer transfer;
+    int files_left;
+    double transfer_rate;
+    int remaining_time;
+    guint64 now;
+    CommonJob *job;
+    gboolean is_move;
+    gchar *status;
+    gchar *tmp;
+
+    job = (CommonJob *) copy_job;
+
+    is_move = copy_job->is_move;
+
+    now = g_get_monotonic_time ();
+
+    files_left = source_info->num_files - transfer_info->num_files;
+
+    /* Races and whatnot could cause this to be negative... */
+    if (files_left < 0)
+    {
+        files_left = 0;
+    }
+
+    if (transfer_info->last_report_time == 0)
+    {
+        nautilus_progress_info_set_details_func (job->progress, get_transfer_details);
+    }
+
+    /* This is called for every chunk copied, so only the counters are
+     * updated each time. Building the strings is left to the UI, which
+     * samples the counters when it redraws.
+     */
+    transfer.files_done = transfer_info->num_files;
+    transfer.files_total = source_info->num_files;
+    transfer.bytes_done = transfer_info->num_bytes;
+    transfer.bytes_total = MAX (source_info->num_bytes, transfer_info->num_bytes);
+    transfer.elapsed = g_timer_elapsed (job->time, NULL);
+    nautilus_progress_info_set_transfer (job->progress, &transfer);
+
+    /* If the number of files left is 0, we want to update the status without
+     * considering this time, since we want to change the status to completed
+     * and probably we won't get more calls to this function */
+    if (transfer_info->last_report_time != 0 &&
+        ABS ((gint64) (transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC &&
+        files_left > 0)
+    {
+        return;
+    }
+    transfer_info->last_report_time = now;
+
+    if (files_left != transfer_info->last_reported_files_left ||
+        transfer_info->last_reported_files_left == 0)
+    {
+        /* Avoid changing this unless files_left changed since last time */
+        transfer_info->last_reported_files_left = files_left;
+
+        if (source_info->num_files == 1)
         {
             g_autofree gchar *basename_dest = NULL;
 
@@ -3841,137 +4850,14 @@ report_copy_progress (CopyMoveJob  *copy_job,
         }
     }
 
-    total_size = MAX (source_info->num_bytes, transfer_info->num_bytes);
-
-    elapsed = g_timer_elapsed (job->time, NULL);
-    transfer_rate = 0;
-    remaining_time = INT_MAX;
-    if (elapsed > 0)
-    {
-        transfer_rate = transfer_info->num_bytes / elapsed;
-        if (transfer_rate > 0)
-        {
-            remaining_time = (total_size - transfer_info->num_bytes) / transfer_rate;
-        }
-    }
-
-    if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE &&
-        transfer_rate > 0)
-    {
-        if (source_info->num_files == 1)
-        {
-            g_autofree gchar *formatted_size_num_bytes = NULL;
-            g_autofree gchar *formatted_size_total_size = NULL;
-
-            formatted_size_num_bytes = g_format_size (transfer_info->num_bytes);
-            formatted_size_total_size = g_format_size (total_size);
-            /* To translators: %s will expand to a size like "2 bytes" or "3 MB", so something like "4 kb / 4 MB" */
-            details = g_strdup_printf (_("%s / %s"),
-                                       formatted_size_num_bytes,
-                                       formatted_size_total_size);
-        }
-        else
-        {
-            if (files_left > 0)
-            {
-                /* To translators: %'d is the number of files completed for the operation,
-                 * so it will be something like 2/14. */
-                details = g_strdup_printf (_("%'d / %'d"),
-                                           transfer_info->num_files + 1,
-                                           source_info->num_files);
-            }
-            else
-            {
-                /* To translators: %'d is the number of files completed for the operation,
-                 * so it will be something like 2/14. */
-                details = g_strdup_printf (_("%'d / %'d"),
-                                           transfer_info->num_files,
-                                           source_info->num_files);
-            }
-        }
-    }
-    else
-    {
-        if (source_info->num_files == 1)
-        {
-            if (files_left > 0)
-            {
-                g_autofree gchar *formatted_time = NULL;
-                g_autofree gchar *formatted_size_num_bytes = NULL;
-                g_autofree gchar *formatted_size_total_size = NULL;
-                g_autofree gchar *formatted_size_transfer_rate = NULL;
-
-                formatted_time = get_formatted_time (remaining_time);
-                formatted_size_num_bytes = g_format_size (transfer_info->num_bytes);
-                formatted_size_total_size = g_format_size (total_size);
-                formatted_size_transfer_rate = g_format_size ((goffset) transfer_rate);
-                /* To translators: %s will expand to a size like "2 bytes" or "3 MB", %s to a time duration like
-                 * "2 minutes". So the whole thing will be something like "2 kb / 4 MB -- 2 hours left (4kb/sec)"
-                 *
-                 * The singular/plural form will be used depending on the remaining time (i.e. the %s argument).
-                 */
-                details = g_strdup_printf (ngettext ("%s / %s \xE2\x80\x94 %s left (%s/sec)",
-                                                     "%s / %s \xE2\x80\x94 %s left (%s/sec)",
-                                                     seconds_count_format_time_units (remaining_time)),
-                                           formatted_size_num_bytes,
-                                           formatted_size_total_size,
-                                           formatted_time,
-                                           formatted_size_transfer_rate);
-            }
-            else
-            {
-                g_autofree gchar *formatted_size_num_bytes = NULL;
-                g_autofree gchar *formatted_size_total_size = NULL;
-
-                formatted_size_num_bytes = g_format_size (transfer_info->num_bytes);
-                formatted_size_total_size = g_format_size (total_size);
-                /* To translators: %s will expand to a size like "2 bytes" or "3 MB". */
-                details = g_strdup_printf (_("%s / %s"),
-                                           formatted_size_num_bytes,
-                                           formatted_size_total_size);
-            }
-        }
-        else
-        {
-            if (files_left > 0)
-            {
-                g_autofree gchar *formatted_time = NULL;
-                g_autofree gchar *formatted_size = NULL;
-                formatted_time = get_formatted_time (remaining_time);
-                formatted_size = g_format_size ((goffset) transfer_rate);
-                /* To translators: %s will expand to a time duration like "2 minutes".
-                 * So the whole thing will be something like "1 / 5 -- 2 hours left (4kb/sec)"
-                 *
-                 * The singular/plural form will be used depending on the remaining time (i.e. the %s argument).
-                 */
-                details = g_strdup_printf (ngettext ("%'d / %'d \xE2\x80\x94 %s left (%s/sec)",
-                                                     "%'d / %'d \xE2\x80\x94 %s left (%s/sec)",
-                                                     seconds_count_format_time_units (remaining_time)),
-                                           transfer_info->num_files + 1, source_info->num_files,
-                                           formatted_time,
-                                           formatted_size);
-            }
-            else
-            {
-                /* To translators: %'d is the number of files completed for the operation,
-                 * so it will be something like 2/14. */
-                details = g_strdup_printf (_("%'d / %'d"),
-                                           transfer_info->num_files,
-                                           source_info->num_files);
-            }
-        }
-    }
-    nautilus_progress_info_take_details (job->progress, details);
-
-    if (elapsed > SECONDS_NEEDED_FOR_APROXIMATE_TRANSFER_RATE)
+    if (transfer.elapsed > SECONDS_NEEDED_FOR_APROXIMATE_TRANSFER_RATE)
     {
+        remaining_time = get_transfer_remaining_time (&transfer, &transfer_rate);
         nautilus_progress_info_set_remaining_time (job->progress,
                                                    remaining_time);
         nautilus_progress_info_set_elapsed_time (job->progress,
-                                                 elapsed);
+                                                 transfer.elapsed);
     }
-
-    nautilus_progress_info_set_progress (job->progress, transfer_info->num_bytes, total_size);
 }
 #pragma GCC diagnostic pop
 
@@ -4360,78 +5246,642 @@ map_possibly_volatile_file_to_real (GFile         *volatile_file,
         {
             const gchar *target;
 
-            target = g_file_info_get_symlink_target (info);
-            real_file = g_file_resolve_relative_path (volatile_file, target);
-        }
+            target = g_file_info_get_symlink_target (info);
+            real_file = g_file_resolve_relative_path (volatile_file, target);
+        }
+    }
+
+    g_object_unref (info);
+
+    if (real_file == NULL)
+    {
+        real_file = g_object_ref (volatile_file);
+    }
+
+    return real_file;
+}
+
+static GFile *
+map_possibly_volatile_file_to_real_on_write (GFile              *volatile_file,
+                                             GFileOutputStream  *stream,
+                                             GCancellable       *cancellable,
+                                             GError            **error)
+{
+    GFile *real_file = NULL;
+    GFileInfo *info = NULL;
+
+    info = g_file_output_stream_query_info (stream,
+                                            G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK ","
+                                            G_FILE_ATTRIBUTE_STANDARD_IS_VOLATILE ","
+                                            G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET,
+                                            cancellable,
+                                            error);
+    if (info == NULL)
+    {
+        return NULL;
+    }
+    else
+    {
+        gboolean is_volatile;
+
+        is_volatile = g_file_info_get_attribute_boolean (info,
+                                                         G_FILE_ATTRIBUTE_STANDARD_IS_VOLATILE);
+        if (is_volatile)
+        {
+            const gchar *target;
+
+            target = g_file_info_get_symlink_target (info);
+            real_file = g_file_resolve_relative_path (volatile_file, target);
+        }
+    }
+
+    g_object_unref (info);
+
+    if (real_file == NULL)
+    {
+        real_file = g_object_ref (volatile_file);
+    }
+
+    return real_file;
+}
+
+typedef enum
+{
+    NATIVE_COPY_UNSUPPORTED,
+    NATIVE_COPY_FAILED,
+    NATIVE_COPY_SUCCESS
+} NativeCopyResult;
+
+/* The most copy_file_range() is asked to copy at once, so that progress is
+ * reported and cancellation noticed while copying large files.
+ */
+#define NATIVE_COPY_CHUNK_SIZE (64 * 1024 * 1024)
+
+/* Copies a local regular file without its contents going through user
+ * space: by sharing its blocks where the file system can, and with
+ * copy_file_range() otherwise. Anything else, replacing files included,
+ * is left to g_file_copy().
+ */
+static NativeCopyResult
+copy_file_native (GFile                  *src,
+                  GFile                  *dest,
+                  GFileCopyFlags          flags,
+                  GCancellable           *cancellable,
+                  GFileProgressCallback   progress_callback,
+                  gpointer                progress_callback_data,
+                  GError                **error)
+{
+#if defined (FICLONE) || defined (HAVE_COPY_FILE_RANGE)
+    g_autofree char *src_path = NULL;
+    g_autofree char *dest_path = NULL;
+    struct stat src_stat;
+    int src_fd, dest_fd;
+    int open_flags;
+    mode_t mode;
+    NativeCopyResult result;
+    int errsv;
+#ifdef HAVE_COPY_FILE_RANGE
+    goffset offset;
+#endif
+
+    if ((flags & (G_FILE_COPY_OVERWRITE | G_FILE_COPY_BACKUP)) != 0)
+    {
+        return NATIVE_COPY_UNSUPPORTED;
+    }
+
+    src_path = g_file_get_path (src);
+    dest_path = g_file_get_path (dest);
+    if (src_path == NULL || dest_path == NULL)
+    {
+        return NATIVE_COPY_UNSUPPORTED;
+    }
+
+    open_flags = O_RDONLY | O_CLOEXEC;
+    if (flags & G_FILE_COPY_NOFOLLOW_SYMLINKS)
+    {
+        open_flags |= O_NOFOLLOW;
+    }
+
+    src_fd = open (src_path, open_flags);
+    if (src_fd < 0)
+    {
+        return NATIVE_COPY_UNSUPPORTED;
+    }
+
+    if (fstat (src_fd, &src_stat) != 0 || !S_ISREG (src_stat.st_mode))
+    {
+        close (src_fd);
+        return NATIVE_COPY_UNSUPPORTED;
+    }
+
+    mode = (flags & G_FILE_COPY_TARGET_DEFAULT_PERMS) ? 0666 : src_stat.st_mode & 0777;
+    /* g_file_copy() reports why the file can't be created */
+    dest_fd = open (dest_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+    if (dest_fd < 0)
+    {
+        close (src_fd);
+        return NATIVE_COPY_UNSUPPORTED;
+    }
+
+    result = NATIVE_COPY_UNSUPPORTED;
+    errsv = 0;
+
+#ifdef FICLONE
+    if (ioctl (dest_fd, FICLONE, src_fd) == 0)
+    {
+        result = NATIVE_COPY_SUCCESS;
+        if (progress_callback != NULL)
+        {
+            progress_callback (src_stat.st_size, src_stat.st_size, progress_callback_data);
+        }
+    }
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+    offset = 0;
+    while (result == NATIVE_COPY_UNSUPPORTED)
+    {
+        ssize_t n_copied;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+            result = NATIVE_COPY_FAILED;
+            break;
+        }
+
+        n_copied = copy_file_range (src_fd, NULL, dest_fd, NULL, NATIVE_COPY_CHUNK_SIZE, 0);
+        if (n_copied < 0)
+        {
+            errsv = errno;
+
+            if (errsv == EINTR)
+            {
+                continue;
+            }
+
+            /* Not for these files, nothing was written yet */
+            if (offset == 0 &&
+                (errsv == ENOSYS || errsv == EXDEV || errsv == EINVAL ||
+                 errsv == EOPNOTSUPP || errsv == EBADF || errsv == EPERM))
+            {
+                break;
+            }
+
+            g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                                 g_strerror (errsv));
+            result = NATIVE_COPY_FAILED;
+            break;
+        }
+
+        if (n_copied == 0)
+        {
+            /* Files in procfs or sysfs give nothing through
+             * copy_file_range(), whatever size they claim, so a file
+             * that seems empty is left to g_file_copy().
+             */
+            if (offset == 0)
+            {
+                break;
+            }
+
+            result = NATIVE_COPY_SUCCESS;
+            break;
+        }
+
+        offset += n_copied;
+        if (progress_callback != NULL)
+        {
+            progress_callback (offset, MAX (offset, src_stat.st_size), progress_callback_data);
+        }
+    }
+#endif
+
+    close (src_fd);
+
+    if (result == NATIVE_COPY_SUCCESS && close (dest_fd) != 0)
+    {
+        errsv = errno;
+        g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                             g_strerror (errsv));
+        result = NATIVE_COPY_FAILED;
+    }
+    else if (result != NATIVE_COPY_SUCCESS)
+    {
+        close (dest_fd);
+    }
+
+    if (result != NATIVE_COPY_SUCCESS)
+    {
+        /* The file was created above, so it is ours to remove */
+        unlink (dest_path);
+        return result;
+    }
+
+    /* What g_file_copy() copies along with the contents */
+    g_file_copy_attributes (src, dest, flags, cancellable, NULL);
+
+    return NATIVE_COPY_SUCCESS;
+#else
+    return NATIVE_COPY_UNSUPPORTED;
+#endif
+}
+
+static gboolean
+copy_file (GFile                  *src,
+           GFile                  *dest,
+           GFileCopyFlags          flags,
+           GCancellable           *cancellable,
+           GFileProgressCallback   progress_callback,
+           gpointer                progress_callback_data,
+           GError                **error)
+{
+    switch (copy_file_native (src, dest, flags, cancellable,
+                              progress_callback, progress_callback_data, error))
+    {
+        case NATIVE_COPY_SUCCESS:
+        {
+            return TRUE;
+        }
+
+        case NATIVE_COPY_FAILED:
+        {
+            return FALSE;
+        }
+
+        case NATIVE_COPY_UNSUPPORTED:
+        default:
+        {
+        }
+        break;
+    }
+
+    return g_file_copy (src, dest, flags, cancellable,
+                        progress_callback, progress_callback_data, error);
+}
+
+static void copy_move_file (CopyMoveJob  *job,
+                            GFile        *src,
+                            GFile        *dest_dir,
+                            gboolean      same_fs,
+                            gboolean      unique_names,
+                            char        **dest_fs_type,
+                            SourceInfo   *source_info,
+                            TransferInfo *transfer_info,
+                            GHashTable   *debuting_files,
+                            GdkPoint     *point,
+                            gboolean      overwrite,
+                            gboolean     *skipped_file,
+                            gboolean      readonly_source_fs);
+
+/* How long the job thread waits for a copy to finish before it updates
+ * the progress with what was copied so far.
+ */
+#define PARALLEL_COPY_WAIT_USEC (100 * 1000)
+
+typedef struct
+{
+    ParallelCopy *parallel_copy;
+    GCancellable *cancellable;
+    GFile *src;
+    GFile *dest_dir;
+    GFile *dest;
+    char *dest_fs_type;
+    gboolean same_fs;
+    GFileCopyFlags flags;
+    gboolean readonly_source_fs;
+    gboolean debuting;
+
+    goffset num_bytes;
+    GError *error;
+} ParallelCopyTask;
+
+typedef struct
+{
+    GFile *src;
+    GFile *dest;
+    GFileCopyFlags flags;
+} ParallelCopyDirectory;
+
+static void
+parallel_copy_task_free (ParallelCopyTask *task)
+{
+    g_object_unref (task->cancellable);
+    g_object_unref (task->src);
+    g_object_unref (task->dest_dir);
+    g_object_unref (task->dest);
+    g_free (task->dest_fs_type);
+    g_clear_error (&task->error);
+    g_free (task);
+}
+
+static void
+parallel_copy_directory_free (ParallelCopyDirectory *directory)
+{
+    g_object_unref (directory->src);
+    g_object_unref (directory->dest);
+    g_free (directory);
+}
+
+static void
+parallel_copy_progress_callback (goffset  current_num_bytes,
+                                 goffset  total_num_bytes,
+                                 gpointer user_data)
+{
+    ParallelCopyTask *task;
+    goffset new_size;
+
+    task = user_data;
+
+    new_size = current_num_bytes - task->num_bytes;
+
+    if (new_size > 0)
+    {
+        g_mutex_lock (&task->parallel_copy->mutex);
+        task->parallel_copy->num_bytes += new_size;
+        g_mutex_unlock (&task->parallel_copy->mutex);
+        task->num_bytes = current_num_bytes;
+    }
+}
+
+/* Runs on the pool */
+static void
+parallel_copy_thread_func (gpointer data,
+                           gpointer user_data)
+{
+    ParallelCopyTask *task;
+    GFile *real;
+    gboolean dest_existed;
+
+    task = data;
+
+    /* Copies never overwrite, so whatever is left at the destination after a
+     * failure is what this copy wrote, unless something was there before.
+     */
+    dest_existed = g_file_query_file_type (task->dest,
+                                           G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                           NULL) != G_FILE_TYPE_UNKNOWN;
+
+    if (copy_file (task->src, task->dest,
+                   task->flags,
+                   task->cancellable,
+                   parallel_copy_progress_callback,
+                   task,
+                   &task->error))
+    {
+        real = map_possibly_volatile_file_to_real (task->dest, task->cancellable, &task->error);
+        if (real != NULL)
+        {
+            g_object_unref (task->dest);
+            task->dest = real;
+        }
+    }
+    else if (!dest_existed && !IS_IO_ERROR (task->error, EXISTS))
+    {
+        /* Remove the partial copy, so the retry on the job thread reports
+         * the error itself instead of a conflict with it.
+         */
+        g_file_delete (task->dest, NULL, NULL);
+    }
+
+    g_async_queue_push (task->parallel_copy->results, task);
+}
+
+static ParallelCopy *
+parallel_copy_new (void)
+{
+    ParallelCopy *parallel_copy;
+    int n_threads;
+
+    n_threads = g_settings_get_int (nautilus_preferences,
+                                    NAUTILUS_PREFERENCES_PARALLEL_COPIES);
+    if (n_threads <= 1)
+    {
+        return NULL;
+    }
+
+    parallel_copy = g_new0 (ParallelCopy, 1);
+    parallel_copy->pool = g_thread_pool_new (parallel_copy_thread_func, parallel_copy,
+                                             n_threads, FALSE, NULL);
+    parallel_copy->results = g_async_queue_new ();
+    /* Keep the pool busy while the job thread reads the next folder */
+    parallel_copy->max_pending = n_threads * 2;
+    g_mutex_init (&parallel_copy->mutex);
+
+    return parallel_copy;
+}
+
+/* Called on the job thread with a copy the pool is done with. Failed copies
+ * are done again the usual way, so that conflicts and errors are handled,
+ * and asked about, one at a time.
+ */
+static void
+parallel_copy_task_done (CopyMoveJob      *copy_job,
+                         ParallelCopyTask *task,
+                         SourceInfo       *source_info,
+                         TransferInfo     *transfer_info)
+{
+    CommonJob *job;
+    char *dest_fs_type;
+    gboolean skipped_file;
+
+    job = (CommonJob *) copy_job;
+
+    if (task->error == NULL)
+    {
+        transfer_info->num_files++;
+        nautilus_file_changes_queue_file_added (task->dest);
+
+        if (task->debuting)
+        {
+            g_hash_table_replace (copy_job->debuting_files,
+                                  g_object_ref (task->dest), GINT_TO_POINTER (TRUE));
+        }
+
+        if (job->undo_info != NULL)
+        {
+            nautilus_file_undo_info_ext_add_origin_target_pair (NAUTILUS_FILE_UNDO_INFO_EXT (job->undo_info),
+                                                                task->src, task->dest);
+        }
+    }
+    else if (!IS_IO_ERROR (task->error, CANCELLED) && !job_aborted (job))
+    {
+        /* The copy counts its bytes again */
+        transfer_info->num_bytes -= task->num_bytes;
+
+        dest_fs_type = g_strdup (task->dest_fs_type);
+        copy_move_file (copy_job, task->src, task->dest_dir, task->same_fs, FALSE,
+                        &dest_fs_type, source_info, transfer_info,
+                        task->debuting ? copy_job->debuting_files : NULL,
+                        NULL, FALSE, &skipped_file, task->readonly_source_fs);
+        g_free (dest_fs_type);
+
+        if (skipped_file)
+        {
+            source_info_remove_file_from_count (task->src, job, source_info);
+        }
+    }
+
+    parallel_copy_task_free (task);
+}
+
+/* Handles the copies that are done, waiting for one first if @wait is set */
+static void
+parallel_copy_collect (CopyMoveJob  *copy_job,
+                       SourceInfo   *source_info,
+                       TransferInfo *transfer_info,
+                       gboolean      wait)
+{
+    ParallelCopy *parallel_copy;
+    ParallelCopyTask *task;
+    GList *done, *l;
+
+    parallel_copy = copy_job->parallel_copy;
+
+    done = NULL;
+    if (wait)
+    {
+        task = g_async_queue_timeout_pop (parallel_copy->results, PARALLEL_COPY_WAIT_USEC);
+    }
+    else
+    {
+        task = g_async_queue_try_pop (parallel_copy->results);
+    }
+    while (task != NULL)
+    {
+        done = g_list_prepend (done, task);
+        parallel_copy->n_pending--;
+        task = g_async_queue_try_pop (parallel_copy->results);
+    }
+
+    /* The bytes of the copies that are done are all in by now */
+    g_mutex_lock (&parallel_copy->mutex);
+    transfer_info->num_bytes += parallel_copy->num_bytes;
+    parallel_copy->num_bytes = 0;
+    g_mutex_unlock (&parallel_copy->mutex);
+
+    done = g_list_reverse (done);
+    for (l = done; l != NULL; l = l->next)
+    {
+        parallel_copy_task_done (copy_job, l->data, source_info, transfer_info);
+    }
+    g_list_free (done);
+
+    report_copy_progress (copy_job, source_info, transfer_info);
+}
+
+/* Queues a copy of the regular file @src. Set @debuting for the files the
+ * user picked, so they are selected once they are there.
+ */
+static void
+parallel_copy_file (CopyMoveJob   *copy_job,
+                    GFile         *src,
+                    GFile         *dest_dir,
+                    gboolean       same_fs,
+                    const char    *dest_fs_type,
+                    SourceInfo    *source_info,
+                    TransferInfo  *transfer_info,
+                    gboolean       debuting,
+                    gboolean      *skipped_file,
+                    gboolean       readonly_source_fs)
+{
+    ParallelCopy *parallel_copy;
+    ParallelCopyTask *task;
+    CommonJob *job;
+
+    job = (CommonJob *) copy_job;
+    parallel_copy = copy_job->parallel_copy;
+
+    *skipped_file = FALSE;
+
+    if (should_skip_file (job, src))
+    {
+        *skipped_file = TRUE;
+        return;
     }
 
-    g_object_unref (info);
+    while (parallel_copy->n_pending >= parallel_copy->max_pending)
+    {
+        parallel_copy_collect (copy_job, source_info, transfer_info, TRUE);
+    }
 
-    if (real_file == NULL)
+    task = g_new0 (ParallelCopyTask, 1);
+    task->parallel_copy = parallel_copy;
+    task->cancellable = g_object_ref (job->cancellable);
+    task->src = g_object_ref (src);
+    task->dest_dir = g_object_ref (dest_dir);
+    task->dest = get_target_file (src, dest_dir, dest_fs_type, same_fs);
+    task->dest_fs_type = g_strdup (dest_fs_type);
+    task->same_fs = same_fs;
+    task->readonly_source_fs = readonly_source_fs;
+    task->debuting = debuting;
+    task->flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+    if (readonly_source_fs)
     {
-        real_file = g_object_ref (volatile_file);
+        task->flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
     }
 
-    return real_file;
+    parallel_copy->n_pending++;
+    g_thread_pool_push (parallel_copy->pool, task, NULL);
+
+    parallel_copy_collect (copy_job, source_info, transfer_info, FALSE);
 }
 
-static GFile *
-map_possibly_volatile_file_to_real_on_write (GFile              *volatile_file,
-                                             GFileOutputStream  *stream,
-                                             GCancellable       *cancellable,
-                                             GError            **error)
+/* Copying the attributes of a folder has to wait until nothing is written
+ * into it anymore, or its modification time would change again.
+ */
+static void
+parallel_copy_add_directory (ParallelCopy   *parallel_copy,
+                             GFile          *src,
+                             GFile          *dest,
+                             GFileCopyFlags  flags)
 {
-    GFile *real_file = NULL;
-    GFileInfo *info = NULL;
+    ParallelCopyDirectory *directory;
 
-    info = g_file_output_stream_query_info (stream,
-                                            G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK ","
-                                            G_FILE_ATTRIBUTE_STANDARD_IS_VOLATILE ","
-                                            G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET,
-                                            cancellable,
-                                            error);
-    if (info == NULL)
-    {
-        return NULL;
-    }
-    else
-    {
-        gboolean is_volatile;
+    directory = g_new0 (ParallelCopyDirectory, 1);
+    directory->src = g_object_ref (src);
+    directory->dest = g_object_ref (dest);
+    directory->flags = flags;
 
-        is_volatile = g_file_info_get_attribute_boolean (info,
-                                                         G_FILE_ATTRIBUTE_STANDARD_IS_VOLATILE);
-        if (is_volatile)
-        {
-            const gchar *target;
+    parallel_copy->directories = g_list_prepend (parallel_copy->directories, directory);
+}
 
-            target = g_file_info_get_symlink_target (info);
-            real_file = g_file_resolve_relative_path (volatile_file, target);
-        }
-    }
+static void
+parallel_copy_finish (CopyMoveJob  *copy_job,
+                      SourceInfo   *source_info,
+                      TransferInfo *transfer_info)
+{
+    ParallelCopy *parallel_copy;
+    ParallelCopyDirectory *directory;
+    CommonJob *job;
+    GList *l;
 
-    g_object_unref (info);
+    job = (CommonJob *) copy_job;
+    parallel_copy = copy_job->parallel_copy;
 
-    if (real_file == NULL)
+    while (parallel_copy->n_pending > 0)
     {
-        real_file = g_object_ref (volatile_file);
+        parallel_copy_collect (copy_job, source_info, transfer_info, TRUE);
     }
 
-    return real_file;
-}
+    /* Inner folders first, as they were finished */
+    parallel_copy->directories = g_list_reverse (parallel_copy->directories);
+    for (l = parallel_copy->directories; l != NULL; l = l->next)
+    {
+        directory = l->data;
+        /* Ignore errors here. Failure to copy metadata is not a hard error */
+        g_file_copy_attributes (directory->src, directory->dest,
+                                directory->flags,
+                                job->cancellable, NULL);
+    }
 
-static void copy_move_file (CopyMoveJob  *job,
-                            GFile        *src,
-                            GFile        *dest_dir,
-                            gboolean      same_fs,
-                            gboolean      unique_names,
-                            char        **dest_fs_type,
-                            SourceInfo   *source_info,
-                            TransferInfo *transfer_info,
-                            GHashTable   *debuting_files,
-                            GdkPoint     *point,
-                            gboolean      overwrite,
-                            gboolean     *skipped_file,
-                            gboolean      readonly_source_fs);
+    copy_job->parallel_copy = NULL;
+
+    g_thread_pool_free (parallel_copy->pool, FALSE, TRUE);
+    g_async_queue_unref (parallel_copy->results);
+    g_mutex_clear (&parallel_copy->mutex);
+    g_list_free_full (parallel_copy->directories, (GDestroyNotify) parallel_copy_directory_free);
+    g_free (parallel_copy);
+}
 
 typedef enum
 {
@@ -4574,6 +6024,45 @@ retry:
     return CREATE_DEST_DIR_SUCCESS;
 }
 
+static void
+copy_move_directory_child (CopyMoveJob   *copy_job,
+                           GFile         *src,
+                           const char    *name,
+                           GFileType      type,
+                           GFile         *dest,
+                           gboolean       same_fs,
+                           gboolean       parallel,
+                           char         **dest_fs_type,
+                           SourceInfo    *source_info,
+                           TransferInfo  *transfer_info,
+                           gboolean      *skipped_file,
+                           gboolean       readonly_source_fs)
+{
+    GFile *src_file;
+
+    src_file = g_file_get_child (src, name);
+    if (parallel && type == G_FILE_TYPE_REGULAR)
+    {
+        parallel_copy_file (copy_job, src_file, dest, same_fs, *dest_fs_type,
+                            source_info, transfer_info, FALSE, skipped_file,
+                            readonly_source_fs);
+    }
+    else
+    {
+        copy_move_file (copy_job, src_file, dest, same_fs, FALSE, dest_fs_type,
+                        source_info, transfer_info, NULL, NULL, FALSE, skipped_file,
+                        readonly_source_fs);
+    }
+
+    if (*skipped_file)
+    {
+        source_info_remove_file_from_count (src_file, (CommonJob *) copy_job, source_info);
+        report_copy_progress (copy_job, source_info, transfer_info);
+    }
+
+    g_object_unref (src_file);
+}
+
 /* a return value of FALSE means retry, i.e.
  * the destination has changed and the source
  * is expected to re-try the preceding
@@ -4595,15 +6084,18 @@ copy_move_directory (CopyMoveJob   *copy_job,
 {
     GFileInfo *info;
     GError *error;
-    GFile *src_file;
     GFileEnumerator *enumerator;
+    GPtrArray *listing;
+    ScannedEntry *entry;
     char *primary, *secondary, *details;
     char *dest_fs_type;
     int response;
     gboolean skip_error;
     gboolean local_skipped_file;
+    gboolean parallel;
     CommonJob *job;
     GFileCopyFlags flags;
+    guint i;
 
     job = (CommonJob *) copy_job;
 
@@ -4642,38 +6134,73 @@ copy_move_directory (CopyMoveJob   *copy_job,
     local_skipped_file = FALSE;
     dest_fs_type = NULL;
 
+    /* What scanning found is used once, as the folder may change after */
+    listing = NULL;
+    if (source_info->listings != NULL &&
+        g_hash_table_lookup_extended (source_info->listings, src, NULL, (gpointer *) &listing))
+    {
+        g_ptr_array_ref (listing);
+        g_hash_table_remove (source_info->listings, src);
+    }
+
     skip_error = should_skip_readdir_error (job, src);
 retry:
     error = NULL;
-    enumerator = g_file_enumerate_children (src,
-                                            G_FILE_ATTRIBUTE_STANDARD_NAME,
-                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                            job->cancellable,
-                                            &error);
-    if (enumerator)
+    enumerator = NULL;
+    if (listing == NULL)
+    {
+        enumerator = g_file_enumerate_children (src,
+                                                G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                                G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                                job->cancellable,
+                                                &error);
+    }
+    if (listing != NULL || enumerator != NULL)
     {
         error = NULL;
 
-        while (!job_aborted (job) &&
-               (info = g_file_enumerator_next_file (enumerator, job->cancellable, skip_error ? NULL : &error)) != NULL)
+        /* Desktop files copied to the desktop may need to be marked as
+         * trusted, which is left to copy_move_file().
+         */
+        parallel = copy_job->parallel_copy != NULL &&
+                   (copy_job->desktop_location == NULL ||
+                    !g_file_equal (copy_job->desktop_location, *dest));
+
+        /* The pool has no way to find out about names the destination
+         * can't take, so the file system is looked up once beforehand.
+         */
+        if (parallel && dest_fs_type == NULL)
         {
-            src_file = g_file_get_child (src,
-                                         g_file_info_get_name (info));
-            copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
-                            source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
-                            readonly_source_fs);
+            dest_fs_type = query_fs_type (*dest, job->cancellable);
+        }
 
-            if (local_skipped_file)
+        if (listing != NULL)
+        {
+            for (i = 0; i < listing->len && !job_aborted (job); i++)
             {
-                source_info_remove_file_from_count (src_file, job, source_info);
-                report_copy_progress (copy_job, source_info, transfer_info);
+                entry = g_ptr_array_index (listing, i);
+                copy_move_directory_child (copy_job, src, entry->name, entry->type,
+                                           *dest, same_fs, parallel, &dest_fs_type,
+                                           source_info, transfer_info, &local_skipped_file,
+                                           readonly_source_fs);
             }
-
-            g_object_unref (src_file);
-            g_object_unref (info);
         }
-        g_file_enumerator_close (enumerator, job->cancellable, NULL);
-        g_object_unref (enumerator);
+        else
+        {
+            while (!job_aborted (job) &&
+                   (info = g_file_enumerator_next_file (enumerator, job->cancellable, skip_error ? NULL : &error)) != NULL)
+            {
+                copy_move_directory_child (copy_job, src, g_file_info_get_name (info),
+                                           g_file_info_get_file_type (info),
+                                           *dest, same_fs, parallel, &dest_fs_type,
+                                           source_info, transfer_info, &local_skipped_file,
+                                           readonly_source_fs);
+                g_object_unref (info);
+            }
+            g_file_enumerator_close (enumerator, job->cancellable, NULL);
+            g_object_unref (enumerator);
+        }
 
         if (error && IS_IO_ERROR (error, CANCELLED))
         {
@@ -4806,10 +6333,17 @@ retry:
     {
         flags = (readonly_source_fs) ? G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_TARGET_DEFAULT_PERMS
                 : G_FILE_COPY_NOFOLLOW_SYMLINKS;
-        /* Ignore errors here. Failure to copy metadata is not a hard error */
-        g_file_copy_attributes (src, *dest,
-                                flags,
-                                job->cancellable, NULL);
+        if (copy_job->parallel_copy != NULL)
+        {
+            parallel_copy_add_directory (copy_job->parallel_copy, src, *dest, flags);
+        }
+        else
+        {
+            /* Ignore errors here. Failure to copy metadata is not a hard error */
+            g_file_copy_attributes (src, *dest,
+                                    flags,
+                                    job->cancellable, NULL);
+        }
     }
 
     if (!job_aborted (job) && copy_job->is_move &&
@@ -4864,6 +6398,7 @@ skip:
         *skipped_file = TRUE;
     }
 
+    g_clear_pointer (&listing, g_ptr_array_unref);
     g_free (dest_fs_type);
     return TRUE;
 }
@@ -5220,12 +6755,12 @@ retry:
     }
     else
     {
-        res = g_file_copy (src, dest,
-                           flags,
-                           job->cancellable,
-                           copy_file_progress_callback,
-                           &pdata,
-                           &error);
+        res = copy_file (src, dest,
+                         flags,
+                         job->cancellable,
+                         copy_file_progress_callback,
+                         &pdata,
+                         &error);
     }
 
     if (res)
@@ -5647,13 +7182,33 @@ copy_files (CopyMoveJob  *job,
         if (dest)
         {
             skipped_file = FALSE;
-            copy_move_file (job, src, dest,
-                            same_fs, unique_names,
-                            &dest_fs_type,
-                            source_info, transfer_info,
-                            job->debuting_files,
-                            point, FALSE, &skipped_file,
-                            readonly_source_fs);
+            /* Picked files go to the pool too, unless they need a new name
+             * or a place on the desktop, which only the usual way handles.
+             */
+            if (job->parallel_copy != NULL && !unique_names && point == NULL &&
+                (job->desktop_location == NULL ||
+                 !g_file_equal (job->desktop_location, dest)) &&
+                g_file_query_file_type (src, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                        common->cancellable) == G_FILE_TYPE_REGULAR)
+            {
+                if (dest_fs_type == NULL)
+                {
+                    dest_fs_type = query_fs_type (dest, common->cancellable);
+                }
+                parallel_copy_file (job, src, dest, same_fs, dest_fs_type,
+                                    source_info, transfer_info, TRUE,
+                                    &skipped_file, readonly_source_fs);
+            }
+            else
+            {
+                copy_move_file (job, src, dest,
+                                same_fs, unique_names,
+                                &dest_fs_type,
+                                source_info, transfer_info,
+                                job->debuting_files,
+                                point, FALSE, &skipped_file,
+                                readonly_source_fs);
+            }
             g_object_unref (dest);
 
             if (skipped_file)
@@ -5727,6 +7282,7 @@ copy_task_thread_func (GTask        *task,
                   OP_KIND_COPY);
     if (job_aborted (common))
     {
+        g_hash_table_unref (source_info.listings);
         return;
     }
 
@@ -5749,15 +7305,29 @@ copy_task_thread_func (GTask        *task,
     g_object_unref (dest);
     if (job_aborted (common))
     {
+        g_hash_table_unref (source_info.listings);
         return;
     }
 
     g_timer_start (job->common.time);
 
+    /* Moves, and copies under a given name, go one file at a time */
+    if (!job->is_move && job->target_name == NULL)
+    {
+        job->parallel_copy = parallel_copy_new ();
+    }
+
     memset (&transfer_info, 0, sizeof (transfer_info));
     copy_files (job,
                 dest_fs_id,
                 &source_info, &transfer_info);
+
+    if (job->parallel_copy != NULL)
+    {
+        parallel_copy_finish (job, &source_info, &transfer_info);
+    }
+
+    g_hash_table_unref (source_info.listings);
 }
 
 void
@@ -7873,6 +9443,197 @@ nautilus_file_operations_empty_trash (GtkWidget *parent_view)
     g_task_run_in_thread (task, empty_trash_thread_func);
 }
 
+/* The time files were trashed at is taken when the operation starts, so it
+ * can be a second or so off from the deletion date the trash keeps.
+ */
+#define RESTORE_TIME_EPSILON 2
+
+/* Progress is reported once for this many files restored */
+#define RESTORE_BATCH_SIZE 100
+
+static void
+restore_task_done (GObject      *source_object,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+    RestoreJob *job;
+
+    job = user_data;
+
+    g_hash_table_unref (job->trashed);
+
+    nautilus_file_changes_consume_changes (TRUE);
+
+    if (job->done_callback)
+    {
+        job->done_callback (NULL,
+                            job->success && !job_aborted ((CommonJob *) job),
+                            job->done_callback_data);
+    }
+
+    finalize_common ((CommonJob *) job);
+}
+
+/* Looks the top level of the trash up by original path, so that only the
+ * files to restore get a GFile.
+ */
+static void
+find_files_to_restore (RestoreJob  *job,
+                       GPtrArray   *sources,
+                       GPtrArray   *destinations,
+                       GError     **error)
+{
+    CommonJob *common;
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    GFile *trash;
+    GDateTime *date;
+    const char *orig_path;
+    gpointer trashed_time;
+    gint64 deletion_time;
+
+    common = (CommonJob *) job;
+
+    trash = g_file_new_for_uri ("trash:///");
+    enumerator = g_file_enumerate_children (trash,
+                                            G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                            G_FILE_ATTRIBUTE_TRASH_DELETION_DATE ","
+                                            G_FILE_ATTRIBUTE_TRASH_ORIG_PATH,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            common->cancellable, error);
+    if (enumerator == NULL)
+    {
+        g_object_unref (trash);
+        return;
+    }
+
+    while (!job_aborted (common) &&
+           g_hash_table_size (job->trashed) > 0 &&
+           (info = g_file_enumerator_next_file (enumerator, common->cancellable, error)) != NULL)
+    {
+        orig_path = g_file_info_get_attribute_byte_string (info, G_FILE_ATTRIBUTE_TRASH_ORIG_PATH);
+        trashed_time = orig_path != NULL ? g_hash_table_lookup (job->trashed, orig_path) : NULL;
+
+        if (trashed_time != NULL)
+        {
+            deletion_time = 0;
+            date = g_file_info_get_deletion_date (info);
+            if (date != NULL)
+            {
+                deletion_time = g_date_time_to_unix (date);
+                g_date_time_unref (date);
+            }
+
+            if (ABS ((gint64) GPOINTER_TO_SIZE (trashed_time) - deletion_time) <= RESTORE_TIME_EPSILON)
+            {
+                g_ptr_array_add (sources, g_file_get_child (trash, g_file_info_get_name (info)));
+                g_ptr_array_add (destinations, g_file_new_for_path (orig_path));
+                /* Only restore the first match */
+                g_hash_table_remove (job->trashed, orig_path);
+            }
+        }
+
+        g_object_unref (info);
+    }
+
+    g_file_enumerator_close (enumerator, NULL, NULL);
+    g_object_unref (enumerator);
+    g_object_unref (trash);
+}
+
+static void
+restore_task_thread_func (GTask        *task,
+                          gpointer      source_object,
+                          gpointer      task_data,
+                          GCancellable *cancellable)
+{
+    RestoreJob *job = task_data;
+    CommonJob *common;
+    GPtrArray *sources;
+    GPtrArray *destinations;
+    GFile *source, *destination;
+    GError *error;
+    guint i;
+
+    common = (CommonJob *) job;
+
+    nautilus_progress_info_take_status (common->progress,
+                                        g_strdup_printf (ngettext ("Restoring %'d file from trash",
+                                                                   "Restoring %'d files from trash",
+                                                                   g_hash_table_size (job->trashed)),
+                                                         g_hash_table_size (job->trashed)));
+    nautilus_progress_info_start (common->progress);
+    nautilus_progress_info_pulse_progress (common->progress);
+
+    sources = g_ptr_array_new_with_free_func (g_object_unref);
+    destinations = g_ptr_array_new_with_free_func (g_object_unref);
+
+    error = NULL;
+    find_files_to_restore (job, sources, destinations, &error);
+    job->success = error == NULL && sources->len > 0;
+    g_clear_error (&error);
+
+    for (i = 0; i < sources->len && !job_aborted (common); i++)
+    {
+        source = g_ptr_array_index (sources, i);
+        destination = g_ptr_array_index (destinations, i);
+
+        /* As before, files that can't be moved back are left in the trash */
+        if (g_file_move (source, destination, G_FILE_COPY_NOFOLLOW_SYMLINKS,
+                         common->cancellable, NULL, NULL, NULL))
+        {
+            nautilus_file_changes_queue_file_moved (source, destination);
+        }
+
+        if ((i + 1) % RESTORE_BATCH_SIZE == 0 || i + 1 == sources->len)
+        {
+            /* To translators: %'d is the number of files completed for the operation,
+             * so it will be something like 2/14. */
+            nautilus_progress_info_take_details (common->progress,
+                                                 g_strdup_printf (_("%'d / %'d"),
+                                                                  i + 1, sources->len));
+            nautilus_progress_info_set_progress (common->progress, i + 1, sources->len);
+        }
+    }
+
+    g_ptr_array_unref (sources);
+    g_ptr_array_unref (destinations);
+}
+
+void
+nautilus_file_operations_restore_from_trash (GHashTable           *trashed,
+                                             GtkWindow            *parent_window,
+                                             NautilusCopyCallback  done_callback,
+                                             gpointer              done_callback_data)
+{
+    g_autoptr (GTask) task = NULL;
+    RestoreJob *job;
+    GHashTableIter iter;
+    gpointer location, trashed_time;
+    char *path;
+
+    job = op_job_new (RestoreJob, parent_window);
+    job->trashed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    job->done_callback = done_callback;
+    job->done_callback_data = done_callback_data;
+
+    g_hash_table_iter_init (&iter, trashed);
+    while (g_hash_table_iter_next (&iter, &location, &trashed_time))
+    {
+        path = g_file_get_path (location);
+        if (path != NULL)
+        {
+            g_hash_table_insert (job->trashed, path, trashed_time);
+        }
+    }
+
+    inhibit_power_manager ((CommonJob *) job, _("Restoring Files"));
+
+    task = g_task_new (NULL, job->common.cancellable, restore_task_done, job);
+    g_task_set_task_data (task, job, NULL);
+    g_task_run_in_thread (task, restore_task_thread_func);
+}
+
 static void
 mark_desktop_file_executable_task_done (GObject      *source_object,
                                         GAsyncResult *res,
@@ -66,6 +66,13 @@ void nautilus_file_operations_copy_file (GFile *source_file,
 					 NautilusCopyCallback done_callback,
 					 gpointer done_callback_data);
 void nautilus_file_operations_empty_trash (GtkWidget                 *parent_view);
+/* Moves back the files in @trashed, a table of their original locations
+ * to the time they were trashed at, that are still in the trash.
+ */
+void nautilus_file_operations_restore_from_trash (GHashTable           *trashed,
+						  GtkWindow            *parent_window,
+						  NautilusCopyCallback  done_callback,
+						  gpointer              done_callback_data);
 void nautilus_file_operations_new_folder  (GtkWidget                 *parent_view,
 					   GdkPoint                  *target_point,
 					   const char                *parent_dir_uri,
@@ -44,6 +44,8 @@ typedef enum {
 struct NautilusFileDetails
 {
 	NautilusDirectory *directory;
+	/* Index in the files array of the directory, while listed there. */
+	guint directory_file_index;
 	
 	eel_ref_str name;
 
@@ -135,6 +137,10 @@ struct NautilusFileDetails
            many NautilusFile objects. */
 
 	eel_boolean_bit unconfirmed                   : 1;
+	/* Shown from a directory snapshot and not reported by an
+	 * enumeration yet, so there is no telling whether it exists.
+	 */
+	eel_boolean_bit from_snapshot                 : 1;
 	eel_boolean_bit is_gone                       : 1;
 	/* Set when emitting files_added on the directory to make sure we
 	   add a file, and only once */
@@ -146,6 +152,11 @@ struct NautilusFileDetails
 	eel_boolean_bit got_file_info                 : 1;
 	eel_boolean_bit get_info_failed               : 1;
 	eel_boolean_bit file_info_is_up_to_date       : 1;
+	/* Set while the info is being fetched as part of a batch for the
+	 * whole directory, and kept if the batch didn't return this file,
+	 * so that it falls back to being queried on its own.
+	 */
+	eel_boolean_bit file_info_batch_tried         : 1;
 	
 	eel_boolean_bit got_directory_count           : 1;
 	eel_boolean_bit directory_count_failed        : 1;
@@ -128,3 +128,19 @@ nautilus_file_queue_is_empty (NautilusFileQueue *queue)
 {
     return (queue->head == NULL);
 }
+
+void
+nautilus_file_queue_foreach (NautilusFileQueue     *queue,
+                             NautilusFileQueueFunc  func,
+                             gpointer               callback_data)
+{
+    GList *node;
+
+    for (node = queue->head; node != NULL; node = node->next)
+    {
+        if (!(*func)(NAUTILUS_FILE (node->data), callback_data))
+        {
+            break;
+        }
+    }
+}
@@ -24,6 +24,9 @@
 
 typedef struct NautilusFileQueue NautilusFileQueue;
 
+typedef gboolean (* NautilusFileQueueFunc) (NautilusFile *file,
+					    gpointer      callback_data);
+
 NautilusFileQueue *nautilus_file_queue_new      (void);
 void               nautilus_file_queue_destroy  (NautilusFileQueue *queue);
 
@@ -46,4 +49,11 @@ NautilusFile *     nautilus_file_queue_head     (NautilusFileQueue *queue);
 
 gboolean           nautilus_file_queue_is_empty (NautilusFileQueue *queue);
 
+/* Call func on the files of the queue from head to tail, stopping as
+ * soon as it returns FALSE. The queue must not be changed from func.
+ */
+void               nautilus_file_queue_foreach  (NautilusFileQueue     *queue,
+						 NautilusFileQueueFunc  func,
+						 gpointer               callback_data);
+
 #endif /* NAUTILUS_FILE_CHANGES_QUEUE_H */
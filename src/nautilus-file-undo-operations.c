@@ -35,14 +35,6 @@
 #include "nautilus-batch-rename-utilities.h"
 
 
-/* Since we use g_get_current_time for setting "orig_trash_time" in the undo
- * info, there are situations where the difference between this value and the
- * real deletion time can differ enough to make the rounding a difference of 1
- * second, failing the equality check. To make sure we avoid this, and to be
- * preventive, use 2 seconds epsilon.
- */
-#define TRASH_TIME_EPSILON 2
-
 G_DEFINE_TYPE (NautilusFileUndoInfo, nautilus_file_undo_info, G_TYPE_OBJECT)
 
 enum
@@ -1414,152 +1406,14 @@ trash_redo_func (NautilusFileUndoInfo *info,
     }
 }
 
-static void
-trash_retrieve_files_to_restore_thread (GTask        *task,
-                                        gpointer      source_object,
-                                        gpointer      task_data,
-                                        GCancellable *cancellable)
-{
-    NautilusFileUndoInfoTrash *self = NAUTILUS_FILE_UNDO_INFO_TRASH (source_object);
-    GFileEnumerator *enumerator;
-    GHashTable *to_restore;
-    GFile *trash;
-    GError *error = NULL;
-
-    to_restore = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
-                                        g_object_unref, g_object_unref);
-
-    trash = g_file_new_for_uri ("trash:///");
-
-    enumerator = g_file_enumerate_children (trash,
-                                            G_FILE_ATTRIBUTE_STANDARD_NAME ","
-                                            G_FILE_ATTRIBUTE_TRASH_DELETION_DATE ","
-                                            G_FILE_ATTRIBUTE_TRASH_ORIG_PATH,
-                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                            NULL, &error);
-
-    if (enumerator)
-    {
-        GFileInfo *info;
-        gpointer lookupvalue;
-        GFile *item;
-        glong trash_time, orig_trash_time;
-        const char *origpath;
-        GFile *origfile;
-
-        while ((info = g_file_enumerator_next_file (enumerator, NULL, &error)) != NULL)
-        {
-            /* Retrieve the original file uri */
-            origpath = g_file_info_get_attribute_byte_string (info, G_FILE_ATTRIBUTE_TRASH_ORIG_PATH);
-            origfile = g_file_new_for_path (origpath);
-
-            lookupvalue = g_hash_table_lookup (self->priv->trashed, origfile);
-
-            if (lookupvalue)
-            {
-                GDateTime *date;
-
-                orig_trash_time = GPOINTER_TO_SIZE (lookupvalue);
-                trash_time = 0;
-                date = g_file_info_get_deletion_date (info);
-                if (date)
-                {
-                    trash_time = g_date_time_to_unix (date);
-                    g_date_time_unref (date);
-                }
-
-                if (ABS (orig_trash_time - trash_time) <= TRASH_TIME_EPSILON)
-                {
-                    /* File in the trash */
-                    item = g_file_get_child (trash, g_file_info_get_name (info));
-                    g_hash_table_insert (to_restore, item, g_object_ref (origfile));
-                }
-            }
-
-            g_object_unref (origfile);
-        }
-        g_file_enumerator_close (enumerator, FALSE, NULL);
-        g_object_unref (enumerator);
-    }
-    g_object_unref (trash);
-
-    if (error != NULL)
-    {
-        g_task_return_error (task, error);
-        g_hash_table_destroy (to_restore);
-    }
-    else
-    {
-        g_task_return_pointer (task, to_restore, NULL);
-    }
-}
-
-static void
-trash_retrieve_files_to_restore_async (NautilusFileUndoInfoTrash *self,
-                                       GAsyncReadyCallback        callback,
-                                       gpointer                   user_data)
-{
-    GTask *task;
-
-    task = g_task_new (G_OBJECT (self), NULL, callback, user_data);
-
-    g_task_run_in_thread (task, trash_retrieve_files_to_restore_thread);
-
-    g_object_unref (task);
-}
-
-static void
-trash_retrieve_files_ready (GObject      *source,
-                            GAsyncResult *res,
-                            gpointer      user_data)
-{
-    NautilusFileUndoInfoTrash *self = NAUTILUS_FILE_UNDO_INFO_TRASH (source);
-    GHashTable *files_to_restore;
-    GError *error = NULL;
-
-    files_to_restore = g_task_propagate_pointer (G_TASK (res), &error);
-
-    if (error == NULL && g_hash_table_size (files_to_restore) > 0)
-    {
-        GList *gfiles_in_trash, *l;
-        GFile *item;
-        GFile *dest;
-
-        gfiles_in_trash = g_hash_table_get_keys (files_to_restore);
-
-        for (l = gfiles_in_trash; l != NULL; l = l->next)
-        {
-            item = l->data;
-            dest = g_hash_table_lookup (files_to_restore, item);
-
-            g_file_move (item, dest, G_FILE_COPY_NOFOLLOW_SYMLINKS, NULL, NULL, NULL, NULL);
-        }
-
-        g_list_free (gfiles_in_trash);
-
-        /* Here we must do what's necessary for the callback */
-        file_undo_info_transfer_callback (NULL, (error == NULL), self);
-    }
-    else
-    {
-        file_undo_info_transfer_callback (NULL, FALSE, self);
-    }
-
-    if (files_to_restore != NULL)
-    {
-        g_hash_table_destroy (files_to_restore);
-    }
-
-    g_clear_error (&error);
-}
-
 static void
 trash_undo_func (NautilusFileUndoInfo *info,
                  GtkWindow            *parent_window)
 {
     NautilusFileUndoInfoTrash *self = NAUTILUS_FILE_UNDO_INFO_TRASH (info);
 
-    trash_retrieve_files_to_restore_async (self, trash_retrieve_files_ready, NULL);
+    nautilus_file_operations_restore_from_trash (self->priv->trashed, parent_window,
+                                                 file_undo_info_transfer_callback, self);
 }
 
 static void
@@ -2621,7 +2621,7 @@ update_info_internal (NautilusFile *file,
                       GFileInfo    *info,
                       gboolean      update_name)
 {
-    GList *node;
+    gboolean was_listed;
     gboolean changed;
     gboolean is_symlink, is_hidden, is_mountpoint;
     gboolean has_permissions;
@@ -3092,8 +3092,8 @@ update_info_internal (NautilusFile *file,
         {
             changed = TRUE;
 
-            node = nautilus_directory_begin_file_name_change
-                       (file->details->directory, file);
+            was_listed = nautilus_directory_begin_file_name_change
+                             (file->details->directory, file);
 
             eel_ref_str_unref (file->details->name);
             if (g_strcmp0 (eel_ref_str_peek (file->details->display_name),
@@ -3117,7 +3117,7 @@ update_info_internal (NautilusFile *file,
             }
 
             nautilus_directory_end_file_name_change
-                (file->details->directory, file, node);
+                (file->details->directory, file, was_listed);
         }
     }
 
@@ -3150,7 +3150,7 @@ update_name_internal (NautilusFile *file,
                       const char   *name,
                       gboolean      in_directory)
 {
-    GList *node;
+    gboolean was_listed;
 
     g_assert (name != NULL);
 
@@ -3164,11 +3164,11 @@ update_name_internal (NautilusFile *file,
         return FALSE;
     }
 
-    node = NULL;
+    was_listed = FALSE;
     if (in_directory)
     {
-        node = nautilus_directory_begin_file_name_change
-                   (file->details->directory, file);
+        was_listed = nautilus_directory_begin_file_name_change
+                         (file->details->directory, file);
     }
 
     eel_ref_str_unref (file->details->name);
@@ -3182,7 +3182,7 @@ update_name_internal (NautilusFile *file,
     if (in_directory)
     {
         nautilus_directory_end_file_name_change
-            (file->details->directory, file, node);
+            (file->details->directory, file, was_listed);
     }
 
     return TRUE;
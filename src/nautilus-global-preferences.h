@@ -177,6 +177,19 @@ typedef enum
 /* Full Text Search as default */
 #define NAUTILUS_PREFERENCES_FTS_DEFAULT "fts-default"
 
+/* Show cached folder contents while the folder is read again */
+#define NAUTILUS_PREFERENCES_CACHE_DIRECTORY_LISTINGS "cache-directory-listings"
+
+/* Keep an index of the names of listed files to search */
+#define NAUTILUS_PREFERENCES_SEARCH_INDEX "search-index"
+
+/* How many files inside folders are copied at the same time */
+#define NAUTILUS_PREFERENCES_PARALLEL_COPIES "parallel-copies"
+
+/* How many item counts and thumbnails of a folder are loaded at the same time */
+#define NAUTILUS_PREFERENCES_DIRECTORY_COUNT_REQUESTS "directory-count-requests"
+#define NAUTILUS_PREFERENCES_THUMBNAIL_REQUESTS "thumbnail-requests"
+
 void nautilus_global_preferences_init                      (void);
 
 extern GSettings *nautilus_preferences;
@@ -48,6 +48,12 @@ static GQuark attribute_name_q,
 /* msec delay after Loading... dummy row turns into (empty) */
 #define LOADING_TO_EMPTY_DELAY 100
 
+/* Bytes of rendered icons kept before starting over */
+#define ICON_SURFACES_MAX_SIZE (32 * 1024 * 1024)
+
+#define ICON_SURFACE_KEY(size, scale, flags) \
+    GUINT_TO_POINTER (((guint) (size) << 16) | ((guint) (scale) << 8) | (guint) (flags))
+
 static guint list_model_signals[LAST_SIGNAL] = { 0 };
 
 static int nautilus_list_model_file_entry_compare_func (gconstpointer a,
@@ -76,6 +82,10 @@ typedef struct
     GPtrArray *columns;
 
     GList *highlight_files;
+    GHashTable *highlight_locations;    /* set of the locations of highlight_files */
+
+    GHashTable *icon_surfaces;          /* map from files to their rendered icons */
+    gsize icon_surfaces_size;
 } NautilusListModelPrivate;
 
 typedef struct
@@ -288,6 +298,128 @@ nautilus_list_model_get_path (GtkTreeModel *tree_model,
     return path;
 }
 
+static gsize
+get_icon_surfaces_size (GHashTable *surfaces)
+{
+    GHashTableIter iter;
+    gpointer value;
+    gsize size;
+
+    size = 0;
+    g_hash_table_iter_init (&iter, surfaces);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+        size += cairo_image_surface_get_stride (value) *
+                cairo_image_surface_get_height (value);
+    }
+
+    return size;
+}
+
+static void
+invalidate_icon_surfaces (NautilusListModel *model,
+                          NautilusFile      *file)
+{
+    NautilusListModelPrivate *priv;
+    GHashTable *surfaces;
+
+    priv = nautilus_list_model_get_instance_private (model);
+
+    surfaces = g_hash_table_lookup (priv->icon_surfaces, file);
+    if (surfaces != NULL)
+    {
+        priv->icon_surfaces_size -= get_icon_surfaces_size (surfaces);
+        g_hash_table_remove (priv->icon_surfaces, file);
+    }
+}
+
+static cairo_surface_t *
+lookup_icon_surface (NautilusListModel     *model,
+                     NautilusFile          *file,
+                     int                    icon_size,
+                     int                    icon_scale,
+                     NautilusFileIconFlags  flags)
+{
+    NautilusListModelPrivate *priv;
+    GHashTable *surfaces;
+
+    priv = nautilus_list_model_get_instance_private (model);
+
+    surfaces = g_hash_table_lookup (priv->icon_surfaces, file);
+    if (surfaces == NULL)
+    {
+        return NULL;
+    }
+
+    return g_hash_table_lookup (surfaces,
+                                ICON_SURFACE_KEY (icon_size, icon_scale, flags));
+}
+
+static void
+store_icon_surface (NautilusListModel     *model,
+                    NautilusFile          *file,
+                    int                    icon_size,
+                    int                    icon_scale,
+                    NautilusFileIconFlags  flags,
+                    cairo_surface_t       *surface)
+{
+    NautilusListModelPrivate *priv;
+    GHashTable *surfaces;
+
+    priv = nautilus_list_model_get_instance_private (model);
+
+    if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE)
+    {
+        return;
+    }
+
+    /* Fast scrolling through a big folder would otherwise keep every
+     * icon it went past, so start over once the cache gets too big.
+     */
+    if (priv->icon_surfaces_size > ICON_SURFACES_MAX_SIZE)
+    {
+        g_hash_table_remove_all (priv->icon_surfaces);
+        priv->icon_surfaces_size = 0;
+    }
+
+    surfaces = g_hash_table_lookup (priv->icon_surfaces, file);
+    if (surfaces == NULL)
+    {
+        surfaces = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                          NULL,
+                                          (GDestroyNotify) cairo_surface_destroy);
+        g_hash_table_insert (priv->icon_surfaces, nautilus_file_ref (file), surfaces);
+    }
+
+    g_hash_table_insert (surfaces,
+                         ICON_SURFACE_KEY (icon_size, icon_scale, flags),
+                         cairo_surface_reference (surface));
+    priv->icon_surfaces_size += cairo_image_surface_get_stride (surface) *
+                                cairo_image_surface_get_height (surface);
+}
+
+static gboolean
+is_file_highlighted (NautilusListModel *model,
+                     NautilusFile      *file)
+{
+    NautilusListModelPrivate *priv;
+    GFile *location;
+    gboolean highlighted;
+
+    priv = nautilus_list_model_get_instance_private (model);
+
+    if (priv->highlight_locations == NULL)
+    {
+        return FALSE;
+    }
+
+    location = nautilus_file_get_location (file);
+    highlighted = g_hash_table_contains (priv->highlight_locations, location);
+    g_object_unref (location);
+
+    return highlighted;
+}
+
 static gint
 nautilus_list_model_get_icon_scale (NautilusListModel *model)
 {
@@ -413,11 +545,16 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model,
                     }
                 }
 
+                surface = lookup_icon_surface (model, file, icon_size, icon_scale, flags);
+                if (surface != NULL)
+                {
+                    g_value_set_boxed (value, surface);
+                    break;
+                }
+
                 icon = nautilus_file_get_icon_pixbuf (file, icon_size, TRUE, icon_scale, flags);
 
-                if (priv->highlight_files != NULL &&
-                    g_list_find_custom (priv->highlight_files,
-                                        file, (GCompareFunc) nautilus_file_compare_location))
+                if (is_file_highlighted (model, file))
                 {
                     rendered_icon = eel_create_spotlight_pixbuf (icon);
 
@@ -429,6 +566,7 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model,
                 }
 
                 surface = gdk_cairo_surface_create_from_pixbuf (icon, icon_scale, NULL);
+                store_icon_surface (model, file, icon_size, icon_scale, flags, surface);
                 g_value_take_boxed (value, surface);
                 g_object_unref (icon);
             }
@@ -1107,6 +1245,8 @@ nautilus_list_model_file_changed (NautilusListModel *model,
         return;
     }
 
+    /* The icon might have changed along with the file */
+    invalidate_icon_surfaces (model, file);
 
     pos_before = g_sequence_iter_get_position (ptr);
 
@@ -1219,6 +1359,8 @@ nautilus_list_model_remove (NautilusListModel *model,
 
     if (file_entry->file != NULL)       /* Don't try to remove dummy row */
     {
+        invalidate_icon_surfaces (model, file_entry->file);
+
         if (file_entry->parent != NULL)
         {
             g_hash_table_remove (file_entry->parent->reverse_map, file_entry->file);
@@ -1694,6 +1836,9 @@ nautilus_list_model_finalize (GObject *object)
         priv->highlight_files = NULL;
     }
 
+    g_clear_pointer (&priv->highlight_locations, g_hash_table_destroy);
+    g_hash_table_destroy (priv->icon_surfaces);
+
     G_OBJECT_CLASS (nautilus_list_model_parent_class)->finalize (object);
 }
 
@@ -1710,6 +1855,9 @@ nautilus_list_model_init (NautilusListModel *model)
     priv->stamp = g_random_int ();
     priv->sort_attribute = 0;
     priv->columns = g_ptr_array_new ();
+    priv->icon_surfaces = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                 (GDestroyNotify) nautilus_file_unref,
+                                                 (GDestroyNotify) g_hash_table_destroy);
 }
 
 static void
@@ -1831,6 +1979,9 @@ refresh_row (gpointer data,
     model = user_data;
     file = data;
 
+    /* The highlight is part of the rendered icon */
+    invalidate_icon_surfaces (model, file);
+
     iters = nautilus_list_model_get_all_iters_for_file (model, file);
     for (l = iters; l != NULL; l = l->next)
     {
@@ -1848,19 +1999,36 @@ nautilus_list_model_set_highlight_for_files (NautilusListModel *model,
                                              GList             *files)
 {
     NautilusListModelPrivate *priv;
+    GList *old_files, *l;
 
     priv = nautilus_list_model_get_instance_private (model);
 
-    if (priv->highlight_files != NULL)
-    {
-        g_list_foreach (priv->highlight_files, refresh_row, model);
-        nautilus_file_list_free (priv->highlight_files);
-        priv->highlight_files = NULL;
-    }
+    /* Rows are refreshed once the new highlight is in place, so that no
+     * icon gets rendered and cached with the old one.
+     */
+    old_files = priv->highlight_files;
+    priv->highlight_files = NULL;
+    g_clear_pointer (&priv->highlight_locations, g_hash_table_destroy);
 
     if (files != NULL)
     {
         priv->highlight_files = nautilus_file_list_copy (files);
+        priv->highlight_locations = g_hash_table_new_full (g_file_hash,
+                                                           (GEqualFunc) g_file_equal,
+                                                           g_object_unref,
+                                                           NULL);
+        for (l = priv->highlight_files; l != NULL; l = l->next)
+        {
+            g_hash_table_add (priv->highlight_locations,
+                              nautilus_file_get_location (l->data));
+        }
+
         g_list_foreach (priv->highlight_files, refresh_row, model);
     }
+
+    if (old_files != NULL)
+    {
+        g_list_foreach (old_files, refresh_row, model);
+        nautilus_file_list_free (old_files);
+    }
 }
@@ -71,6 +71,16 @@ struct _NautilusProgressInfo
     gboolean changed_at_idle;
     gboolean progress_at_idle;
 
+    NautilusProgressDetailsFunc details_func;
+
+    /* Only written by the thread running the job. The sequence number is
+     * odd while the counters are being written, so readers can retry
+     * instead of taking the lock.
+     */
+    gint transfer_seq;
+    NautilusProgressTransfer transfer;
+    gint transfer_queued;
+
     GFile *destination;
 };
 
@@ -228,6 +238,7 @@ idle_callback (gpointer data)
     info->changed_at_idle = FALSE;
     info->progress_at_idle = FALSE;
     info->cancel_at_idle = FALSE;
+    g_atomic_int_set (&info->transfer_queued, FALSE);
 
     G_UNLOCK (progress_info);
 
@@ -386,27 +397,63 @@ nautilus_progress_info_get_status (NautilusProgressInfo *info)
 char *
 nautilus_progress_info_get_details (NautilusProgressInfo *info)
 {
+    NautilusProgressDetailsFunc details_func;
+    NautilusProgressTransfer transfer;
     char *res;
 
     G_LOCK (progress_info);
 
-    if (info->details)
+    details_func = info->details_func;
+    if (g_cancellable_is_cancelled (info->cancellable) ||
+        !nautilus_progress_info_get_transfer (info, &transfer))
     {
-        res = g_strdup (info->details);
+        details_func = NULL;
     }
-    else
+
+    res = NULL;
+    if (details_func == NULL)
     {
-        res = g_strdup (_("Preparing"));
+        if (info->details)
+        {
+            res = g_strdup (info->details);
+        }
+        else
+        {
+            res = g_strdup (_("Preparing"));
+        }
     }
 
     G_UNLOCK (progress_info);
 
+    /* Formatting doesn't need the lock */
+    if (details_func != NULL)
+    {
+        res = details_func (&transfer);
+    }
+
     return res;
 }
 
+static double
+get_fraction (double current,
+              double total)
+{
+    double fraction;
+
+    if (total <= 0)
+    {
+        return 1.0;
+    }
+
+    fraction = current / total;
+
+    return CLAMP (fraction, 0.0, 1.0);
+}
+
 double
 nautilus_progress_info_get_progress (NautilusProgressInfo *info)
 {
+    NautilusProgressTransfer transfer;
     double res;
 
     G_LOCK (progress_info);
@@ -415,6 +462,10 @@ nautilus_progress_info_get_progress (NautilusProgressInfo *info)
     {
         res = -1.0;
     }
+    else if (nautilus_progress_info_get_transfer (info, &transfer))
+    {
+        res = get_fraction (transfer.bytes_done, transfer.bytes_total);
+    }
     else
     {
         res = info->progress;
@@ -672,24 +723,7 @@ nautilus_progress_info_set_progress (NautilusProgressInfo *info,
 {
     double current_percent;
 
-    if (total <= 0)
-    {
-        current_percent = 1.0;
-    }
-    else
-    {
-        current_percent = current / total;
-
-        if (current_percent < 0)
-        {
-            current_percent = 0;
-        }
-
-        if (current_percent > 1.0)
-        {
-            current_percent = 1.0;
-        }
-    }
+    current_percent = get_fraction (current, total);
 
     G_LOCK (progress_info);
 
@@ -706,6 +740,61 @@ nautilus_progress_info_set_progress (NautilusProgressInfo *info,
     G_UNLOCK (progress_info);
 }
 
+void
+nautilus_progress_info_set_details_func (NautilusProgressInfo        *info,
+                                         NautilusProgressDetailsFunc  func)
+{
+    G_LOCK (progress_info);
+    info->details_func = func;
+    G_UNLOCK (progress_info);
+}
+
+/* Called for every chunk of a transfer, so this must stay cheap: no
+ * allocations, and the lock is only taken when no update is queued yet.
+ */
+void
+nautilus_progress_info_set_transfer (NautilusProgressInfo           *info,
+                                     const NautilusProgressTransfer *transfer)
+{
+    g_atomic_int_inc (&info->transfer_seq);
+    info->transfer = *transfer;
+    g_atomic_int_inc (&info->transfer_seq);
+
+    if (g_atomic_int_compare_and_exchange (&info->transfer_queued, FALSE, TRUE))
+    {
+        G_LOCK (progress_info);
+
+        if (!g_cancellable_is_cancelled (info->cancellable))
+        {
+            info->activity_mode = FALSE;
+            info->changed_at_idle = TRUE;
+            info->progress_at_idle = TRUE;
+            queue_idle (info, FALSE);
+        }
+
+        G_UNLOCK (progress_info);
+    }
+}
+
+gboolean
+nautilus_progress_info_get_transfer (NautilusProgressInfo     *info,
+                                     NautilusProgressTransfer *transfer)
+{
+    gint seq;
+
+    do
+    {
+        seq = g_atomic_int_get (&info->transfer_seq);
+        *transfer = info->transfer;
+    }
+    /* Adding 0 rather than reading, so the check can't be reordered
+     * before the copy.
+     */
+    while ((seq & 1) != 0 || g_atomic_int_add (&info->transfer_seq, 0) != seq);
+
+    return seq != 0;
+}
+
 void
 nautilus_progress_info_set_remaining_time (NautilusProgressInfo *info,
                                            gdouble               time)
@@ -39,6 +39,20 @@ G_DECLARE_FINAL_TYPE (NautilusProgressInfo, nautilus_progress_info, NAUTILUS, PR
    All methods are threadsafe.
  */
 
+/* Counters of a transfer. They are published without locking, so that
+   they can be updated for every chunk copied, and the details are built
+   from them by whoever shows the info. */
+typedef struct
+{
+	int files_done;
+	int files_total;
+	goffset bytes_done;
+	goffset bytes_total;
+	gdouble elapsed;
+} NautilusProgressTransfer;
+
+typedef char * (* NautilusProgressDetailsFunc) (const NautilusProgressTransfer *transfer);
+
 NautilusProgressInfo *nautilus_progress_info_new (void);
 
 GList *       nautilus_get_all_progress_info (void);
@@ -70,6 +84,13 @@ void          nautilus_progress_info_set_progress    (NautilusProgressInfo *info
 						      double                total);
 void          nautilus_progress_info_pulse_progress  (NautilusProgressInfo *info);
 
+void          nautilus_progress_info_set_details_func (NautilusProgressInfo        *info,
+						       NautilusProgressDetailsFunc  func);
+void          nautilus_progress_info_set_transfer    (NautilusProgressInfo           *info,
+						      const NautilusProgressTransfer *transfer);
+gboolean      nautilus_progress_info_get_transfer    (NautilusProgressInfo     *info,
+						      NautilusProgressTransfer *transfer);
+
 void          nautilus_progress_info_set_remaining_time (NautilusProgressInfo *info,
                                                          gdouble               time);
 gdouble       nautilus_progress_info_get_remaining_time (NautilusProgressInfo *info);
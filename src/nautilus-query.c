@@ -35,6 +35,26 @@
 #define MIN_RANK 10.0
 #define MAX_RANK 50.0
 
+/* Longest file name the ASCII fast path lowercases on the stack */
+#define ASCII_BUFFER_SIZE 512
+
+/* The words of a query, prepared for comparing once. Immutable after
+ * creation, so any thread holding a reference can use it without locking.
+ */
+struct _NautilusQueryMatcher
+{
+    gint ref_count;
+
+    char **words;
+    gsize *word_lengths;
+
+    /* Whether g_ascii_tolower() gives the same result as g_utf8_strdown()
+     * on ASCII text in the current locale. It doesn't in Turkish, where 'I'
+     * lowercases to a dotless i.
+     */
+    gboolean ascii_lowercase_is_exact;
+};
+
 struct _NautilusQuery
 {
     GObject parent;
@@ -49,8 +69,8 @@ struct _NautilusQuery
 
     gboolean searching;
     gboolean recursive;
-    char **prepared_words;
-    GMutex prepared_words_mutex;
+    NautilusQueryMatcher *matcher;
+    GMutex matcher_mutex;
 };
 
 static void  nautilus_query_class_init (NautilusQueryClass *class);
@@ -80,10 +100,10 @@ finalize (GObject *object)
     query = NAUTILUS_QUERY (object);
 
     g_free (query->text);
-    g_strfreev (query->prepared_words);
+    g_clear_pointer (&query->matcher, nautilus_query_matcher_unref);
     g_clear_object (&query->location);
     g_clear_pointer (&query->date_range, g_ptr_array_unref);
-    g_mutex_clear (&query->prepared_words_mutex);
+    g_mutex_clear (&query->matcher_mutex);
 
     G_OBJECT_CLASS (nautilus_query_parent_class)->finalize (object);
 }
@@ -343,7 +363,7 @@ nautilus_query_init (NautilusQuery *query)
     query->location = g_file_new_for_path (g_get_home_dir ());
     query->search_type = g_settings_get_enum (nautilus_preferences, "search-filter-time-type");
     query->search_content = NAUTILUS_QUERY_SEARCH_CONTENT_SIMPLE;
-    g_mutex_init (&query->prepared_words_mutex);
+    g_mutex_init (&query->matcher_mutex);
 }
 
 static gchar *
@@ -358,49 +378,96 @@ prepare_string_for_compare (const gchar *string)
     return res;
 }
 
-gdouble
-nautilus_query_matches_string (NautilusQuery *query,
-                               const gchar   *string)
+static NautilusQueryMatcher *
+nautilus_query_matcher_new (const gchar *text)
 {
-    gchar *prepared_string, *ptr;
-    gboolean found;
-    gdouble retval;
-    gint idx, nonexact_malus;
+    NautilusQueryMatcher *matcher;
+    gchar *prepared_string;
+    guint n_words, idx;
+
+    matcher = g_new0 (NautilusQueryMatcher, 1);
+    matcher->ref_count = 1;
+
+    prepared_string = prepare_string_for_compare (text);
+    matcher->words = g_strsplit (prepared_string, " ", -1);
+    g_free (prepared_string);
 
-    if (!query->text)
+    n_words = g_strv_length (matcher->words);
+    matcher->word_lengths = g_new (gsize, n_words);
+    for (idx = 0; idx < n_words; idx++)
     {
-        return -1;
+        matcher->word_lengths[idx] = strlen (matcher->words[idx]);
     }
 
-    g_mutex_lock (&query->prepared_words_mutex);
-    if (!query->prepared_words)
+    prepared_string = g_utf8_strdown ("I", -1);
+    matcher->ascii_lowercase_is_exact = strcmp (prepared_string, "i") == 0;
+    g_free (prepared_string);
+
+    return matcher;
+}
+
+NautilusQueryMatcher *
+nautilus_query_matcher_ref (NautilusQueryMatcher *matcher)
+{
+    g_atomic_int_inc (&matcher->ref_count);
+
+    return matcher;
+}
+
+void
+nautilus_query_matcher_unref (NautilusQueryMatcher *matcher)
+{
+    if (g_atomic_int_dec_and_test (&matcher->ref_count))
     {
-        prepared_string = prepare_string_for_compare (query->text);
-        query->prepared_words = g_strsplit (prepared_string, " ", -1);
-        g_free (prepared_string);
+        g_strfreev (matcher->words);
+        g_free (matcher->word_lengths);
+        g_free (matcher);
     }
+}
 
-    prepared_string = prepare_string_for_compare (string);
-    found = TRUE;
-    ptr = NULL;
-    nonexact_malus = 0;
+/* Lowercases @string into @buffer if it is plain ASCII and fits, in which
+ * case normalizing it would change nothing.
+ */
+static gboolean
+prepare_ascii_string_for_compare (const gchar *string,
+                                  gchar       *buffer,
+                                  gsize       *length)
+{
+    gsize i;
 
-    for (idx = 0; query->prepared_words[idx] != NULL; idx++)
+    for (i = 0; string[i] != '\0'; i++)
     {
-        if ((ptr = strstr (prepared_string, query->prepared_words[idx])) == NULL)
+        if (i + 1 >= ASCII_BUFFER_SIZE || (guchar) string[i] >= 0x80)
         {
-            found = FALSE;
-            break;
+            return FALSE;
         }
-
-        nonexact_malus += strlen (ptr) - strlen (query->prepared_words[idx]);
+        buffer[i] = g_ascii_tolower (string[i]);
     }
-    g_mutex_unlock (&query->prepared_words_mutex);
+    buffer[i] = '\0';
+    *length = i;
+
+    return TRUE;
+}
+
+static gdouble
+rank_prepared_string (NautilusQueryMatcher *matcher,
+                      const gchar          *prepared_string,
+                      gsize                 length)
+{
+    const gchar *ptr;
+    gint idx, nonexact_malus;
+
+    ptr = prepared_string;
+    nonexact_malus = 0;
 
-    if (!found)
+    for (idx = 0; matcher->words[idx] != NULL; idx++)
     {
-        g_free (prepared_string);
-        return -1;
+        if ((ptr = strstr (prepared_string, matcher->words[idx])) == NULL)
+        {
+            return -1;
+        }
+
+        nonexact_malus += length - (ptr - prepared_string) - matcher->word_lengths[idx];
     }
 
     /* The rank value depends on the numbers of letters before and after the match.
@@ -408,12 +475,69 @@ nautilus_query_matches_string (NautilusQuery *query,
      * after the match is divided by a factor, so that it decreases the rank by a
      * smaller amount.
      */
-    retval = MAX (MIN_RANK, MAX_RANK - (gdouble) (ptr - prepared_string) - (gdouble) nonexact_malus / RANK_SCALE_FACTOR);
+    return MAX (MIN_RANK, MAX_RANK - (gdouble) (ptr - prepared_string) - (gdouble) nonexact_malus / RANK_SCALE_FACTOR);
+}
+
+gdouble
+nautilus_query_matcher_match (NautilusQueryMatcher *matcher,
+                              const gchar          *string)
+{
+    gchar buffer[ASCII_BUFFER_SIZE];
+    gchar *prepared_string;
+    gsize length;
+    gdouble retval;
+
+    if (matcher->ascii_lowercase_is_exact &&
+        prepare_ascii_string_for_compare (string, buffer, &length))
+    {
+        return rank_prepared_string (matcher, buffer, length);
+    }
+
+    prepared_string = prepare_string_for_compare (string);
+    retval = rank_prepared_string (matcher, prepared_string, strlen (prepared_string));
     g_free (prepared_string);
 
     return retval;
 }
 
+NautilusQueryMatcher *
+nautilus_query_get_matcher (NautilusQuery *query)
+{
+    NautilusQueryMatcher *matcher;
+
+    g_return_val_if_fail (NAUTILUS_IS_QUERY (query), NULL);
+
+    matcher = NULL;
+
+    g_mutex_lock (&query->matcher_mutex);
+    if (query->matcher != NULL)
+    {
+        matcher = nautilus_query_matcher_ref (query->matcher);
+    }
+    g_mutex_unlock (&query->matcher_mutex);
+
+    return matcher;
+}
+
+gdouble
+nautilus_query_matches_string (NautilusQuery *query,
+                               const gchar   *string)
+{
+    NautilusQueryMatcher *matcher;
+    gdouble retval;
+
+    matcher = nautilus_query_get_matcher (query);
+    if (matcher == NULL)
+    {
+        return -1;
+    }
+
+    retval = nautilus_query_matcher_match (matcher, string);
+    nautilus_query_matcher_unref (matcher);
+
+    return retval;
+}
+
 NautilusQuery *
 nautilus_query_new (void)
 {
@@ -433,15 +557,25 @@ void
 nautilus_query_set_text (NautilusQuery *query,
                          const char    *text)
 {
+    NautilusQueryMatcher *old_matcher;
+    NautilusQueryMatcher *new_matcher;
+
     g_return_if_fail (NAUTILUS_IS_QUERY (query));
 
     g_free (query->text);
     query->text = g_strstrip (g_strdup (text));
 
-    g_mutex_lock (&query->prepared_words_mutex);
-    g_strfreev (query->prepared_words);
-    query->prepared_words = NULL;
-    g_mutex_unlock (&query->prepared_words_mutex);
+    new_matcher = nautilus_query_matcher_new (query->text);
+
+    g_mutex_lock (&query->matcher_mutex);
+    old_matcher = query->matcher;
+    query->matcher = new_matcher;
+    g_mutex_unlock (&query->matcher_mutex);
+
+    if (old_matcher != NULL)
+    {
+        nautilus_query_matcher_unref (old_matcher);
+    }
 
     g_object_notify (G_OBJECT (query), "text");
 }
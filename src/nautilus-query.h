@@ -79,6 +79,17 @@ void           nautilus_query_set_searching      (NautilusQuery *query,
 
 gdouble        nautilus_query_matches_string     (NautilusQuery *query, const gchar *string);
 
+/* A snapshot of the query text prepared for matching, safe to use from
+ * any thread without locking.
+ */
+typedef struct _NautilusQueryMatcher NautilusQueryMatcher;
+
+NautilusQueryMatcher * nautilus_query_get_matcher   (NautilusQuery        *query);
+NautilusQueryMatcher * nautilus_query_matcher_ref   (NautilusQueryMatcher *matcher);
+void                   nautilus_query_matcher_unref (NautilusQueryMatcher *matcher);
+gdouble                nautilus_query_matcher_match (NautilusQueryMatcher *matcher,
+                                                     const gchar          *string);
+
 char *         nautilus_query_to_readable_string (NautilusQuery *query);
 
 gboolean       nautilus_query_is_empty           (NautilusQuery *query);
@@ -60,7 +60,7 @@ struct _NautilusSearchDirectory
      * scheduled timeouts. */
     gboolean search_ready_and_valid;
 
-    GList *files;
+    GPtrArray *files;    /* NautilusFiles, in the order they were found */
     GHashTable *files_hash;
 
     GList *monitor_list;
@@ -121,17 +121,34 @@ static void search_callback_file_ready_callback (NautilusFile *file,
 static void file_changed (NautilusFile            *file,
                           NautilusSearchDirectory *self);
 
+/* Returns a list of the files found so far, with a reference each */
+static GList *
+copy_file_list (NautilusSearchDirectory *self)
+{
+    GList *list;
+    guint i;
+
+    list = NULL;
+    for (i = self->files->len; i > 0; i--)
+    {
+        list = g_list_prepend (list, nautilus_file_ref (g_ptr_array_index (self->files, i - 1)));
+    }
+
+    return list;
+}
+
 static void
 reset_file_list (NautilusSearchDirectory *self)
 {
-    GList *list, *monitor_list;
+    GList *monitor_list;
     NautilusFile *file;
     SearchMonitor *monitor;
+    guint i;
 
     /* Remove file connections */
-    for (list = self->files; list != NULL; list = list->next)
+    for (i = 0; i < self->files->len; i++)
     {
-        file = list->data;
+        file = g_ptr_array_index (self->files, i);
 
         /* Disconnect change handler */
         g_signal_handlers_disconnect_by_func (file, file_changed, self);
@@ -145,8 +162,7 @@ reset_file_list (NautilusSearchDirectory *self)
         }
     }
 
-    nautilus_file_list_free (self->files);
-    self->files = NULL;
+    g_ptr_array_set_size (self->files, 0);
 
     g_hash_table_remove_all (self->files_hash);
 }
@@ -252,6 +268,7 @@ search_monitor_add (NautilusDirectory         *directory,
     SearchMonitor *monitor;
     NautilusSearchDirectory *self;
     NautilusFile *file;
+    guint i;
 
     self = NAUTILUS_SEARCH_DIRECTORY (directory);
 
@@ -264,12 +281,14 @@ search_monitor_add (NautilusDirectory         *directory,
 
     if (callback != NULL)
     {
-        (*callback)(directory, self->files, callback_data);
+        list = copy_file_list (self);
+        (*callback)(directory, list, callback_data);
+        nautilus_file_list_free (list);
     }
 
-    for (list = self->files; list != NULL; list = list->next)
+    for (i = 0; i < self->files->len; i++)
     {
-        file = list->data;
+        file = g_ptr_array_index (self->files, i);
 
         /* Add monitors */
         nautilus_file_monitor_add (file, monitor, file_attributes);
@@ -282,12 +301,12 @@ static void
 search_monitor_remove_file_monitors (SearchMonitor           *monitor,
                                      NautilusSearchDirectory *self)
 {
-    GList *list;
     NautilusFile *file;
+    guint i;
 
-    for (list = self->files; list != NULL; list = list->next)
+    for (i = 0; i < self->files->len; i++)
     {
-        file = list->data;
+        file = g_ptr_array_index (self->files, i);
 
         nautilus_file_monitor_remove (file, monitor);
     }
@@ -453,21 +472,23 @@ search_callback_find_pending (NautilusSearchDirectory   *self,
 }
 
 static GHashTable *
-file_list_to_hash_table (GList *file_list)
+file_array_to_hash_table (GPtrArray *files)
 {
-    GList *list;
     GHashTable *table;
+    gpointer file;
+    guint i;
 
-    if (!file_list)
+    if (files->len == 0)
     {
         return NULL;
     }
 
     table = g_hash_table_new (NULL, NULL);
 
-    for (list = file_list; list != NULL; list = list->next)
+    for (i = 0; i < files->len; i++)
     {
-        g_hash_table_insert (table, list->data, list->data);
+        file = g_ptr_array_index (files, i);
+        g_hash_table_insert (table, file, file);
     }
 
     return table;
@@ -517,8 +538,8 @@ search_call_when_ready (NautilusDirectory         *directory,
     }
     else
     {
-        search_callback->file_list = nautilus_file_list_copy (self->files);
-        search_callback->non_ready_hash = file_list_to_hash_table (self->files);
+        search_callback->file_list = copy_file_list (self);
+        search_callback->non_ready_hash = file_array_to_hash_table (self->files);
 
         if (!search_callback->non_ready_hash)
         {
@@ -575,8 +596,8 @@ done:
 static void
 search_callback_add_pending_file_callbacks (SearchCallback *callback)
 {
-    callback->file_list = nautilus_file_list_copy (callback->search_directory->files);
-    callback->non_ready_hash = file_list_to_hash_table (callback->search_directory->files);
+    callback->file_list = copy_file_list (callback->search_directory);
+    callback->non_ready_hash = file_array_to_hash_table (callback->search_directory->files);
 
     search_callback_add_file_callbacks (callback);
 }
@@ -614,6 +635,8 @@ search_engine_hits_added (NautilusSearchEngine    *engine,
 
     file_list = NULL;
 
+    nautilus_search_hit_list_compute_scores (hits, self->query);
+
     for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next)
     {
         NautilusSearchHit *hit = hit_list->data;
@@ -621,9 +644,13 @@ search_engine_hits_added (NautilusSearchEngine    *engine,
 
         uri = nautilus_search_hit_get_uri (hit);
 
-        nautilus_search_hit_compute_scores (hit, self->query);
-
         file = nautilus_file_get_by_uri (uri);
+        if (g_hash_table_contains (self->files_hash, file))
+        {
+            nautilus_file_unref (file);
+            continue;
+        }
+
         nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
         nautilus_file_set_search_fts_snippet (file, nautilus_search_hit_get_fts_snippet (hit));
 
@@ -638,16 +665,20 @@ search_engine_hits_added (NautilusSearchEngine    *engine,
         g_signal_connect (file, "changed", G_CALLBACK (file_changed), self),
 
         file_list = g_list_prepend (file_list, file);
+        g_ptr_array_add (self->files, file);
         g_hash_table_add (self->files_hash, file);
     }
 
-    self->files = g_list_concat (self->files, file_list);
-
-    nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (self), file_list);
+    if (file_list != NULL)
+    {
+        file_list = g_list_reverse (file_list);
+        nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (self), file_list);
+        g_list_free (file_list);
 
-    file = nautilus_directory_get_corresponding_file (NAUTILUS_DIRECTORY (self));
-    nautilus_file_emit_changed (file);
-    nautilus_file_unref (file);
+        file = nautilus_directory_get_corresponding_file (NAUTILUS_DIRECTORY (self));
+        nautilus_file_emit_changed (file);
+        nautilus_file_unref (file);
+    }
 
     search_directory_add_pending_files_callbacks (self);
 }
@@ -744,7 +775,7 @@ search_get_file_list (NautilusDirectory *directory)
 
     self = NAUTILUS_SEARCH_DIRECTORY (directory);
 
-    return nautilus_file_list_copy (self->files);
+    return copy_file_list (self);
 }
 
 
@@ -920,6 +951,7 @@ search_finalize (GObject *object)
 
     self = NAUTILUS_SEARCH_DIRECTORY (object);
 
+    g_ptr_array_unref (self->files);
     g_hash_table_destroy (self->files_hash);
 
     G_OBJECT_CLASS (nautilus_search_directory_parent_class)->finalize (object);
@@ -929,6 +961,7 @@ static void
 nautilus_search_directory_init (NautilusSearchDirectory *self)
 {
     self->query = NULL;
+    self->files = g_ptr_array_new_with_free_func ((GDestroyNotify) nautilus_file_unref);
     self->files_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
 
     self->engine = nautilus_search_engine_new ();
@@ -0,0 +1,487 @@
+/*
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "nautilus-search-hit.h"
+#include "nautilus-search-provider.h"
+#include "nautilus-search-engine-index.h"
+#include "nautilus-search-index.h"
+#include "nautilus-ui-utilities.h"
+#define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
+#include "nautilus-debug.h"
+
+#include <errno.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define BATCH_SIZE 500
+
+enum
+{
+    PROP_0,
+    PROP_RUNNING,
+    LAST_PROP
+};
+
+typedef struct
+{
+    NautilusSearchEngineIndex *engine;
+    GCancellable *cancellable;
+
+    NautilusQueryMatcher *matcher;
+    GFile *location;
+    gboolean recursive;
+    gboolean show_hidden;
+    GList *mime_types;
+    GPtrArray *date_range;
+    NautilusQuerySearchType search_type;
+
+    /* The search location as the index spells its folders, for the depth */
+    char *location_uri;
+    gsize location_uri_length;
+
+    GList *hits;
+    guint n_hits;
+} IndexSearchData;
+
+typedef struct
+{
+    GList *hits;
+    GList *gone_locations;
+    IndexSearchData *data;
+} IndexHitsData;
+
+struct _NautilusSearchEngineIndex
+{
+    GObject parent_instance;
+    NautilusQuery *query;
+
+    IndexSearchData *active_search;
+};
+
+static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineIndex,
+                         nautilus_search_engine_index,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_SEARCH_PROVIDER,
+                                                nautilus_search_provider_init))
+
+static void
+finalize (GObject *object)
+{
+    NautilusSearchEngineIndex *index = NAUTILUS_SEARCH_ENGINE_INDEX (object);
+    g_clear_object (&index->query);
+
+    G_OBJECT_CLASS (nautilus_search_engine_index_parent_class)->finalize (object);
+}
+
+static IndexSearchData *
+index_search_data_new (NautilusSearchEngineIndex *engine,
+                       NautilusQuery             *query)
+{
+    IndexSearchData *data;
+
+    data = g_new0 (IndexSearchData, 1);
+
+    data->engine = g_object_ref (engine);
+    data->cancellable = g_cancellable_new ();
+    data->matcher = nautilus_query_get_matcher (query);
+    data->location = nautilus_query_get_location (query);
+    data->recursive = nautilus_query_get_recursive (query);
+    data->show_hidden = nautilus_query_get_show_hidden_files (query);
+    data->mime_types = nautilus_query_get_mime_types (query);
+    data->date_range = nautilus_query_get_date_range (query);
+    data->search_type = nautilus_query_get_search_type (query);
+
+    data->location_uri = g_file_get_uri (data->location);
+    data->location_uri_length = strlen (data->location_uri);
+    if (data->location_uri_length > 0 &&
+        data->location_uri[data->location_uri_length - 1] == '/')
+    {
+        data->location_uri[--data->location_uri_length] = '\0';
+    }
+
+    return data;
+}
+
+static void
+index_search_data_free (IndexSearchData *data)
+{
+    g_clear_pointer (&data->matcher, nautilus_query_matcher_unref);
+    g_clear_pointer (&data->date_range, g_ptr_array_unref);
+    g_list_free_full (data->mime_types, g_free);
+    g_list_free_full (data->hits, g_object_unref);
+    g_free (data->location_uri);
+    g_object_unref (data->location);
+    g_object_unref (data->cancellable);
+    g_object_unref (data->engine);
+
+    g_free (data);
+}
+
+static gboolean
+search_thread_add_hits_idle (gpointer user_data)
+{
+    IndexHitsData *hits_data = user_data;
+    IndexSearchData *data = hits_data->data;
+
+    /* Even for a cancelled search, what is gone is gone. The index is
+     * only changed from the main thread.
+     */
+    nautilus_search_index_remove_files (hits_data->gone_locations);
+
+    if (!g_cancellable_is_cancelled (data->cancellable) && hits_data->hits != NULL)
+    {
+        DEBUG ("Index engine add hits");
+        nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (data->engine),
+                                             hits_data->hits);
+    }
+
+    g_list_free_full (hits_data->hits, g_object_unref);
+    g_list_free_full (hits_data->gone_locations, g_object_unref);
+    g_free (hits_data);
+
+    return FALSE;
+}
+
+/* The index only hears about the changes made in the folders Nautilus
+ * shows, so files deleted or renamed by other programs are still in it.
+ * Only the hits are checked, with an lstat each, and the ones that are
+ * gone are dropped from the batch and returned.
+ */
+static GList *
+remove_gone_hits (IndexSearchData  *data,
+                  GList           **hits)
+{
+    GList *gone_locations;
+    GList *l, *next;
+    GStatBuf buf;
+    const char *uri;
+    char *path;
+    gboolean exists;
+
+    gone_locations = NULL;
+    for (l = *hits; l != NULL; l = next)
+    {
+        next = l->next;
+
+        if (g_cancellable_is_cancelled (data->cancellable))
+        {
+            break;
+        }
+
+        uri = nautilus_search_hit_get_uri (l->data);
+        path = g_filename_from_uri (uri, NULL, NULL);
+        /* Only failing to find it counts, not failing to look */
+        exists = path == NULL || g_lstat (path, &buf) == 0 ||
+                 (errno != ENOENT && errno != ENOTDIR);
+        g_free (path);
+
+        if (!exists)
+        {
+            gone_locations = g_list_prepend (gone_locations,
+                                             g_file_new_for_uri (uri));
+            g_object_unref (l->data);
+            *hits = g_list_delete_link (*hits, l);
+        }
+    }
+
+    return gone_locations;
+}
+
+static void
+send_batch (IndexSearchData *data)
+{
+    IndexHitsData *hits_data;
+    GList *gone_locations;
+
+    data->n_hits = 0;
+
+    gone_locations = remove_gone_hits (data, &data->hits);
+
+    if (data->hits != NULL || gone_locations != NULL)
+    {
+        hits_data = g_new (IndexHitsData, 1);
+        hits_data->hits = data->hits;
+        hits_data->gone_locations = gone_locations;
+        hits_data->data = data;
+        g_idle_add (search_thread_add_hits_idle, hits_data);
+    }
+    data->hits = NULL;
+}
+
+static gboolean
+search_thread_done_idle (gpointer user_data)
+{
+    IndexSearchData *data = user_data;
+    NautilusSearchEngineIndex *engine = data->engine;
+
+    DEBUG ("Index engine finished");
+    engine->active_search = NULL;
+    nautilus_search_provider_finished (NAUTILUS_SEARCH_PROVIDER (engine),
+                                       NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL);
+
+    g_object_notify (G_OBJECT (engine), "running");
+
+    index_search_data_free (data);
+
+    return FALSE;
+}
+
+/* Folders between the search location and @uri, the way the simple
+ * engine counts them: 0 for the children of the location itself.
+ */
+static guint
+get_hit_depth (IndexSearchData *data,
+               const char      *uri)
+{
+    const char *p;
+    guint depth;
+
+    if (strncmp (uri, data->location_uri, data->location_uri_length) != 0 ||
+        uri[data->location_uri_length] != '/')
+    {
+        return 0;
+    }
+
+    depth = 0;
+    for (p = uri + data->location_uri_length + 1; *p != '\0'; p++)
+    {
+        if (*p == '/' && p[1] != '\0')
+        {
+            depth++;
+        }
+    }
+
+    return depth;
+}
+
+static gboolean
+match_indexed_file (const char *uri,
+                    const char *display_name,
+                    const char *mime_type,
+                    guint64     mtime,
+                    guint64     atime,
+                    gboolean    is_hidden,
+                    gpointer    user_data)
+{
+    IndexSearchData *data = user_data;
+    NautilusSearchHit *hit;
+    GDateTime *date;
+    gdouble match;
+    gboolean found;
+    GList *l;
+
+    if (g_cancellable_is_cancelled (data->cancellable))
+    {
+        return FALSE;
+    }
+
+    if (is_hidden && !data->show_hidden)
+    {
+        return TRUE;
+    }
+
+    match = nautilus_query_matcher_match (data->matcher, display_name);
+    if (match <= -1)
+    {
+        return TRUE;
+    }
+
+    if (data->mime_types != NULL)
+    {
+        found = FALSE;
+        for (l = data->mime_types; mime_type[0] != '\0' && l != NULL; l = l->next)
+        {
+            if (g_content_type_is_a (mime_type, l->data))
+            {
+                found = TRUE;
+                break;
+            }
+        }
+
+        if (!found)
+        {
+            return TRUE;
+        }
+    }
+
+    if (data->date_range != NULL &&
+        !nautilus_file_date_in_between (data->search_type == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS ?
+                                        atime : mtime,
+                                        g_ptr_array_index (data->date_range, 0),
+                                        g_ptr_array_index (data->date_range, 1)))
+    {
+        return TRUE;
+    }
+
+    hit = nautilus_search_hit_new (uri);
+    nautilus_search_hit_set_fts_rank (hit, match);
+    date = g_date_time_new_from_unix_local (mtime);
+    nautilus_search_hit_set_modification_time (hit, date);
+    g_date_time_unref (date);
+    nautilus_search_hit_set_depth (hit, get_hit_depth (data, uri));
+
+    data->hits = g_list_prepend (data->hits, hit);
+
+    data->n_hits++;
+    if (data->n_hits == BATCH_SIZE)
+    {
+        send_batch (data);
+    }
+
+    return TRUE;
+}
+
+static gpointer
+search_thread_func (gpointer user_data)
+{
+    IndexSearchData *data = user_data;
+
+    if (data->matcher != NULL)
+    {
+        nautilus_search_index_foreach (data->location, data->recursive,
+                                       match_indexed_file, data);
+    }
+
+    /* Queued after the last batch, so that one is still added first */
+    send_batch (data);
+    g_idle_add (search_thread_done_idle, data);
+
+    return NULL;
+}
+
+static void
+nautilus_search_engine_index_start (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineIndex *index;
+    GThread *thread;
+
+    index = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    if (index->active_search != NULL)
+    {
+        return;
+    }
+
+    DEBUG ("Index engine start");
+
+    index->active_search = index_search_data_new (index, index->query);
+
+    thread = g_thread_new ("nautilus-search-index", search_thread_func,
+                           index->active_search);
+
+    g_object_notify (G_OBJECT (provider), "running");
+
+    g_thread_unref (thread);
+}
+
+static void
+nautilus_search_engine_index_stop (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineIndex *index = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    if (index->active_search != NULL)
+    {
+        DEBUG ("Index engine stop");
+        g_cancellable_cancel (index->active_search->cancellable);
+    }
+}
+
+static void
+nautilus_search_engine_index_set_query (NautilusSearchProvider *provider,
+                                        NautilusQuery          *query)
+{
+    NautilusSearchEngineIndex *index = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    g_object_ref (query);
+    g_clear_object (&index->query);
+    index->query = query;
+}
+
+static gboolean
+nautilus_search_engine_index_is_running (NautilusSearchProvider *provider)
+{
+    NautilusSearchEngineIndex *index;
+
+    index = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+    return index->active_search != NULL;
+}
+
+static void
+nautilus_search_engine_index_get_property (GObject    *object,
+                                           guint       prop_id,
+                                           GValue     *value,
+                                           GParamSpec *pspec)
+{
+    NautilusSearchProvider *self = NAUTILUS_SEARCH_PROVIDER (object);
+
+    switch (prop_id)
+    {
+        case PROP_RUNNING:
+        {
+            g_value_set_boolean (value, nautilus_search_engine_index_is_running (self));
+        }
+        break;
+
+        default:
+        {
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        }
+        break;
+    }
+}
+
+static void
+nautilus_search_provider_init (NautilusSearchProviderInterface *iface)
+{
+    iface->set_query = nautilus_search_engine_index_set_query;
+    iface->start = nautilus_search_engine_index_start;
+    iface->stop = nautilus_search_engine_index_stop;
+    iface->is_running = nautilus_search_engine_index_is_running;
+}
+
+static void
+nautilus_search_engine_index_class_init (NautilusSearchEngineIndexClass *class)
+{
+    GObjectClass *gobject_class;
+
+    gobject_class = G_OBJECT_CLASS (class);
+    gobject_class->finalize = finalize;
+    gobject_class->get_property = nautilus_search_engine_index_get_property;
+
+    /**
+     * NautilusSearchEngine::running:
+     *
+     * Whether the search engine is running a search.
+     */
+    g_object_class_override_property (gobject_class, PROP_RUNNING, "running");
+}
+
+static void
+nautilus_search_engine_index_init (NautilusSearchEngineIndex *engine)
+{
+}
+
+NautilusSearchEngineIndex *
+nautilus_search_engine_index_new (void)
+{
+    return g_object_new (NAUTILUS_TYPE_SEARCH_ENGINE_INDEX, NULL);
+}
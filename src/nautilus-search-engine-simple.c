@@ -33,6 +33,17 @@
 
 #define BATCH_SIZE 500
 
+/* Upper bound on the threads walking the tree of a recursive search. Most
+ * of their time goes into waiting for the file system, so twice the number
+ * of cores are started, up to this many.
+ */
+#define MAX_WALKERS 16
+
+/* Attached to the queued subdirectories, so hits don't need their depth
+ * worked out again when they are scored. The search location has none.
+ */
+#define DEPTH_KEY "nautilus-search-depth"
+
 enum
 {
     PROP_RECURSIVE = 1,
@@ -48,17 +59,28 @@ typedef struct
     GList *mime_types;
     GList *found_list;
 
+    /* Shared by the walkers, protected by lock */
+    GMutex lock;
+    GCond cond;
     GQueue *directories;     /* GFiles */
-
     GHashTable *visited;
+    guint n_busy_walkers;    /* walkers visiting a directory */
+    guint n_running_walkers;
 
     gboolean recursive;
-    gint n_processed_files;
-    GList *hits;
 
     NautilusQuery *query;
+    NautilusQueryMatcher *matcher;
 } SearchThreadData;
 
+/* One of the threads visiting directories of a search */
+typedef struct
+{
+    SearchThreadData *data;
+    gint n_processed_files;
+    GList *hits;
+} SearchWalker;
+
 
 struct _NautilusSearchEngineSimple
 {
@@ -100,6 +122,10 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
     data->directories = g_queue_new ();
     data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     data->query = g_object_ref (query);
+    data->matcher = nautilus_query_get_matcher (query);
+    data->recursive = engine->recursive;
+    g_mutex_init (&data->lock);
+    g_cond_init (&data->cond);
 
     location = nautilus_query_get_location (query);
 
@@ -118,10 +144,12 @@ search_thread_data_free (SearchThreadData *data)
                      (GFunc) g_object_unref, NULL);
     g_queue_free (data->directories);
     g_hash_table_destroy (data->visited);
+    g_mutex_clear (&data->lock);
+    g_cond_clear (&data->cond);
     g_object_unref (data->cancellable);
     g_object_unref (data->query);
+    g_clear_pointer (&data->matcher, nautilus_query_matcher_unref);
     g_list_free_full (data->mime_types, g_free);
-    g_list_free_full (data->hits, g_object_unref);
     g_object_unref (data->engine);
 
     g_free (data);
@@ -178,20 +206,20 @@ search_thread_add_hits_idle (gpointer user_data)
 }
 
 static void
-send_batch (SearchThreadData *thread_data)
+send_batch (SearchWalker *walker)
 {
     SearchHitsData *data;
 
-    thread_data->n_processed_files = 0;
+    walker->n_processed_files = 0;
 
-    if (thread_data->hits)
+    if (walker->hits)
     {
         data = g_new (SearchHitsData, 1);
-        data->hits = thread_data->hits;
-        data->thread_data = thread_data;
+        data->hits = walker->hits;
+        data->thread_data = walker->data;
         g_idle_add (search_thread_add_hits_idle, data);
     }
-    thread_data->hits = NULL;
+    walker->hits = NULL;
 }
 
 #define STD_ATTRIBUTES \
@@ -204,10 +232,49 @@ send_batch (SearchThreadData *thread_data)
     G_FILE_ATTRIBUTE_TIME_ACCESS "," \
     G_FILE_ATTRIBUTE_ID_FILE
 
+/* Adds the directories found in a directory to the shared queue, skipping
+ * the ones some walker has already seen.
+ */
 static void
-visit_directory (GFile            *dir,
-                 SearchThreadData *data)
+queue_directories (SearchThreadData *data,
+                   GList            *directories,
+                   GList            *ids)
 {
+    GList *l, *id;
+    gboolean added;
+
+    added = FALSE;
+
+    g_mutex_lock (&data->lock);
+    for (l = directories, id = ids; l != NULL; l = l->next, id = id->next)
+    {
+        if (id->data != NULL)
+        {
+            if (g_hash_table_contains (data->visited, id->data))
+            {
+                g_object_unref (l->data);
+                continue;
+            }
+            g_hash_table_add (data->visited, g_strdup (id->data));
+        }
+
+        g_queue_push_tail (data->directories, l->data);
+        added = TRUE;
+    }
+    if (added)
+    {
+        g_cond_broadcast (&data->cond);
+    }
+    g_mutex_unlock (&data->lock);
+
+    g_list_free (directories);
+}
+
+static void
+visit_directory (GFile        *dir,
+                 SearchWalker *walker)
+{
+    SearchThreadData *data;
     GFileEnumerator *enumerator;
     GFileInfo *info;
     GFile *child;
@@ -215,14 +282,18 @@ visit_directory (GFile            *dir,
     gdouble match;
     gboolean is_hidden, found;
     GList *l;
-    const char *id;
-    gboolean visited;
+    GList *subdirectories, *subdirectory_ids;
+    guint depth;
     guint64 atime;
     guint64 mtime;
     GPtrArray *date_range;
     GDateTime *initial_date;
     GDateTime *end_date;
 
+    data = walker->data;
+    subdirectories = NULL;
+    subdirectory_ids = NULL;
+    depth = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (dir), DEPTH_KEY));
 
     enumerator = g_file_enumerate_children (dir,
                                             data->mime_types != NULL ?
@@ -254,7 +325,8 @@ visit_directory (GFile            *dir,
         }
 
         child = g_file_get_child (dir, g_file_info_get_name (info));
-        match = nautilus_query_matches_string (data->query, display_name);
+        match = data->matcher != NULL ?
+                nautilus_query_matcher_match (data->matcher, display_name) : -1;
         found = (match > -1);
 
         if (found && data->mime_types)
@@ -309,40 +381,26 @@ visit_directory (GFile            *dir,
             hit = nautilus_search_hit_new (uri);
             g_free (uri);
             nautilus_search_hit_set_fts_rank (hit, match);
+            nautilus_search_hit_set_depth (hit, depth);
             date = g_date_time_new_from_unix_local (mtime);
             nautilus_search_hit_set_modification_time (hit, date);
             g_date_time_unref (date);
 
-            data->hits = g_list_prepend (data->hits, hit);
+            walker->hits = g_list_prepend (walker->hits, hit);
         }
 
-        data->n_processed_files++;
-        if (data->n_processed_files > BATCH_SIZE)
+        walker->n_processed_files++;
+        if (walker->n_processed_files > BATCH_SIZE)
         {
-            send_batch (data);
+            send_batch (walker);
         }
 
-        if (data->engine->recursive && g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+        if (data->recursive && g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
         {
-            id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
-            visited = FALSE;
-            if (id)
-            {
-                if (g_hash_table_lookup_extended (data->visited,
-                                                  id, NULL, NULL))
-                {
-                    visited = TRUE;
-                }
-                else
-                {
-                    g_hash_table_insert (data->visited, g_strdup (id), NULL);
-                }
-            }
-
-            if (!visited)
-            {
-                g_queue_push_tail (data->directories, g_object_ref (child));
-            }
+            g_object_set_data (G_OBJECT (child), DEPTH_KEY, GUINT_TO_POINTER (depth + 1));
+            subdirectories = g_list_prepend (subdirectories, g_object_ref (child));
+            subdirectory_ids = g_list_prepend (subdirectory_ids,
+                                               g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE)));
         }
 
         g_object_unref (child);
@@ -351,16 +409,94 @@ next:
     }
 
     g_object_unref (enumerator);
+
+    if (subdirectories != NULL)
+    {
+        queue_directories (data,
+                           g_list_reverse (subdirectories),
+                           g_list_reverse (subdirectory_ids));
+        g_list_free_full (subdirectory_ids, g_free);
+    }
 }
 
 
+/* Takes directories off the shared queue until it is empty and no other
+ * walker can add to it anymore.
+ */
+static gpointer
+search_walker_thread_func (gpointer user_data)
+{
+    SearchWalker walker = { 0 };
+    SearchThreadData *data;
+    GFile *dir;
+    gboolean last;
+
+    data = user_data;
+    walker.data = data;
+
+    g_mutex_lock (&data->lock);
+    while (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        dir = g_queue_pop_head (data->directories);
+        if (dir != NULL)
+        {
+            data->n_busy_walkers++;
+            g_mutex_unlock (&data->lock);
+
+            visit_directory (dir, &walker);
+            g_object_unref (dir);
+
+            g_mutex_lock (&data->lock);
+            data->n_busy_walkers--;
+            if (data->n_busy_walkers == 0 && g_queue_is_empty (data->directories))
+            {
+                /* Wake up the idle walkers so they can finish */
+                g_cond_broadcast (&data->cond);
+            }
+        }
+        else if (data->n_busy_walkers == 0)
+        {
+            break;
+        }
+        else
+        {
+            g_cond_wait (&data->cond, &data->lock);
+        }
+    }
+    /* If cancelled, the others may be waiting */
+    g_cond_broadcast (&data->cond);
+    g_mutex_unlock (&data->lock);
+
+    if (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        send_batch (&walker);
+    }
+    g_list_free_full (walker.hits, g_object_unref);
+
+    g_mutex_lock (&data->lock);
+    data->n_running_walkers--;
+    last = data->n_running_walkers == 0;
+    g_mutex_unlock (&data->lock);
+
+    /* The last walker to finish hands the data back */
+    if (last)
+    {
+        g_idle_add (search_thread_done_idle, data);
+    }
+
+    return NULL;
+}
+
 static gpointer
 search_thread_func (gpointer user_data)
 {
     SearchThreadData *data;
     GFile *dir;
     GFileInfo *info;
+    GThread *thread;
     const char *id;
+    guint n_walkers;
+    guint i;
 
     data = user_data;
 
@@ -372,26 +508,28 @@ search_thread_func (gpointer user_data)
         id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
         if (id)
         {
-            g_hash_table_insert (data->visited, g_strdup (id), NULL);
+            g_hash_table_add (data->visited, g_strdup (id));
         }
         g_object_unref (info);
     }
 
-    while (!g_cancellable_is_cancelled (data->cancellable) &&
-           (dir = g_queue_pop_head (data->directories)) != NULL)
+    /* Only a recursive search has more than one directory to visit */
+    n_walkers = 1;
+    if (data->recursive)
     {
-        visit_directory (dir, data);
-        g_object_unref (dir);
+        /* Walkers mostly wait on the disk, twice the cores keeps it busy */
+        n_walkers = CLAMP (g_get_num_processors () * 2, 2, MAX_WALKERS);
     }
 
-    if (!g_cancellable_is_cancelled (data->cancellable))
+    data->n_running_walkers = n_walkers;
+    for (i = 1; i < n_walkers; i++)
     {
-        send_batch (data);
+        thread = g_thread_new ("nautilus-search-walker",
+                               search_walker_thread_func, data);
+        g_thread_unref (thread);
     }
 
-    g_idle_add (search_thread_done_idle, data);
-
-    return NULL;
+    return search_walker_thread_func (data);
 }
 
 static void
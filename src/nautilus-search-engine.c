@@ -26,6 +26,8 @@
 #include "nautilus-search-engine.h"
 #include "nautilus-search-engine-simple.h"
 #include "nautilus-search-engine-model.h"
+#include "nautilus-search-engine-index.h"
+#include "nautilus-search-index.h"
 #define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
 #include "nautilus-debug.h"
 #include "nautilus-search-engine-tracker.h"
@@ -35,6 +37,7 @@ typedef struct
     NautilusSearchEngineTracker *tracker;
     NautilusSearchEngineSimple *simple;
     NautilusSearchEngineModel *model;
+    NautilusSearchEngineIndex *index;
 
     GHashTable *uris;
     guint providers_running;
@@ -76,6 +79,7 @@ nautilus_search_engine_set_query (NautilusSearchProvider *provider,
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->tracker), query);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->model), query);
     nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->simple), query);
+    nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (priv->index), query);
 }
 
 static void
@@ -104,6 +108,12 @@ search_engine_start_real (NautilusSearchEngine *engine)
         priv->providers_running++;
     }
 
+    if (nautilus_search_index_is_enabled ())
+    {
+        nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (priv->index));
+        priv->providers_running++;
+    }
+
     nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (priv->simple));
     priv->providers_running++;
 }
@@ -161,6 +171,7 @@ nautilus_search_engine_stop (NautilusSearchProvider *provider)
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->tracker));
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->model));
     nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->simple));
+    nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (priv->index));
 
     priv->running = FALSE;
     priv->restart = FALSE;
@@ -189,16 +200,17 @@ search_provider_hits_added (NautilusSearchProvider *provider,
     for (l = hits; l != NULL; l = l->next)
     {
         NautilusSearchHit *hit = l->data;
-        int count;
         const char *uri;
 
         uri = nautilus_search_hit_get_uri (hit);
-        count = GPOINTER_TO_INT (g_hash_table_lookup (priv->uris, uri));
-        if (count == 0)
+        if (!g_hash_table_contains (priv->uris, uri))
         {
+            /* The hit is kept alive by the table, so its URI can be
+             * the key without copying it.
+             */
+            g_hash_table_insert (priv->uris, (gpointer) uri, g_object_ref (hit));
             added = g_list_prepend (added, hit);
         }
-        g_hash_table_replace (priv->uris, g_strdup (uri), GINT_TO_POINTER (++count));
     }
     if (added != NULL)
     {
@@ -336,6 +348,7 @@ nautilus_search_engine_finalize (GObject *object)
     g_clear_object (&priv->tracker);
     g_clear_object (&priv->model);
     g_clear_object (&priv->simple);
+    g_clear_object (&priv->index);
 
     G_OBJECT_CLASS (nautilus_search_engine_parent_class)->finalize (object);
 }
@@ -385,7 +398,7 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
     NautilusSearchEnginePrivate *priv;
 
     priv = nautilus_search_engine_get_instance_private (engine);
-    priv->uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->uris = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
 
     priv->tracker = nautilus_search_engine_tracker_new ();
     connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->tracker));
@@ -395,6 +408,9 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
 
     priv->simple = nautilus_search_engine_simple_new ();
     connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->simple));
+
+    priv->index = nautilus_search_engine_index_new ();
+    connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (priv->index));
 }
 
 NautilusSearchEngine *
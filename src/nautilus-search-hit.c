@@ -32,6 +32,8 @@ struct _NautilusSearchHit
     GObject parent_instance;
 
     char *uri;
+    /* Folders between the hit and the search location, -1 if not known */
+    gint depth;
 
     GDateTime *modification_time;
     GDateTime *access_time;
@@ -54,47 +56,62 @@ enum
 
 G_DEFINE_TYPE (NautilusSearchHit, nautilus_search_hit, G_TYPE_OBJECT)
 
-void
-nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
-                                    NautilusQuery     *query)
+/* Number of folders between @uri and @prefix, or -1 if @uri is not inside
+ * @prefix. Plain string work, so it is cheap enough for every hit.
+ */
+static gint
+get_depth_below (const char *uri,
+                 const char *prefix,
+                 gsize       prefix_length)
+{
+    const char *p;
+    gint depth;
+
+    if (strncmp (uri, prefix, prefix_length) != 0 ||
+        uri[prefix_length] != '/' ||
+        uri[prefix_length + 1] == '\0')
+    {
+        return -1;
+    }
+
+    depth = 0;
+    for (p = uri + prefix_length + 1; *p != '\0'; p++)
+    {
+        /* A trailing slash doesn't make another level */
+        if (*p == '/' && p[1] != '\0')
+        {
+            depth++;
+        }
+    }
+
+    return depth;
+}
+
+static void
+compute_scores (NautilusSearchHit *hit,
+                const char        *location_uri,
+                gsize              location_uri_length,
+                GDateTime         *now)
 {
-    GDateTime *now;
-    GFile *query_location;
-    GFile *hit_location;
     GTimeSpan m_diff = G_MAXINT64;
     GTimeSpan a_diff = G_MAXINT64;
     GTimeSpan t_diff = G_MAXINT64;
     gdouble recent_bonus = 0.0;
     gdouble proximity_bonus = 0.0;
     gdouble match_bonus = 0.0;
+    gint dir_count;
 
-    query_location = nautilus_query_get_location (query);
-    hit_location = g_file_new_for_uri (hit->uri);
-
-    if (g_file_has_prefix (hit_location, query_location))
+    dir_count = hit->depth;
+    if (dir_count < 0)
     {
-        GFile *parent, *location;
-        guint dir_count = 0;
-
-        parent = g_file_get_parent (hit_location);
-
-        while (!g_file_equal (parent, query_location))
-        {
-            dir_count++;
-            location = parent;
-            parent = g_file_get_parent (location);
-            g_object_unref (location);
-        }
-        g_object_unref (parent);
+        dir_count = get_depth_below (hit->uri, location_uri, location_uri_length);
+    }
 
-        if (dir_count < 10)
-        {
-            proximity_bonus = 10000.0 - 1000.0 * dir_count;
-        }
+    if (dir_count >= 0 && dir_count < 10)
+    {
+        proximity_bonus = 10000.0 - 1000.0 * dir_count;
     }
-    g_object_unref (hit_location);
 
-    now = g_date_time_new_now_local ();
     if (hit->modification_time != NULL)
     {
         m_diff = g_date_time_difference (now, hit->modification_time);
@@ -143,11 +160,53 @@ nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
     hit->relevance = recent_bonus + proximity_bonus + match_bonus;
     DEBUG ("Hit %s computed relevance %.2f (%.2f + %.2f + %.2f)", hit->uri, hit->relevance,
            proximity_bonus, recent_bonus, match_bonus);
+}
+
+void
+nautilus_search_hit_list_compute_scores (GList         *hits,
+                                         NautilusQuery *query)
+{
+    GDateTime *now;
+    GFile *query_location;
+    char *location_uri;
+    gsize location_uri_length;
+    GList *l;
+
+    if (hits == NULL)
+    {
+        return;
+    }
+
+    query_location = nautilus_query_get_location (query);
+    location_uri = g_file_get_uri (query_location);
+    location_uri_length = strlen (location_uri);
+    /* The root has a trailing slash already */
+    if (location_uri_length > 0 && location_uri[location_uri_length - 1] == '/')
+    {
+        location_uri[--location_uri_length] = '\0';
+    }
+
+    now = g_date_time_new_now_local ();
+
+    for (l = hits; l != NULL; l = l->next)
+    {
+        compute_scores (l->data, location_uri, location_uri_length, now);
+    }
 
     g_date_time_unref (now);
+    g_free (location_uri);
     g_object_unref (query_location);
 }
 
+void
+nautilus_search_hit_compute_scores (NautilusSearchHit *hit,
+                                    NautilusQuery     *query)
+{
+    GList list = { hit, NULL, NULL };
+
+    nautilus_search_hit_list_compute_scores (&list, query);
+}
+
 const char *
 nautilus_search_hit_get_uri (NautilusSearchHit *hit)
 {
@@ -174,6 +233,13 @@ nautilus_search_hit_set_uri (NautilusSearchHit *hit,
     hit->uri = g_strdup (uri);
 }
 
+void
+nautilus_search_hit_set_depth (NautilusSearchHit *hit,
+                               guint              depth)
+{
+    hit->depth = depth;
+}
+
 void
 nautilus_search_hit_set_fts_rank (NautilusSearchHit *hit,
                                   gdouble            rank)
@@ -420,6 +486,7 @@ nautilus_search_hit_class_init (NautilusSearchHitClass *class)
 static void
 nautilus_search_hit_init (NautilusSearchHit *hit)
 {
+    hit->depth = -1;
     hit = G_TYPE_INSTANCE_GET_PRIVATE (hit,
                                        NAUTILUS_TYPE_SEARCH_HIT,
                                        NautilusSearchHit);
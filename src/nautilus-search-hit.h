@@ -31,6 +31,11 @@ G_DECLARE_FINAL_TYPE (NautilusSearchHit, nautilus_search_hit, NAUTILUS, SEARCH_H
 
 NautilusSearchHit * nautilus_search_hit_new                   (const char        *uri);
 
+/* How many folders down from the search location the hit is. Providers
+ * that know it save the scoring from working it out from the URI.
+ */
+void                nautilus_search_hit_set_depth             (NautilusSearchHit *hit,
+							       guint              depth);
 void                nautilus_search_hit_set_fts_rank          (NautilusSearchHit *hit,
 							       gdouble            fts_rank);
 void                nautilus_search_hit_set_modification_time (NautilusSearchHit *hit,
@@ -41,6 +46,8 @@ void                nautilus_search_hit_set_fts_snippet       (NautilusSearchHit
                                                                const gchar       *snippet);
 void                nautilus_search_hit_compute_scores        (NautilusSearchHit *hit,
 							       NautilusQuery     *query);
+void                nautilus_search_hit_list_compute_scores   (GList             *hits,
+							       NautilusQuery     *query);
 
 const char *        nautilus_search_hit_get_uri               (NautilusSearchHit *hit);
 gdouble             nautilus_search_hit_get_relevance         (NautilusSearchHit *hit);
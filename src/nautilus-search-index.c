@@ -0,0 +1,872 @@
+/*
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "nautilus-search-index.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "nautilus-directory-notify.h"
+#include "nautilus-global-preferences.h"
+#define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
+#include "nautilus-debug.h"
+
+#define INDEX_VERSION 1
+
+/* (version, [(uri, display name, mime type, mtime, atime, hidden)]) */
+#define INDEX_TYPE "(ua(sssttb))"
+
+/* Keeps the memory used by the index in check */
+#define MAX_ENTRIES 200000
+
+/* Changes are written out this long after the first one */
+#define SAVE_TIMEOUT_SECONDS 30
+
+/* What is recorded for each file, when it has to be asked for again */
+#define INDEX_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+    G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," \
+    G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE "," \
+    G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+    G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+    G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+    G_FILE_ATTRIBUTE_TIME_ACCESS
+
+
+/* Entries never change once they are in the index, they are replaced
+ * instead. That lets searches take references to them and match them
+ * without holding the lock.
+ */
+typedef struct
+{
+    gint ref_count;
+    char *uri;
+    const char *name;                /* points into uri */
+    char *display_name;
+    char *mime_type;
+    guint64 mtime;
+    guint64 atime;
+    gboolean is_hidden;
+} IndexEntry;
+
+/* Everything below is protected by index_mutex, except save_timeout_id
+ * which is only used from the main thread.
+ */
+static GMutex index_mutex;
+static GCond index_loaded_cond;
+static GHashTable *index_folders;    /* folder uri -> (name -> IndexEntry) */
+static gboolean index_loaded;
+static guint index_size;
+static gboolean index_dirty;
+static gboolean index_saving;
+static guint save_timeout_id;
+
+static IndexEntry *
+index_entry_new (const char *uri,
+                 const char *display_name,
+                 const char *mime_type,
+                 guint64     mtime,
+                 guint64     atime,
+                 gboolean    is_hidden)
+{
+    IndexEntry *entry;
+
+    entry = g_new (IndexEntry, 1);
+    entry->ref_count = 1;
+    entry->uri = g_strdup (uri);
+    entry->name = strrchr (entry->uri, '/') + 1;
+    entry->display_name = g_strdup (display_name);
+    entry->mime_type = g_strdup (mime_type);
+    entry->mtime = mtime;
+    entry->atime = atime;
+    entry->is_hidden = is_hidden;
+
+    return entry;
+}
+
+static IndexEntry *
+index_entry_ref (IndexEntry *entry)
+{
+    g_atomic_int_inc (&entry->ref_count);
+
+    return entry;
+}
+
+static void
+index_entry_unref (IndexEntry *entry)
+{
+    if (g_atomic_int_dec_and_test (&entry->ref_count))
+    {
+        g_free (entry->uri);
+        g_free (entry->display_name);
+        g_free (entry->mime_type);
+        g_free (entry);
+    }
+}
+
+/* Folders are keyed by their uri without a trailing slash, which is
+ * also what the uris of their children start with.
+ */
+static char *
+get_folder_uri (GFile *location)
+{
+    char *uri;
+    gsize length;
+
+    uri = g_file_get_uri (location);
+    length = strlen (uri);
+    /* The root has a trailing slash already */
+    if (length > 0 && uri[length - 1] == '/')
+    {
+        uri[length - 1] = '\0';
+    }
+
+    return uri;
+}
+
+/* Called with index_mutex held */
+static GHashTable *
+lookup_parent_folder (const char *uri)
+{
+    char *parent_uri;
+    GHashTable *folder;
+
+    parent_uri = g_strndup (uri, strrchr (uri, '/') - uri);
+    folder = g_hash_table_lookup (index_folders, parent_uri);
+    g_free (parent_uri);
+
+    return folder;
+}
+
+/* Called with index_mutex held, takes ownership of @entry */
+static void
+insert_entry (IndexEntry *entry)
+{
+    GHashTable *folder;
+
+    folder = lookup_parent_folder (entry->uri);
+    if (folder == NULL)
+    {
+        if (index_size >= MAX_ENTRIES)
+        {
+            index_entry_unref (entry);
+            return;
+        }
+
+        folder = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        NULL, (GDestroyNotify) index_entry_unref);
+        g_hash_table_insert (index_folders,
+                             g_strndup (entry->uri, entry->name - 1 - entry->uri),
+                             folder);
+    }
+
+    if (!g_hash_table_contains (folder, entry->name))
+    {
+        if (index_size >= MAX_ENTRIES)
+        {
+            index_entry_unref (entry);
+            return;
+        }
+        index_size++;
+    }
+
+    /* Replace rather than insert, the key points into the entry */
+    g_hash_table_replace (folder, (gpointer) entry->name, entry);
+}
+
+/* Called with index_mutex held. Adds references to everything inside
+ * the folder @uri, at any depth, to @entries.
+ */
+static void
+collect_folder (const char *uri,
+                GPtrArray  *entries)
+{
+    GHashTable *folder;
+    GHashTableIter iter;
+    IndexEntry *entry;
+
+    folder = g_hash_table_lookup (index_folders, uri);
+    if (folder == NULL)
+    {
+        return;
+    }
+
+    g_hash_table_iter_init (&iter, folder);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+        g_ptr_array_add (entries, index_entry_ref (entry));
+        collect_folder (entry->uri, entries);
+    }
+}
+
+/* Called with index_mutex held */
+static gboolean
+remove_folder (const char *uri)
+{
+    GHashTable *folder;
+    GHashTableIter iter;
+    IndexEntry *entry;
+
+    folder = g_hash_table_lookup (index_folders, uri);
+    if (folder == NULL)
+    {
+        return FALSE;
+    }
+
+    g_hash_table_iter_init (&iter, folder);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+        remove_folder (entry->uri);
+    }
+
+    index_size -= g_hash_table_size (folder);
+    g_hash_table_remove (index_folders, uri);
+
+    return TRUE;
+}
+
+/* Called with index_mutex held. Removes @uri and everything inside it. */
+static gboolean
+remove_entry (const char *uri)
+{
+    GHashTable *folder;
+    char *parent_uri;
+    gboolean removed;
+
+    removed = remove_folder (uri);
+
+    parent_uri = g_strndup (uri, strrchr (uri, '/') - uri);
+    folder = g_hash_table_lookup (index_folders, parent_uri);
+    if (folder != NULL && g_hash_table_remove (folder, strrchr (uri, '/') + 1))
+    {
+        index_size--;
+        removed = TRUE;
+
+        if (g_hash_table_size (folder) == 0)
+        {
+            g_hash_table_remove (index_folders, parent_uri);
+        }
+    }
+    g_free (parent_uri);
+
+    return removed;
+}
+
+static char *
+get_index_path (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "nautilus", "search-index", NULL);
+}
+
+static void
+load_index (void)
+{
+    char *path;
+    GMappedFile *mapped_file;
+    GBytes *bytes;
+    GVariant *index;
+    GVariant *entries;
+    GVariantIter iter;
+    const char *uri, *display_name, *mime_type;
+    guint64 mtime, atime;
+    gboolean is_hidden;
+    guint32 version;
+    GPtrArray *loaded;
+    GHashTable *folder;
+    IndexEntry *entry;
+    guint i;
+
+    path = get_index_path ();
+    mapped_file = g_mapped_file_new (path, FALSE, NULL);
+    g_free (path);
+
+    if (mapped_file == NULL)
+    {
+        return;
+    }
+
+    bytes = g_mapped_file_get_bytes (mapped_file);
+    g_mapped_file_unref (mapped_file);
+
+    index = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (INDEX_TYPE),
+                                                          bytes, FALSE));
+    g_bytes_unref (bytes);
+
+    g_variant_get (index, "(u@a(sssttb))", &version, &entries);
+    if (version == INDEX_VERSION)
+    {
+        /* Build the entries first, so that the lock is only held while
+         * putting them in place.
+         */
+        loaded = g_ptr_array_new ();
+        g_variant_iter_init (&iter, entries);
+        while (loaded->len < MAX_ENTRIES &&
+               g_variant_iter_next (&iter, "(&s&s&sttb)", &uri, &display_name,
+                                    &mime_type, &mtime, &atime, &is_hidden))
+        {
+            if (strchr (uri, '/') == NULL)
+            {
+                continue;
+            }
+
+            g_ptr_array_add (loaded,
+                             index_entry_new (uri, display_name, mime_type,
+                                              mtime, atime, is_hidden));
+        }
+
+        g_mutex_lock (&index_mutex);
+        for (i = 0; i < loaded->len; i++)
+        {
+            entry = g_ptr_array_index (loaded, i);
+
+            /* What was recorded since startup is newer */
+            folder = lookup_parent_folder (entry->uri);
+            if (folder != NULL && g_hash_table_contains (folder, entry->name))
+            {
+                index_entry_unref (entry);
+                continue;
+            }
+
+            insert_entry (entry);
+        }
+        DEBUG ("Search index loaded, %u files", index_size);
+        g_mutex_unlock (&index_mutex);
+
+        g_ptr_array_free (loaded, TRUE);
+    }
+
+    g_variant_unref (entries);
+    g_variant_unref (index);
+}
+
+static gpointer
+load_thread_func (gpointer user_data)
+{
+    load_index ();
+
+    g_mutex_lock (&index_mutex);
+    index_loaded = TRUE;
+    g_cond_broadcast (&index_loaded_cond);
+    g_mutex_unlock (&index_mutex);
+
+    return NULL;
+}
+
+static IndexEntry *
+index_entry_new_from_info (const char *uri,
+                           GFileInfo  *info)
+{
+    const char *display_name, *mime_type;
+
+    display_name = g_file_info_get_display_name (info);
+    if (display_name == NULL)
+    {
+        return NULL;
+    }
+
+    mime_type = g_file_info_get_content_type (info);
+
+    return index_entry_new (uri, display_name,
+                            mime_type != NULL ? mime_type : "",
+                            g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+                            g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_ACCESS),
+                            g_file_info_get_is_hidden (info) ||
+                            g_file_info_get_is_backup (info));
+}
+
+static void
+ensure_index (void)
+{
+    GThread *thread;
+    gboolean load;
+
+    g_mutex_lock (&index_mutex);
+    load = index_folders == NULL;
+    if (load)
+    {
+        index_folders = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free, (GDestroyNotify) g_hash_table_destroy);
+    }
+    g_mutex_unlock (&index_mutex);
+
+    if (load)
+    {
+        thread = g_thread_new ("nautilus-search-index-load", load_thread_func, NULL);
+        g_thread_unref (thread);
+    }
+}
+
+static gpointer
+save_thread_func (gpointer user_data)
+{
+    GVariantBuilder builder;
+    GHashTableIter iter, folder_iter;
+    GHashTable *folder;
+    GPtrArray *entries;
+    IndexEntry *entry;
+    GVariant *index;
+    char *path;
+    char *dirname;
+    GError *error;
+    guint i;
+
+    /* Only take references under the lock, and write them out after */
+    entries = g_ptr_array_new_with_free_func ((GDestroyNotify) index_entry_unref);
+
+    g_mutex_lock (&index_mutex);
+    g_hash_table_iter_init (&folder_iter, index_folders);
+    while (g_hash_table_iter_next (&folder_iter, NULL, (gpointer *) &folder))
+    {
+        g_hash_table_iter_init (&iter, folder);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+        {
+            g_ptr_array_add (entries, index_entry_ref (entry));
+        }
+    }
+    index_dirty = FALSE;
+    g_mutex_unlock (&index_mutex);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sssttb)"));
+    for (i = 0; i < entries->len; i++)
+    {
+        entry = g_ptr_array_index (entries, i);
+        g_variant_builder_add (&builder, "(sssttb)", entry->uri, entry->display_name,
+                               entry->mime_type, entry->mtime, entry->atime,
+                               entry->is_hidden);
+    }
+    g_ptr_array_unref (entries);
+
+    index = g_variant_ref_sink (g_variant_new ("(u@a(sssttb))", INDEX_VERSION,
+                                               g_variant_builder_end (&builder)));
+
+    path = get_index_path ();
+    dirname = g_path_get_dirname (path);
+    error = NULL;
+    if (g_mkdir_with_parents (dirname, 0700) != 0 ||
+        !g_file_set_contents (path, g_variant_get_data (index),
+                              g_variant_get_size (index), &error))
+    {
+        DEBUG ("Failed to save search index: %s",
+               error != NULL ? error->message : g_strerror (errno));
+        g_clear_error (&error);
+    }
+
+    g_free (dirname);
+    g_free (path);
+    g_variant_unref (index);
+
+    g_mutex_lock (&index_mutex);
+    index_saving = FALSE;
+    g_mutex_unlock (&index_mutex);
+
+    return NULL;
+}
+
+static gboolean
+save_timeout_callback (gpointer user_data)
+{
+    GThread *thread;
+    gboolean start;
+    gboolean retry;
+
+    save_timeout_id = 0;
+
+    g_mutex_lock (&index_mutex);
+    start = index_dirty && !index_saving;
+    retry = index_dirty && index_saving;
+    if (start)
+    {
+        index_saving = TRUE;
+    }
+    g_mutex_unlock (&index_mutex);
+
+    if (start)
+    {
+        thread = g_thread_new ("nautilus-search-index-save", save_thread_func, NULL);
+        g_thread_unref (thread);
+    }
+    else if (retry)
+    {
+        /* A save is still running, try again later */
+        save_timeout_id = g_timeout_add_seconds (SAVE_TIMEOUT_SECONDS,
+                                                 save_timeout_callback, NULL);
+    }
+
+    return FALSE;
+}
+
+/* Called with index_mutex held */
+static void
+schedule_save (void)
+{
+    index_dirty = TRUE;
+
+    if (save_timeout_id == 0)
+    {
+        save_timeout_id = g_timeout_add_seconds (SAVE_TIMEOUT_SECONDS,
+                                                 save_timeout_callback, NULL);
+    }
+}
+
+gboolean
+nautilus_search_index_is_enabled (void)
+{
+    return g_settings_get_boolean (nautilus_preferences,
+                                   NAUTILUS_PREFERENCES_SEARCH_INDEX);
+}
+
+void
+nautilus_search_index_add_files (GFile *parent,
+                                 GList *infos)
+{
+    GFileInfo *info;
+    GPtrArray *entries;
+    IndexEntry *entry;
+    GFile *child;
+    char *uri;
+    GList *l;
+    guint i;
+
+    if (infos == NULL ||
+        !nautilus_search_index_is_enabled () ||
+        !g_file_is_native (parent))
+    {
+        return;
+    }
+
+    ensure_index ();
+
+    entries = g_ptr_array_new ();
+    for (l = infos; l != NULL; l = l->next)
+    {
+        info = l->data;
+
+        if (g_file_info_get_name (info) == NULL)
+        {
+            continue;
+        }
+
+        child = g_file_get_child (parent, g_file_info_get_name (info));
+        uri = g_file_get_uri (child);
+        g_object_unref (child);
+
+        entry = index_entry_new_from_info (uri, info);
+        if (entry != NULL)
+        {
+            g_ptr_array_add (entries, entry);
+        }
+        g_free (uri);
+    }
+
+    g_mutex_lock (&index_mutex);
+    for (i = 0; i < entries->len; i++)
+    {
+        insert_entry (g_ptr_array_index (entries, i));
+    }
+    schedule_save ();
+    g_mutex_unlock (&index_mutex);
+
+    g_ptr_array_free (entries, TRUE);
+}
+
+void
+nautilus_search_index_remove_files (GList *locations)
+{
+    GPtrArray *uris;
+    gboolean removed;
+    GList *l;
+    guint i;
+
+    if (locations == NULL)
+    {
+        return;
+    }
+
+    uris = g_ptr_array_new_with_free_func (g_free);
+    for (l = locations; l != NULL; l = l->next)
+    {
+        g_ptr_array_add (uris, get_folder_uri (l->data));
+    }
+
+    g_mutex_lock (&index_mutex);
+    if (index_folders != NULL)
+    {
+        removed = FALSE;
+        for (i = 0; i < uris->len; i++)
+        {
+            if (strchr (g_ptr_array_index (uris, i), '/') != NULL &&
+                remove_entry (g_ptr_array_index (uris, i)))
+            {
+                removed = TRUE;
+            }
+        }
+
+        if (removed)
+        {
+            schedule_save ();
+        }
+    }
+    g_mutex_unlock (&index_mutex);
+
+    g_ptr_array_unref (uris);
+}
+
+static void
+refresh_files_thread (GTask        *task,
+                      gpointer      source_object,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+    GPtrArray *locations = task_data;
+    GFileInfo *info;
+    GHashTable *folder;
+    IndexEntry *entry;
+    gboolean changed;
+    char *uri;
+    guint i;
+
+    changed = FALSE;
+    for (i = 0; i < locations->len; i++)
+    {
+        info = g_file_query_info (g_ptr_array_index (locations, i), INDEX_ATTRIBUTES,
+                                  G_FILE_QUERY_INFO_NONE, NULL, NULL);
+        uri = get_folder_uri (g_ptr_array_index (locations, i));
+        entry = info != NULL ? index_entry_new_from_info (uri, info) : NULL;
+
+        g_mutex_lock (&index_mutex);
+        folder = lookup_parent_folder (uri);
+        if (folder == NULL || !g_hash_table_contains (folder, strrchr (uri, '/') + 1))
+        {
+            /* Dropped while the info was being read */
+            g_clear_pointer (&entry, index_entry_unref);
+        }
+        else if (entry != NULL)
+        {
+            insert_entry (entry);
+            changed = TRUE;
+        }
+        else
+        {
+            remove_entry (uri);
+            changed = TRUE;
+        }
+        g_mutex_unlock (&index_mutex);
+
+        g_free (uri);
+        g_clear_object (&info);
+    }
+
+    g_task_return_boolean (task, changed);
+}
+
+static void
+refresh_files_callback (GObject      *source_object,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+    if (g_task_propagate_boolean (G_TASK (res), NULL))
+    {
+        g_mutex_lock (&index_mutex);
+        schedule_save ();
+        g_mutex_unlock (&index_mutex);
+    }
+}
+
+void
+nautilus_search_index_refresh_files (GList *locations)
+{
+    GPtrArray *indexed;
+    GHashTable *folder;
+    GTask *task;
+    GList *l;
+    char *uri;
+
+    if (locations == NULL)
+    {
+        return;
+    }
+
+    /* Only the files already in the index are worth asking about */
+    indexed = g_ptr_array_new_with_free_func (g_object_unref);
+    g_mutex_lock (&index_mutex);
+    if (index_folders != NULL)
+    {
+        for (l = locations; l != NULL; l = l->next)
+        {
+            uri = get_folder_uri (l->data);
+            folder = strchr (uri, '/') != NULL ? lookup_parent_folder (uri) : NULL;
+            if (folder != NULL && g_hash_table_contains (folder, strrchr (uri, '/') + 1))
+            {
+                g_ptr_array_add (indexed, g_object_ref (l->data));
+            }
+            g_free (uri);
+        }
+    }
+    g_mutex_unlock (&index_mutex);
+
+    if (indexed->len == 0)
+    {
+        g_ptr_array_unref (indexed);
+        return;
+    }
+
+    task = g_task_new (NULL, NULL, refresh_files_callback, NULL);
+    g_task_set_task_data (task, indexed, (GDestroyNotify) g_ptr_array_unref);
+    g_task_run_in_thread (task, refresh_files_thread);
+    g_object_unref (task);
+}
+
+void
+nautilus_search_index_move_files (GList *file_pairs)
+{
+    GFilePair *pair;
+    GPtrArray *moved;
+    IndexEntry *entry, *new_entry;
+    GHashTable *folder;
+    GList *l;
+    char *from_uri, *to_uri, *uri, *basename, *display_name;
+    gsize from_length;
+    guint i;
+
+    g_mutex_lock (&index_mutex);
+    if (index_folders == NULL)
+    {
+        g_mutex_unlock (&index_mutex);
+        return;
+    }
+
+    for (l = file_pairs; l != NULL; l = l->next)
+    {
+        pair = l->data;
+        from_uri = get_folder_uri (pair->from);
+        from_length = strlen (from_uri);
+        if (strchr (from_uri, '/') == NULL)
+        {
+            g_free (from_uri);
+            continue;
+        }
+
+        /* Take out the file and anything inside it, then put them back
+         * under their new names.
+         */
+        moved = g_ptr_array_new_with_free_func ((GDestroyNotify) index_entry_unref);
+        folder = lookup_parent_folder (from_uri);
+        entry = folder != NULL ? g_hash_table_lookup (folder, strrchr (from_uri, '/') + 1) : NULL;
+        if (entry != NULL)
+        {
+            g_ptr_array_add (moved, index_entry_ref (entry));
+        }
+        collect_folder (from_uri, moved);
+
+        if (moved->len == 0)
+        {
+            g_ptr_array_unref (moved);
+            g_free (from_uri);
+            continue;
+        }
+
+        remove_entry (from_uri);
+
+        if (g_file_is_native (pair->to))
+        {
+            to_uri = get_folder_uri (pair->to);
+            basename = g_file_get_basename (pair->to);
+            display_name = g_filename_display_name (basename);
+            for (i = 0; i < moved->len; i++)
+            {
+                entry = g_ptr_array_index (moved, i);
+                uri = g_strconcat (to_uri, entry->uri + from_length, NULL);
+                /* The moved file itself may have been renamed */
+                new_entry = index_entry_new (uri,
+                                             entry->uri[from_length] == '\0' ?
+                                             display_name : entry->display_name,
+                                             entry->mime_type, entry->mtime,
+                                             entry->atime, entry->is_hidden);
+                insert_entry (new_entry);
+                g_free (uri);
+            }
+            g_free (display_name);
+            g_free (basename);
+            g_free (to_uri);
+        }
+
+        schedule_save ();
+        g_ptr_array_unref (moved);
+        g_free (from_uri);
+    }
+    g_mutex_unlock (&index_mutex);
+}
+
+void
+nautilus_search_index_foreach (GFile                   *location,
+                               gboolean                 recursive,
+                               NautilusSearchIndexFunc  func,
+                               gpointer                 user_data)
+{
+    GHashTableIter iter;
+    GHashTable *folder;
+    GPtrArray *entries;
+    IndexEntry *entry;
+    char *uri;
+    guint i;
+
+    /* Searching may be the first use of the index this session. This runs
+     * in the search thread, so it can wait for what was saved to be read.
+     */
+    ensure_index ();
+
+    uri = get_folder_uri (location);
+    entries = g_ptr_array_new_with_free_func ((GDestroyNotify) index_entry_unref);
+
+    /* Matching is left until after the lock is released, as the main
+     * thread updates the index while folders are loaded.
+     */
+    g_mutex_lock (&index_mutex);
+    while (!index_loaded)
+    {
+        g_cond_wait (&index_loaded_cond, &index_mutex);
+    }
+
+    if (recursive)
+    {
+        collect_folder (uri, entries);
+    }
+    else if ((folder = g_hash_table_lookup (index_folders, uri)) != NULL)
+    {
+        g_hash_table_iter_init (&iter, folder);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+        {
+            g_ptr_array_add (entries, index_entry_ref (entry));
+        }
+    }
+    g_mutex_unlock (&index_mutex);
+
+    for (i = 0; i < entries->len; i++)
+    {
+        entry = g_ptr_array_index (entries, i);
+        if (!func (entry->uri, entry->display_name, entry->mime_type,
+                   entry->mtime, entry->atime, entry->is_hidden, user_data))
+        {
+            break;
+        }
+    }
+
+    g_ptr_array_unref (entries);
+    g_free (uri);
+}
@@ -0,0 +1,62 @@
+/*
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef NAUTILUS_SEARCH_INDEX_H
+#define NAUTILUS_SEARCH_INDEX_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* A process wide index of the names and basic metadata of the local files
+ * Nautilus has listed, kept on disk between sessions. It only knows about
+ * the folders that have been shown, so it complements the other search
+ * providers rather than replacing them.
+ */
+
+typedef gboolean (* NautilusSearchIndexFunc) (const char *uri,
+                                              const char *display_name,
+                                              const char *mime_type,
+                                              guint64     mtime,
+                                              guint64     atime,
+                                              gboolean    is_hidden,
+                                              gpointer    user_data);
+
+gboolean nautilus_search_index_is_enabled    (void);
+
+/* Records @infos, as returned by enumerating @parent. */
+void     nautilus_search_index_add_files     (GFile                   *parent,
+                                              GList                   *infos);
+void     nautilus_search_index_remove_files  (GList                   *locations);
+/* Reads the info of the indexed files among @locations again, in a
+ * thread, and updates or drops them.
+ */
+void     nautilus_search_index_refresh_files (GList                   *locations);
+/* Takes a list of GFilePair */
+void     nautilus_search_index_move_files    (GList                   *file_pairs);
+
+/* Calls @func for each indexed file inside @location, from the calling
+ * thread, until it returns FALSE.
+ */
+void     nautilus_search_index_foreach       (GFile                   *location,
+                                              gboolean                 recursive,
+                                              NautilusSearchIndexFunc  func,
+                                              gpointer                 user_data);
+
+G_END_DECLS
+
+#endif /* NAUTILUS_SEARCH_INDEX_H */
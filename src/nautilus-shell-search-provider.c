@@ -163,10 +163,11 @@ search_hits_added_cb (NautilusSearchEngine *engine,
 
     g_debug ("*** Search engine hits added");
 
+    nautilus_search_hit_list_compute_scores (hits, search->query);
+
     for (l = hits; l != NULL; l = l->next)
     {
         hit = l->data;
-        nautilus_search_hit_compute_scores (hit, search->query);
         hit_uri = nautilus_search_hit_get_uri (hit);
         g_debug ("    %s", hit_uri);
 
@@ -50,10 +50,13 @@
 /* Cool-off period between last file modification time and thumbnail creation */
 #define THUMBNAIL_CREATION_DELAY_SECS 3
 
-static void thumbnail_thread_func (GTask        *task,
-                                   gpointer      source_object,
-                                   gpointer      task_data,
-                                   GCancellable *cancellable);
+/* Upper bound on the thumbnail threads. Each of them may have a
+ * thumbnailer process decoding a large image, so this is kept well below
+ * what a big machine could run.
+ */
+#define MAX_THUMBNAIL_THREADS 8
+
+static gpointer thumbnail_thread_func (gpointer data);
 
 /* structure used for making thumbnails, associating a uri with where the thumbnail is to be stored */
 
@@ -62,6 +65,13 @@ typedef struct
     char *image_uri;
     char *mime_type;
     time_t original_file_mtime;
+
+    /* Set while a thread is making the thumbnail. The info is not in
+     * thumbnails_to_make then, but still in thumbnails_to_make_hash so
+     * it is not queued twice. */
+    gboolean in_progress;
+    /* Set when the file goes away while its thumbnail is being made */
+    gboolean cancelled;
 } NautilusThumbnailInfo;
 
 /*
@@ -73,25 +83,23 @@ typedef struct
 static guint thumbnail_thread_starter_id = 0;
 
 /* Our mutex used when accessing data shared between the main thread and the
- *  thumbnail thread, i.e. the thumbnail_thread_is_running flag and the
+ *  thumbnail threads, i.e. the thumbnail_threads_running count and the
  *  thumbnails_to_make list. */
 static GMutex thumbnails_mutex;
 
-/* A flag to indicate whether a thumbnail thread is running, so we don't
- *  start more than one. Lock thumbnails_mutex when accessing this. */
-static volatile gboolean thumbnail_thread_is_running = FALSE;
+/* How many thumbnail threads are running, so we don't start more than
+ *  get_max_thumbnail_threads(). Lock thumbnails_mutex when accessing this. */
+static guint thumbnail_threads_running = 0;
 
 /* The list of NautilusThumbnailInfo structs containing information about the
- *  thumbnails we are making. Lock thumbnails_mutex when accessing this. */
+ *  thumbnails waiting to be made, next one first. Lock thumbnails_mutex when
+ *  accessing this. */
 static volatile GQueue thumbnails_to_make = G_QUEUE_INIT;
 
-/* Quickly check if uri is in thumbnails_to_make list */
+/* Maps the uri of every thumbnail waiting or being made to its link, which
+ *  is in thumbnails_to_make unless the info is in progress. */
 static GHashTable *thumbnails_to_make_hash = NULL;
 
-/* The currently thumbnailed icon. it also exists in the thumbnails_to_make list
- * to avoid adding it again. Lock thumbnails_mutex when accessing this. */
-static NautilusThumbnailInfo *currently_thumbnailing = NULL;
-
 static GnomeDesktopThumbnailFactory *thumbnail_factory = NULL;
 
 static gboolean
@@ -130,6 +138,19 @@ free_thumbnail_info (NautilusThumbnailInfo *info)
     g_free (info);
 }
 
+static guint
+get_max_thumbnail_threads (void)
+{
+    static guint max_threads = 0;
+
+    if (max_threads == 0)
+    {
+        max_threads = CLAMP (g_get_num_processors (), 1, MAX_THUMBNAIL_THREADS);
+    }
+
+    return max_threads;
+}
+
 static GnomeDesktopThumbnailFactory *
 get_thumbnail_factory (void)
 {
@@ -145,13 +166,15 @@ get_thumbnail_factory (void)
 
 
 /* This function is added as a very low priority idle function to start the
- *  thread to create any needed thumbnails. It is added with a very low priority
+ *  threads to create any needed thumbnails. It is added with a very low priority
  *  so that it doesn't delay showing the directory in the icon/list views.
  *  We want to show the files in the directory as quickly as possible. */
 static gboolean
 thumbnail_thread_starter_cb (gpointer data)
 {
-    GTask *task;
+    GThread *thread;
+    guint n_threads;
+    guint i;
 
     /* Don't do this in thread, since g_object_ref is not threadsafe */
     if (thumbnail_factory == NULL)
@@ -159,19 +182,24 @@ thumbnail_thread_starter_cb (gpointer data)
         thumbnail_factory = get_thumbnail_factory ();
     }
 
-    g_debug ("(Main Thread) Creating thumbnails thread\n");
-
-    /* We set a flag to indicate the thread is running, so we don't create
-     *  a new one. We don't need to lock a mutex here, as the thumbnail
-     *  thread isn't running yet. And we know we won't create the thread
-     *  twice, as we also check thumbnail_thread_starter_id before
-     *  scheduling this idle function. */
-    thumbnail_thread_is_running = TRUE;
-    task = g_task_new (NULL, NULL, NULL, NULL);
-    g_task_run_in_thread (task, thumbnail_thread_func);
     thumbnail_thread_starter_id = 0;
 
-    g_object_unref (task);
+    /* Start as many threads as there is work for, up to the limit. The
+     *  count is raised here so the threads never see it lower than the
+     *  number that is running. */
+    g_mutex_lock (&thumbnails_mutex);
+    n_threads = MIN (get_max_thumbnail_threads () - thumbnail_threads_running,
+                     g_queue_get_length ((GQueue *) &thumbnails_to_make));
+    thumbnail_threads_running += n_threads;
+    g_mutex_unlock (&thumbnails_mutex);
+
+    g_debug ("(Main Thread) Creating %u thumbnail threads\n", n_threads);
+
+    for (i = 0; i < n_threads; i++)
+    {
+        thread = g_thread_new ("nautilus-thumbnail", thumbnail_thread_func, NULL);
+        g_thread_unref (thread);
+    }
 
     return FALSE;
 }
@@ -179,6 +207,7 @@ thumbnail_thread_starter_cb (gpointer data)
 void
 nautilus_thumbnail_remove_from_queue (const char *file_uri)
 {
+    NautilusThumbnailInfo *info;
     GList *node;
 
     g_debug ("(Remove from queue) Locking mutex\n");
@@ -192,11 +221,17 @@ nautilus_thumbnail_remove_from_queue (const char *file_uri)
     if (thumbnails_to_make_hash)
     {
         node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+        info = node != NULL ? node->data : NULL;
 
-        if (node && node->data != currently_thumbnailing)
+        if (info != NULL && info->in_progress)
+        {
+            /* The thread making it cleans up */
+            info->cancelled = TRUE;
+        }
+        else if (info != NULL)
         {
             g_hash_table_remove (thumbnails_to_make_hash, file_uri);
-            free_thumbnail_info (node->data);
+            free_thumbnail_info (info);
             g_queue_delete_link ((GQueue *) &thumbnails_to_make, node);
         }
     }
@@ -227,7 +262,7 @@ nautilus_thumbnail_prioritize (const char *file_uri)
     {
         node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 
-        if (node && node->data != currently_thumbnailing)
+        if (node && !((NautilusThumbnailInfo *) node->data)->in_progress)
         {
             g_queue_unlink ((GQueue *) &thumbnails_to_make, node);
             g_queue_push_head_link ((GQueue *) &thumbnails_to_make, node);
@@ -422,11 +457,11 @@ nautilus_create_thumbnail (NautilusFile *file)
         g_hash_table_insert (thumbnails_to_make_hash,
                              info->image_uri,
                              node);
-        /* If the thumbnail thread isn't running, and we haven't
+        /* If there is room for another thumbnail thread, and we haven't
          *  scheduled an idle function to start it up, do that now.
          *  We don't want to start it until all the other work is done,
          *  so the GUI will be updated as quickly as possible.*/
-        if (thumbnail_thread_is_running == FALSE &&
+        if (thumbnail_threads_running < get_max_thumbnail_threads () &&
             thumbnail_thread_starter_id == 0)
         {
             thumbnail_thread_starter_id = g_idle_add_full (G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
@@ -440,6 +475,8 @@ nautilus_create_thumbnail (NautilusFile *file)
         /* The file in the queue might need a new original mtime */
         existing_info = existing->data;
         existing_info->original_file_mtime = info->original_file_mtime;
+        /* It is wanted again, even if its file went away meanwhile */
+        existing_info->cancelled = FALSE;
         free_thumbnail_info (info);
     }
 
@@ -452,18 +489,43 @@ nautilus_create_thumbnail (NautilusFile *file)
     g_mutex_unlock (&thumbnails_mutex);
 }
 
-/* thumbnail_thread is invoked as a separate thread to to make thumbnails. */
+/* Called with thumbnails_mutex held once a thread is done with @node,
+ *  which is not in thumbnails_to_make while in progress. */
 static void
-thumbnail_thread_func (GTask        *task,
-                       gpointer      source_object,
-                       gpointer      task_data,
-                       GCancellable *cancellable)
+thumbnail_finished (GList    *node,
+                    time_t    orig_mtime,
+                    gboolean  dropped)
 {
-    NautilusThumbnailInfo *info = NULL;
+    NautilusThumbnailInfo *info;
+
+    info = node->data;
+    info->in_progress = FALSE;
+
+    /* Put the request back if the original file mtime changed meanwhile.
+     *  Then we need to redo the thumbnail. The same goes if the result
+     *  was dropped, but it was asked for again since. */
+    if (!info->cancelled &&
+        (dropped || info->original_file_mtime != orig_mtime))
+    {
+        g_queue_push_head_link ((GQueue *) &thumbnails_to_make, node);
+        return;
+    }
+
+    g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+    free_thumbnail_info (info);
+    g_list_free_1 (node);
+}
+
+/* thumbnail_thread is invoked as several separate threads to make thumbnails. */
+static gpointer
+thumbnail_thread_func (gpointer data)
+{
+    NautilusThumbnailInfo *info;
     GdkPixbuf *pixbuf;
     time_t current_orig_mtime = 0;
     time_t current_time;
-    GList *node;
+    GList *node = NULL;
+    gboolean cancelled = FALSE;
 
     /* We loop until there are no more thumbails to make, at which point
      *  we exit the thread. */
@@ -477,43 +539,33 @@ thumbnail_thread_func (GTask        *task,
          * MUTEX LOCKED
          *********************************/
 
-        /* Pop the last thumbnail we just made off the head of the
-         *  list and free it. I did this here so we only have to lock
-         *  the mutex once per thumbnail, rather than once before
-         *  creating it and once after.
-         *  Don't pop the thumbnail off the queue if the original file
-         *  mtime of the request changed. Then we need to redo the thumbnail.
-         */
-        if (currently_thumbnailing &&
-            currently_thumbnailing->original_file_mtime == current_orig_mtime)
+        /* Finish the last thumbnail we made. I did this here so we only
+         *  have to lock the mutex once per thumbnail, rather than once
+         *  before creating it and once after. */
+        if (node != NULL)
         {
-            g_assert (info == currently_thumbnailing);
-            node = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
-            g_assert (node != NULL);
-            g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
-            free_thumbnail_info (info);
-            g_queue_delete_link ((GQueue *) &thumbnails_to_make, node);
+            thumbnail_finished (node, current_orig_mtime, cancelled);
         }
-        currently_thumbnailing = NULL;
 
-        /* If there are no more thumbnails to make, reset the
-         *  thumbnail_thread_is_running flag, unlock the mutex, and
-         *  exit the thread. */
+        /* If there are no more thumbnails to make, count this thread
+         *  out, unlock the mutex, and exit the thread. */
         if (g_queue_is_empty ((GQueue *) &thumbnails_to_make))
         {
             g_debug ("(Thumbnail Thread) Exiting\n");
 
-            thumbnail_thread_is_running = FALSE;
+            thumbnail_threads_running--;
             g_mutex_unlock (&thumbnails_mutex);
-            return;
+            return NULL;
         }
 
-        /* Get the next one to make. We leave it on the list until it
-         *  is created so the main thread doesn't add it again while we
-         *  are creating it. */
-        info = g_queue_peek_head ((GQueue *) &thumbnails_to_make);
-        currently_thumbnailing = info;
+        /* Take the next one to make off the queue. It stays in the hash
+         *  table until it is created so the main thread doesn't add it
+         *  again while we are creating it. */
+        node = g_queue_pop_head_link ((GQueue *) &thumbnails_to_make);
+        info = node->data;
+        info->in_progress = TRUE;
         current_orig_mtime = info->original_file_mtime;
+        cancelled = FALSE;
         /*********************************
          * MUTEX UNLOCKED
          *********************************/
@@ -546,6 +598,21 @@ thumbnail_thread_func (GTask        *task,
                                                                      info->image_uri,
                                                                      info->mime_type);
 
+        /* The thumbnailer can't be interrupted, but nobody is waiting for
+         *  the result if the file went away in the meantime. */
+        g_mutex_lock (&thumbnails_mutex);
+        cancelled = info->cancelled;
+        g_mutex_unlock (&thumbnails_mutex);
+
+        if (cancelled)
+        {
+            g_debug ("(Thumbnail Thread) Thumbnail cancelled: %s\n",
+                       info->image_uri);
+
+            g_clear_object (&pixbuf);
+            continue;
+        }
+
         if (pixbuf)
         {
             g_debug ("(Thumbnail Thread) Saving thumbnail: %s\n",
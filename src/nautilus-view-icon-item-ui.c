@@ -10,9 +10,12 @@ struct _NautilusViewIconItemUi
 
     NautilusViewItemModel *model;
 
+    /* Only built while the item is near the visible part of the view */
     NautilusContainerMaxWidth *item_container;
     GtkWidget *icon;
     GtkLabel *label;
+
+    int label_height;
 };
 
 G_DEFINE_TYPE (NautilusViewIconItemUi, nautilus_view_icon_item_ui, GTK_TYPE_FLOW_BOX_CHILD)
@@ -108,6 +111,16 @@ on_view_item_file_changed (GObject    *object,
     }
 }
 
+/* Keeps the space of the item reserved whether its content is built or not */
+static void
+update_size_request (NautilusViewIconItemUi *self)
+{
+    guint icon_size;
+
+    icon_size = nautilus_view_item_model_get_icon_size (self->model);
+    gtk_widget_set_size_request (GTK_WIDGET (self), icon_size, icon_size + self->label_height);
+}
+
 static void
 on_view_item_size_changed (GObject    *object,
                            GParamSpec *pspec,
@@ -115,6 +128,8 @@ on_view_item_size_changed (GObject    *object,
 {
     NautilusViewIconItemUi *self = NAUTILUS_VIEW_ICON_ITEM_UI (user_data);
 
+    update_size_request (self);
+
     if (self->icon)
     {
         update_icon (self);
@@ -125,13 +140,30 @@ static void
 constructed (GObject *object)
 {
     NautilusViewIconItemUi *self = NAUTILUS_VIEW_ICON_ITEM_UI (object);
+
+    G_OBJECT_CLASS (nautilus_view_icon_item_ui_parent_class)->constructed (object);
+
+    update_size_request (self);
+
+    g_signal_connect (self->model, "notify::icon-size",
+                      (GCallback) on_view_item_size_changed, self);
+    g_signal_connect (self->model, "notify::file",
+                      (GCallback) on_view_item_file_changed, self);
+}
+
+void
+nautilus_view_icon_item_ui_materialize (NautilusViewIconItemUi *self)
+{
     GtkBox *container;
     GtkLabel *label;
     GtkStyleContext *style_context;
     NautilusFile *file;
     guint icon_size;
 
-    G_OBJECT_CLASS (nautilus_view_icon_item_ui_parent_class)->constructed (object);
+    if (self->item_container != NULL)
+    {
+        return;
+    }
 
     file = nautilus_view_item_model_get_file (self->model);
     icon_size = nautilus_view_item_model_get_icon_size (self->model);
@@ -150,6 +182,7 @@ constructed (GObject *object)
     gtk_label_set_justify (label, GTK_JUSTIFY_CENTER);
     gtk_widget_set_valign (GTK_WIDGET (label), GTK_ALIGN_START);
     gtk_box_pack_end (container, GTK_WIDGET (label), TRUE, TRUE, 0);
+    self->label = label;
 
     style_context = gtk_widget_get_style_context (GTK_WIDGET (container));
     gtk_style_context_add_class (style_context, "icon-item-background");
@@ -164,11 +197,28 @@ constructed (GObject *object)
 
     gtk_container_add (GTK_CONTAINER (self), GTK_WIDGET (self->item_container));
     gtk_widget_show_all (GTK_WIDGET (self->item_container));
+}
 
-    g_signal_connect (self->model, "notify::icon-size",
-                      (GCallback) on_view_item_size_changed, self);
-    g_signal_connect (self->model, "notify::file",
-                      (GCallback) on_view_item_file_changed, self);
+void
+nautilus_view_icon_item_ui_release (NautilusViewIconItemUi *self)
+{
+    if (self->item_container == NULL)
+    {
+        return;
+    }
+
+    gtk_container_remove (GTK_CONTAINER (self), GTK_WIDGET (self->item_container));
+    self->item_container = NULL;
+    self->icon = NULL;
+    self->label = NULL;
+}
+
+void
+nautilus_view_icon_item_ui_set_label_height (NautilusViewIconItemUi *self,
+                                             int                     label_height)
+{
+    self->label_height = label_height;
+    update_size_request (self);
 }
 
 static void
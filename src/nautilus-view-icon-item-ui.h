@@ -16,6 +16,15 @@ NautilusViewIconItemUi * nautilus_view_icon_item_ui_new (NautilusViewItemModel *
 
 NautilusViewItemModel * nautilus_view_icon_item_ui_get_model (NautilusViewIconItemUi *self);
 
+/* The icon and the label are only built when the view asks for them, so
+ * that items far from the visible area cost little more than their space.
+ */
+void nautilus_view_icon_item_ui_materialize (NautilusViewIconItemUi *self);
+void nautilus_view_icon_item_ui_release (NautilusViewIconItemUi *self);
+/* Space reserved below the icon when the label isn't built */
+void nautilus_view_icon_item_ui_set_label_height (NautilusViewIconItemUi *self,
+                                                  int                     label_height);
+
 G_END_DECLS
 
 #endif /* NAUTILUS_VIEW_ICON_ITEM_UI_H */
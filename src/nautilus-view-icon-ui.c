@@ -27,11 +27,25 @@
 #include "nautilus-directory.h"
 #include "nautilus-global-preferences.h"
 
+/* The content of the items is built this many pages above and below the
+ * visible ones, and released again once they are twice as far.
+ */
+#define MATERIALIZE_PAGES 1
+
+/* Folders with up to this many items have all of them built right away */
+#define MATERIALIZE_ALL_MAX_ITEMS 500
+
 struct _NautilusViewIconUi
 {
     GtkFlowBox parent_instance;
 
     NautilusViewIconController *controller;
+
+    GtkWidget *scrolled_window;
+    GtkAdjustment *vadjustment;
+    guint update_visible_id;
+    GHashTable *materialized;      /* NautilusViewIconItemUi */
+    int label_height;
 };
 
 G_DEFINE_TYPE (NautilusViewIconUi, nautilus_view_icon_ui, GTK_TYPE_FLOW_BOX)
@@ -130,17 +144,202 @@ nautilus_view_icon_ui_set_selection (NautilusViewIconUi *self,
 }
 
 
+/* Vertical position of @child in the coordinates of @self */
+static int
+get_child_y (NautilusViewIconUi *self,
+             GtkWidget          *child)
+{
+    int x, y;
+
+    if (!gtk_widget_translate_coordinates (child, GTK_WIDGET (self), 0, 0, &x, &y))
+    {
+        return -1;
+    }
+
+    return y;
+}
+
+/* Children are laid out in order, so the first one reaching @top can be
+ * found with a binary search.
+ */
+static guint
+find_first_child_below (NautilusViewIconUi *self,
+                        int                 top,
+                        guint               n_children)
+{
+    GtkWidget *child;
+    guint low, high, middle;
+
+    low = 0;
+    high = n_children;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        child = GTK_WIDGET (gtk_flow_box_get_child_at_index (GTK_FLOW_BOX (self), middle));
+        if (get_child_y (self, child) + gtk_widget_get_allocated_height (child) < top)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static gboolean
+update_visible_items (gpointer user_data)
+{
+    NautilusViewIconUi *self = NAUTILUS_VIEW_ICON_UI (user_data);
+    NautilusViewModel *model;
+    GHashTableIter iter;
+    GtkWidget *child;
+    int x, y;
+    int page_height, top, bottom, child_y;
+    guint n_children, i;
+    gboolean lazy;
+
+    self->update_visible_id = 0;
+
+    if (self->scrolled_window == NULL ||
+        !gtk_widget_get_realized (GTK_WIDGET (self)) ||
+        !gtk_widget_translate_coordinates (self->scrolled_window, GTK_WIDGET (self),
+                                           0, 0, &x, &y))
+    {
+        return G_SOURCE_REMOVE;
+    }
+
+    page_height = gtk_widget_get_allocated_height (self->scrolled_window);
+    top = y - page_height * MATERIALIZE_PAGES;
+    bottom = y + page_height * (MATERIALIZE_PAGES + 1);
+
+    model = nautilus_view_icon_controller_get_model (self->controller);
+    n_children = g_list_model_get_n_items (G_LIST_MODEL (nautilus_view_model_get_g_model (model)));
+
+    /* Items whose content isn't built only reserve their space. In large
+     * folders the flow box is made homogeneous, so the layout doesn't
+     * move as they are built and released. Small folders are built in
+     * full and keep the natural size of each item.
+     */
+    lazy = n_children > MATERIALIZE_ALL_MAX_ITEMS;
+    if (gtk_flow_box_get_homogeneous (GTK_FLOW_BOX (self)) != lazy)
+    {
+        gtk_flow_box_set_homogeneous (GTK_FLOW_BOX (self), lazy);
+    }
+
+    g_hash_table_iter_init (&iter, self->materialized);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &child, NULL))
+    {
+        /* Removed from the model */
+        if (gtk_widget_get_parent (child) != GTK_WIDGET (self))
+        {
+            g_hash_table_iter_remove (&iter);
+            continue;
+        }
+
+        if (!lazy)
+        {
+            continue;
+        }
+
+        child_y = get_child_y (self, child);
+        if (child_y + gtk_widget_get_allocated_height (child) < top - page_height * MATERIALIZE_PAGES ||
+            child_y > bottom + page_height * MATERIALIZE_PAGES)
+        {
+            nautilus_view_icon_item_ui_release (NAUTILUS_VIEW_ICON_ITEM_UI (child));
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+
+    for (i = lazy ? find_first_child_below (self, top, n_children) : 0; i < n_children; i++)
+    {
+        child = GTK_WIDGET (gtk_flow_box_get_child_at_index (GTK_FLOW_BOX (self), i));
+        if (child == NULL || (lazy && get_child_y (self, child) > bottom))
+        {
+            break;
+        }
+
+        if (!g_hash_table_contains (self->materialized, child))
+        {
+            nautilus_view_icon_item_ui_materialize (NAUTILUS_VIEW_ICON_ITEM_UI (child));
+            g_hash_table_add (self->materialized, g_object_ref (child));
+        }
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+queue_update_visible_items (NautilusViewIconUi *self)
+{
+    if (self->update_visible_id == 0)
+    {
+        self->update_visible_id = g_idle_add (update_visible_items, self);
+    }
+}
+
+static void
+on_size_allocate (GtkWidget    *widget,
+                  GdkRectangle *allocation,
+                  gpointer      user_data)
+{
+    NautilusViewIconUi *self = NAUTILUS_VIEW_ICON_UI (user_data);
+
+    if (self->scrolled_window == NULL)
+    {
+        self->scrolled_window = gtk_widget_get_ancestor (widget, GTK_TYPE_SCROLLED_WINDOW);
+        if (self->scrolled_window != NULL)
+        {
+            self->vadjustment = g_object_ref (gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (self->scrolled_window)));
+            g_signal_connect_swapped (self->vadjustment, "value-changed",
+                                      G_CALLBACK (queue_update_visible_items), self);
+            g_signal_connect_swapped (self->vadjustment, "changed",
+                                      G_CALLBACK (queue_update_visible_items), self);
+        }
+    }
+
+    queue_update_visible_items (self);
+}
+
+static int
+get_label_height (NautilusViewIconUi *self)
+{
+    PangoFontMetrics *metrics;
+    int line_height;
+
+    if (self->label_height == 0)
+    {
+        metrics = pango_context_get_metrics (gtk_widget_get_pango_context (GTK_WIDGET (self)),
+                                             NULL, NULL);
+        line_height = pango_font_metrics_get_ascent (metrics) +
+                      pango_font_metrics_get_descent (metrics);
+        pango_font_metrics_unref (metrics);
+
+        /* The labels are up to three lines */
+        self->label_height = PANGO_PIXELS (line_height * 3);
+    }
+
+    return self->label_height;
+}
+
 static GtkWidget *
 create_widget_func (gpointer item,
                     gpointer user_data)
 {
+    NautilusViewIconUi *self = NAUTILUS_VIEW_ICON_UI (user_data);
     NautilusViewItemModel *item_model = NAUTILUS_VIEW_ITEM_MODEL (item);
     NautilusViewIconItemUi *child;
 
     child = nautilus_view_icon_item_ui_new (item_model);
+    nautilus_view_icon_item_ui_set_label_height (child, get_label_height (self));
     nautilus_view_item_model_set_item_ui (item_model, GTK_WIDGET (child));
     gtk_widget_show (GTK_WIDGET (child));
 
+    /* The content is built once the child is laid out near the visible area */
+    queue_update_visible_items (self);
+
     return GTK_WIDGET (child);
 }
 
@@ -171,9 +370,34 @@ on_ui_selected_children_changed (GtkFlowBox *box,
     nautilus_files_view_notify_selection_changed (NAUTILUS_FILES_VIEW (self->controller));
 }
 
+static void
+dispose (GObject *object)
+{
+    NautilusViewIconUi *self = NAUTILUS_VIEW_ICON_UI (object);
+
+    if (self->update_visible_id != 0)
+    {
+        g_source_remove (self->update_visible_id);
+        self->update_visible_id = 0;
+    }
+
+    if (self->vadjustment != NULL)
+    {
+        g_signal_handlers_disconnect_by_data (self->vadjustment, self);
+        g_clear_object (&self->vadjustment);
+    }
+    self->scrolled_window = NULL;
+
+    G_OBJECT_CLASS (nautilus_view_icon_ui_parent_class)->dispose (object);
+}
+
 static void
 finalize (GObject *object)
 {
+    NautilusViewIconUi *self = NAUTILUS_VIEW_ICON_UI (object);
+
+    g_hash_table_destroy (self->materialized);
+
     G_OBJECT_CLASS (nautilus_view_icon_ui_parent_class)->finalize (object);
 }
 
@@ -189,7 +413,6 @@ constructed (GObject *object)
     gtk_flow_box_set_activate_on_single_click (GTK_FLOW_BOX (self), FALSE);
     gtk_flow_box_set_max_children_per_line (GTK_FLOW_BOX (self), 20);
     gtk_flow_box_set_selection_mode (GTK_FLOW_BOX (self), GTK_SELECTION_MULTIPLE);
-    gtk_flow_box_set_homogeneous (GTK_FLOW_BOX (self), FALSE);
     gtk_widget_set_valign (GTK_WIDGET (self), GTK_ALIGN_START);
     gtk_widget_set_margin_top (GTK_WIDGET (self), 10);
     gtk_widget_set_margin_start (GTK_WIDGET (self), 10);
@@ -204,6 +427,7 @@ constructed (GObject *object)
 
     g_signal_connect (self, "child-activated", (GCallback) on_child_activated, self);
     g_signal_connect (self, "selected-children-changed", (GCallback) on_ui_selected_children_changed, self);
+    g_signal_connect (self, "size-allocate", (GCallback) on_size_allocate, self);
 }
 
 static void
@@ -211,6 +435,7 @@ nautilus_view_icon_ui_class_init (NautilusViewIconUiClass *klass)
 {
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+    object_class->dispose = dispose;
     object_class->finalize = finalize;
     object_class->set_property = set_property;
     object_class->get_property = get_property;
@@ -228,6 +453,7 @@ nautilus_view_icon_ui_class_init (NautilusViewIconUiClass *klass)
 static void
 nautilus_view_icon_ui_init (NautilusViewIconUi *self)
 {
+    self->materialized = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
 }
 
 NautilusViewIconUi *
@@ -6,7 +6,12 @@ struct _NautilusViewModel
 {
     GObject parent_instance;
 
-    GHashTable *map_files_to_model;
+    /* The items are also kept in a sequence, in the same order as in
+     * internal_model, so that their position can be found without
+     * comparing files.
+     */
+    GHashTable *map_files_to_model;   /* NautilusFile -> GSequenceIter */
+    GSequence *items;
     GListStore *internal_model;
     NautilusViewModelSortData *sort_data;
 };
@@ -29,6 +34,7 @@ finalize (GObject *object)
     G_OBJECT_CLASS (nautilus_view_model_parent_class)->finalize (object);
 
     g_hash_table_destroy (self->map_files_to_model);
+    g_sequence_free (self->items);
     if (self->sort_data)
     {
         g_free (self->sort_data);
@@ -97,6 +103,7 @@ constructed (GObject *object)
 
     self->internal_model = g_list_store_new (NAUTILUS_TYPE_VIEW_ITEM_MODEL);
     self->map_files_to_model = g_hash_table_new (NULL, NULL);
+    self->items = g_sequence_new (NULL);
 }
 
 static void
@@ -133,6 +140,39 @@ compare_data_func (gconstpointer a,
                                            self->sort_data->reversed);
 }
 
+static gint
+compare_array_data_func (gconstpointer a,
+                         gconstpointer b,
+                         gpointer      user_data)
+{
+    return compare_data_func (*(gpointer *) a, *(gpointer *) b, user_data);
+}
+
+/* Replaces the whole content of internal_model with the sequence */
+static void
+splice_all_items (NautilusViewModel *self)
+{
+    g_autofree gpointer *array = NULL;
+    GSequenceIter *iter;
+    guint n_items;
+    guint i;
+
+    n_items = g_sequence_get_length (self->items);
+    array = g_malloc_n (n_items, sizeof (NautilusViewItemModel *));
+
+    i = 0;
+    for (iter = g_sequence_get_begin_iter (self->items);
+         !g_sequence_iter_is_end (iter);
+         iter = g_sequence_iter_next (iter))
+    {
+        array[i++] = g_sequence_get (iter);
+    }
+
+    g_list_store_splice (self->internal_model,
+                         0, g_list_model_get_n_items (G_LIST_MODEL (self->internal_model)),
+                         array, n_items);
+}
+
 NautilusViewModel *
 nautilus_view_model_new ()
 {
@@ -153,7 +193,8 @@ nautilus_view_model_set_sort_type (NautilusViewModel         *self,
     self->sort_data->reversed = sort_data->reversed;
     self->sort_data->directories_first = sort_data->directories_first;
 
-    g_list_store_sort (self->internal_model, compare_data_func, self);
+    g_sequence_sort (self->items, compare_data_func, self);
+    splice_all_items (self);
 }
 
 NautilusViewModelSortData *
@@ -179,26 +220,10 @@ nautilus_view_model_get_items_from_files (NautilusViewModel *self,
     item_models = g_queue_new ();
     for (l = g_queue_peek_head_link (files); l != NULL; l = l->next)
     {
-        NautilusFile *file1;
-        gint i = 0;
-
-        file1 = NAUTILUS_FILE (l->data);
-        while ((item_model = g_list_model_get_item (G_LIST_MODEL (self->internal_model), i)))
+        item_model = nautilus_view_model_get_item_from_file (self, NAUTILUS_FILE (l->data));
+        if (item_model != NULL)
         {
-            NautilusFile *file2;
-            g_autofree gchar *file1_uri;
-            g_autofree gchar *file2_uri;
-
-            file2 = nautilus_view_item_model_get_file (item_model);
-            file1_uri = nautilus_file_get_uri (file1);
-            file2_uri = nautilus_file_get_uri (file2);
-            if (g_strcmp0 (file1_uri, file2_uri) == 0)
-            {
-                g_queue_push_tail (item_models, item_model);
-                break;
-            }
-
-            i++;
+            g_queue_push_tail (item_models, item_model);
         }
     }
 
@@ -209,42 +234,43 @@ NautilusViewItemModel *
 nautilus_view_model_get_item_from_file (NautilusViewModel *self,
                                         NautilusFile      *file)
 {
-    return g_hash_table_lookup (self->map_files_to_model, file);
+    GSequenceIter *iter;
+
+    iter = g_hash_table_lookup (self->map_files_to_model, file);
+
+    return iter != NULL ? g_sequence_get (iter) : NULL;
 }
 
 void
 nautilus_view_model_remove_item (NautilusViewModel     *self,
                                  NautilusViewItemModel *item)
 {
-    NautilusViewItemModel *item_model;
-    gint i;
+    NautilusFile *file;
+    GSequenceIter *iter;
 
-    i = 0;
-    item_model = NULL;
-    while ((item_model = g_list_model_get_item (G_LIST_MODEL (self->internal_model), i)))
+    if (item == NULL)
     {
-        if (item_model == item)
-        {
-            break;
-        }
-
-        i++;
+        return;
     }
 
-    if (item_model != NULL)
+    file = nautilus_view_item_model_get_file (item);
+    iter = g_hash_table_lookup (self->map_files_to_model, file);
+    if (iter == NULL || g_sequence_get (iter) != item)
     {
-        NautilusFile *file;
-
-        file = nautilus_view_item_model_get_file (item_model);
-        g_list_store_remove (self->internal_model, i);
-        g_hash_table_remove (self->map_files_to_model, file);
+        return;
     }
+
+    g_list_store_remove (self->internal_model, g_sequence_iter_get_position (iter));
+    g_sequence_remove (iter);
+    g_hash_table_remove (self->map_files_to_model, file);
 }
 
 void
 nautilus_view_model_remove_all_items (NautilusViewModel *self)
 {
     g_list_store_remove_all (self->internal_model);
+    g_sequence_remove_range (g_sequence_get_begin_iter (self->items),
+                             g_sequence_get_end_iter (self->items));
     g_hash_table_remove_all (self->map_files_to_model);
 }
 
@@ -252,17 +278,20 @@ void
 nautilus_view_model_add_item (NautilusViewModel     *self,
                               NautilusViewItemModel *item)
 {
+    GSequenceIter *iter;
+
+    iter = g_sequence_insert_sorted (self->items, item, compare_data_func, self);
     g_hash_table_insert (self->map_files_to_model,
                          nautilus_view_item_model_get_file (item),
-                         item);
-    g_list_store_insert_sorted (self->internal_model, item, compare_data_func, self);
+                         iter);
+    g_list_store_insert (self->internal_model, g_sequence_iter_get_position (iter), item);
 }
 
-void
-nautilus_view_model_add_items (NautilusViewModel *self,
-                               GQueue            *items)
+static gpointer *
+get_sorted_array (NautilusViewModel *self,
+                  GQueue            *items)
 {
-    g_autofree gpointer *array = NULL;
+    gpointer *array;
     GList *l;
     int i = 0;
 
@@ -272,17 +301,90 @@ nautilus_view_model_add_items (NautilusViewModel *self,
     for (l = g_queue_peek_head_link (items); l != NULL; l = l->next)
     {
         array[i] = l->data;
-        g_hash_table_insert (self->map_files_to_model,
-                             nautilus_view_item_model_get_file (l->data),
-                             l->data);
         i++;
     }
 
-    g_list_store_splice (self->internal_model,
-                         g_list_model_get_n_items (G_LIST_MODEL (self->internal_model)),
-                         0, array, g_queue_get_length (items));
+    g_qsort_with_data (array, g_queue_get_length (items), sizeof (gpointer),
+                       compare_array_data_func, self);
+
+    return array;
+}
+
+typedef struct
+{
+    GSequenceIter *iter;
+    guint position;
+} AddedItem;
+
+static gint
+compare_added_items (gconstpointer a,
+                     gconstpointer b,
+                     gpointer      user_data)
+{
+    const AddedItem *added_a = a;
+    const AddedItem *added_b = b;
+
+    return added_a->position < added_b->position ? -1 : added_a->position > added_b->position;
+}
+
+void
+nautilus_view_model_add_items (NautilusViewModel *self,
+                               GQueue            *items)
+{
+    g_autofree gpointer *array = NULL;
+    g_autofree AddedItem *added = NULL;
+    GSequenceIter *iter;
+    guint n_items;
+    guint i, run_start;
+
+    n_items = g_queue_get_length (items);
+    if (n_items == 0)
+    {
+        return;
+    }
+
+    if (g_sequence_get_length (self->items) == 0)
+    {
+        nautilus_view_model_set_items (self, items);
+        return;
+    }
+
+    /* Merge the sorted batch into the items already shown, instead of
+     * sorting all of them again.
+     */
+    array = get_sorted_array (self, items);
+    added = g_new (AddedItem, n_items);
+    for (i = 0; i < n_items; i++)
+    {
+        iter = g_sequence_insert_sorted (self->items, array[i], compare_data_func, self);
+        g_hash_table_insert (self->map_files_to_model,
+                             nautilus_view_item_model_get_file (array[i]),
+                             iter);
+        added[i].iter = iter;
+    }
+
+    /* Positions are only final once the whole batch is in */
+    for (i = 0; i < n_items; i++)
+    {
+        added[i].position = g_sequence_iter_get_position (added[i].iter);
+    }
+    g_qsort_with_data (added, n_items, sizeof (AddedItem), compare_added_items, NULL);
+
+    /* Insert each run of adjacent items at once, from the top, so that
+     * everything before a run is already in place.
+     */
+    run_start = 0;
+    for (i = 0; i < n_items; i++)
+    {
+        array[i] = g_sequence_get (added[i].iter);
 
-    g_list_store_sort (self->internal_model, compare_data_func, self);
+        if (i + 1 == n_items || added[i + 1].position != added[i].position + 1)
+        {
+            g_list_store_splice (self->internal_model, added[run_start].position, 0,
+                                 array + run_start, i + 1 - run_start);
+            run_start = i + 1;
+        }
+    }
 }
 
 void
@@ -290,25 +392,25 @@ nautilus_view_model_set_items (NautilusViewModel *self,
                                GQueue            *items)
 {
     g_autofree gpointer *array = NULL;
-    GList *l;
-    int i = 0;
+    GSequenceIter *iter;
+    guint n_items;
+    guint i;
 
-    array = g_malloc_n (g_queue_get_length (items),
-                        sizeof (NautilusViewItemModel *));
+    n_items = g_queue_get_length (items);
+    array = get_sorted_array (self, items);
 
+    g_sequence_remove_range (g_sequence_get_begin_iter (self->items),
+                             g_sequence_get_end_iter (self->items));
     g_hash_table_remove_all (self->map_files_to_model);
-    for (l = g_queue_peek_head_link (items); l != NULL; l = l->next)
+    for (i = 0; i < n_items; i++)
     {
-        array[i] = l->data;
+        iter = g_sequence_append (self->items, array[i]);
         g_hash_table_insert (self->map_files_to_model,
-                             nautilus_view_item_model_get_file (l->data),
-                             l->data);
-        i++;
+                             nautilus_view_item_model_get_file (array[i]),
+                             iter);
     }
 
     g_list_store_splice (self->internal_model,
                          0, g_list_model_get_n_items (G_LIST_MODEL (self->internal_model)),
-                         array, g_queue_get_length (items));
-
-    g_list_store_sort (self->internal_model, compare_data_func, self);
+                         array, n_items);
 }
@@ -0,0 +1,433 @@
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <src/nautilus-deep-count-cache.h>
+#include <src/nautilus-file.h>
+#include <src/nautilus-file-utilities.h>
+#include <src/nautilus-global-preferences.h>
+
+/* More folders than a total could list if they counted as links */
+#define MANY_FOLDERS 5000
+
+/* How long counting a tree may take */
+#define COUNT_TIMEOUT_SECONDS 30
+
+/* Whether the settings the files need are around */
+static gboolean have_preferences;
+
+static NautilusDeepCountListing *
+make_listing (guint   file_count,
+              goffset size)
+{
+    NautilusDeepCountListing *listing;
+
+    listing = nautilus_deep_count_listing_new ();
+    listing->file_count = file_count;
+    listing->size = size;
+
+    return listing;
+}
+
+static void
+add_subdirectory (NautilusDeepCountListing *listing,
+                  const char               *name)
+{
+    listing->directory_count++;
+    g_ptr_array_add (listing->subdirectories, g_strdup (name));
+}
+
+static void
+add_link (NautilusDeepCountListing *listing,
+          guint64                   inode,
+          goffset                   size)
+{
+    NautilusDeepCountLink link;
+
+    link.device = 1;
+    link.inode = inode;
+    link.size = size;
+    g_array_append_val (listing->links, link);
+}
+
+/* root/ holds a/ and b/, which share a file with two links */
+static GFile *
+store_tree (const char *uri)
+{
+    NautilusDeepCountListing *listing;
+    GFile *root;
+    GFile *child;
+
+    root = g_file_new_for_uri (uri);
+
+    listing = make_listing (1, 10);
+    add_subdirectory (listing, "a");
+    add_subdirectory (listing, "b");
+    nautilus_deep_count_cache_store_listing (root, 100, listing);
+
+    listing = make_listing (2, 20);
+    add_link (listing, 42, 5);
+    child = g_file_get_child (root, "a");
+    nautilus_deep_count_cache_store_listing (child, 200, listing);
+    g_object_unref (child);
+
+    listing = make_listing (2, 1);
+    add_link (listing, 42, 5);
+    child = g_file_get_child (root, "b");
+    nautilus_deep_count_cache_store_listing (child, 300, listing);
+    g_object_unref (child);
+
+    return root;
+}
+
+static void
+test_listing_is_kept_for_the_same_mtime ()
+{
+    const NautilusDeepCountListing *listing;
+    GFile *folder;
+
+    folder = g_file_new_for_uri ("file:///nautilus-test/listing");
+
+    nautilus_deep_count_cache_store_listing (folder, 100, make_listing (3, 42));
+
+    listing = nautilus_deep_count_cache_lookup_listing (folder, 100);
+    g_assert_nonnull (listing);
+    g_assert_cmpuint (listing->file_count, ==, 3);
+    g_assert_cmpint (listing->size, ==, 42);
+
+    g_assert_null (nautilus_deep_count_cache_lookup_listing (folder, 101));
+
+    g_object_unref (folder);
+}
+
+static void
+test_changed_file_drops_listing_of_its_folder ()
+{
+    GFile *folder;
+    GFile *file;
+
+    folder = g_file_new_for_uri ("file:///nautilus-test/invalidate");
+    file = g_file_get_child (folder, "file");
+
+    nautilus_deep_count_cache_store_listing (folder, 100, make_listing (1, 1));
+    g_assert_nonnull (nautilus_deep_count_cache_lookup_listing (folder, 100));
+
+    nautilus_deep_count_cache_invalidate (file);
+    g_assert_null (nautilus_deep_count_cache_lookup_listing (folder, 100));
+
+    g_object_unref (file);
+    g_object_unref (folder);
+}
+
+static void
+test_total_rolls_up_subfolders ()
+{
+    const NautilusDeepCountTotal *total;
+    GFile *root;
+
+    root = store_tree ("file:///nautilus-test/total");
+
+    total = nautilus_deep_count_cache_lookup_total (root, 100);
+    g_assert_nonnull (total);
+    g_assert_cmpuint (total->directory_count, ==, 2);
+    g_assert_cmpuint (total->file_count, ==, 5);
+    g_assert_cmpint (total->size, ==, 31);
+    /* Linked from both subfolders, but one file */
+    g_assert_cmpuint (total->links->len, ==, 1);
+
+    g_assert_null (nautilus_deep_count_cache_lookup_total (root, 101));
+
+    g_object_unref (root);
+}
+
+static void
+test_change_below_drops_totals_above ()
+{
+    GFile *root;
+    GFile *a;
+    GFile *b;
+    GFile *file;
+
+    root = store_tree ("file:///nautilus-test/change");
+    a = g_file_get_child (root, "a");
+    b = g_file_get_child (root, "b");
+    file = g_file_get_child (a, "file");
+
+    g_assert_nonnull (nautilus_deep_count_cache_lookup_total (root, 100));
+
+    nautilus_deep_count_cache_invalidate (file);
+
+    g_assert_null (nautilus_deep_count_cache_lookup_total (root, 100));
+    g_assert_null (nautilus_deep_count_cache_lookup_total (a, 200));
+    g_assert_nonnull (nautilus_deep_count_cache_lookup_total (b, 300));
+
+    /* Counted again, the tree rolls up again */
+    nautilus_deep_count_cache_store_listing (a, 201, make_listing (1, 1));
+    g_assert_nonnull (nautilus_deep_count_cache_lookup_total (root, 100));
+
+    g_object_unref (file);
+    g_object_unref (b);
+    g_object_unref (a);
+    g_object_unref (root);
+}
+
+static void
+test_total_needs_every_subfolder ()
+{
+    NautilusDeepCountListing *listing;
+    GFile *root;
+
+    root = g_file_new_for_uri ("file:///nautilus-test/incomplete");
+
+    listing = make_listing (1, 1);
+    add_subdirectory (listing, "never-listed");
+    nautilus_deep_count_cache_store_listing (root, 100, listing);
+
+    g_assert_nonnull (nautilus_deep_count_cache_lookup_listing (root, 100));
+    g_assert_null (nautilus_deep_count_cache_lookup_total (root, 100));
+
+    g_object_unref (root);
+}
+
+static void
+test_unreadable_folder_is_rolled_up ()
+{
+    const NautilusDeepCountTotal *total;
+    NautilusDeepCountListing *listing;
+    GFile *root;
+    GFile *child;
+
+    root = g_file_new_for_uri ("file:///nautilus-test/unreadable");
+
+    listing = make_listing (1, 1);
+    add_subdirectory (listing, "locked");
+    nautilus_deep_count_cache_store_listing (root, 100, listing);
+
+    listing = make_listing (0, 0);
+    listing->unreadable_count = 1;
+    child = g_file_get_child (root, "locked");
+    nautilus_deep_count_cache_store_listing (child, 200, listing);
+    g_object_unref (child);
+
+    total = nautilus_deep_count_cache_lookup_total (root, 100);
+    g_assert_nonnull (total);
+    g_assert_cmpuint (total->directory_count, ==, 1);
+    g_assert_cmpuint (total->unreadable_count, ==, 1);
+
+    g_object_unref (root);
+}
+
+static void
+test_total_of_many_folders ()
+{
+    const NautilusDeepCountTotal *total;
+    NautilusDeepCountListing *listing;
+    GFile *root;
+    GFile *child;
+    char *name;
+    int i;
+
+    root = g_file_new_for_uri ("file:///nautilus-test/many");
+
+    listing = make_listing (0, 0);
+    for (i = 0; i < MANY_FOLDERS; i++)
+    {
+        name = g_strdup_printf ("%d", i);
+        add_subdirectory (listing, name);
+        g_free (name);
+    }
+    nautilus_deep_count_cache_store_listing (root, 100, listing);
+
+    for (i = 0; i < MANY_FOLDERS; i++)
+    {
+        name = g_strdup_printf ("%d", i);
+        child = g_file_get_child (root, name);
+        nautilus_deep_count_cache_store_listing (child, 200, make_listing (1, 2));
+        g_object_unref (child);
+        g_free (name);
+    }
+
+    total = nautilus_deep_count_cache_lookup_total (root, 100);
+    g_assert_nonnull (total);
+    g_assert_cmpuint (total->directory_count, ==, MANY_FOLDERS);
+    g_assert_cmpuint (total->file_count, ==, MANY_FOLDERS);
+    g_assert_cmpint (total->size, ==, MANY_FOLDERS * 2);
+
+    g_object_unref (root);
+}
+
+static void
+count_ready_callback (NautilusFile *file,
+                      gpointer      user_data)
+{
+    gboolean *done = user_data;
+
+    *done = TRUE;
+}
+
+static gboolean
+timeout_callback (gpointer user_data)
+{
+    gboolean *timed_out = user_data;
+
+    *timed_out = TRUE;
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Every folder has more than one link, which must not keep a tree with
+ * many of them from being rolled up.
+ */
+static void
+test_counted_tree_of_many_folders_is_rolled_up ()
+{
+    const NautilusDeepCountTotal *total;
+    NautilusFile *file;
+    GFileInfo *info;
+    GFile *root;
+    gboolean done;
+    gboolean timed_out;
+    guint timeout_id;
+    guint directory_count;
+    guint64 mtime;
+    char *root_path;
+    char *path;
+    int i;
+
+    if (!have_preferences)
+    {
+        g_test_skip ("Nautilus settings schemas not available");
+        return;
+    }
+
+    root_path = g_dir_make_tmp ("nautilus-deep-count-tree-XXXXXX", NULL);
+    g_assert_nonnull (root_path);
+    for (i = 0; i < MANY_FOLDERS; i++)
+    {
+        path = g_strdup_printf ("%s/%d", root_path, i);
+        g_assert_cmpint (g_mkdir (path, 0700), ==, 0);
+        g_free (path);
+    }
+
+    root = g_file_new_for_path (root_path);
+    file = nautilus_file_get (root);
+
+    done = FALSE;
+    nautilus_file_call_when_ready (file,
+                                   NAUTILUS_FILE_ATTRIBUTE_INFO |
+                                   NAUTILUS_FILE_ATTRIBUTE_DEEP_COUNTS,
+                                   count_ready_callback, &done);
+
+    timed_out = FALSE;
+    timeout_id = g_timeout_add_seconds (COUNT_TIMEOUT_SECONDS,
+                                        timeout_callback, &timed_out);
+    while (!done && !timed_out)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+    g_assert_false (timed_out);
+    g_source_remove (timeout_id);
+
+    nautilus_file_get_deep_counts (file, &directory_count, NULL, NULL, NULL, TRUE);
+    g_assert_cmpuint (directory_count, ==, MANY_FOLDERS);
+
+    info = g_file_query_info (root,
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
+    g_assert_nonnull (info);
+    mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+            g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+    g_object_unref (info);
+
+    total = nautilus_deep_count_cache_lookup_total (root, mtime);
+    g_assert_nonnull (total);
+    g_assert_cmpuint (total->directory_count, ==, MANY_FOLDERS);
+    g_assert_cmpuint (total->links->len, ==, 0);
+
+    nautilus_file_unref (file);
+    g_object_unref (root);
+
+    for (i = 0; i < MANY_FOLDERS; i++)
+    {
+        path = g_strdup_printf ("%s/%d", root_path, i);
+        g_rmdir (path);
+        g_free (path);
+    }
+    g_rmdir (root_path);
+    g_free (root_path);
+}
+
+/* The ones nautilus_global_preferences_init () needs */
+static gboolean
+have_schemas (void)
+{
+    const char *ids[] =
+    {
+        "org.gnome.nautilus.preferences",
+        "org.gtk.Settings.FileChooser",
+        "org.gnome.desktop.lockdown",
+        "org.gnome.desktop.background",
+        "org.gnome.desktop.interface",
+        "org.gnome.desktop.privacy",
+        NULL
+    };
+    GSettingsSchemaSource *source;
+    GSettingsSchema *schema;
+    int i;
+
+    source = g_settings_schema_source_get_default ();
+    for (i = 0; ids[i] != NULL; i++)
+    {
+        schema = source != NULL ?
+                 g_settings_schema_source_lookup (source, ids[i], TRUE) : NULL;
+        if (schema == NULL)
+        {
+            return FALSE;
+        }
+        g_settings_schema_unref (schema);
+    }
+
+    return TRUE;
+}
+
+static void
+setup_test_suite ()
+{
+    g_test_add_func ("/deep-count-cache/listing/1.0",
+                     test_listing_is_kept_for_the_same_mtime);
+    g_test_add_func ("/deep-count-cache/invalidate/1.0",
+                     test_changed_file_drops_listing_of_its_folder);
+    g_test_add_func ("/deep-count-cache/total/1.0",
+                     test_total_rolls_up_subfolders);
+    g_test_add_func ("/deep-count-cache/total/1.1",
+                     test_change_below_drops_totals_above);
+    g_test_add_func ("/deep-count-cache/total/1.2",
+                     test_total_needs_every_subfolder);
+    g_test_add_func ("/deep-count-cache/total/1.3",
+                     test_unreadable_folder_is_rolled_up);
+    g_test_add_func ("/deep-count-cache/total/1.4",
+                     test_total_of_many_folders);
+    g_test_add_func ("/deep-count-cache/count/1.0",
+                     test_counted_tree_of_many_folders_is_rolled_up);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    /* Keep the settings away from the ones of the user */
+    g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+    g_test_init (&argc, &argv, NULL);
+
+    have_preferences = have_schemas ();
+    if (have_preferences)
+    {
+        nautilus_global_preferences_init ();
+        nautilus_ensure_extension_points ();
+    }
+
+    setup_test_suite ();
+
+    return g_test_run ();
+}
@@ -0,0 +1,388 @@
+#include <gio/gio.h>
+#include <unistd.h>
+
+#include <src/nautilus-directory.h>
+#include <src/nautilus-directory-snapshot.h>
+#include <src/nautilus-file.h>
+#include <src/nautilus-file-utilities.h>
+#include <src/nautilus-global-preferences.h>
+
+/* Saving happens in a thread without telling when it is done */
+#define SAVE_TIMEOUT_SECONDS 10
+
+/* How long a folder may take to load */
+#define LOAD_TIMEOUT_SECONDS 10
+
+/* Whether the settings the folders need are around */
+static gboolean have_preferences;
+
+static GFileInfo *
+make_directory_info (guint64 mtime)
+{
+    GFileInfo *info;
+
+    info = g_file_info_new ();
+    g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime);
+    g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, 0);
+
+    return info;
+}
+
+static GList *
+make_file_infos (void)
+{
+    GFileInfo *info;
+    GList *infos;
+
+    infos = NULL;
+
+    info = g_file_info_new ();
+    g_file_info_set_name (info, "first");
+    g_file_info_set_display_name (info, "First");
+    g_file_info_set_size (info, 1234);
+    infos = g_list_append (infos, info);
+
+    info = g_file_info_new ();
+    g_file_info_set_name (info, "second");
+    g_file_info_set_is_hidden (info, TRUE);
+    infos = g_list_append (infos, info);
+
+    return infos;
+}
+
+static void
+load_callback (GObject      *source_object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+    GList **infos = user_data;
+
+    *infos = nautilus_directory_snapshot_load_finish (res);
+}
+
+static GList *
+load_snapshot (GFile     *location,
+               GFileInfo *directory_info)
+{
+    GList *infos;
+
+    infos = GINT_TO_POINTER (-1);
+    nautilus_directory_snapshot_load_async (location, directory_info, NULL,
+                                            load_callback, &infos);
+    while (infos == GINT_TO_POINTER (-1))
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+    return infos;
+}
+
+static GList *
+wait_for_snapshot (GFile     *location,
+                   GFileInfo *directory_info)
+{
+    GList *infos;
+    gint64 deadline;
+
+    deadline = g_get_monotonic_time () + SAVE_TIMEOUT_SECONDS * G_USEC_PER_SEC;
+    while ((infos = load_snapshot (location, directory_info)) == NULL &&
+           g_get_monotonic_time () < deadline)
+    {
+        g_usleep (G_USEC_PER_SEC / 100);
+    }
+
+    return infos;
+}
+
+static void
+test_saved_snapshot_is_loaded_back ()
+{
+    GFileInfo *directory_info;
+    GFileInfo *info;
+    GFile *location;
+    GList *saved;
+    GList *loaded;
+
+    location = g_file_new_for_uri ("file:///nautilus-test/saved");
+    directory_info = make_directory_info (100);
+    saved = make_file_infos ();
+
+    nautilus_directory_snapshot_save (location, directory_info, saved);
+    loaded = wait_for_snapshot (location, directory_info);
+
+    g_assert_cmpuint (g_list_length (loaded), ==, 2);
+
+    info = loaded->data;
+    g_assert_cmpstr (g_file_info_get_name (info), ==, "first");
+    g_assert_cmpstr (g_file_info_get_display_name (info), ==, "First");
+    g_assert_cmpint (g_file_info_get_size (info), ==, 1234);
+
+    info = loaded->next->data;
+    g_assert_cmpstr (g_file_info_get_name (info), ==, "second");
+    g_assert_true (g_file_info_get_is_hidden (info));
+
+    g_list_free_full (loaded, g_object_unref);
+    g_list_free_full (saved, g_object_unref);
+    g_object_unref (directory_info);
+    g_object_unref (location);
+}
+
+static void
+test_snapshot_of_other_mtime_is_not_loaded ()
+{
+    GFileInfo *directory_info;
+    GFileInfo *changed_info;
+    GFile *location;
+    GList *saved;
+    GList *loaded;
+
+    location = g_file_new_for_uri ("file:///nautilus-test/changed");
+    directory_info = make_directory_info (100);
+    changed_info = make_directory_info (200);
+    saved = make_file_infos ();
+
+    nautilus_directory_snapshot_save (location, directory_info, saved);
+    loaded = wait_for_snapshot (location, directory_info);
+    g_assert_nonnull (loaded);
+    g_list_free_full (loaded, g_object_unref);
+
+    g_assert_null (load_snapshot (location, changed_info));
+
+    g_list_free_full (saved, g_object_unref);
+    g_object_unref (changed_info);
+    g_object_unref (directory_info);
+    g_object_unref (location);
+}
+
+static void
+test_missing_snapshot_is_not_loaded ()
+{
+    GFileInfo *directory_info;
+    GFile *location;
+
+    location = g_file_new_for_uri ("file:///nautilus-test/missing");
+    directory_info = make_directory_info (100);
+
+    g_assert_null (load_snapshot (location, directory_info));
+
+    g_object_unref (directory_info);
+    g_object_unref (location);
+}
+
+static void
+files_added_callback (NautilusDirectory *directory,
+                      GList             *files,
+                      gpointer           user_data)
+{
+    GList **added_files = user_data;
+
+    *added_files = g_list_concat (*added_files, nautilus_file_list_copy (files));
+}
+
+static void
+done_loading_callback (NautilusDirectory *directory,
+                       gpointer           user_data)
+{
+    gboolean *done = user_data;
+
+    *done = TRUE;
+}
+
+static gboolean
+timeout_callback (gpointer user_data)
+{
+    gboolean *timed_out = user_data;
+
+    *timed_out = TRUE;
+
+    return G_SOURCE_REMOVE;
+}
+
+/* A load that fails must not confirm the files that only came from the
+ * snapshot. Enumerating a regular file fails right away, while it still
+ * has a modification time to key a snapshot with.
+ */
+static void
+test_failed_load_drops_snapshot_files ()
+{
+    NautilusDirectory *directory;
+    GFileInfo *directory_info;
+    GFile *location;
+    GList *saved;
+    GList *loaded;
+    GList *added_files;
+    GList *l;
+    gboolean done;
+    gboolean timed_out;
+    guint timeout_id;
+    char *path;
+    int fd;
+
+    if (!have_preferences)
+    {
+        g_test_skip ("Nautilus settings schemas not available");
+        return;
+    }
+
+    fd = g_file_open_tmp ("nautilus-snapshot-not-a-folder-XXXXXX", &path, NULL);
+    g_assert_cmpint (fd, >=, 0);
+    close (fd);
+    location = g_file_new_for_path (path);
+    g_free (path);
+
+    directory_info = g_file_query_info (location, NAUTILUS_DIRECTORY_SNAPSHOT_ATTRIBUTES,
+                                        0, NULL, NULL);
+    g_assert_nonnull (directory_info);
+
+    saved = make_file_infos ();
+    nautilus_directory_snapshot_save (location, directory_info, saved);
+    loaded = wait_for_snapshot (location, directory_info);
+    g_assert_nonnull (loaded);
+    g_list_free_full (loaded, g_object_unref);
+
+    g_settings_set_boolean (nautilus_preferences,
+                            NAUTILUS_PREFERENCES_CACHE_DIRECTORY_LISTINGS, TRUE);
+
+    directory = nautilus_directory_get (location);
+    added_files = NULL;
+    done = FALSE;
+    g_signal_connect (directory, "files-added",
+                      G_CALLBACK (files_added_callback), &added_files);
+    g_signal_connect (directory, "done-loading",
+                      G_CALLBACK (done_loading_callback), &done);
+    nautilus_directory_file_monitor_add (directory, &added_files, TRUE,
+                                         0, NULL, NULL);
+
+    timed_out = FALSE;
+    timeout_id = g_timeout_add_seconds (LOAD_TIMEOUT_SECONDS,
+                                        timeout_callback, &timed_out);
+    while (!done && !timed_out)
+    {
+        g_main_context_iteration (NULL, TRUE);
+    }
+    g_assert_false (timed_out);
+    g_source_remove (timeout_id);
+
+    /* Shown from the snapshot, then dropped with the failed load */
+    g_assert_cmpuint (g_list_length (added_files), ==, 2);
+    for (l = added_files; l != NULL; l = l->next)
+    {
+        g_assert_true (nautilus_file_is_gone (l->data));
+    }
+
+    nautilus_directory_file_monitor_remove (directory, &added_files);
+    g_signal_handlers_disconnect_by_data (directory, &added_files);
+    g_signal_handlers_disconnect_by_data (directory, &done);
+    nautilus_directory_unref (directory);
+
+    nautilus_file_list_free (added_files);
+    g_list_free_full (saved, g_object_unref);
+    g_object_unref (directory_info);
+    g_file_delete (location, NULL, NULL);
+    g_object_unref (location);
+}
+
+static void
+delete_recursively (GFile *file)
+{
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    GFile *child;
+
+    enumerator = g_file_enumerate_children (file, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            NULL, NULL);
+    if (enumerator != NULL)
+    {
+        while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL)
+        {
+            child = g_file_get_child (file, g_file_info_get_name (info));
+            delete_recursively (child);
+            g_object_unref (child);
+            g_object_unref (info);
+        }
+        g_object_unref (enumerator);
+    }
+
+    g_file_delete (file, NULL, NULL);
+}
+
+/* The ones nautilus_global_preferences_init () needs */
+static gboolean
+have_schemas (void)
+{
+    const char *ids[] =
+    {
+        "org.gnome.nautilus.preferences",
+        "org.gtk.Settings.FileChooser",
+        "org.gnome.desktop.lockdown",
+        "org.gnome.desktop.background",
+        "org.gnome.desktop.interface",
+        "org.gnome.desktop.privacy",
+        NULL
+    };
+    GSettingsSchemaSource *source;
+    GSettingsSchema *schema;
+    int i;
+
+    source = g_settings_schema_source_get_default ();
+    for (i = 0; ids[i] != NULL; i++)
+    {
+        schema = source != NULL ?
+                 g_settings_schema_source_lookup (source, ids[i], TRUE) : NULL;
+        if (schema == NULL)
+        {
+            return FALSE;
+        }
+        g_settings_schema_unref (schema);
+    }
+
+    return TRUE;
+}
+
+static void
+setup_test_suite ()
+{
+    g_test_add_func ("/directory-snapshot/load/1.0",
+                     test_saved_snapshot_is_loaded_back);
+    g_test_add_func ("/directory-snapshot/load/1.1",
+                     test_snapshot_of_other_mtime_is_not_loaded);
+    g_test_add_func ("/directory-snapshot/load/1.2",
+                     test_missing_snapshot_is_not_loaded);
+    g_test_add_func ("/directory-snapshot/load-error/1.0",
+                     test_failed_load_drops_snapshot_files);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    GFile *cache_location;
+    char *cache_dir;
+    int result;
+
+    /* Keep the snapshots and settings away from the ones of the user */
+    cache_dir = g_dir_make_tmp ("nautilus-snapshot-XXXXXX", NULL);
+    g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+    g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+    g_test_init (&argc, &argv, NULL);
+
+    have_preferences = have_schemas ();
+    if (have_preferences)
+    {
+        nautilus_global_preferences_init ();
+        nautilus_ensure_extension_points ();
+    }
+
+    setup_test_suite ();
+
+    result = g_test_run ();
+
+    cache_location = g_file_new_for_path (cache_dir);
+    delete_recursively (cache_location);
+    g_object_unref (cache_location);
+    g_free (cache_dir);
+
+    return result;
+}
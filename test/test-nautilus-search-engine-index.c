@@ -0,0 +1,443 @@
+#include <string.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <src/nautilus-directory-notify.h>
+#include <src/nautilus-global-preferences.h>
+#include <src/nautilus-search-engine-index.h>
+#include <src/nautilus-search-hit.h>
+#include <src/nautilus-search-index.h>
+#include <src/nautilus-search-provider.h>
+
+#define INDEX_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+    G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," \
+    G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE "," \
+    G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+    G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+    G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+    G_FILE_ATTRIBUTE_TIME_ACCESS
+
+/* The tree every test starts from. Folders end with a slash. */
+static const char *tree[] =
+{
+    "apple.txt",
+    "banana.txt",
+    "sub/",
+    "sub/apple-pie.txt",
+    "sub/deep/",
+    "sub/deep/apple-tart.txt",
+    NULL
+};
+
+static GFile *root;
+
+/* Whether the settings the index needs are around */
+static gboolean have_preferences;
+
+static void
+create_tree (void)
+{
+    GFile *file;
+    char *path;
+    int i;
+
+    path = g_dir_make_tmp ("nautilus-search-index-XXXXXX", NULL);
+    g_assert_nonnull (path);
+    root = g_file_new_for_path (path);
+    g_free (path);
+
+    for (i = 0; tree[i] != NULL; i++)
+    {
+        file = g_file_resolve_relative_path (root, tree[i]);
+        if (g_str_has_suffix (tree[i], "/"))
+        {
+            g_assert_true (g_file_make_directory (file, NULL, NULL));
+        }
+        else
+        {
+            g_assert_true (g_file_replace_contents (file, "x", 1, NULL, FALSE,
+                                                    G_FILE_CREATE_NONE,
+                                                    NULL, NULL, NULL));
+        }
+        g_object_unref (file);
+    }
+}
+
+static void
+delete_tree (void)
+{
+    GFile *file;
+    int i;
+
+    /* Deepest first */
+    for (i = G_N_ELEMENTS (tree) - 2; i >= 0; i--)
+    {
+        file = g_file_resolve_relative_path (root, tree[i]);
+        g_file_delete (file, NULL, NULL);
+        g_object_unref (file);
+    }
+
+    g_file_delete (root, NULL, NULL);
+    g_clear_object (&root);
+}
+
+/* Records the files of @folder and of the folders below it, the way
+ * listing them in a view does.
+ */
+static void
+index_folder (GFile *folder)
+{
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    GFile *child;
+    GList *infos;
+
+    enumerator = g_file_enumerate_children (folder, INDEX_ATTRIBUTES,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            NULL, NULL);
+    g_assert_nonnull (enumerator);
+
+    infos = NULL;
+    while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL)
+    {
+        if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+        {
+            child = g_file_get_child (folder, g_file_info_get_name (info));
+            index_folder (child);
+            g_object_unref (child);
+        }
+        infos = g_list_prepend (infos, info);
+    }
+    g_object_unref (enumerator);
+
+    nautilus_search_index_add_files (folder, infos);
+    g_list_free_full (infos, g_object_unref);
+}
+
+static char *
+get_relative_uri (const char *uri)
+{
+    char *root_uri;
+    char *relative;
+
+    root_uri = g_file_get_uri (root);
+    g_assert_true (g_str_has_prefix (uri, root_uri));
+    relative = g_strdup (uri + strlen (root_uri) + 1);
+    g_free (root_uri);
+
+    return relative;
+}
+
+static gboolean
+collect_uri (const char *uri,
+             const char *display_name,
+             const char *mime_type,
+             guint64     mtime,
+             guint64     atime,
+             gboolean    is_hidden,
+             gpointer    user_data)
+{
+    GHashTable *uris = user_data;
+
+    g_hash_table_add (uris, get_relative_uri (uri));
+
+    return TRUE;
+}
+
+static GHashTable *
+foreach_indexed (const char *relative_path,
+                 gboolean    recursive)
+{
+    GHashTable *uris;
+    GFile *location;
+
+    uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    location = g_file_resolve_relative_path (root, relative_path);
+    nautilus_search_index_foreach (location, recursive, collect_uri, uris);
+    g_object_unref (location);
+
+    return uris;
+}
+
+static void
+hits_added_callback (NautilusSearchProvider *provider,
+                     GList                  *hits,
+                     gpointer                user_data)
+{
+    GHashTable *uris = user_data;
+    GList *l;
+
+    for (l = hits; l != NULL; l = l->next)
+    {
+        g_hash_table_add (uris, get_relative_uri (nautilus_search_hit_get_uri (l->data)));
+    }
+}
+
+static void
+finished_callback (NautilusSearchProvider       *provider,
+                   NautilusSearchProviderStatus  status,
+                   gpointer                      user_data)
+{
+    g_main_loop_quit (user_data);
+}
+
+static GHashTable *
+search (const char *text,
+        gboolean    recursive)
+{
+    NautilusSearchEngineIndex *engine;
+    NautilusQuery *query;
+    GHashTable *uris;
+    GMainLoop *loop;
+
+    uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    loop = g_main_loop_new (NULL, FALSE);
+
+    query = nautilus_query_new ();
+    nautilus_query_set_text (query, text);
+    nautilus_query_set_location (query, root);
+    nautilus_query_set_recursive (query, recursive);
+
+    engine = nautilus_search_engine_index_new ();
+    g_signal_connect (engine, "hits-added",
+                      G_CALLBACK (hits_added_callback), uris);
+    g_signal_connect (engine, "finished",
+                      G_CALLBACK (finished_callback), loop);
+    nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine), query);
+    nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine));
+
+    g_main_loop_run (loop);
+
+    g_object_unref (engine);
+    g_object_unref (query);
+    g_main_loop_unref (loop);
+
+    return uris;
+}
+
+/* Returns FALSE if the test can't run */
+static gboolean
+setup (void)
+{
+    if (!have_preferences)
+    {
+        g_test_skip ("Nautilus settings schema not available");
+        return FALSE;
+    }
+
+    create_tree ();
+    index_folder (root);
+
+    return TRUE;
+}
+
+static void
+teardown (void)
+{
+    GList *locations;
+
+    /* Leave nothing behind for the next test */
+    locations = g_list_prepend (NULL, g_object_ref (root));
+    nautilus_search_index_remove_files (locations);
+    g_list_free_full (locations, g_object_unref);
+
+    delete_tree ();
+}
+
+static void
+test_foreach_lists_folder ()
+{
+    GHashTable *uris;
+
+    if (!setup ())
+    {
+        return;
+    }
+
+    uris = foreach_indexed (".", FALSE);
+    g_assert_cmpuint (g_hash_table_size (uris), ==, 3);
+    g_assert_true (g_hash_table_contains (uris, "apple.txt"));
+    g_assert_true (g_hash_table_contains (uris, "banana.txt"));
+    g_assert_true (g_hash_table_contains (uris, "sub"));
+    g_hash_table_destroy (uris);
+
+    uris = foreach_indexed (".", TRUE);
+    g_assert_cmpuint (g_hash_table_size (uris), ==, 6);
+    g_assert_true (g_hash_table_contains (uris, "sub/deep/apple-tart.txt"));
+    g_hash_table_destroy (uris);
+
+    teardown ();
+}
+
+static void
+test_search_finds_indexed_files ()
+{
+    GHashTable *uris;
+
+    if (!setup ())
+    {
+        return;
+    }
+
+    uris = search ("apple", TRUE);
+    g_assert_cmpuint (g_hash_table_size (uris), ==, 3);
+    g_assert_true (g_hash_table_contains (uris, "apple.txt"));
+    g_assert_true (g_hash_table_contains (uris, "sub/apple-pie.txt"));
+    g_assert_true (g_hash_table_contains (uris, "sub/deep/apple-tart.txt"));
+    g_hash_table_destroy (uris);
+
+    uris = search ("apple", FALSE);
+    g_assert_cmpuint (g_hash_table_size (uris), ==, 1);
+    g_assert_true (g_hash_table_contains (uris, "apple.txt"));
+    g_hash_table_destroy (uris);
+
+    teardown ();
+}
+
+static void
+test_removed_folder_is_forgotten ()
+{
+    GHashTable *uris;
+    GList *locations;
+
+    if (!setup ())
+    {
+        return;
+    }
+
+    locations = g_list_prepend (NULL, g_file_get_child (root, "sub"));
+    nautilus_search_index_remove_files (locations);
+    g_list_free_full (locations, g_object_unref);
+
+    uris = search ("apple", TRUE);
+    g_assert_cmpuint (g_hash_table_size (uris), ==, 1);
+    g_assert_true (g_hash_table_contains (uris, "apple.txt"));
+    g_hash_table_destroy (uris);
+
+    teardown ();
+}
+
+static void
+test_moved_folder_keeps_its_contents ()
+{
+    GFilePair pair;
+    GHashTable *uris;
+    GList *pairs;
+
+    if (!setup ())
+    {
+        return;
+    }
+
+    pair.from = g_file_get_child (root, "sub");
+    pair.to = g_file_get_child (root, "moved");
+    pairs = g_list_prepend (NULL, &pair);
+    nautilus_search_index_move_files (pairs);
+    g_list_free (pairs);
+
+    uris = foreach_indexed (".", TRUE);
+    g_assert_false (g_hash_table_contains (uris, "sub"));
+    g_assert_true (g_hash_table_contains (uris, "moved"));
+    g_assert_true (g_hash_table_contains (uris, "moved/deep/apple-tart.txt"));
+    g_hash_table_destroy (uris);
+
+    g_object_unref (pair.from);
+    g_object_unref (pair.to);
+
+    teardown ();
+}
+
+/* Files deleted by other programs, in folders nobody is watching, are
+ * still in the index. Searching must not return them, and forget them.
+ */
+static void
+test_file_deleted_outside_is_forgotten ()
+{
+    GHashTable *uris;
+    GFile *file;
+
+    if (!setup ())
+    {
+        return;
+    }
+
+    file = g_file_resolve_relative_path (root, "sub/apple-pie.txt");
+    g_assert_true (g_file_delete (file, NULL, NULL));
+    g_object_unref (file);
+
+    uris = foreach_indexed (".", TRUE);
+    g_assert_true (g_hash_table_contains (uris, "sub/apple-pie.txt"));
+    g_hash_table_destroy (uris);
+
+    uris = search ("apple", TRUE);
+    g_assert_cmpuint (g_hash_table_size (uris), ==, 2);
+    g_assert_false (g_hash_table_contains (uris, "sub/apple-pie.txt"));
+    g_hash_table_destroy (uris);
+
+    uris = foreach_indexed (".", TRUE);
+    g_assert_false (g_hash_table_contains (uris, "sub/apple-pie.txt"));
+    g_assert_true (g_hash_table_contains (uris, "sub/deep/apple-tart.txt"));
+    g_hash_table_destroy (uris);
+
+    teardown ();
+}
+
+static void
+setup_test_suite ()
+{
+    g_test_add_func ("/search-index/foreach/1.0",
+                     test_foreach_lists_folder);
+    g_test_add_func ("/search-index/search/1.0",
+                     test_search_finds_indexed_files);
+    g_test_add_func ("/search-index/remove/1.0",
+                     test_removed_folder_is_forgotten);
+    g_test_add_func ("/search-index/move/1.0",
+                     test_moved_folder_keeps_its_contents);
+    g_test_add_func ("/search-index/deleted-outside/1.0",
+                     test_file_deleted_outside_is_forgotten);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+    GSettingsSchemaSource *source;
+    GSettingsSchema *schema;
+    char *cache_dir;
+    int result;
+
+    /* Keep the index away from the one of the user */
+    cache_dir = g_dir_make_tmp ("nautilus-search-index-cache-XXXXXX", NULL);
+    g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+    g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+    g_test_init (&argc, &argv, NULL);
+
+    /* Compiled into the build directory by meson, the tests are
+     * skipped when run without it.
+     */
+    source = g_settings_schema_source_get_default ();
+    schema = source != NULL ?
+             g_settings_schema_source_lookup (source, "org.gnome.nautilus.preferences", TRUE) :
+             NULL;
+    have_preferences = schema != NULL;
+    g_clear_pointer (&schema, g_settings_schema_unref);
+
+    if (have_preferences)
+    {
+        /* Only the preferences of Nautilus itself are used by the index */
+        nautilus_preferences = g_settings_new ("org.gnome.nautilus.preferences");
+        g_settings_set_boolean (nautilus_preferences, NAUTILUS_PREFERENCES_SEARCH_INDEX, TRUE);
+    }
+
+    setup_test_suite ();
+
+    result = g_test_run ();
+
+    g_clear_object (&nautilus_preferences);
+    g_rmdir (cache_dir);
+    g_free (cache_dir);
+
+    return result;
+}